@@ -0,0 +1,479 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "BatchCompareDialog.h"
+
+#include <windowsx.h>
+#include <commctrl.h>
+#include <commdlg.h>
+#include <uxtheme.h>
+#include <cwchar>
+
+#ifndef MULTITHREAD
+#define MULTITHREAD		1
+#endif
+
+
+namespace // anonymous namespace
+{
+
+const wchar_t* statusStr(BatchCmpStatus status)
+{
+	switch (status)
+	{
+		case BatchCmpStatus::MATCH:			return L"Same";
+		case BatchCmpStatus::MISMATCH:		return L"Different";
+		case BatchCmpStatus::READ_ERROR:	return L"Read error";
+		case BatchCmpStatus::COMPARE_ERROR:	return L"Compare error";
+		default:							return L"";
+	}
+}
+
+
+// Columns of the summary counts - after the file and status ones
+enum SummaryColumn
+{
+	COL_ADDED = 2,
+	COL_REMOVED,
+	COL_CHANGED,
+	COL_MOVED,
+	COLUMNS_COUNT
+};
+
+
+void setCountText(HWND hList, int row, int col, intptr_t count)
+{
+	wchar_t countStr[32];
+
+	_snwprintf_s(countStr, _countof(countStr), _TRUNCATE, L"%Id", count);
+	ListView_SetItemText(hList, row, col, countStr);
+}
+
+} // anonymous namespace
+
+
+UINT BatchCompareDialog::doDialog(const BatchCmpReference* reference, BatchCmpResults* results)
+{
+	_reference = reference;
+	_results = results;
+	_results->selected = -1;
+
+	return (UINT)::DialogBoxParam(_hInst, MAKEINTRESOURCE(IDD_BATCH_CMP_DIALOG), _hParent,
+			(DLGPROC)dlgProc, (LPARAM)this);
+}
+
+
+INT_PTR CALLBACK BatchCompareDialog::run_dlgProc(UINT Message, WPARAM wParam, LPARAM lParam)
+{
+	switch (Message)
+	{
+		case WM_INITDIALOG:
+		{
+			goToCenter();
+
+			ETDTProc EnableDlgTheme =
+					(ETDTProc)::SendMessage(_nppData._nppHandle, NPPM_GETENABLETHEMETEXTUREFUNC, 0, 0);
+
+			if (EnableDlgTheme != NULL)
+				EnableDlgTheme(_hSelf, ETDT_ENABLETAB);
+
+			Edit_SetText(::GetDlgItem(_hSelf, IDC_BATCH_REFERENCE), _reference->name.c_str());
+
+			initList();
+			fillList();
+
+			// The candidates of the last time are compared to the (perhaps different) reference right away
+			if (!_results->entries.empty())
+				startCompare();
+		}
+		break;
+
+		case WM_TIMER:
+			if (wParam == cProgressTimer)
+			{
+				wchar_t status[128];
+
+				_snwprintf_s(status, _countof(status), _TRUNCATE, L"Comparing to reference: %Id of %Id",
+						static_cast<intptr_t>(_done), static_cast<intptr_t>(_total));
+				setStatus(status);
+			}
+		break;
+
+		case cCompareDoneMsg:
+			onCompareDone();
+		break;
+
+		case WM_NOTIFY:
+		{
+			const NMHDR* hdr = reinterpret_cast<const NMHDR*>(lParam);
+
+			if (hdr->idFrom == IDC_BATCH_CMP_LIST && hdr->code == NM_DBLCLK && !_worker && openSelected())
+				::EndDialog(_hSelf, IDOK);
+		}
+		break;
+
+		case WM_COMMAND:
+		{
+			switch (LOWORD(wParam))
+			{
+				case IDC_BATCH_ADD:
+					addFiles();
+				return TRUE;
+
+				case IDC_BATCH_REMOVE:
+					removeSelected();
+				return TRUE;
+
+				case IDC_BATCH_COMPARE:
+					startCompare();
+				return TRUE;
+
+				case IDOK:
+					if (!_worker && openSelected())
+						::EndDialog(_hSelf, IDOK);
+				return TRUE;
+
+				case IDCANCEL:
+					stopCompare();
+					::EndDialog(_hSelf, IDCANCEL);
+				return TRUE;
+
+				default:
+				return FALSE;
+			}
+		}
+		break;
+	}
+
+	return FALSE;
+}
+
+
+void BatchCompareDialog::initList()
+{
+	HWND hList = ::GetDlgItem(_hSelf, IDC_BATCH_CMP_LIST);
+
+	ListView_SetExtendedListViewStyle(hList, LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+
+	RECT rc;
+	::GetClientRect(hList, &rc);
+
+	const int countWidth = (rc.right - rc.left) / 10;
+
+	LVCOLUMN col = {};
+	col.mask = LVCF_TEXT | LVCF_WIDTH;
+
+	col.cx		= rc.right - rc.left - countWidth * 6 - ::GetSystemMetrics(SM_CXVSCROLL);
+	col.pszText	= const_cast<LPWSTR>(L"File");
+	ListView_InsertColumn(hList, 0, &col);
+
+	col.cx		= countWidth * 2;
+	col.pszText	= const_cast<LPWSTR>(L"Status");
+	ListView_InsertColumn(hList, 1, &col);
+
+	static const wchar_t* const cCountNames[] = { L"Added", L"Removed", L"Changed", L"Moved" };
+
+	col.mask	|= LVCF_FMT;
+	col.fmt		= LVCFMT_RIGHT;
+	col.cx		= countWidth;
+
+	for (int i = COL_ADDED; i < COLUMNS_COUNT; ++i)
+	{
+		col.pszText = const_cast<LPWSTR>(cCountNames[i - COL_ADDED]);
+		ListView_InsertColumn(hList, i, &col);
+	}
+}
+
+
+void BatchCompareDialog::fillList()
+{
+	HWND hList = ::GetDlgItem(_hSelf, IDC_BATCH_CMP_LIST);
+
+	::SendMessage(hList, WM_SETREDRAW, FALSE, 0);
+
+	ListView_DeleteAllItems(hList);
+
+	intptr_t sameCount		= 0;
+	intptr_t differentCount	= 0;
+	intptr_t errorsCount	= 0;
+
+	for (size_t i = 0; i < _results->entries.size(); ++i)
+	{
+		const BatchCmpEntry& entry = _results->entries[i];
+		const int row = static_cast<int>(i);
+
+		LVITEM item = {};
+		item.mask		= LVIF_TEXT | LVIF_PARAM;
+		item.iItem		= row;
+		item.pszText	= const_cast<LPWSTR>(entry.file.c_str());
+		item.lParam		= static_cast<LPARAM>(i);
+
+		ListView_InsertItem(hList, &item);
+		ListView_SetItemText(hList, row, 1, const_cast<LPWSTR>(statusStr(entry.status)));
+
+		switch (entry.status)
+		{
+			case BatchCmpStatus::MATCH:			++sameCount;		break;
+			case BatchCmpStatus::MISMATCH:		++differentCount;	break;
+			case BatchCmpStatus::READ_ERROR:
+			case BatchCmpStatus::COMPARE_ERROR:	++errorsCount;		break;
+			default:												break;
+		}
+
+		if (entry.status == BatchCmpStatus::MATCH || entry.status == BatchCmpStatus::MISMATCH)
+		{
+			setCountText(hList, row, COL_ADDED,		entry.summary.added);
+			setCountText(hList, row, COL_REMOVED,	entry.summary.removed);
+			setCountText(hList, row, COL_CHANGED,	entry.summary.changed);
+			setCountText(hList, row, COL_MOVED,		entry.summary.moved);
+		}
+	}
+
+	::SendMessage(hList, WM_SETREDRAW, TRUE, 0);
+
+	if (sameCount || differentCount || errorsCount)
+	{
+		wchar_t status[256];
+
+		_snwprintf_s(status, _countof(status), _TRUNCATE,
+				L"%Iu files: %Id different, %Id same, %Id not readable, %Id not compared",
+				_results->entries.size(), differentCount, sameCount, errorsCount,
+				static_cast<intptr_t>(_results->entries.size()) - differentCount - sameCount - errorsCount);
+		setStatus(status);
+	}
+	else
+	{
+		setStatus(L"");
+	}
+}
+
+
+void BatchCompareDialog::addFiles()
+{
+	// Room for many selected files - their names follow the folder path
+	std::vector<wchar_t> files(64 * 1024, L'\0');
+
+	OPENFILENAME ofn = {};
+	ofn.lStructSize	= sizeof(ofn);
+	ofn.hwndOwner	= _hSelf;
+	ofn.lpstrFilter	= L"All files (*.*)\0*.*\0";
+	ofn.lpstrFile	= files.data();
+	ofn.nMaxFile	= static_cast<DWORD>(files.size());
+	ofn.lpstrTitle	= L"Select files to compare to the reference";
+	ofn.Flags		= OFN_ALLOWMULTISELECT | OFN_EXPLORER | OFN_FILEMUSTEXIST | OFN_HIDEREADONLY;
+
+	if (!::GetOpenFileName(&ofn))
+		return;
+
+	std::vector<std::wstring> paths;
+
+	const wchar_t* name = files.data() + wcslen(files.data()) + 1;
+
+	// A single file is returned as a full path, more files as their folder followed by their names
+	if (*name == L'\0')
+	{
+		paths.emplace_back(files.data());
+	}
+	else
+	{
+		std::wstring folder = files.data();
+
+		if (folder.back() != L'\\')
+			folder += L'\\';
+
+		for (; *name; name += wcslen(name) + 1)
+			paths.emplace_back(folder + name);
+	}
+
+	for (auto& path : paths)
+	{
+		bool added = false;
+
+		for (const auto& entry : _results->entries)
+		{
+			if (_wcsicmp(entry.file.c_str(), path.c_str()) == 0)
+			{
+				added = true;
+				break;
+			}
+		}
+
+		if (!added)
+		{
+			_results->entries.emplace_back();
+			_results->entries.back().file = std::move(path);
+		}
+	}
+
+	fillList();
+}
+
+
+void BatchCompareDialog::removeSelected()
+{
+	HWND hList = ::GetDlgItem(_hSelf, IDC_BATCH_CMP_LIST);
+
+	const int row = ListView_GetNextItem(hList, -1, LVNI_SELECTED);
+
+	if (row < 0)
+		return;
+
+	_results->entries.erase(_results->entries.begin() + row);
+
+	fillList();
+}
+
+
+void BatchCompareDialog::startCompare()
+{
+	if (_worker || _results->entries.empty())
+		return;
+
+	_newEntries.clear();
+
+	for (const auto& entry : _results->entries)
+	{
+		_newEntries.emplace_back();
+		_newEntries.back().file = entry.file;
+	}
+
+	_cancelled	= false;
+	_done		= 0;
+	_total		= static_cast<intptr_t>(_newEntries.size());
+
+	setBusy(true);
+	setStatus(L"Hashing the reference...");
+
+	// Worker threads only update the counters - the dialog shows them on its timer
+	auto doCompare =
+		[this]()
+		{
+			try
+			{
+				// The entries compared till cancelled are kept as well
+				compareToReference(_reference->options, *_reference->doc, _reference->view, CP_UTF8, _newEntries,
+						&_cancelled, [this](intptr_t done, intptr_t total) { _done = done; _total = total; });
+				_newEntriesValid = true;
+			}
+			catch (...)
+			{
+				_newEntriesValid = false;
+			}
+
+			::PostMessage(_hSelf, cCompareDoneMsg, 0, 0);
+		};
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	try
+	{
+		_worker = std::make_unique<std::thread>(doCompare);
+		::SetTimer(_hSelf, cProgressTimer, 200, NULL);
+
+		return;
+	}
+	catch (...)
+	{
+		_worker = nullptr;
+	}
+#endif // MULTITHREAD
+
+	HCURSOR hOldCursor = ::SetCursor(::LoadCursor(NULL, IDC_WAIT));
+
+	doCompare();
+
+	::SetCursor(hOldCursor);
+}
+
+
+void BatchCompareDialog::stopCompare()
+{
+	if (!_worker)
+		return;
+
+	_cancelled = true;
+
+	_worker->join();
+	_worker = nullptr;
+
+	::KillTimer(_hSelf, cProgressTimer);
+}
+
+
+void BatchCompareDialog::onCompareDone()
+{
+	if (_worker)
+	{
+		_worker->join();
+		_worker = nullptr;
+
+		::KillTimer(_hSelf, cProgressTimer);
+	}
+
+	setBusy(false);
+
+	if (_newEntriesValid)
+	{
+		_results->entries = std::move(_newEntries);
+		fillList();
+	}
+	else
+	{
+		fillList();
+		setStatus(L"Not enough memory to compare all files.");
+	}
+
+	_newEntries.clear();
+}
+
+
+void BatchCompareDialog::setStatus(const wchar_t* status)
+{
+	::SetDlgItemText(_hSelf, IDC_BATCH_CMP_STATUS, status);
+}
+
+
+void BatchCompareDialog::setBusy(bool busy)
+{
+	static constexpr int cCtrlIds[] = {
+		IDC_BATCH_ADD, IDC_BATCH_REMOVE, IDC_BATCH_COMPARE, IDC_BATCH_CMP_LIST, IDOK
+	};
+
+	for (int id : cCtrlIds)
+		::EnableWindow(::GetDlgItem(_hSelf, id), !busy);
+}
+
+
+bool BatchCompareDialog::openSelected()
+{
+	HWND hList = ::GetDlgItem(_hSelf, IDC_BATCH_CMP_LIST);
+
+	const int row = ListView_GetNextItem(hList, -1, LVNI_SELECTED);
+
+	if (row < 0)
+		return false;
+
+	LVITEM item = {};
+	item.mask	= LVIF_PARAM;
+	item.iItem	= row;
+
+	if (!ListView_GetItem(hList, &item))
+		return false;
+
+	_results->selected = static_cast<intptr_t>(item.lParam);
+
+	return true;
+}
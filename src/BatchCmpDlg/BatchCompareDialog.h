@@ -0,0 +1,115 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+#include "PluginInterface.h"
+#include "DockingFeature/StaticDialog.h"
+#include "resource.h"
+#include "CompareOptions.h"
+#include "DocSource.h"
+#include "BatchCompare.h"
+
+#if defined(__MINGW32__) && !defined(_GLIBCXX_HAS_GTHREADS)
+#include "../mingw-std-threads/mingw.thread.h"
+#else
+#include <thread>
+#endif // __MINGW32__ ...
+
+
+// The reference document the candidates are compared to - taken from the active view when the dialog is opened
+struct BatchCmpReference
+{
+	std::wstring						name;
+	std::unique_ptr<MemoryDocSource>	doc;
+
+	// The view the reference is compared in and the options of the compare in the views
+	int									view {MAIN_VIEW};
+	CompareOptions						options;
+};
+
+
+// Last batch compare - kept between the dialog invocations
+struct BatchCmpResults
+{
+	std::vector<BatchCmpEntry>	entries;
+
+	// Entry chosen to be opened, -1 if none
+	intptr_t					selected {-1};
+};
+
+
+class BatchCompareDialog : public StaticDialog
+{
+
+public:
+	BatchCompareDialog(HINSTANCE hInst, NppData nppDataParam) : StaticDialog()
+	{
+		_nppData = nppDataParam;
+		Window::init(hInst, nppDataParam._nppHandle);
+	};
+
+	~BatchCompareDialog()
+	{
+		stopCompare();
+		destroy();
+	}
+
+	// Returns IDOK if an entry is selected to be opened. The candidates kept in results from the last time are
+	// compared right away.
+	UINT doDialog(const BatchCmpReference* reference, BatchCmpResults* results);
+
+	virtual void destroy() {};
+
+protected :
+	INT_PTR CALLBACK run_dlgProc(UINT Message, WPARAM wParam, LPARAM lParam);
+
+private:
+	static constexpr UINT		cCompareDoneMsg	= WM_APP + 1;
+	static constexpr UINT_PTR	cProgressTimer	= 1;
+
+	void initList();
+	void fillList();
+	void addFiles();
+	void removeSelected();
+	void startCompare();
+	void stopCompare();
+	void onCompareDone();
+	void setStatus(const wchar_t* status);
+	void setBusy(bool busy);
+	bool openSelected();
+
+	/* Handles */
+	NppData _nppData;
+
+	const BatchCmpReference*	_reference {nullptr};
+	BatchCmpResults*			_results {nullptr};
+
+	std::vector<BatchCmpEntry>	_newEntries;
+	bool						_newEntriesValid {false};
+
+	std::unique_ptr<std::thread>	_worker;
+	std::atomic<bool>				_cancelled {false};
+	std::atomic<intptr_t>			_done {0};
+	std::atomic<intptr_t>			_total {0};
+};
@@ -0,0 +1,713 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <windows.h>
+#include <psapi.h>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+
+#include "Benchmark.h"
+#include "CliCompare.h"
+#include "diff.h"
+#include "histogram_diff.h"
+#include "Workload.h"
+
+
+namespace // anonymous namespace
+{
+
+// Char level diffs are run on the beginnings of the texts - Myers complexity grows with the text size times the diffs
+constexpr intptr_t cCharDiffTextSize = 16 * 1024;
+
+// Totally different texts are that many times smaller than the others for the same reason
+constexpr intptr_t cDifferentTextDivisor = 10;
+
+// Lines of the blocks moved around by the moves corpus
+constexpr intptr_t cMovedBlockLen = 50;
+
+// Lines of the blocks changed by the large changed blocks corpus and the lines between them
+constexpr intptr_t cChangedBlockLen		= 1000;
+constexpr intptr_t cChangedBlocksGap	= 19 * cChangedBlockLen;
+
+
+struct Corpus
+{
+	const char*			name;
+	std::vector<char>	text1;
+	std::vector<char>	text2;
+};
+
+
+/**
+ *  \class  TextGenerator
+ *  \brief  Generates reproducible (for the given seed) code-like text lines and edits
+ */
+class TextGenerator
+{
+public:
+	explicit TextGenerator(uint32_t seed) : _rng(seed) {}
+
+	std::string line()
+	{
+		static const char* const cWords[] = {
+			"int", "return", "if", "else", "for", "while", "const", "auto", "std::vector", "count", "Index",
+			"value", "result", "=", "==", "+", "(", ")", "{", "}", ";", "nullptr", "true", "FALSE", "getText",
+			"SetMaxCount", "0", "42", "0x80", "// TODO", "\"string\""
+		};
+
+		std::string text(pick(4), '\t');
+
+		const int wordsCount = pick(12);
+
+		for (int i = 0; i < wordsCount; ++i)
+		{
+			if (i)
+				text.append(pick(8) ? 1 : 3, ' ');
+
+			text += cWords[pick(sizeof(cWords) / sizeof(cWords[0]))];
+		}
+
+		return text;
+	}
+
+	std::vector<std::string> lines(intptr_t count)
+	{
+		std::vector<std::string> text(count);
+
+		for (auto& l : text)
+			l = line();
+
+		return text;
+	}
+
+	// Changes, removes and adds about editsPerThousand lines of every thousand
+	std::vector<std::string> edit(const std::vector<std::string>& text, int editsPerThousand)
+	{
+		std::vector<std::string> edited;
+
+		edited.reserve(text.size() + text.size() / 100);
+
+		for (const auto& l : text)
+		{
+			if (pick(1000) >= editsPerThousand)
+			{
+				edited.push_back(l);
+				continue;
+			}
+
+			switch (pick(3))
+			{
+				case 0:
+					edited.push_back(l + " + 1");
+				break;
+
+				case 1:
+				break;
+
+				default:
+					edited.push_back(l);
+					edited.push_back(line());
+			}
+		}
+
+		return edited;
+	}
+
+	// Moves about movesPerThousand of every thousand blocks of blockLen lines to random places
+	std::vector<std::string> moveBlocks(const std::vector<std::string>& text, intptr_t blockLen, int movesPerThousand)
+	{
+		const intptr_t linesCount = static_cast<intptr_t>(text.size());
+
+		// Offset and length of each block in the moved blocks order
+		std::vector<std::pair<intptr_t, intptr_t>> blocks;
+		std::vector<std::pair<intptr_t, intptr_t>> moved;
+
+		for (intptr_t off = 0; off < linesCount; off += blockLen)
+		{
+			const std::pair<intptr_t, intptr_t> block(off, std::min(blockLen, linesCount - off));
+
+			if (pick(1000) < movesPerThousand)
+				moved.push_back(block);
+			else
+				blocks.push_back(block);
+		}
+
+		for (const auto& block : moved)
+			blocks.insert(blocks.begin() + pick(blocks.size() + 1), block);
+
+		std::vector<std::string> edited;
+
+		edited.reserve(text.size());
+
+		for (const auto& block : blocks)
+			edited.insert(edited.end(), text.begin() + block.first, text.begin() + block.first + block.second);
+
+		return edited;
+	}
+
+	// Changes all lines of the blocks of blockLen lines with gapLen unchanged lines between them
+	std::vector<std::string> changeBlocks(const std::vector<std::string>& text, intptr_t blockLen, intptr_t gapLen)
+	{
+		const intptr_t linesCount = static_cast<intptr_t>(text.size());
+
+		std::vector<std::string> edited(text);
+
+		for (intptr_t off = gapLen; off < linesCount; off += blockLen + gapLen)
+		{
+			const intptr_t end = std::min(off + blockLen, linesCount);
+
+			for (intptr_t line = off; line < end; ++line)
+				edited[line] += pick(2) ? " + 1" : " - value";
+		}
+
+		return edited;
+	}
+
+	inline int pick(size_t count)
+	{
+		return static_cast<int>(_rng() % count);
+	}
+
+private:
+	std::mt19937 _rng;
+};
+
+
+std::vector<char> joinLines(const std::vector<std::string>& lines)
+{
+	std::vector<char> text;
+
+	for (const auto& l : lines)
+	{
+		text.insert(text.end(), l.begin(), l.end());
+		text.push_back('\r');
+		text.push_back('\n');
+	}
+
+	return text;
+}
+
+
+std::vector<Corpus> generateCorpora(const BenchmarkParams& params)
+{
+	TextGenerator gen(params.seed);
+
+	std::vector<Corpus> corpora;
+
+	{
+		const std::vector<std::string> base = gen.lines(params.linesCount);
+
+		corpora.push_back({ "random_edits", joinLines(base), joinLines(gen.edit(base, 10)) });
+	}
+
+	// Few distinct lines repeated all over - worst case for the anchors based algorithms
+	{
+		const std::vector<std::string> distinct = gen.lines(8);
+
+		std::vector<std::string> base(params.linesCount);
+
+		for (auto& l : base)
+			l = distinct[gen.pick(distinct.size())];
+
+		corpora.push_back({ "mass_repetition", joinLines(base), joinLines(gen.edit(base, 10)) });
+	}
+
+	{
+		const intptr_t linesCount = std::max<intptr_t>(params.linesCount / cDifferentTextDivisor, 1);
+
+		std::vector<char> text1 = joinLines(gen.lines(linesCount));
+		std::vector<char> text2 = joinLines(gen.lines(linesCount));
+
+		corpora.push_back({ "fully_different", std::move(text1), std::move(text2) });
+	}
+
+	// The moves detection (findMoves()) work
+	{
+		const std::vector<std::string> base = gen.lines(params.linesCount);
+
+		corpora.push_back({ "moved_blocks", joinLines(base), joinLines(gen.moveBlocks(base, cMovedBlockLen, 100)) });
+	}
+
+	// The changed lines matching of large blocks (getOrderedConvergence()) work
+	{
+		const std::vector<std::string> base = gen.lines(params.linesCount);
+
+		corpora.push_back({ "large_changed_blocks", joinLines(base),
+				joinLines(gen.changeBlocks(base, cChangedBlockLen, cChangedBlocksGap)) });
+	}
+
+	return corpora;
+}
+
+
+class BenchTimer
+{
+public:
+	BenchTimer() : _start(std::chrono::steady_clock::now()) {}
+
+	double seconds() const
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point _start;
+};
+
+
+void printResult(const std::string& name, double seconds, intptr_t linesCount, intptr_t bytesCount,
+	const std::string& info = std::string())
+{
+	if (seconds <= 0.)
+		seconds = 1e-9;
+
+	std::printf("%-48s %10.1f ms %14.0f lines/s %10.1f MB/s  %s\n", name.c_str(), seconds * 1000.,
+			linesCount / seconds, bytesCount / seconds / (1024. * 1024.), info.c_str());
+}
+
+
+void benchHashing(const Corpus& corpus)
+{
+	struct HashOptions
+	{
+		const char*		name;
+		bool			ignoreChangedSpaces;
+		bool			ignoreAllSpaces;
+		bool			ignoreCase;
+		const wchar_t*	ignoreRegex;
+	};
+
+	static const HashOptions cHashOptions[] = {
+		{ "no ignore options",			false,	false,	false,	nullptr },
+		{ "ignore changed spaces",		true,	false,	false,	nullptr },
+		{ "ignore all spaces",			false,	true,	false,	nullptr },
+		{ "ignore case",					false,	false,	true,	nullptr },
+		{ "ignore regex (linear)",		false,	false,	false,	L"0x[0-9]+|\\d+" },
+		{ "ignore regex (std::wregex)",	false,	false,	false,	L"(?=\\d)\\d+" }
+	};
+
+	MemoryDocSource doc(std::vector<char>(corpus.text1));
+
+	for (const auto& hashOptions : cHashOptions)
+	{
+		CompareOptions options;
+
+		resetCompareOptions(options);
+
+		options.ignoreChangedSpaces	= hashOptions.ignoreChangedSpaces;
+		options.ignoreAllSpaces		= hashOptions.ignoreAllSpaces;
+		options.ignoreCase			= hashOptions.ignoreCase;
+
+		if (hashOptions.ignoreRegex)
+			options.setIgnoreRegex(hashOptions.ignoreRegex);
+
+		BenchTimer timer;
+
+		const std::vector<Line> lines = getLines(doc, options);
+
+		printResult(std::string("getLines: ") + hashOptions.name, timer.seconds(), doc.linesCount(), doc.length());
+	}
+}
+
+
+void benchLinesDiff(const Corpus& corpus)
+{
+	MemoryDocSource doc1(std::vector<char>(corpus.text1));
+	MemoryDocSource doc2(std::vector<char>(corpus.text2));
+
+	CompareOptions options;
+
+	resetCompareOptions(options);
+
+	const std::vector<Line> lines1 = getLines(doc1, options);
+	const std::vector<Line> lines2 = getLines(doc2, options);
+
+	const intptr_t linesCount	= static_cast<intptr_t>(lines1.size() + lines2.size());
+	const intptr_t bytesCount	= doc1.length() + doc2.length();
+
+	{
+		BenchTimer timer;
+
+		const auto diffRes = DiffCalc<Line>(lines1, lines2)(true, true);
+
+		printResult(std::string("DiffCalc<Line> Myers: ") + corpus.name, timer.seconds(), linesCount, bytesCount,
+				std::to_string(diffRes.first.size()) + " diff blocks");
+	}
+
+	{
+		BenchTimer timer;
+
+		const auto diffRes = HistogramDiffCalc<Line, void, LineHash>(lines1, lines2)(true, true);
+
+		printResult(std::string("DiffCalc<Line> histogram: ") + corpus.name, timer.seconds(), linesCount,
+				bytesCount, std::to_string(diffRes.first.size()) + " diff blocks");
+	}
+}
+
+
+void benchCharsDiff(const Corpus& corpus)
+{
+	const intptr_t len1 = std::min(static_cast<intptr_t>(corpus.text1.size()), cCharDiffTextSize);
+	const intptr_t len2 = std::min(static_cast<intptr_t>(corpus.text2.size()), cCharDiffTextSize);
+
+	const std::vector<char> chars1(corpus.text1.begin(), corpus.text1.begin() + len1);
+	const std::vector<char> chars2(corpus.text2.begin(), corpus.text2.begin() + len2);
+
+	BenchTimer timer;
+
+	const auto diffRes = DiffCalc<char>(chars1, chars2)(true, true);
+
+	const intptr_t linesCount =
+			std::count(chars1.begin(), chars1.end(), '\n') + std::count(chars2.begin(), chars2.end(), '\n');
+
+	printResult(std::string("DiffCalc<char>: ") + corpus.name + " (16 KB)", timer.seconds(), linesCount,
+			len1 + len2, std::to_string(diffRes.first.size()) + " diff blocks");
+}
+
+
+// Runs the whole compare by the engine (with the plugin default options) and prints its phases wall times - the moves
+// detection (findMoves()) and the changed blocks compare (getOrderedConvergence() and the changed lines diffs)
+void benchEngine(const Corpus& corpus)
+{
+	MemoryDocSource doc1(std::vector<char>(corpus.text1));
+	MemoryDocSource doc2(std::vector<char>(corpus.text2));
+
+	CompareOptions options;
+
+	setEngineDefaults(options);
+
+	FilesCompareViews views(doc1, doc2);
+	SilentProgress progress;
+
+	CompareSummary summary;
+
+	summary.clear();
+
+	BenchTimer timer;
+
+	const CompareResult result = runCompare(options, views, progress, summary);
+
+	const double seconds = timer.seconds();
+
+	const intptr_t linesCount	= doc1.linesCount() + doc2.linesCount();
+	const intptr_t bytesCount	= doc1.length() + doc2.length();
+
+	if (result != CompareResult::COMPARE_MISMATCH)
+	{
+		printResult(std::string("runCompare: ") + corpus.name, seconds, linesCount, bytesCount,
+				(result == CompareResult::COMPARE_MATCH) ? "match" : "failed");
+		return;
+	}
+
+	const CompareStats& stats = summary.stats;
+
+	printResult(std::string("runCompare: ") + corpus.name, seconds, linesCount, bytesCount,
+			std::to_string(summary.added + summary.removed) + " added / removed, " + std::to_string(summary.moved) +
+			" moved, " + std::to_string(summary.changed) + " changed lines");
+
+	printResult(std::string("  findMoves: ") + corpus.name, stats.phaseMs[CompareStats::MOVES] / 1000.,
+			linesCount, bytesCount, std::to_string(stats.linesEditDistance) + " diff lines searched");
+
+	printResult(std::string("  getOrderedConvergence: ") + corpus.name,
+			stats.phaseMs[CompareStats::BLOCKS_COMPARE] / 1000., linesCount, bytesCount,
+			std::to_string(stats.convPairsScored) + " lines pairs scored, " +
+			std::to_string(stats.convPairsPruned) + " pruned");
+}
+
+
+bool writeFile(const std::wstring& filePath, const std::vector<char>& text)
+{
+	FILE* file = _wfopen(filePath.c_str(), L"wb");
+
+	if (!file)
+		return false;
+
+	const bool written = (std::fwrite(text.data(), 1, text.size(), file) == text.size());
+
+	std::fclose(file);
+
+	return written;
+}
+
+
+void printPeakMemory()
+{
+	PROCESS_MEMORY_COUNTERS memCounters;
+
+	if (::GetProcessMemoryInfo(::GetCurrentProcess(), &memCounters, sizeof(memCounters)))
+		std::printf("\nPeak memory: %.1f MB\n", memCounters.PeakWorkingSetSize / (1024. * 1024.));
+}
+
+
+std::vector<char> toUtf8(const std::wstring& wStr)
+{
+	const int len = ::WideCharToMultiByte(CP_UTF8, 0, wStr.c_str(), static_cast<int>(wStr.size()),
+			NULL, 0, NULL, NULL);
+
+	std::vector<char> str(len);
+
+	::WideCharToMultiByte(CP_UTF8, 0, wStr.c_str(), static_cast<int>(wStr.size()), str.data(), len, NULL, NULL);
+
+	return str;
+}
+
+
+// Text of the lines of the same hash in the rebuilt workload documents - letters of the hash class ID padded to the
+// recorded line length so that different classes never match and no ignore option changes them
+std::string classText(size_t classId, uint32_t length)
+{
+	std::string text;
+
+	do
+	{
+		text += static_cast<char>('a' + classId % 16);
+		classId /= 16;
+	}
+	while (classId);
+
+	if (text.size() < length)
+		text.append(length - text.size(), '_');
+
+	return text;
+}
+
+
+// Rebuilds the workload documents text (UTF-8). The recorded (scrambled) changed blocks lines keep their text, the
+// other lines get the text of their hash class - the lines of the same hash get the same text so the engine finds the
+// same lines diff.
+void rebuildWorkloadDocs(const CompareWorkload& workload, std::vector<char> texts[2])
+{
+	std::unordered_map<uint64_t, std::vector<char>> lineTexts;
+
+	for (const auto& blockPair : workload.changedBlocks)
+	{
+		for (int d = 0; d < 2; ++d)
+		{
+			const std::vector<uint64_t>& hashes = workload.docs[d].hashes;
+
+			for (size_t line = 0; line < blockPair.text[d].size(); ++line)
+			{
+				const size_t idx = static_cast<size_t>(blockPair.off[d]) + line;
+
+				if (idx < hashes.size())
+					lineTexts.emplace(hashes[idx], toUtf8(blockPair.text[d][line]));
+			}
+		}
+	}
+
+	for (int d = 0; d < 2; ++d)
+	{
+		const WorkloadDoc& doc = workload.docs[d];
+
+		texts[d].clear();
+
+		for (size_t line = 0; line < doc.hashes.size(); ++line)
+		{
+			auto found = lineTexts.find(doc.hashes[line]);
+
+			if (found == lineTexts.end())
+			{
+				std::vector<char> text;
+
+				if (doc.lengths[line])
+				{
+					const std::string cls = classText(lineTexts.size(), doc.lengths[line]);
+
+					text.assign(cls.begin(), cls.end());
+				}
+
+				found = lineTexts.emplace(doc.hashes[line], std::move(text)).first;
+			}
+
+			texts[d].insert(texts[d].end(), found->second.begin(), found->second.end());
+			texts[d].push_back('\r');
+			texts[d].push_back('\n');
+		}
+	}
+}
+
+
+// Replays the whole compare by the engine on the rebuilt workload documents and prints its phases wall times
+void replayCompare(const CompareWorkload& workload)
+{
+	static const char* const cPhaseNames[CompareStats::PHASES_COUNT] = {
+		"hashing", "lines diff", "findMoves", "changed blocks (getOrderedConvergence)", "marking"
+	};
+
+	// The documents are rebuilt as a whole and the ignore regex would not match the scrambled text as it matched the
+	// original one
+	CompareOptions options;
+
+	options.copyFrom(workload.options);
+	options.findUniqueMode		= false;
+	options.selectionCompare	= false;
+	options.backgroundCompare	= false;
+	options.clearIgnoreRegex();
+
+	std::vector<char> texts[2];
+
+	{
+		BenchTimer timer;
+
+		rebuildWorkloadDocs(workload, texts);
+
+		printResult("rebuild documents", timer.seconds(),
+				static_cast<intptr_t>(workload.docs[0].hashes.size() + workload.docs[1].hashes.size()),
+				static_cast<intptr_t>(texts[0].size() + texts[1].size()));
+	}
+
+	MemoryDocSource doc1(std::move(texts[0]));
+	MemoryDocSource doc2(std::move(texts[1]));
+
+	const intptr_t linesCount	= doc1.linesCount() + doc2.linesCount();
+	const intptr_t bytesCount	= doc1.length() + doc2.length();
+
+	FilesCompareViews views(doc1, doc2);
+	SilentProgress progress;
+
+	CompareSummary summary;
+
+	summary.clear();
+
+	BenchTimer timer;
+
+	const CompareResult result = runCompare(options, views, progress, summary);
+
+	const double seconds = timer.seconds();
+
+	if (result != CompareResult::COMPARE_MISMATCH)
+	{
+		printResult("runCompare", seconds, linesCount, bytesCount,
+				(result == CompareResult::COMPARE_MATCH) ? "match" : "failed");
+		return;
+	}
+
+	const CompareStats& stats = summary.stats;
+
+	printResult("runCompare", seconds, linesCount, bytesCount,
+			std::to_string(summary.added + summary.removed) + " added / removed, " + std::to_string(summary.moved) +
+			" moved, " + std::to_string(summary.changed) + " changed lines" +
+			(stats.diffApproximated ? ", approximated - diff cost limit reached" : ""));
+
+	for (int phase = 0; phase < CompareStats::PHASES_COUNT; ++phase)
+		printResult(std::string("  ") + cPhaseNames[phase], stats.phaseMs[phase] / 1000., linesCount, bytesCount);
+
+	std::printf("\n%lld lines pairs scored, %lld pruned by the changed blocks compare\n",
+			static_cast<long long>(stats.convPairsScored), static_cast<long long>(stats.convPairsPruned));
+
+	if (stats.budgetDegraded())
+		std::printf("Memory budget reached - %lld blocks banded, %lld blocks not matched by lines\n",
+				static_cast<long long>(stats.budgetBandedBlocks), static_cast<long long>(stats.budgetLinesOnlyBlocks));
+}
+
+} // anonymous namespace
+
+
+int runBenchmark(const BenchmarkParams& params)
+{
+	std::printf("Corpora of %lld lines, seed %u\n\n", static_cast<long long>(params.linesCount), params.seed);
+
+	const std::vector<Corpus> corpora = generateCorpora(params);
+
+	benchHashing(corpora[0]);
+
+	std::printf("\n");
+
+	for (const auto& corpus : corpora)
+		benchLinesDiff(corpus);
+
+	std::printf("\n");
+
+	for (const auto& corpus : corpora)
+		benchCharsDiff(corpus);
+
+	std::printf("\n");
+
+	for (const auto& corpus : corpora)
+		benchEngine(corpus);
+
+	printPeakMemory();
+
+	return 0;
+}
+
+
+int replayWorkload(const wchar_t* filePath)
+{
+	CompareWorkload workload;
+
+	if (!loadWorkload(filePath, workload))
+	{
+		std::fwprintf(stderr, L"Cannot read workload: %ls\n", filePath);
+		return 2;
+	}
+
+	const CompareOptions& options = workload.options;
+
+	std::printf("Workload of %lld and %lld lines (code pages %d and %d), diff cost limit %d, memory budget %d MB\n\n",
+			static_cast<long long>(workload.docs[0].hashes.size()),
+			static_cast<long long>(workload.docs[1].hashes.size()),
+			workload.docs[0].codepage, workload.docs[1].codepage, options.diffCostLimit, options.memoryBudgetMB);
+
+	if (workload.changedBlocks.empty())
+		std::printf("No changed lines text recorded - the changed blocks lines match nothing in the replay\n\n");
+
+	replayCompare(workload);
+
+	printPeakMemory();
+
+	return 0;
+}
+
+
+bool generateCorpus(const wchar_t* dirPath, const BenchmarkParams& params)
+{
+	if (!::CreateDirectoryW(dirPath, NULL) && ::GetLastError() != ERROR_ALREADY_EXISTS)
+		return false;
+
+	const std::wstring dir = std::wstring(dirPath) + L"\\";
+
+	std::vector<char> pairsList;
+
+	for (const auto& corpus : generateCorpora(params))
+	{
+		const std::wstring name(corpus.name, corpus.name + std::char_traits<char>::length(corpus.name));
+
+		const std::wstring file1 = dir + name + L"_1.txt";
+		const std::wstring file2 = dir + name + L"_2.txt";
+
+		if (!writeFile(file1, corpus.text1) || !writeFile(file2, corpus.text2))
+			return false;
+
+		const std::vector<char> path1 = toUtf8(file1);
+		const std::vector<char> path2 = toUtf8(file2);
+
+		pairsList.insert(pairsList.end(), path1.begin(), path1.end());
+		pairsList.push_back('\t');
+		pairsList.insert(pairsList.end(), path2.begin(), path2.end());
+		pairsList.push_back('\r');
+		pairsList.push_back('\n');
+	}
+
+	return writeFile(dir + L"pairs.txt", pairsList);
+}
@@ -0,0 +1,37 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+
+struct BenchmarkParams
+{
+	intptr_t	linesCount {200000};
+	uint32_t	seed {1};
+};
+
+
+// Runs the engine benchmarks on synthetic corpora and prints the results to stdout. Returns the exit code.
+int runBenchmark(const BenchmarkParams& params);
+
+// Replays the compare workload recorded by the plugin (see Workload.h) and prints the timings. Returns the exit code.
+int replayWorkload(const wchar_t* filePath);
+
+// Writes the synthetic corpora files to the directory along with a pairs list file (for --pairs)
+bool generateCorpus(const wchar_t* dirPath, const BenchmarkParams& params);
@@ -0,0 +1,123 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "CompareOptions.h"
+#include "DocSource.h"
+#include "LineHash.h"
+#include "Engine.h"
+
+
+struct Line
+{
+	intptr_t line;
+
+	uint64_t hash;
+
+	inline bool operator==(const Line& rhs) const
+	{
+		return (hash == rhs.hash);
+	}
+
+	inline bool operator!=(const Line& rhs) const
+	{
+		return (hash != rhs.hash);
+	}
+};
+
+
+struct LineHash
+{
+	inline size_t operator()(const Line& l) const
+	{
+		return static_cast<size_t>(l.hash);
+	}
+};
+
+
+// Turns off all compare options
+inline void resetCompareOptions(CompareOptions& options)
+{
+	options.newFileViewId		= 0;
+	options.findUniqueMode		= false;
+	options.alignAllMatches		= false;
+	options.neverMarkIgnored	= false;
+	options.histogramDiff		= false;
+	options.verifyLineMatches	= false;
+	options.detectMoves			= false;
+	options.detectCharDiffs		= false;
+	options.bestSeqChangedLines	= false;
+	options.ignoreEmptyLines	= false;
+	options.ignoreChangedSpaces	= false;
+	options.ignoreAllSpaces		= false;
+	options.ignoreCase			= false;
+	options.recompareOnChange	= false;
+	options.backgroundCompare	= false;
+	options.changedThresholdPercent = 0;
+	options.diffCostLimit		= 0;
+	options.bandedMatchLines	= 0;
+	options.memoryBudgetMB		= 0;
+	options.selectionCompare	= false;
+	options.clearIgnoreRegex();
+}
+
+
+// The compare engine options the plugin defaults to - file1 (the main view one) is the old file
+inline void setEngineDefaults(CompareOptions& options)
+{
+	resetCompareOptions(options);
+
+	options.newFileViewId			= SUB_VIEW;
+	options.detectMoves				= true;
+	options.changedThresholdPercent	= 30;
+}
+
+
+// Hashes the document lines as the plugin does - ignored empty lines are left out
+inline std::vector<Line> getLines(const DocSource& doc, const CompareOptions& options)
+{
+	const intptr_t linesCount = doc.linesCount();
+
+	std::vector<Line> lines;
+
+	lines.reserve(linesCount);
+
+	for (intptr_t docLine = 0; docLine < linesCount; ++docLine)
+	{
+		const intptr_t lineStart	= doc.lineStart(docLine);
+		const intptr_t lineEnd		= doc.lineEnd(docLine);
+
+		LineHasher hasher;
+
+		if (lineStart < lineEnd)
+			addLineText(hasher, doc.rangePointer(lineStart, lineEnd - lineStart), lineEnd - lineStart,
+					doc.codepage(), options);
+
+		Line newLine;
+		newLine.hash = hasher.Get();
+		newLine.line = docLine;
+
+		if (!options.ignoreEmptyLines || newLine.hash != cHashSeed)
+			lines.emplace_back(newLine);
+	}
+
+	return lines;
+}
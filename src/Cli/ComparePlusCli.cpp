@@ -0,0 +1,682 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Command line compare of files (or lists of file pairs) by the plugin's compare engine - the same lines diff, moves
+ * detection and changed lines compare as the plugin runs. The files are read through memory mappings and the results
+ * are written to stdout as JSON - one object per line for each compared pair. Exit code is 0 if all pairs match, 1 if
+ * any differs and 2 on errors.
+ */
+
+
+#include <windows.h>
+#include <cstdio>
+#include <cstdint>
+#include <cwchar>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <regex>
+
+#if defined(__MINGW32__) && !defined(_GLIBCXX_HAS_GTHREADS)
+#include "../mingw-std-threads/mingw.thread.h"
+#else
+#include <thread>
+#endif // __MINGW32__ ...
+
+#include "CompareOptions.h"
+#include "DocSource.h"
+#include "Engine.h"
+#include "CliCompare.h"
+#include "Benchmark.h"
+#include "FolderCompare.h"
+#include "BatchCompare.h"
+
+
+#ifdef DLOG
+
+// The compare engine debug log goes to stderr
+void engineLog(const std::string& str)
+{
+	std::fputs(str.c_str(), stderr);
+}
+
+
+void engineLogTime()
+{
+}
+
+#endif
+
+
+namespace // anonymous namespace
+{
+
+
+struct FilesPair
+{
+	std::wstring file1;
+	std::wstring file2;
+};
+
+
+enum class PairResult
+{
+	PAIR_MATCH,
+	PAIR_MISMATCH,
+	PAIR_ERROR
+};
+
+
+struct CmdLineParams
+{
+	CompareOptions			options;
+	int						codepage {CP_UTF8};
+	unsigned				jobs {0};
+	std::vector<FilesPair>	pairs;
+
+	// The two files are folders whose file trees are compared by content
+	bool					folders {false};
+
+	// Reference file all other files are compared to - the pairs are the reference and each of the candidates
+	const wchar_t*			reference {nullptr};
+
+	bool					benchmark {false};
+	const wchar_t*			corpusDir {nullptr};
+	const wchar_t*			workloadFile {nullptr};
+	BenchmarkParams			benchParams;
+};
+
+
+void printUsage()
+{
+	std::fwprintf(stderr,
+		L"Usage: ComparePlusCli [options] <file1> <file2>\n"
+		L"       ComparePlusCli [options] --pairs <list file>\n"
+		L"       ComparePlusCli [--jobs <count>] --folders <folder1> <folder2>\n"
+		L"       ComparePlusCli [options] --reference <file> <candidate1> [<candidate2> ...]\n\n"
+		L"Options:\n"
+		L"  --ignore-empty-lines      Ignore empty lines\n"
+		L"  --ignore-changed-spaces   Ignore changes in spaces\n"
+		L"  --ignore-all-spaces       Ignore all spaces\n"
+		L"  --ignore-case             Ignore case\n"
+		L"  --ignore-regex <regex>    Ignore the line parts matching the ECMAScript regex\n"
+		L"  --histogram               Use histogram diff algorithm\n"
+		L"  --no-moves                Don't detect moved lines - they are reported as added and removed\n"
+		L"  --char-diffs              Compare the changed lines by characters instead of by words\n"
+		L"  --best-seq-changed        Find the best matching sequence of changed lines (slower)\n"
+		L"  --changed-threshold <%%>   Percent of a line that must match for it to be reported as changed\n"
+		L"                            (30 by default, 0 reports no changed lines)\n"
+		L"  --codepage <codepage>     Code page of the files text (UTF-8 by default)\n"
+		L"  --pairs <list file>       Compare the file pairs listed one per line (tab separated) in the list file\n"
+		L"  --jobs <count>            Number of pairs compared in parallel (number of CPU cores by default)\n"
+		L"  --folders                 Compare the two folders files by content - prints each file status\n"
+		L"  --reference <file>        Compare each of the candidate files to the reference file - prints a summary\n"
+		L"                            of each candidate as the plugin's Compare to Reference does (the reference\n"
+		L"                            is read and hashed once)\n\n"
+		L"Benchmarks:\n"
+		L"  --benchmark               Run the engine benchmarks on synthetic corpora\n"
+		L"  --generate-corpus <dir>   Write the synthetic corpora and their pairs list to the directory\n"
+		L"  --bench-lines <count>     Lines count of the synthetic corpora (200000 by default)\n"
+		L"  --seed <seed>             Seed the synthetic corpora are generated with (1 by default)\n"
+		L"  --replay <workload file>  Replay the compare workload recorded by the plugin and print the timings\n");
+}
+
+
+std::string toUtf8(const std::wstring& wStr)
+{
+	const int len = ::WideCharToMultiByte(CP_UTF8, 0, wStr.c_str(), static_cast<int>(wStr.size()),
+			NULL, 0, NULL, NULL);
+
+	std::string str(len, 0);
+
+	::WideCharToMultiByte(CP_UTF8, 0, wStr.c_str(), static_cast<int>(wStr.size()), &str[0], len, NULL, NULL);
+
+	return str;
+}
+
+
+std::string jsonString(const std::wstring& wStr)
+{
+	const std::string str = toUtf8(wStr);
+
+	std::string json = "\"";
+
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+		{
+			json += '\\';
+			json += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20)
+		{
+			char esc[8];
+
+			std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+			json += esc;
+		}
+		else
+		{
+			json += c;
+		}
+	}
+
+	json += '"';
+
+	return json;
+}
+
+
+// Reads the tab separated file pairs list (UTF-8). Returns false if the list file can't be read.
+bool readPairsList(const wchar_t* listFile, std::vector<FilesPair>& pairs)
+{
+	MappedFileDocSource list;
+
+	if (!list.open(listFile))
+		return false;
+
+	for (intptr_t line = 0; line < list.linesCount(); ++line)
+	{
+		const intptr_t lineStart	= list.lineStart(line);
+		const intptr_t lineEnd		= list.lineEnd(line);
+
+		if (lineStart >= lineEnd)
+			continue;
+
+		const std::vector<char> text = list.text(lineStart, lineEnd);
+
+		const int wLen = ::MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(lineEnd - lineStart),
+				NULL, 0);
+
+		std::wstring wLine(wLen, 0);
+
+		::MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(lineEnd - lineStart), &wLine[0], wLen);
+
+		const size_t tabPos = wLine.find(L'\t');
+
+		if (tabPos == std::wstring::npos)
+			continue;
+
+		pairs.push_back({ wLine.substr(0, tabPos), wLine.substr(tabPos + 1) });
+	}
+
+	return true;
+}
+
+
+bool parseCmdLine(int argc, wchar_t* argv[], CmdLineParams& params)
+{
+	CompareOptions& options = params.options;
+
+	setEngineDefaults(options);
+
+	std::vector<std::wstring> files;
+	const wchar_t* pairsList = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::wstring arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+
+		if (arg == L"--ignore-empty-lines")
+		{
+			options.ignoreEmptyLines = true;
+		}
+		else if (arg == L"--ignore-changed-spaces")
+		{
+			options.ignoreChangedSpaces = true;
+		}
+		else if (arg == L"--ignore-all-spaces")
+		{
+			options.ignoreAllSpaces = true;
+		}
+		else if (arg == L"--ignore-case")
+		{
+			options.ignoreCase = true;
+		}
+		else if (arg == L"--histogram")
+		{
+			options.histogramDiff = true;
+		}
+		else if (arg == L"--no-moves")
+		{
+			options.detectMoves = false;
+		}
+		else if (arg == L"--char-diffs")
+		{
+			options.detectCharDiffs = true;
+		}
+		else if (arg == L"--best-seq-changed")
+		{
+			options.bestSeqChangedLines = true;
+		}
+		else if (arg == L"--changed-threshold" && hasValue)
+		{
+			options.changedThresholdPercent = static_cast<int>(std::wcstol(argv[++i], nullptr, 10));
+
+			if (options.changedThresholdPercent < 0 || options.changedThresholdPercent > 100)
+				return false;
+		}
+		else if (arg == L"--ignore-regex" && hasValue)
+		{
+			try
+			{
+				options.setIgnoreRegex(argv[++i]);
+			}
+			catch (std::regex_error&)
+			{
+				std::fwprintf(stderr, L"Invalid regex: %ls\n", argv[i]);
+				return false;
+			}
+		}
+		else if (arg == L"--codepage" && hasValue)
+		{
+			params.codepage = static_cast<int>(std::wcstol(argv[++i], nullptr, 10));
+		}
+		else if (arg == L"--jobs" && hasValue)
+		{
+			params.jobs = static_cast<unsigned>(std::wcstoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == L"--pairs" && hasValue)
+		{
+			pairsList = argv[++i];
+		}
+		else if (arg == L"--folders")
+		{
+			params.folders = true;
+		}
+		else if (arg == L"--reference" && hasValue)
+		{
+			params.reference = argv[++i];
+		}
+		else if (arg == L"--benchmark")
+		{
+			params.benchmark = true;
+		}
+		else if (arg == L"--generate-corpus" && hasValue)
+		{
+			params.corpusDir = argv[++i];
+		}
+		else if (arg == L"--bench-lines" && hasValue)
+		{
+			params.benchParams.linesCount = static_cast<intptr_t>(std::wcstoll(argv[++i], nullptr, 10));
+		}
+		else if (arg == L"--seed" && hasValue)
+		{
+			params.benchParams.seed = static_cast<uint32_t>(std::wcstoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == L"--replay" && hasValue)
+		{
+			params.workloadFile = argv[++i];
+		}
+		else if (arg.compare(0, 2, L"--") == 0)
+		{
+			return false;
+		}
+		else
+		{
+			files.push_back(arg);
+		}
+	}
+
+	if (params.workloadFile)
+		return (files.empty() && !pairsList && !params.benchmark && !params.corpusDir);
+
+	if (params.benchmark || params.corpusDir)
+		return (files.empty() && !pairsList && params.benchParams.linesCount > 0);
+
+	if (params.folders && pairsList)
+		return false;
+
+	if (params.reference)
+	{
+		if (params.folders || pairsList || files.empty())
+			return false;
+
+		for (const auto& file : files)
+			params.pairs.push_back({ params.reference, file });
+
+		return true;
+	}
+
+	if (pairsList)
+	{
+		if (!files.empty())
+			return false;
+
+		if (!readPairsList(pairsList, params.pairs))
+		{
+			std::fwprintf(stderr, L"Cannot read pairs list: %ls\n", pairsList);
+			return false;
+		}
+
+		return true;
+	}
+
+	if (files.size() != 2)
+		return false;
+
+	params.pairs.push_back({ files[0], files[1] });
+
+	return true;
+}
+
+
+inline const char* blockType(int mask)
+{
+	if (mask & (1 << MARKER_MOVED_LINE))
+		return "moved";
+
+	if (mask & (1 << MARKER_CHANGED_LINE))
+		return "changed";
+
+	return (mask & (1 << MARKER_ADDED_LINE)) ? "added" : "removed";
+}
+
+
+// Prints the diff marked lines of the file as JSON blocks of the same type - doc line numbers are one based
+void addBlocks(std::string& out, int file, const DiffMap_t& diffMap)
+{
+	const size_t runsCount = diffMap.size();
+
+	for (size_t i = 0; i < runsCount;)
+	{
+		const char* const type = blockType(diffMap[i].mask);
+
+		const intptr_t firstLine = diffMap[i].line;
+		intptr_t endLine = firstLine + diffMap[i].len;
+
+		for (++i; i < runsCount && diffMap[i].line == endLine && blockType(diffMap[i].mask) == type; ++i)
+			endLine += diffMap[i].len;
+
+		char block[160];
+
+		std::snprintf(block, sizeof(block),
+				"%s{\"file\":%d,\"type\":\"%s\",\"firstLine\":%lld,\"lastLine\":%lld,\"lines\":%lld}",
+				(out.back() == '[') ? "" : ",", file, type, static_cast<long long>(firstLine + 1),
+				static_cast<long long>(endLine), static_cast<long long>(endLine - firstLine));
+
+		out += block;
+	}
+}
+
+
+void addSummary(std::string& out, bool isMatch, const CompareSummary& summary)
+{
+	char summaryStr[256];
+
+	std::snprintf(summaryStr, sizeof(summaryStr),
+			",\"result\":\"%s\",\"summary\":{\"diffLines\":%lld,\"added\":%lld,\"removed\":%lld,\"changed\":%lld,"
+			"\"moved\":%lld,\"match\":%lld}}",
+			isMatch ? "match" : "mismatch", static_cast<long long>(summary.diffLines),
+			static_cast<long long>(summary.added), static_cast<long long>(summary.removed),
+			static_cast<long long>(summary.changed), static_cast<long long>(summary.moved),
+			static_cast<long long>(summary.match));
+
+	out += summaryStr;
+}
+
+
+// Compares doc2 to doc1 (the old one) by the compare engine and prints the result - the diff blocks of both files
+// and the summary
+PairResult compareDocs(const DocSource& doc1, const DocSource& doc2, const CmdLineParams& params, std::string& out)
+{
+	FilesCompareViews views(doc1, doc2);
+	SilentProgress progress;
+
+	CompareSummary summary;
+
+	summary.clear();
+
+	const CompareResult result = runCompare(params.options, views, progress, summary);
+
+	if (result != CompareResult::COMPARE_MATCH && result != CompareResult::COMPARE_MISMATCH)
+	{
+		out += ",\"result\":\"error\",\"error\":\"compare failed\"}";
+		return PairResult::PAIR_ERROR;
+	}
+
+	const bool isMatch = (result == CompareResult::COMPARE_MATCH);
+
+	// The engine doesn't count the lines of matching files
+	if (isMatch)
+		summary.match = doc1.linesCount();
+
+	out += ",\"blocks\":[";
+
+	addBlocks(out, 1, summary.diffMap[MAIN_VIEW]);
+	addBlocks(out, 2, summary.diffMap[SUB_VIEW]);
+
+	out += ']';
+
+	addSummary(out, isMatch, summary);
+
+	return isMatch ? PairResult::PAIR_MATCH : PairResult::PAIR_MISMATCH;
+}
+
+
+PairResult comparePair(const FilesPair& pair, const CmdLineParams& params, std::string& out)
+{
+	out = "{\"file1\":" + jsonString(pair.file1) + ",\"file2\":" + jsonString(pair.file2);
+
+	MappedFileDocSource doc1;
+	MappedFileDocSource doc2;
+
+	if (!doc1.open(pair.file1.c_str(), params.codepage) || !doc2.open(pair.file2.c_str(), params.codepage))
+	{
+		out += ",\"result\":\"error\",\"error\":\"cannot open file\"}";
+		return PairResult::PAIR_ERROR;
+	}
+
+	return compareDocs(doc1, doc2, params, out);
+}
+
+// The candidates (the pairs second files) are compared to the reference by the batch compare the plugin runs - the
+// reference is read and hashed once. Only the summaries are printed.
+int runReferenceCompare(const CmdLineParams& params)
+{
+	MappedFileDocSource reference;
+
+	if (!reference.open(params.reference, params.codepage))
+	{
+		std::fwprintf(stderr, L"Cannot open reference file: %ls\n", params.reference);
+		return 2;
+	}
+
+	std::vector<BatchCmpEntry> entries(params.pairs.size());
+
+	for (size_t i = 0; i < entries.size(); ++i)
+		entries[i].file = params.pairs[i].file2;
+
+	try
+	{
+		compareToReference(params.options, reference, MAIN_VIEW, params.codepage, entries, nullptr, nullptr,
+				static_cast<int>(params.jobs));
+	}
+	catch (std::exception&)
+	{
+		// The candidates left not compared are reported below
+	}
+
+	int exitCode = 0;
+
+	for (const auto& entry : entries)
+	{
+		std::string out = "{\"file1\":" + jsonString(params.reference) + ",\"file2\":" + jsonString(entry.file);
+
+		switch (entry.status)
+		{
+			case BatchCmpStatus::MATCH:
+			case BatchCmpStatus::MISMATCH:
+				addSummary(out, entry.status == BatchCmpStatus::MATCH, entry.summary);
+			break;
+
+			case BatchCmpStatus::READ_ERROR:
+				out += ",\"result\":\"error\",\"error\":\"cannot open file\"}";
+			break;
+
+			case BatchCmpStatus::COMPARE_ERROR:
+				out += ",\"result\":\"error\",\"error\":\"compare failed\"}";
+			break;
+
+			default:
+				out += ",\"result\":\"error\",\"error\":\"out of memory\"}";
+		}
+
+		std::fputs(out.c_str(), stdout);
+		std::fputc('\n', stdout);
+
+		if (entry.status == BatchCmpStatus::MISMATCH)
+		{
+			if (exitCode == 0)
+				exitCode = 1;
+		}
+		else if (entry.status != BatchCmpStatus::MATCH)
+		{
+			exitCode = 2;
+		}
+	}
+
+	return exitCode;
+}
+
+
+int runFoldersCompare(const CmdLineParams& params)
+{
+	static const char* const cStatusStr[] = { "match", "mismatch", "only_in_1", "only_in_2", "error" };
+
+	const FilesPair& folders = params.pairs[0];
+
+	std::vector<FolderCmpEntry> entries;
+
+	if (!compareFolders(folders.file1.c_str(), folders.file2.c_str(), entries, nullptr, nullptr,
+			static_cast<int>(params.jobs)))
+	{
+		std::fwprintf(stderr, L"Cannot read folders: %ls, %ls\n", folders.file1.c_str(), folders.file2.c_str());
+		return 2;
+	}
+
+	int exitCode = 0;
+
+	for (const auto& entry : entries)
+	{
+		std::printf("{\"path\":%s,\"result\":\"%s\"}\n", jsonString(entry.relPath).c_str(),
+				cStatusStr[static_cast<int>(entry.status)]);
+
+		if (entry.status == FolderCmpStatus::READ_ERROR)
+			exitCode = 2;
+		else if (entry.status != FolderCmpStatus::SAME && exitCode == 0)
+			exitCode = 1;
+	}
+
+	return exitCode;
+}
+
+} // anonymous namespace
+
+
+int wmain(int argc, wchar_t* argv[])
+{
+	CmdLineParams params;
+
+	if (!parseCmdLine(argc, argv, params))
+	{
+		printUsage();
+		return 2;
+	}
+
+	if (params.workloadFile)
+		return replayWorkload(params.workloadFile);
+
+	if (params.corpusDir && !generateCorpus(params.corpusDir, params.benchParams))
+	{
+		std::fwprintf(stderr, L"Cannot write corpus to: %ls\n", params.corpusDir);
+		return 2;
+	}
+
+	if (params.benchmark)
+		return runBenchmark(params.benchParams);
+
+	if (params.corpusDir)
+		return 0;
+
+	if (params.folders)
+		return runFoldersCompare(params);
+
+	if (params.reference)
+		return runReferenceCompare(params);
+
+	const size_t pairsCount = params.pairs.size();
+
+	std::vector<std::string> results(pairsCount);
+	std::vector<PairResult> pairResults(pairsCount, PairResult::PAIR_ERROR);
+
+	std::atomic<size_t> nextPair(0);
+
+	auto worker =
+		[&]()
+		{
+			for (size_t i = nextPair++; i < pairsCount; i = nextPair++)
+			{
+				try
+				{
+					pairResults[i] = comparePair(params.pairs[i], params, results[i]);
+				}
+				catch (std::exception&)
+				{
+					results[i] = "{\"file1\":" + jsonString(params.pairs[i].file1) +
+							",\"file2\":" + jsonString(params.pairs[i].file2) +
+							",\"result\":\"error\",\"error\":\"out of memory\"}";
+				}
+			}
+		};
+
+	unsigned jobs = params.jobs ? params.jobs : std::thread::hardware_concurrency();
+
+	if (jobs == 0)
+		jobs = 1;
+
+	if (jobs > pairsCount)
+		jobs = static_cast<unsigned>(pairsCount);
+
+	std::vector<std::thread> threads;
+
+	for (unsigned i = 1; i < jobs; ++i)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (auto& thread : threads)
+		thread.join();
+
+	int exitCode = 0;
+
+	for (size_t i = 0; i < pairsCount; ++i)
+	{
+		std::fputs(results[i].c_str(), stdout);
+		std::fputc('\n', stdout);
+
+		if (pairResults[i] == PairResult::PAIR_ERROR)
+			exitCode = 2;
+		else if (pairResults[i] == PairResult::PAIR_MISMATCH && exitCode == 0)
+			exitCode = 1;
+	}
+
+	return exitCode;
+}
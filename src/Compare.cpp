@@ -22,9 +22,11 @@
 #include <vector>
 #include <memory>
 #include <utility>
+#include <algorithm>
 #include <cmath>
 #include <cwchar>
 #include <ctime>
+#include <atomic>
 
 #include <windows.h>
 #include <tchar.h>
@@ -39,11 +41,27 @@
 #include "AboutDialog.h"
 #include "SettingsDialog.h"
 #include "IgnoreRegexDialog.h"
+#include "FolderCompareDialog.h"
+#include "BatchCompareDialog.h"
 #include "NavDialog.h"
-#include "Engine.h"
+#include "ViewsCompare.h"
+#include "LineHashIndex.h"
+#include "BinaryCompare.h"
+#include "Trace.h"
+#include "ProgressDlg.h"
 #include "NppInternalDefines.h"
 #include "resource.h"
 
+#if defined(__MINGW32__) && !defined(_GLIBCXX_HAS_GTHREADS)
+#include "mingw-std-threads/mingw.thread.h"
+#else
+#include <thread>
+#endif // __MINGW32__ ...
+
+#ifndef MULTITHREAD
+#define MULTITHREAD		1
+#endif
+
 
 const TCHAR PLUGIN_NAME[] = TEXT("ComparePlus");
 
@@ -72,6 +90,11 @@ constexpr int MIN_NOTEPADPP_VERSION_MINOR = 420;
 
 constexpr int MIN_NOTEPADPP_VERSION = ((MIN_NOTEPADPP_VERSION_MAJOR << 16) | MIN_NOTEPADPP_VERSION_MINOR);
 
+// Above that many alignment points blank sections are added only around the viewport (lazy alignment)
+constexpr intptr_t LAZY_ALIGNMENT_MIN_POINTS = 4096;
+// Lazily aligned margin around the viewport in screens
+constexpr intptr_t LAZY_ALIGNMENT_MARGIN_SCREENS = 3;
+
 
 /**
  *  \class
@@ -143,7 +166,22 @@ struct DeletedSection
 	 */
 	struct UndoData
 	{
-		AlignmentInfo_t					alignment;
+		/**
+		 *  \struct
+		 *  \brief  The alignment points of the deleted lines - the following points are only shifted by the deletion
+		 *          so the alignment is restored by shifting them back and re-inserting these (it is not copied whole)
+		 */
+		struct AlignmentDelta
+		{
+			bool			stored {false};
+			intptr_t		idx {0};		// Index of the first point of the deleted lines
+			intptr_t		linesCount {0};
+			intptr_t		sizeBefore {0};
+			intptr_t		nextLine {-1};	// Line of the point following the deleted lines, -1 if none
+			AlignmentInfo_t	points;
+		};
+
+		AlignmentDelta					alignment;
 		std::pair<intptr_t, intptr_t>	selection {-1, -1};
 		std::vector<int>				otherViewMarks;
 	};
@@ -268,7 +306,8 @@ enum Temp_t
 	LAST_SAVED_TEMP,
 	CLIPBOARD_TEMP,
 	SVN_TEMP,
-	GIT_TEMP
+	GIT_TEMP,
+	BINARY_TEMP
 };
 
 
@@ -312,11 +351,120 @@ public:
 	intptr_t	sciDoc;
 	TCHAR		name[MAX_PATH];
 
+	LineHashCache	lineHashes;
+
 private:
 	DeletedSectionsList deletedSections;
 };
 
 
+/**
+ *  \class
+ *  \brief  Picks the delay of the pair's auto re-compares by the cost of its recent compares and the user's typing
+ *          rate. A burst of edits is coalesced into a single re-compare and the costly ones (that would freeze the
+ *          editing) wait until the user is idle instead of turning auto re-compare off.
+ */
+class RecompareScheduler
+{
+public:
+	// Notes a pair edit - returns the delay of the re-compare it needs (incremental - the re-compare can reuse the last
+	// compare results)
+	UINT onEdit(bool linesAdded, bool incremental);
+
+	void onCompared(DWORD cost_ms, bool incremental);
+
+	// Time the user still has to be idle for before the due re-compare is run, 0 if it can be run now
+	DWORD idleWaitTime(bool incremental) const;
+
+private:
+	static constexpr UINT	cLinesEditDelay_ms	= 500;
+
+	// Bigger delay if the change is on a single line because the user might be typing and we shouldn't interrupt
+	static constexpr UINT	cLineEditDelay_ms	= 1000;
+	static constexpr UINT	cMaxDelay_ms		= 5000;
+
+	// Re-compares that cost more wait until the user has been idle for as long as they take (up to cMaxIdleWait_ms)
+	static constexpr DWORD	cDeferCost_ms		= 1000;
+	static constexpr DWORD	cMaxIdleWait_ms		= 3000;
+
+	static inline DWORD average(DWORD avg, DWORD sample)
+	{
+		return avg ? (avg * 3 + sample) / 4 : sample;
+	}
+
+	inline DWORD cost(bool incremental) const
+	{
+		return (incremental && _incrementalCost_ms) ? _incrementalCost_ms : _fullCost_ms;
+	}
+
+	// Last edit of the current burst, 0 if a compare has been run since (the next edit starts a new burst)
+	DWORD	_lastEditTick		{0};
+
+	// Delay of the re-compare due - longer pauses in the typing end the burst
+	DWORD	_delay_ms			{0};
+
+	// Moving averages of the time between the edits of a burst and of the compares costs, 0 if not measured yet
+	DWORD	_editInterval_ms	{0};
+	DWORD	_fullCost_ms		{0};
+	DWORD	_incrementalCost_ms	{0};
+};
+
+
+UINT RecompareScheduler::onEdit(bool linesAdded, bool incremental)
+{
+	const DWORD now = ::GetTickCount();
+
+	// Edits further apart than the re-compare delay are not part of the same burst - the pause ran the re-compare
+	// or would have if it wasn't deferred, sampling it would only drift the delay towards its maximum
+	if (_lastEditTick && (now - _lastEditTick < _delay_ms))
+		_editInterval_ms = average(_editInterval_ms, now - _lastEditTick);
+
+	_lastEditTick = now;
+
+	UINT delay = linesAdded ? cLinesEditDelay_ms : cLineEditDelay_ms;
+
+	// Wait for a pause in the typing and leave the user at least twice the compare time between the re-compares
+	delay = std::max<UINT>(delay, 2 * _editInterval_ms);
+	delay = std::max<UINT>(delay, 2 * cost(incremental));
+
+	_delay_ms = std::min(delay, cMaxDelay_ms);
+
+	return _delay_ms;
+}
+
+
+void RecompareScheduler::onCompared(DWORD cost_ms, bool incremental)
+{
+	// The edits after the compare are a new burst
+	_lastEditTick = 0;
+
+	if (incremental)
+		_incrementalCost_ms = average(_incrementalCost_ms, cost_ms);
+	else
+		_fullCost_ms = average(_fullCost_ms, cost_ms);
+}
+
+
+DWORD RecompareScheduler::idleWaitTime(bool incremental) const
+{
+	const DWORD compareCost = cost(incremental);
+
+	if (compareCost < cDeferCost_ms)
+		return 0;
+
+	LASTINPUTINFO lastInput;
+	lastInput.cbSize = sizeof(lastInput);
+
+	if (!::GetLastInputInfo(&lastInput))
+		return 0;
+
+	const DWORD idleTime = ::GetTickCount() - lastInput.dwTime;
+	const DWORD needed = std::min(compareCost, cMaxIdleWait_ms);
+
+	return (idleTime < needed) ? (needed - idleTime) : 0;
+}
+
+
 /**
  *  \class
  *  \brief
@@ -336,8 +484,20 @@ public:
 
 	void setStatus();
 
+	inline bool isDiffIndexValid() const
+	{
+		return (!compareDirty && (editsCount == markedEditsCount));
+	}
+
 	void adjustAlignment(int view, intptr_t line, intptr_t offset);
 
+	// Stores what adjustAlignment() will remove when the lines [startLine, startLine + linesCount) are deleted
+	void getAlignmentDelta(int view, intptr_t startLine, intptr_t linesCount,
+			DeletedSection::UndoData::AlignmentDelta& delta) const;
+
+	// Reverts the deletion alignment adjustment, returns false if the alignment is not as the deletion left it
+	bool restoreAlignment(int view, const DeletedSection::UndoData::AlignmentDelta& delta);
+
 	void setCompareDirty()
 	{
 		compareDirty = true;
@@ -353,11 +513,35 @@ public:
 
 	CompareSummary	summary;
 
+	IncrementalCompare	incremental;
+
 	bool			compareDirty	= false;
 	bool			manuallyChanged	= false;
 	int				inEqualizeMode	= 0;
 
 	int				autoUpdateDelay	= 0;
+
+	RecompareScheduler	recompareScheduler;
+
+	// Counts the files edits - background re-compare results are dropped if the pair is edited meanwhile
+	unsigned		editsCount		= 0;
+
+	// editsCount when the last compare marked the files - the summary diff maps and index are in sync with the views
+	// markers until the files are edited
+	unsigned		markedEditsCount	= 0;
+
+	// Index in summary.diffIndex of the diff last navigated to, -1 if none
+	intptr_t		currentDiff		= -1;
+
+	// Show Only Diffs hidden lines are updated from these lines on by the next updateViewsFoldState() - the lines above
+	// are up to date after an incremental re-compare
+	intptr_t		foldFromLine[2]	= { 0, 0 };
+
+	// The current files contents have been re-compared in the background already
+	bool			precomputed		= false;
+
+	// Alignment points range [first, second) materialized by the last lazy alignDiffs(), second is -1 if fully aligned
+	std::pair<intptr_t, intptr_t>	lazyAlignment	= { 0, -1 };
 };
 
 
@@ -450,6 +634,165 @@ public:
 };
 
 
+/**
+ *  \class
+ *  \brief  Re-compares the stale inactive compare pairs by a worker thread while the user is idle. The line diffs
+ *          are kept in the engine compare results cache so re-compare on the pair activation has only to mark them.
+ *          Runs one pair at a time and never together with a foreground compare - stop() is called before that.
+ */
+class BackgroundRecompare : public DelayedWork
+{
+public:
+	BackgroundRecompare() : DelayedWork() {}
+	virtual ~BackgroundRecompare() = default;
+
+	virtual void operator()();
+
+	// Cancels the running re-compare and waits for it to end
+	void stop();
+
+	// Schedules the pairs check after the user has been idle for a while
+	inline void schedule()
+	{
+		if (!_job)
+			post(cIdleTime_ms);
+	}
+
+private:
+	static constexpr DWORD	cIdleTime_ms	= 1000;
+	static constexpr UINT	cPollTime_ms	= 100;
+
+	struct Job
+	{
+		LRESULT			buffId;
+		unsigned		editsCount;
+
+		CompareOptions	options;
+
+		std::unique_ptr<MemoryDocSource>	docs[2];
+		LineHashCache						lineHashes[2];
+
+		// Private to the job - the progress dialog instance is left to the foreground compares
+		SilentProgress		progress;
+		std::thread			worker;
+		std::atomic<bool>	done {false};
+		CompareResult		result {CompareResult::COMPARE_CANCELLED};
+	};
+
+	static bool isStale(const ComparedPair& cmpPair);
+
+	std::vector<char> getDocText(intptr_t sciDoc);
+
+	bool start(ComparedPair& cmpPair);
+	void finish();
+
+	// Invisible Scintilla the inactive documents are read through
+	HWND _hSci {NULL};
+
+	std::unique_ptr<Job> _job;
+};
+
+
+/**
+ *  \class
+ *  \brief  syncViews() state kept between the display frames. The views end visible lines (costly to get on big
+ *          wrapped or folded documents) are cached until the views layout changes, the last synced positions let
+ *          repeated syncs of unchanged views be dropped and the syncs requested after one has been done in the
+ *          current frame are coalesced into a single one in the next frame.
+ */
+class ViewsSync
+{
+public:
+	static constexpr DWORD cFrameInterval_ms = 16;
+
+	// Blank lines, hidden lines or markers have been changed - wrapping, zoom and text changes are detected
+	inline void invalidate()
+	{
+		_layout[MAIN_VIEW].valid	= false;
+		_layout[SUB_VIEW].valid		= false;
+		_last.valid					= false;
+	}
+
+	// Visible line of the last unhidden doc line end (its last wrap)
+	inline intptr_t endVisible(int view)
+	{
+		refresh(view);
+		return _layout[view].endVisible;
+	}
+
+	inline intptr_t linesOnScreen(int view)
+	{
+		refresh(view);
+		return _layout[view].linesOnScreen;
+	}
+
+	// The views are positioned as the last sync left them
+	bool isSynced(int biasView);
+
+	void setSynced(int biasView);
+
+	inline void onPainted()
+	{
+		_frameSynced = false;
+	}
+
+	inline bool isFrameSynced() const
+	{
+		return (_frameSynced && (::GetTickCount() - _syncTime < cFrameInterval_ms));
+	}
+
+private:
+	struct Layout
+	{
+		bool		valid {false};
+		intptr_t	doc {0};
+		intptr_t	linesCount {0};
+		int			zoom {0};
+		int			wrapMode {0};
+		LONG		width {0};
+		LONG		height {0};
+
+		intptr_t	endVisible {0};
+		intptr_t	linesOnScreen {0};
+	};
+
+	struct Positions
+	{
+		bool		valid {false};
+		int			biasView {0};
+		intptr_t	firstVisible[2] {};
+		intptr_t	currentLine[2] {};
+	};
+
+	// Returns false if the cached view layout is still valid
+	bool refresh(int view);
+
+	static Positions getPositions(int biasView);
+
+	Layout		_layout[2];
+	Positions	_last;
+
+	bool		_frameSynced {false};
+	DWORD		_syncTime {0};
+};
+
+
+/**
+ *  \class
+ *  \brief  Runs the views sync coalesced by requestSyncViews() in the next frame
+ */
+class DelayedSync : public DelayedWork
+{
+public:
+	DelayedSync() : DelayedWork() {}
+	virtual ~DelayedSync() = default;
+
+	virtual void operator()();
+
+	int biasView {MAIN_VIEW};
+};
+
+
 /**
  *  \class
  *  \brief
@@ -475,6 +818,102 @@ private:
 };
 
 
+/**
+ *  \class
+ *  \brief  The compare being run. Notepad++ is not disabled while the compare runs in the background so the plugin
+ *          commands and Notepad++ notifications come meanwhile - other compares are refused and the compare is
+ *          cancelled (its results are dropped before they get to the views) if its documents get edited, switched
+ *          out of their views or closed.
+ */
+class RunningCompare
+{
+public:
+	// Times the compare is run again if its documents get edited meanwhile
+	static constexpr int cMaxRedos = 2;
+
+	// What made the compare results be dropped - the most severe change is kept
+	enum Change
+	{
+		NONE = 0,
+		DOCS_EDITED,	// The documents are still in the views - they can be compared again
+		VIEWS_CHANGED,
+		FILE_CLOSED,	// The compare pair is cleared by the delayed closure
+		NPP_CLOSED		// The views are gone
+	};
+
+	inline void start(const ComparedPair& cmpPair)
+	{
+		_buffIds[0]	= cmpPair.file[0].buffId;
+		_buffIds[1]	= cmpPair.file[1].buffId;
+
+		_docs[MAIN_VIEW]	= getDocId(MAIN_VIEW);
+		_docs[SUB_VIEW]		= getDocId(SUB_VIEW);
+
+		_change		= NONE;
+		_running	= true;
+	}
+
+	inline void end()
+	{
+		_running = false;
+	}
+
+	inline bool isRunning() const
+	{
+		return _running;
+	}
+
+	inline Change change() const
+	{
+		return _change;
+	}
+
+	void onModified(const SCNotification* notifyCode)
+	{
+		if (!(notifyCode->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)))
+			return;
+
+		const int view = getViewIdSafe((HWND)notifyCode->nmhdr.hwndFrom);
+
+		if (view >= 0 && getDocId(view) == _docs[view])
+			drop(DOCS_EDITED);
+	}
+
+	void onBufferActivated()
+	{
+		if (getDocId(MAIN_VIEW) != _docs[MAIN_VIEW] || getDocId(SUB_VIEW) != _docs[SUB_VIEW])
+			drop(VIEWS_CHANGED);
+	}
+
+	void onFileBeforeClose(LRESULT buffId)
+	{
+		if (buffId == _buffIds[0] || buffId == _buffIds[1])
+			drop(FILE_CLOSED);
+	}
+
+	void onNppClosing(bool shutdown)
+	{
+		drop(shutdown ? NPP_CLOSED : VIEWS_CHANGED);
+	}
+
+private:
+	void drop(Change change)
+	{
+		if (_change < change)
+			_change = change;
+
+		if (ProgressDlg::Get())
+			ProgressDlg::Get()->Cancel();
+	}
+
+	bool		_running {false};
+	Change		_change {NONE};
+
+	LRESULT		_buffIds[2] {};
+	intptr_t	_docs[2] {};
+};
+
+
 /**
  *  \class
  *  \brief
@@ -510,7 +949,8 @@ static const TempMark_t tempMark[] =
 	{ TEXT("_LastSave"),	TEXT(" ** Last Save") },
 	{ TEXT("Clipboard_"),	TEXT(" ** Clipboard") },
 	{ TEXT("_SVN"),			TEXT(" ** SVN") },
-	{ TEXT("_Git"),			TEXT(" ** Git") }
+	{ TEXT("_Git"),			TEXT(" ** Git") },
+	{ TEXT("_Hex"),			TEXT(" ** Hex") }
 };
 
 
@@ -533,6 +973,13 @@ DelayedAlign	delayedAlignment;
 DelayedActivate	delayedActivation;
 DelayedClose	delayedClosure;
 DelayedUpdate	delayedUpdate;
+DelayedSync		delayedSync;
+
+ViewsSync		viewsSync;
+
+BackgroundRecompare	backgroundRecompare;
+
+RunningCompare	runningCompare;
 
 NavDialog		NavDlg;
 
@@ -553,6 +1000,7 @@ FuncItem funcItem[NB_MENU_COMMANDS] = { 0 };
 // Declare local functions that appear before they are defined
 void onBufferActivated(LRESULT buffId);
 void syncViews(int biasView);
+void requestSyncViews(int biasView);
 void temporaryRangeSelect(int view, intptr_t startPos = -1, intptr_t endPos = -1);
 void setArrowMark(int view, intptr_t line = -1, bool down = true);
 intptr_t getAlignmentIdxAfter(const AlignmentViewData AlignmentPair::*pView, const AlignmentInfo_t &alignInfo,
@@ -609,6 +1057,7 @@ void NppSettings::updatePluginMenu()
 			MF_BYCOMMAND | ((compareList.empty() && !newCompare) ? (MF_DISABLED | MF_GRAYED) : MF_ENABLED));
 
 	::EnableMenuItem(hMenu, funcItem[CMD_COMPARE_SUMMARY]._cmdID, flag);
+	::EnableMenuItem(hMenu, funcItem[CMD_RECORD_WORKLOAD]._cmdID, flag);
 	::EnableMenuItem(hMenu, funcItem[CMD_FIRST]._cmdID, flag);
 	::EnableMenuItem(hMenu, funcItem[CMD_PREV]._cmdID, flag);
 	::EnableMenuItem(hMenu, funcItem[CMD_NEXT]._cmdID, flag);
@@ -1162,6 +1611,13 @@ void ComparedPair::setStatus()
 		}
 		else if (Settings.StatusInfo == StatusType::DIFFS_SUMMARY)
 		{
+			if ((currentDiff >= 0) && isDiffIndexValid())
+			{
+				const int len = _sntprintf_s(buf, _countof(buf), _TRUNCATE, TEXT(" Diff %Id of %Id |"),
+						currentDiff + 1, static_cast<intptr_t>(summary.diffIndex.size()));
+				_tcscpy_s(info + infoCurrentPos, _countof(info) - infoCurrentPos, buf);
+				infoCurrentPos += len;
+			}
 			if (summary.diffLines)
 			{
 				const int len =
@@ -1221,23 +1677,58 @@ void ComparedPair::adjustAlignment(int view, intptr_t line, intptr_t offset)
 
 	const intptr_t startIdx = getAlignmentIdxAfter(alignView, alignInfo, line);
 
-	if ((startIdx < static_cast<intptr_t>(alignInfo.size())) && ((alignInfo[startIdx].*alignView).line >= line))
+	if ((startIdx < alignInfo.size()) && ((alignInfo[startIdx].*alignView).line >= line))
 	{
+		// Points of the removed lines
 		if (offset < 0)
-		{
-			intptr_t endIdx = startIdx;
+			alignInfo.erase(startIdx, alignInfo.idxAfter(view, line - offset));
 
-			while ((endIdx < static_cast<intptr_t>(alignInfo.size())) &&
-					(line > (alignInfo[endIdx].*alignView).line + offset))
-				++endIdx;
+		alignInfo.shiftLines(view, startIdx, offset);
+	}
+}
 
-			if (endIdx > startIdx)
-				alignInfo.erase(alignInfo.begin() + startIdx, alignInfo.begin() + endIdx);
-		}
 
-		for (intptr_t i = startIdx; i < static_cast<intptr_t>(alignInfo.size()); ++i)
-			(alignInfo[i].*alignView).line += offset;
-	}
+void ComparedPair::getAlignmentDelta(int view, intptr_t startLine, intptr_t linesCount,
+		DeletedSection::UndoData::AlignmentDelta& delta) const
+{
+	AlignmentViewData AlignmentPair::*alignView = (view == MAIN_VIEW) ? &AlignmentPair::main : &AlignmentPair::sub;
+	const AlignmentInfo_t& alignInfo = summary.alignmentInfo;
+
+	delta.stored		= true;
+	delta.idx			= alignInfo.idxAfter(view, startLine);
+	delta.linesCount	= linesCount;
+	delta.sizeBefore	= alignInfo.size();
+
+	const intptr_t endIdx = alignInfo.idxAfter(view, startLine + linesCount);
+
+	alignInfo.slice(delta.idx, endIdx, delta.points);
+
+	delta.nextLine = (endIdx < alignInfo.size()) ? (alignInfo[endIdx].*alignView).line : -1;
+}
+
+
+bool ComparedPair::restoreAlignment(int view, const DeletedSection::UndoData::AlignmentDelta& delta)
+{
+	AlignmentViewData AlignmentPair::*alignView = (view == MAIN_VIEW) ? &AlignmentPair::main : &AlignmentPair::sub;
+	AlignmentInfo_t& alignInfo = summary.alignmentInfo;
+
+	const intptr_t erasedCount = delta.points.size();
+
+	// The alignment has not been adjusted (selection compare) - it is as before the deletion
+	if ((alignInfo.size() == delta.sizeBefore) &&
+			((delta.nextLine < 0) || ((alignInfo[delta.idx + erasedCount].*alignView).line == delta.nextLine)))
+		return true;
+
+	if ((alignInfo.size() != delta.sizeBefore - erasedCount) ||
+			((delta.nextLine >= 0) && ((alignInfo[delta.idx].*alignView).line != delta.nextLine - delta.linesCount)))
+		return false;
+
+	if (delta.nextLine >= 0)
+		alignInfo.shiftLines(view, delta.idx, delta.linesCount);
+
+	alignInfo.insert(delta.idx, delta.points);
+
+	return true;
 }
 
 
@@ -1445,50 +1936,145 @@ intptr_t getCornerLine(int view, bool down, const CompareList_t::iterator& cmpPa
 }
 
 
-std::pair<int, intptr_t> findNextChange(intptr_t mainStartLine, intptr_t subStartLine, bool down,
-		bool goToCornerDiff = false)
+// Same as SCI_MARKERNEXT / SCI_MARKERPREVIOUS of MARKER_MASK_LINE but binary searching the pair diff map if it is in
+// sync with the view markers - Scintilla scans the lines one by one
+intptr_t nextMarkedLine(const ComparedPair& cmpPair, int view, intptr_t line, bool down)
 {
-	CompareList_t::iterator	cmpPair = getCompare(getCurrentBuffId());
-	if (cmpPair == compareList.end())
-		return std::make_pair(-1, -1);
-
-	int view			= getCurrentViewId();
-	const int otherView	= getOtherViewId(view);
+	if (!cmpPair.isDiffIndexValid())
+		return CallScintilla(view, down ? SCI_MARKERNEXT : SCI_MARKERPREVIOUS, line, MARKER_MASK_LINE);
 
-	const int nextMarker = down ? SCI_MARKERNEXT : SCI_MARKERPREVIOUS;
+	const DiffMap_t& diffMap = cmpPair.summary.diffMap[view];
 
-	intptr_t mainNextLine = -1;
-	intptr_t subNextLine = -1;
+	// First run starting after line
+	auto runIt = std::upper_bound(diffMap.begin(), diffMap.end(), line,
+			[](intptr_t l, const DiffMapRun& run) { return (l < run.line); });
 
-	if (mainStartLine >= 0)
+	if (down)
 	{
-		mainNextLine = CallScintilla(MAIN_VIEW, nextMarker, mainStartLine, MARKER_MASK_LINE);
+		if ((runIt != diffMap.begin()) && (std::prev(runIt)->mask & MARKER_MASK_LINE) &&
+				(std::prev(runIt)->line + std::prev(runIt)->len > line))
+			return line;
 
-		if ((mainNextLine == mainStartLine) && !goToCornerDiff)
-			mainNextLine = -1;
+		for (; runIt != diffMap.end(); ++runIt)
+		{
+			if (runIt->mask & MARKER_MASK_LINE)
+				return runIt->line;
+		}
 	}
-
-	if (subStartLine >= 0)
+	else
 	{
-		subNextLine = CallScintilla(SUB_VIEW, nextMarker, subStartLine, MARKER_MASK_LINE);
+		while (runIt != diffMap.begin())
+		{
+			--runIt;
 
-		if ((subNextLine == subStartLine) && !goToCornerDiff)
-			subNextLine = -1;
+			if (runIt->mask & MARKER_MASK_LINE)
+				return std::min(line, runIt->line + runIt->len - 1);
+		}
 	}
 
-	intptr_t line				= (view == MAIN_VIEW)		? mainNextLine : subNextLine;
-	const intptr_t otherLine	= (otherView == MAIN_VIEW)	? mainNextLine : subNextLine;
+	return -1;
+}
 
-	bool isChangedDiff = false;
 
-	if (line < 0)
-	{
-		// End of doc reached - no more diffs
-		if (otherLine < 0)
-			return std::make_pair(-1, -1);
+// Same as getNextUnmarkedLine() / getPrevUnmarkedLine() of MARKER_MASK_LINE using the pair diff map if it is in sync
+intptr_t nextUnmarkedLine(const ComparedPair& cmpPair, int view, intptr_t line, bool down)
+{
+	if (!cmpPair.isDiffIndexValid())
+		return down ? getNextUnmarkedLine(view, line, MARKER_MASK_LINE) :
+				getPrevUnmarkedLine(view, line, MARKER_MASK_LINE);
 
-		if (cmpPair->options.findUniqueMode)
-		{
+	const DiffMap_t& diffMap = cmpPair.summary.diffMap[view];
+
+	auto runIt = std::upper_bound(diffMap.begin(), diffMap.end(), line,
+			[](intptr_t l, const DiffMapRun& run) { return (l < run.line); });
+
+	if (down)
+	{
+		if ((runIt != diffMap.begin()) && (std::prev(runIt)->mask & MARKER_MASK_LINE) &&
+				(std::prev(runIt)->line + std::prev(runIt)->len > line))
+		{
+			line = std::prev(runIt)->line + std::prev(runIt)->len;
+
+			for (; (runIt != diffMap.end()) && (runIt->line == line) && (runIt->mask & MARKER_MASK_LINE); ++runIt)
+				line = runIt->line + runIt->len;
+		}
+
+		return ((line < CallScintilla(view, SCI_GETLINECOUNT, 0, 0)) ? line : -1);
+	}
+
+	for (; runIt != diffMap.begin(); --runIt)
+	{
+		const DiffMapRun& run = *std::prev(runIt);
+
+		if (!(run.mask & MARKER_MASK_LINE) || (run.line + run.len <= line))
+			break;
+
+		line = run.line - 1;
+	}
+
+	return line;
+}
+
+
+// Keeps the "Diff k of N" status in sync with the navigation
+void setCurrentDiff(ComparedPair& cmpPair, int view, intptr_t line)
+{
+	intptr_t currentDiff = -1;
+
+	if (cmpPair.isDiffIndexValid() && (view >= 0) && (line >= 0))
+		currentDiff = getAlignmentIdxAfter((view == MAIN_VIEW) ? &AlignmentPair::main : &AlignmentPair::sub,
+				cmpPair.summary.diffIndex, line + 1) - 1;
+
+	if (currentDiff != cmpPair.currentDiff)
+	{
+		cmpPair.currentDiff = currentDiff;
+		cmpPair.setStatus();
+	}
+}
+
+
+std::pair<int, intptr_t> findNextChange(intptr_t mainStartLine, intptr_t subStartLine, bool down,
+		bool goToCornerDiff = false)
+{
+	CompareList_t::iterator	cmpPair = getCompare(getCurrentBuffId());
+	if (cmpPair == compareList.end())
+		return std::make_pair(-1, -1);
+
+	int view			= getCurrentViewId();
+	const int otherView	= getOtherViewId(view);
+
+	intptr_t mainNextLine = -1;
+	intptr_t subNextLine = -1;
+
+	if (mainStartLine >= 0)
+	{
+		mainNextLine = nextMarkedLine(*cmpPair, MAIN_VIEW, mainStartLine, down);
+
+		if ((mainNextLine == mainStartLine) && !goToCornerDiff)
+			mainNextLine = -1;
+	}
+
+	if (subStartLine >= 0)
+	{
+		subNextLine = nextMarkedLine(*cmpPair, SUB_VIEW, subStartLine, down);
+
+		if ((subNextLine == subStartLine) && !goToCornerDiff)
+			subNextLine = -1;
+	}
+
+	intptr_t line				= (view == MAIN_VIEW)		? mainNextLine : subNextLine;
+	const intptr_t otherLine	= (otherView == MAIN_VIEW)	? mainNextLine : subNextLine;
+
+	bool isChangedDiff = false;
+
+	if (line < 0)
+	{
+		// End of doc reached - no more diffs
+		if (otherLine < 0)
+			return std::make_pair(-1, -1);
+
+		if (cmpPair->options.findUniqueMode)
+		{
 			view = otherView;
 			line = otherLine;
 		}
@@ -1657,6 +2243,8 @@ std::pair<int, intptr_t> jumpToNextChange(intptr_t mainStartLine, intptr_t subSt
 
 			showBlankAdjacentArrowMark(view, line, down);
 
+			setCurrentDiff(*cmpPair, view, line);
+
 			return nextDiff;
 		}
 	}
@@ -1705,6 +2293,8 @@ std::pair<int, intptr_t> jumpToNextChange(intptr_t mainStartLine, intptr_t subSt
 
 	showBlankAdjacentArrowMark(view, line, down);
 
+	setCurrentDiff(*cmpPair, view, line);
+
 	return std::make_pair(view, line);
 }
 
@@ -1725,6 +2315,10 @@ inline void jumpToLastChange(bool doNotBlink = false)
 
 void jumpToChange(bool down)
 {
+	CompareList_t::iterator	cmpPair = getCompare(getCurrentBuffId());
+	if (cmpPair == compareList.end())
+		return;
+
 	std::pair<int, intptr_t> viewLoc;
 
 	intptr_t mainStartLine	= 0;
@@ -1759,8 +2353,8 @@ void jumpToChange(bool down)
 		if (!currentLineAnnotated && isLineAnnotated(otherView, otherLine))
 			++otherLine;
 
-		viewLoc = jumpToNextChange(getNextUnmarkedLine(MAIN_VIEW, mainStartLine, MARKER_MASK_LINE),
-				getNextUnmarkedLine(SUB_VIEW, subStartLine, MARKER_MASK_LINE), down);
+		viewLoc = jumpToNextChange(nextUnmarkedLine(*cmpPair, MAIN_VIEW, mainStartLine, true),
+				nextUnmarkedLine(*cmpPair, SUB_VIEW, subStartLine, true), down);
 	}
 	else
 	{
@@ -1776,10 +2370,6 @@ void jumpToChange(bool down)
 
 		if (isAdjacentAnnotationVisible(currentView, currentLine, down))
 		{
-			CompareList_t::iterator	cmpPair = getCompare(getCurrentBuffId());
-			if (cmpPair == compareList.end())
-				return;
-
 			if (!(cmpPair->options.selectionCompare && Settings.ShowOnlySelections &&
 				!isLineMarked(currentView, currentLine, MARKER_MASK_LINE) &&
 				(currentLine == cmpPair->options.selections[currentView].first)))
@@ -1800,8 +2390,8 @@ void jumpToChange(bool down)
 		otherLine = (Settings.FollowingCaret ?
 				otherViewMatchingLine(currentView, currentLine) : getFirstLine(otherView));
 
-		viewLoc = jumpToNextChange(getPrevUnmarkedLine(MAIN_VIEW, mainStartLine, MARKER_MASK_LINE),
-				getPrevUnmarkedLine(SUB_VIEW, subStartLine, MARKER_MASK_LINE), down);
+		viewLoc = jumpToNextChange(nextUnmarkedLine(*cmpPair, MAIN_VIEW, mainStartLine, false),
+				nextUnmarkedLine(*cmpPair, SUB_VIEW, subStartLine, false), down);
 	}
 
 	if (viewLoc.first < 0)
@@ -1839,18 +2429,7 @@ void resetCompareView(int view)
 intptr_t getAlignmentIdxAfter(const AlignmentViewData AlignmentPair::*pView, const AlignmentInfo_t &alignInfo,
 	intptr_t line)
 {
-	intptr_t idx = 0;
-
-	for (intptr_t i = static_cast<intptr_t>(alignInfo.size()) / 2; i; i /= 2)
-	{
-		if ((alignInfo[idx + i].*pView).line < line)
-			idx += i;
-	}
-
-	while ((idx < static_cast<intptr_t>(alignInfo.size())) && ((alignInfo[idx].*pView).line < line))
-		++idx;
-
-	return idx;
+	return alignInfo.idxAfter((pView == &AlignmentPair::main) ? MAIN_VIEW : SUB_VIEW, line);
 }
 
 
@@ -1883,6 +2462,19 @@ bool isAlignmentNeeded(int view, const CompareList_t::iterator& cmpPair)
 
 	const intptr_t maxSize = static_cast<intptr_t>(alignmentInfo.size());
 
+	// Lazy alignment - realign before the viewport gets close to the edges of the materialized range
+	if (cmpPair->lazyAlignment.second >= 0)
+	{
+		const intptr_t guard = CallScintilla(view, SCI_LINESONSCREEN, 0, 0);
+
+		if (getAlignmentIdxAfter(pView, alignmentInfo, firstLine - guard) < cmpPair->lazyAlignment.first)
+			return true;
+
+		if ((cmpPair->lazyAlignment.second < maxSize) &&
+				(getAlignmentIdxAfter(pView, alignmentInfo, lastLine + guard) >= cmpPair->lazyAlignment.second))
+			return true;
+	}
+
 	intptr_t i = getAlignmentIdxAfter(pView, alignmentInfo, firstLine);
 
 	if (i >= maxSize)
@@ -1964,12 +2556,63 @@ bool isAlignmentNeeded(int view, const CompareList_t::iterator& cmpPair)
 }
 
 
+// Hides the lines not marked in diffMap (except the context lines around the marked ones) from fromLine on, the lines
+// above are left as they are. The hidden ranges come from the diff map runs instead of scanning the view markers.
+void hideUnmarkedRanges(int view, const DiffMap_t& diffMap, intptr_t fromLine)
+{
+	const intptr_t linesCount	= CallScintilla(view, SCI_GETLINECOUNT, 0, 0);
+	const intptr_t contextLines	= Settings.ShowOnlyDiffsContext;
+
+	if (fromLine >= linesCount)
+		return;
+
+	// Pairs of first and last hidden line - first line (0) cannot be hidden so start from line 1
+	std::vector<std::pair<intptr_t, intptr_t>> hiddenRanges;
+
+	intptr_t hideStart = 1;
+
+	for (const auto& run: diffMap)
+	{
+		if (!(run.mask & MARKER_MASK_LINE))
+			continue;
+
+		const intptr_t hideEnd = run.line - 1 - contextLines;
+
+		if (hideStart <= hideEnd)
+			hiddenRanges.emplace_back(hideStart, hideEnd);
+
+		hideStart = std::max(hideStart, run.line + run.len + contextLines);
+	}
+
+	if (hideStart < linesCount)
+		hiddenRanges.emplace_back(hideStart, linesCount - 1);
+
+	ScopedViewRedrawBlocker redrawBlocker(view);
+
+	if (fromLine > 0)
+		CallScintilla(view, SCI_SHOWLINES, fromLine, linesCount - 1);
+
+	auto rangeIt = std::lower_bound(hiddenRanges.begin(), hiddenRanges.end(), fromLine,
+			[](const std::pair<intptr_t, intptr_t>& range, intptr_t line) { return (range.second < line); });
+
+	for (; rangeIt != hiddenRanges.end(); ++rangeIt)
+		CallScintilla(view, SCI_HIDELINES, std::max(rangeIt->first, fromLine), rangeIt->second);
+}
+
+
 void updateViewsFoldState(const CompareList_t::iterator& cmpPair)
 {
+	viewsSync.invalidate();
+
 	if (Settings.ShowOnlyDiffs)
 	{
-		hideUnmarked(MAIN_VIEW, MARKER_MASK_LINE);
-		hideUnmarked(SUB_VIEW, MARKER_MASK_LINE);
+		for (int view: { MAIN_VIEW, SUB_VIEW })
+		{
+			if (cmpPair->isDiffIndexValid())
+				hideUnmarkedRanges(view, cmpPair->summary.diffMap[view], cmpPair->foldFromLine[view]);
+			else
+				hideUnmarked(view, MARKER_MASK_LINE, Settings.ShowOnlyDiffsContext);
+		}
 	}
 	else if (cmpPair->options.selectionCompare && Settings.ShowOnlySelections)
 	{
@@ -1983,11 +2626,52 @@ void updateViewsFoldState(const CompareList_t::iterator& cmpPair)
 		CallScintilla(MAIN_VIEW, SCI_FOLDALL, SC_FOLDACTION_EXPAND, 0);
 		CallScintilla(SUB_VIEW, SCI_FOLDALL, SC_FOLDACTION_EXPAND, 0);
 	}
+
+	cmpPair->foldFromLine[MAIN_VIEW]	= 0;
+	cmpPair->foldFromLine[SUB_VIEW]		= 0;
+}
+
+
+// The lines above the lazily aligned range are left unaligned - their accumulated visible lines mismatch is put in
+// a single blank section on the top line of the view that has less visible lines to keep the views in sync by visible
+// line in the range. If the top line is not above the first range point the point itself absorbs the mismatch.
+void compensateAboveLazyAlignment(const AlignmentPair& first)
+{
+	const intptr_t mainLine	= getPreviousUnhiddenLine(MAIN_VIEW, first.main.line);
+	const intptr_t subLine	= getPreviousUnhiddenLine(SUB_VIEW, first.sub.line);
+
+	const intptr_t mainTop	= getUnhiddenLine(MAIN_VIEW, 0);
+	const intptr_t subTop	= getUnhiddenLine(SUB_VIEW, 0);
+
+	if (isLineAnnotated(MAIN_VIEW, mainLine))
+		clearAnnotation(MAIN_VIEW, mainLine);
+
+	if (isLineAnnotated(SUB_VIEW, subLine))
+		clearAnnotation(SUB_VIEW, subLine);
+
+	if (mainTop < mainLine && isLineAnnotated(MAIN_VIEW, mainTop))
+		clearAnnotation(MAIN_VIEW, mainTop);
+
+	if (subTop < subLine && isLineAnnotated(SUB_VIEW, subTop))
+		clearAnnotation(SUB_VIEW, subTop);
+
+	const intptr_t mismatchLen =
+			CallScintilla(MAIN_VIEW, SCI_VISIBLEFROMDOCLINE, first.main.line, 0) -
+			CallScintilla(SUB_VIEW, SCI_VISIBLEFROMDOCLINE, first.sub.line, 0);
+
+	if (mismatchLen > 0 && subTop < subLine)
+		addBlankSectionAfter(SUB_VIEW, subTop, mismatchLen);
+	else if (mismatchLen < 0 && mainTop < mainLine)
+		addBlankSectionAfter(MAIN_VIEW, mainTop, -mismatchLen);
 }
 
 
 void alignDiffs(const CompareList_t::iterator& cmpPair)
 {
+	TraceScope trace("AlignDiffs", static_cast<int64_t>(cmpPair->summary.alignmentInfo.size()));
+
+	viewsSync.invalidate();
+
 	updateViewsFoldState(cmpPair);
 
 	const AlignmentInfo_t& alignmentInfo = cmpPair->summary.alignmentInfo;
@@ -2008,12 +2692,68 @@ void alignDiffs(const CompareList_t::iterator& cmpPair)
 		subEndLine	= cmpPair->options.selections[SUB_VIEW].second;
 	}
 
+	intptr_t lazyFirst	= 0;
+	intptr_t lazyEnd	= maxSize;
+
+	// Huge diffs - align only the alignment points around the viewport. The mismatch accumulated above the range is
+	// compensated at the top of the views. The range is moved on scroll as isAlignmentNeeded() detects that the
+	// viewport approaches its edges - the blank sections of the previous range are cleared then.
+	if (!cmpPair->options.selectionCompare && (maxSize > LAZY_ALIGNMENT_MIN_POINTS))
+	{
+		const int view = getCurrentViewId();
+
+		const AlignmentViewData AlignmentPair::*pView = (view == MAIN_VIEW) ? &AlignmentPair::main : &AlignmentPair::sub;
+
+		const intptr_t margin = CallScintilla(view, SCI_LINESONSCREEN, 0, 0) * LAZY_ALIGNMENT_MARGIN_SCREENS;
+
+		lazyFirst	= getAlignmentIdxAfter(pView, alignmentInfo, getFirstLine(view) - margin);
+		lazyEnd		= getAlignmentIdxAfter(pView, alignmentInfo, getLastLine(view) + margin) + 1;
+
+		if (lazyFirst)
+			--lazyFirst;
+
+		if (lazyEnd > maxSize)
+			lazyEnd = maxSize;
+
+		// Zero line diffs need the full handling below
+		if (lazyFirst < maxSize && (alignmentInfo[lazyFirst].main.line == 0 || alignmentInfo[lazyFirst].sub.line == 0))
+			lazyFirst = 0;
+
+		// The range has moved or the views have been fully aligned - the blank sections outside it are stale (clearing
+		// them one by one would cost as much as the full alignment)
+		if (cmpPair->lazyAlignment != std::make_pair(lazyFirst, lazyEnd))
+		{
+			CallScintilla(MAIN_VIEW, SCI_ANNOTATIONCLEARALL, 0, 0);
+			CallScintilla(SUB_VIEW, SCI_ANNOTATIONCLEARALL, 0, 0);
+		}
+
+		cmpPair->lazyAlignment = std::make_pair(lazyFirst, lazyEnd);
+
+		if (lazyFirst > 0 && lazyFirst < maxSize)
+			compensateAboveLazyAlignment(alignmentInfo[lazyFirst]);
+
+		LOGD(LOG_NOTIF, "Lazy alignment of points " + std::to_string(lazyFirst) + " - " + std::to_string(lazyEnd) +
+				" of " + std::to_string(maxSize) + "\n");
+	}
+	else
+	{
+		// Switching from lazy to full alignment - the top compensation and the blank sections of the lazy range
+		if (cmpPair->lazyAlignment.second >= 0)
+		{
+			CallScintilla(MAIN_VIEW, SCI_ANNOTATIONCLEARALL, 0, 0);
+			CallScintilla(SUB_VIEW, SCI_ANNOTATIONCLEARALL, 0, 0);
+		}
+
+		cmpPair->lazyAlignment = std::make_pair(0, -1);
+	}
+
 	bool skipFirst = false;
 
-	intptr_t i = 0;
+	intptr_t i = lazyFirst;
 
 	// Handle zero line diffs that cannot be aligned because annotation on line 0 is not supported by Scintilla
-	for (; i < maxSize && alignmentInfo[i].main.line <= mainEndLine && alignmentInfo[i].sub.line <= subEndLine; ++i)
+	for (; lazyFirst == 0 &&
+			i < maxSize && alignmentInfo[i].main.line <= mainEndLine && alignmentInfo[i].sub.line <= subEndLine; ++i)
 	{
 		intptr_t previousUnhiddenLine = getPreviousUnhiddenLine(MAIN_VIEW, alignmentInfo[i].main.line);
 
@@ -2088,7 +2828,7 @@ void alignDiffs(const CompareList_t::iterator& cmpPair)
 	}
 
 	// Align all other diffs
-	for (; i < maxSize && alignmentInfo[i].main.line <= mainEndLine && alignmentInfo[i].sub.line <= subEndLine; ++i)
+	for (; i < lazyEnd && alignmentInfo[i].main.line <= mainEndLine && alignmentInfo[i].sub.line <= subEndLine; ++i)
 	{
 		intptr_t previousUnhiddenLine = getPreviousUnhiddenLine(MAIN_VIEW, alignmentInfo[i].main.line);
 
@@ -2120,6 +2860,10 @@ void alignDiffs(const CompareList_t::iterator& cmpPair)
 		}
 	}
 
+	// End of file is out of the lazily aligned range (selection compare is never aligned lazily)
+	if (lazyEnd < maxSize)
+		return;
+
 	if (Settings.ShowOnlyDiffs)
 	{
 		mainEndLine	= CallScintilla(MAIN_VIEW, SCI_MARKERPREVIOUS, mainEndLine, MARKER_MASK_LINE);
@@ -2216,6 +2960,17 @@ void alignDiffs(const CompareList_t::iterator& cmpPair)
 }
 
 
+const DiffMap_t* getNavDiffMap(int view)
+{
+	CompareList_t::iterator cmpPair = getCompare(getCurrentBuffId());
+
+	if ((cmpPair == compareList.end()) || cmpPair->compareDirty)
+		return nullptr;
+
+	return &cmpPair->summary.diffMap[view];
+}
+
+
 void showNavBar()
 {
 	if (!NavDlg.SetColors(Settings.colors()))
@@ -2305,15 +3060,104 @@ bool setFirst(bool currFileIsNew, bool markName = false)
 }
 
 
-void setContent(const char* content)
+/**
+ *  \class  ContentLoader
+ *  \brief  Fills the current view (temp) document in chunks - the whole content is allocated once and the source is
+ *          never copied whole in between, no matter how big it is
+ */
+class ContentLoader
 {
-	const int view = getCurrentViewId();
+public:
+	// Chunks are that big at most
+	static constexpr size_t cChunkSize = 1024 * 1024;
+
+	ContentLoader(size_t expectedLen) : _view(getCurrentViewId()), _undoBlock(_view), _writeEn(_view)
+	{
+		CallScintilla(_view, SCI_CLEARALL, 0, 0);
+		CallScintilla(_view, SCI_ALLOCATE, (WPARAM)expectedLen + 1, 0);
+	}
+
+	~ContentLoader()
+	{
+		CallScintilla(_view, SCI_SETSAVEPOINT, 0, 0);
+	}
 
-	ScopedViewUndoCollectionBlocker undoBlock(view);
-	ScopedViewWriteEnabler writeEn(view);
+	// The text might contain zeroes
+	void add(const char* text, size_t len)
+	{
+		for (size_t chunkLen; len; text += chunkLen, len -= chunkLen)
+		{
+			chunkLen = std::min(len, cChunkSize);
 
-	CallScintilla(view, SCI_SETTEXT, 0, (LPARAM)content);
-	CallScintilla(view, SCI_SETSAVEPOINT, 0, 0);
+			CallScintilla(_view, SCI_APPENDTEXT, (WPARAM)chunkLen, (LPARAM)text);
+		}
+	}
+
+	// Converts the text to UTF-8 chunk by chunk
+	void add(const wchar_t* wText, size_t wLen)
+	{
+		std::vector<char> chunk;
+
+		while (wLen)
+		{
+			size_t wChunkLen = std::min(wLen, cChunkSize / 4);
+
+			// Do not split surrogate pairs
+			if (wChunkLen < wLen && IS_HIGH_SURROGATE(wText[wChunkLen - 1]))
+				--wChunkLen;
+
+			const int len = ::WideCharToMultiByte(CP_UTF8, 0, wText, static_cast<int>(wChunkLen), NULL, 0, NULL, NULL);
+
+			chunk.resize(len);
+
+			::WideCharToMultiByte(CP_UTF8, 0, wText, static_cast<int>(wChunkLen), chunk.data(), len, NULL, NULL);
+
+			add(chunk.data(), chunk.size());
+
+			wText	+= wChunkLen;
+			wLen	-= wChunkLen;
+		}
+	}
+
+	// Streams the file content from its current position - returns false on read error
+	bool addFile(HANDLE hFile, size_t skipBytes = 0)
+	{
+		std::vector<char> chunk(cChunkSize);
+
+		DWORD readLen = 0;
+		bool success;
+
+		do
+		{
+			success = (::ReadFile(hFile, chunk.data(), static_cast<DWORD>(chunk.size()), &readLen, NULL) != FALSE);
+
+			if (success)
+			{
+				const size_t skipLen = std::min(static_cast<size_t>(readLen), skipBytes);
+
+				add(chunk.data() + skipLen, readLen - skipLen);
+
+				skipBytes -= skipLen;
+			}
+		}
+		while (success && readLen);
+
+		return success;
+	}
+
+private:
+	const int							_view;
+	ScopedViewUndoCollectionBlocker		_undoBlock;
+	ScopedViewWriteEnabler				_writeEn;
+};
+
+
+// Sets the text directly from the content buffer - the text might contain zeroes
+void setContent(const char* content, size_t len)
+{
+	ContentLoader loader(len);
+
+	loader.add(content, len);
 }
 
 
@@ -2534,63 +3378,247 @@ CompareList_t::iterator addComparePair()
 }
 
 
-CompareResult runCompare(CompareList_t::iterator cmpPair)
+// Line hashes of big saved files are kept in index files so they are not hashed again on the next session compare
+bool useLineHashIndex(const ComparedFile& cmpFile, int view)
 {
-	setStyles(Settings);
+	if (Settings.HashIndexMinSizeMB <= 0 || cmpFile.isTemp || cmpFile.isNew || CallScintilla(view, SCI_GETMODIFY, 0, 0))
+		return false;
 
-	const TCHAR* newName = ::PathFindFileName(cmpPair->getNewFile().name);
-	const TCHAR* oldName = ::PathFindFileName(cmpPair->getOldFile().name);
+	return (static_cast<int64_t>(CallScintilla(view, SCI_GETLENGTH, 0, 0)) >=
+			static_cast<int64_t>(Settings.HashIndexMinSizeMB) * 1024 * 1024);
+}
 
-	TCHAR progressInfo[MAX_PATH];
-	_sntprintf_s(progressInfo, _countof(progressInfo), _TRUNCATE, cmpPair->options.selectionCompare ?
-			TEXT("Comparing selected lines in \"%s\" vs. selected lines in \"%s\"...") :
-			TEXT("Comparing \"%s\" vs. \"%s\"..."), newName, oldName);
 
-	return compareViews(cmpPair->options, progressInfo, cmpPair->summary);
+bool getLineHashIndexDir(std::wstring& indexDir)
+{
+	TCHAR configDir[MAX_PATH];
+
+	::SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, (WPARAM)_countof(configDir), (LPARAM)configDir);
+
+	indexDir = configDir;
+	indexDir += TEXT("\\ComparePlus");
+
+	::CreateDirectory(indexDir.c_str(), NULL);
+
+	indexDir += TEXT("\\LineHashes");
+
+	return (::CreateDirectory(indexDir.c_str(), NULL) || ::GetLastError() == ERROR_ALREADY_EXISTS);
 }
 
 
-void compare(bool selectionCompare = false, bool findUniqueMode = false, bool autoUpdating = false)
+bool loadLineHashes(ComparedFile& cmpFile, int view, const CompareOptions& options)
 {
-	delayedUpdate.cancel();
+	if (!cmpFile.lineHashes.hashes.empty() || !useLineHashIndex(cmpFile, view))
+		return false;
 
-	ScopedIncrementerInt incr(notificationsLock);
+	std::wstring indexDir;
 
-	// Just to be sure any old state is cleared
-	storedLocation = nullptr;
-	goToFirst = false;
-	justCompared = false;
-	copiedSectionMarks.clear();
+	if (!getLineHashIndexDir(indexDir))
+		return false;
 
-	temporaryRangeSelect(-1);
-	setArrowMark(-1);
+	LineHashIndexData data;
 
-	const bool				doubleView		= !isSingleView();
-	const LRESULT			currentBuffId	= getCurrentBuffId();
-	CompareList_t::iterator	cmpPair			= getCompare(currentBuffId);
-	const bool				recompare		= (cmpPair != compareList.end());
+	if (!loadLineHashIndex(indexDir.c_str(), cmpFile.name, options, getCodepage(view), data))
+		return false;
 
-	bool recompareSameSelections = false;
+	const intptr_t linesCount = CallScintilla(view, SCI_GETLINECOUNT, 0, 0);
 
-	if (recompare)
+	if ((data.length != CallScintilla(view, SCI_GETLENGTH, 0, 0)) ||
+		(static_cast<intptr_t>(data.hashes.size()) != linesCount) ||
+		(static_cast<intptr_t>(data.lineStarts.size()) !=
+			(linesCount + cLineHashIndexStartsStep - 1) / cLineHashIndexStartsStep))
+		return false;
+
+	// The file on disk is the same as the last time - the sampled line starts make sure the document lines are too
+	for (size_t i = 0; i < data.lineStarts.size(); ++i)
 	{
-		newCompare = nullptr;
+		if (getLineStart(view, static_cast<intptr_t>(i) * cLineHashIndexStartsStep) != data.lineStarts[i])
+			return false;
+	}
 
-		cmpPair->autoUpdateDelay = 0;
+	LineHashCache& cache = cmpFile.lineHashes;
 
-		if (!autoUpdating && selectionCompare)
-		{
-			bool checkSelections = false;
+	cache.ignoreChangedSpaces	= options.ignoreChangedSpaces;
+	cache.ignoreAllSpaces		= options.ignoreAllSpaces;
+	cache.ignoreCase			= options.ignoreCase;
+	cache.ignoreRegexStr		= options.ignoreRegexStr;
+	cache.codepage				= data.codepage;
+	cache.length				= data.length;
+	cache.hashes				= std::move(data.hashes);
 
-			// New selections to compare - validate them
-			if (isSelection(MAIN_VIEW) && isSelection(SUB_VIEW))
-			{
-				checkSelections = true;
-			}
-			else if (isSelection(MAIN_VIEW) && (cmpPair->options.selections[SUB_VIEW].first != -1))
-			{
-				std::pair<intptr_t, intptr_t> newSelection = getSelectionLines(MAIN_VIEW);
-				checkSelections = (newSelection.first == -1);
+	return true;
+}
+
+
+void saveLineHashes(const ComparedFile& cmpFile, int view, const CompareOptions& options)
+{
+	const LineHashCache& cache = cmpFile.lineHashes;
+
+	// Only fully hashed documents are indexed
+	if (cache.hashes.empty() || std::find(cache.hashes.begin(), cache.hashes.end(), 0) != cache.hashes.end() ||
+			!useLineHashIndex(cmpFile, view))
+		return;
+
+	std::wstring indexDir;
+
+	if (!getLineHashIndexDir(indexDir))
+		return;
+
+	const intptr_t linesCount = static_cast<intptr_t>(cache.hashes.size());
+
+	std::vector<intptr_t> lineStarts;
+	lineStarts.reserve((linesCount + cLineHashIndexStartsStep - 1) / cLineHashIndexStartsStep);
+
+	for (intptr_t line = 0; line < linesCount; line += cLineHashIndexStartsStep)
+		lineStarts.push_back(getLineStart(view, line));
+
+	saveLineHashIndex(indexDir.c_str(), cmpFile.name, options, cache.codepage, cache.length, cache.hashes, lineStarts);
+}
+
+
+// The commands starting or clearing compares are refused while a compare runs in the background
+bool refuseWhileComparing()
+{
+	if (!runningCompare.isRunning())
+		return false;
+
+	::MessageBeep(MB_ICONWARNING);
+
+	return true;
+}
+
+
+CompareResult runCompare(CompareList_t::iterator cmpPair)
+{
+	setStyles(Settings);
+
+	const TCHAR* newName = ::PathFindFileName(cmpPair->getNewFile().name);
+	const TCHAR* oldName = ::PathFindFileName(cmpPair->getOldFile().name);
+
+	TCHAR progressInfo[MAX_PATH];
+	_sntprintf_s(progressInfo, _countof(progressInfo), _TRUNCATE, cmpPair->options.selectionCompare ?
+			TEXT("Comparing selected lines in \"%s\" vs. selected lines in \"%s\"...") :
+			TEXT("Comparing \"%s\" vs. \"%s\"..."), newName, oldName);
+
+	// Background re-compare results of this pair (if ready) are applied by stop() and will be found in the cache
+	backgroundRecompare.stop();
+
+	ComparedFile& mainFile	= cmpPair->getFileByViewId(MAIN_VIEW);
+	ComparedFile& subFile	= cmpPair->getFileByViewId(SUB_VIEW);
+
+	// Hashes not cached before the compare are new and worth indexing if the files are big enough
+	const bool indexMain	= mainFile.lineHashes.hashes.empty() && !loadLineHashes(mainFile, MAIN_VIEW, cmpPair->options);
+	const bool indexSub		= subFile.lineHashes.hashes.empty() && !loadLineHashes(subFile, SUB_VIEW, cmpPair->options);
+
+	runningCompare.start(*cmpPair);
+
+	const CompareResult result = compareViews(cmpPair->options, progressInfo, cmpPair->summary,
+			Settings.RecompareOnChange ? &cmpPair->incremental : nullptr, &mainFile.lineHashes, &subFile.lineHashes);
+
+	runningCompare.end();
+
+	if (runningCompare.change() == RunningCompare::NPP_CLOSED)
+		return result;
+
+	cmpPair->markedEditsCount	= cmpPair->editsCount;
+	cmpPair->currentDiff		= -1;
+
+	// Only the hidden lines below the kept marks (and their context) need to be updated
+	for (int view: { MAIN_VIEW, SUB_VIEW })
+		cmpPair->foldFromLine[view] =
+				std::max<intptr_t>(0, cmpPair->summary.keptMarksEnd[view] - Settings.ShowOnlyDiffsContext);
+
+	if (result != CompareResult::COMPARE_ERROR && runningCompare.change() == RunningCompare::NONE)
+	{
+		if (indexMain)
+			saveLineHashes(mainFile, MAIN_VIEW, cmpPair->options);
+
+		if (indexSub)
+			saveLineHashes(subFile, SUB_VIEW, cmpPair->options);
+	}
+
+	backgroundRecompare.schedule();
+
+	return result;
+}
+
+
+// The compare options of the current settings
+void getCompareOptions(CompareOptions& options, bool selectionCompare = false, bool findUniqueMode = false)
+{
+	options.newFileViewId				= Settings.NewFileViewId;
+
+	options.findUniqueMode				= findUniqueMode;
+	options.alignAllMatches				= Settings.AlignAllMatches;
+	options.neverMarkIgnored			= Settings.NeverMarkIgnored;
+	options.histogramDiff				= Settings.HistogramDiff;
+	options.verifyLineMatches			= Settings.VerifyLineMatches;
+	options.backgroundCompare			= Settings.BackgroundCompare;
+	options.detectMoves					= Settings.DetectMoves;
+	options.detectCharDiffs				= Settings.DetectCharDiffs;
+	options.bestSeqChangedLines			= Settings.BestSeqChangedLines;
+	options.ignoreEmptyLines			= Settings.IgnoreEmptyLines;
+	options.ignoreChangedSpaces			= Settings.IgnoreChangedSpaces;
+	options.ignoreAllSpaces				= Settings.IgnoreAllSpaces;
+	options.ignoreCase					= Settings.IgnoreCase;
+
+	if (Settings.IgnoreRegex)
+		options.setIgnoreRegex(Settings.IgnoreRegexStr);
+	else
+		options.clearIgnoreRegex();
+
+	options.changedThresholdPercent		= Settings.ChangedThresholdPercent;
+	options.diffCostLimit				= Settings.DiffCostLimit;
+	options.bandedMatchLines			= Settings.BandedMatchLines;
+	options.memoryBudgetMB				= Settings.MemoryBudgetMB;
+	options.selectionCompare			= selectionCompare;
+}
+
+
+void compare(bool selectionCompare = false, bool findUniqueMode = false, bool autoUpdating = false)
+{
+	if (refuseWhileComparing())
+		return;
+
+	delayedUpdate.cancel();
+
+	ScopedIncrementerInt incr(notificationsLock);
+
+	// Just to be sure any old state is cleared
+	storedLocation = nullptr;
+	goToFirst = false;
+	justCompared = false;
+	copiedSectionMarks.clear();
+
+	temporaryRangeSelect(-1);
+	setArrowMark(-1);
+
+	const bool				doubleView		= !isSingleView();
+	const LRESULT			currentBuffId	= getCurrentBuffId();
+	CompareList_t::iterator	cmpPair			= getCompare(currentBuffId);
+	const bool				recompare		= (cmpPair != compareList.end());
+
+	bool recompareSameSelections = false;
+
+	if (recompare)
+	{
+		newCompare = nullptr;
+
+		cmpPair->autoUpdateDelay = 0;
+
+		if (!autoUpdating && selectionCompare)
+		{
+			bool checkSelections = false;
+
+			// New selections to compare - validate them
+			if (isSelection(MAIN_VIEW) && isSelection(SUB_VIEW))
+			{
+				checkSelections = true;
+			}
+			else if (isSelection(MAIN_VIEW) && (cmpPair->options.selections[SUB_VIEW].first != -1))
+			{
+				std::pair<intptr_t, intptr_t> newSelection = getSelectionLines(MAIN_VIEW);
+				checkSelections = (newSelection.first == -1);
 
 				if (!checkSelections)
 					cmpPair->options.selections[MAIN_VIEW] = newSelection;
@@ -2671,26 +3699,7 @@ void compare(bool selectionCompare = false, bool findUniqueMode = false, bool au
 	// Compare is triggered manually - get/re-get compare settings and position/reposition files
 	if (!autoUpdating)
 	{
-		cmpPair->options.newFileViewId				= Settings.NewFileViewId;
-
-		cmpPair->options.findUniqueMode				= findUniqueMode;
-		cmpPair->options.alignAllMatches			= Settings.AlignAllMatches;
-		cmpPair->options.neverMarkIgnored			= Settings.NeverMarkIgnored;
-		cmpPair->options.detectMoves				= Settings.DetectMoves;
-		cmpPair->options.detectCharDiffs			= Settings.DetectCharDiffs;
-		cmpPair->options.bestSeqChangedLines		= Settings.BestSeqChangedLines;
-		cmpPair->options.ignoreEmptyLines			= Settings.IgnoreEmptyLines;
-		cmpPair->options.ignoreChangedSpaces		= Settings.IgnoreChangedSpaces;
-		cmpPair->options.ignoreAllSpaces			= Settings.IgnoreAllSpaces;
-		cmpPair->options.ignoreCase					= Settings.IgnoreCase;
-
-		if (Settings.IgnoreRegex)
-			cmpPair->options.setIgnoreRegex(Settings.IgnoreRegexStr);
-		else
-			cmpPair->options.clearIgnoreRegex();
-
-		cmpPair->options.changedThresholdPercent	= Settings.ChangedThresholdPercent;
-		cmpPair->options.selectionCompare			= selectionCompare;
+		getCompareOptions(cmpPair->options, selectionCompare, findUniqueMode);
 
 		cmpPair->positionFiles();
 
@@ -2746,9 +3755,49 @@ void compare(bool selectionCompare = false, bool findUniqueMode = false, bool au
 
 	selectionAutoRecompare = autoUpdating && cmpPair->options.selectionCompare;
 
-	time_t startTime = time(0);
+	// Only auto re-compare can reuse the last compare results - the compare options are the same
+	if (!autoUpdating || !Settings.RecompareOnChange)
+		cmpPair->incremental.clear();
+
+	const bool	incrementalRun	= (cmpPair->incremental.state != nullptr);
+	const DWORD	startTick		= ::GetTickCount();
+
+	CompareResult cmpResult = runCompare(cmpPair);
+
+	// The documents have been edited while compared in the background - the results are dropped, compare them
+	// again (only a few times as the user might be typing still)
+	for (int redo = 0; (redo < RunningCompare::cMaxRedos) &&
+			(runningCompare.change() == RunningCompare::DOCS_EDITED); ++redo)
+	{
+		// The edits have not been tracked meanwhile
+		cmpPair->incremental.clear();
+		cmpPair->file[0].lineHashes.clear();
+		cmpPair->file[1].lineHashes.clear();
+
+		cmpResult = runCompare(cmpPair);
+	}
+
+	switch (runningCompare.change())
+	{
+		case RunningCompare::NONE:
+		break;
+
+		// The delayed closure clears the pair of the closed file, there is nothing to restore if Notepad++ is closed
+		case RunningCompare::FILE_CLOSED:
+		case RunningCompare::NPP_CLOSED:
+			storedLocation = nullptr;
+		return;
 
-	const CompareResult cmpResult = runCompare(cmpPair);
+		default:
+			cmpPair->file[0].lineHashes.clear();
+			cmpPair->file[1].lineHashes.clear();
+
+			clearComparePair(cmpPair->getNewFile().buffId);
+			storedLocation = nullptr;
+		return;
+	}
+
+	cmpPair->recompareScheduler.onCompared(::GetTickCount() - startTick, incrementalRun);
 
 	cmpPair->compareDirty		= false;
 	cmpPair->manuallyChanged	= false;
@@ -2757,8 +3806,8 @@ void compare(bool selectionCompare = false, bool findUniqueMode = false, bool au
 	{
 		case CompareResult::COMPARE_MISMATCH:
 		{
-			// Honour 'Auto Re-compare On Change' user setting only if compare time is less than 5 sec.
-			cmpPair->options.recompareOnChange = Settings.RecompareOnChange && (difftime(time(0), startTime) < 5.0);
+			// Slow re-compares are deferred by the pair's recompare scheduler until the user is idle
+			cmpPair->options.recompareOnChange = Settings.RecompareOnChange;
 
 			justCompared = true;
 
@@ -2829,6 +3878,11 @@ void compare(bool selectionCompare = false, bool findUniqueMode = false, bool au
 								TEXT("%s \"%s\" has no changes against clipboard."),
 								selectionCompare ? TEXT("Selection in file") : TEXT("File"), newName);
 					}
+					else if (oldFile.isTemp == BINARY_TEMP)
+					{
+						_sntprintf_s(msg, _countof(msg), _TRUNCATE,
+								TEXT("Hex dumps \"%s\" and \"%s\" match."), newName, ::PathFindFileName(oldFile.name));
+					}
 					else
 					{
 						_sntprintf_s(msg, _countof(msg), _TRUNCATE,
@@ -2877,49 +3931,59 @@ void compare(bool selectionCompare = false, bool findUniqueMode = false, bool au
 }
 
 
-std::vector<char> getClipboard(bool addLeadingNewLine = false)
+/**
+ *  \class  ClipboardText
+ *  \brief  Keeps the clipboard open and its Unicode text locked for reading while the object lives
+ */
+class ClipboardText
 {
-	std::vector<char> content;
-
-	if (!::OpenClipboard(NULL))
-		return content;
+public:
+	ClipboardText()
+	{
+		_isOpen = (::OpenClipboard(NULL) != FALSE);
 
-	HANDLE hData = ::GetClipboardData(CF_UNICODETEXT);
+		if (!_isOpen)
+			return;
 
-	if (hData != NULL)
-	{
-		wchar_t* pText = static_cast<wchar_t*>(::GlobalLock(hData));
+		_hData = ::GetClipboardData(CF_UNICODETEXT);
 
-		if (pText != NULL)
+		if (_hData != NULL)
 		{
-			const size_t wLen	= wcslen(pText) + 1;
-			const size_t len	=
-					::WideCharToMultiByte(CP_UTF8, 0, pText, static_cast<int>(wLen), NULL, 0, NULL, NULL);
+			_text = static_cast<const wchar_t*>(::GlobalLock(_hData));
 
-			if (addLeadingNewLine)
-			{
-				content.resize(len + 1);
-				content[0] = '\n'; // Needed for selections alignment after comparing
+			if (_text != NULL)
+				_len = wcslen(_text);
+		}
+	}
 
-				::WideCharToMultiByte(CP_UTF8, 0, pText, static_cast<int>(wLen), content.data() + 1,
-						static_cast<int>(len), NULL, NULL);
-			}
-			else
-			{
-				content.resize(len);
+	~ClipboardText()
+	{
+		if (_text != NULL)
+			::GlobalUnlock(_hData);
 
-				::WideCharToMultiByte(CP_UTF8, 0, pText, static_cast<int>(wLen), content.data(),
-						static_cast<int>(len), NULL, NULL);
-			}
-		}
+		if (_isOpen)
+			::CloseClipboard();
+	}
+
+	ClipboardText(const ClipboardText&) = delete;
+	ClipboardText& operator=(const ClipboardText&) = delete;
 
-		::GlobalUnlock(hData);
+	inline const wchar_t* text() const
+	{
+		return _text;
 	}
 
-	::CloseClipboard();
+	inline size_t length() const
+	{
+		return _len;
+	}
 
-	return content;
-}
+private:
+	bool			_isOpen {false};
+	HANDLE			_hData {NULL};
+	const wchar_t*	_text {NULL};
+	size_t			_len {0};
+};
 
 
 void SetAsFirst()
@@ -2955,6 +4019,9 @@ void FindSelectionsUnique()
 
 void ClearActiveCompare()
 {
+	if (refuseWhileComparing())
+		return;
+
 	newCompare = nullptr;
 
 	if (NppSettings::get().compareMode)
@@ -2964,6 +4031,9 @@ void ClearActiveCompare()
 
 void ClearAllCompares()
 {
+	if (refuseWhileComparing())
+		return;
+
 	newCompare = nullptr;
 
 	if (!compareList.size())
@@ -2993,6 +4063,9 @@ void ClearAllCompares()
 
 void LastSaveDiff()
 {
+	if (refuseWhileComparing())
+		return;
+
 	TCHAR file[MAX_PATH];
 
 	::SendMessage(nppData._nppHandle, NPPM_GETFULLCURRENTPATH, _countof(file), (LPARAM)file);
@@ -3000,13 +4073,57 @@ void LastSaveDiff()
 	if (!checkFileExists(file))
 		return;
 
-	if (createTempFile(file, LAST_SAVED_TEMP))
+	const int encoding = getEncoding(getCurrentBuffId());
+
+	// Notepad++ converts UTF-16 files on load so they are copied and re-opened, the rest is streamed as is
+	if (encoding == uni16BE || encoding == uni16LE || encoding == uni16BE_NoBOM || encoding == uni16LE_NoBOM)
+	{
+		if (createTempFile(file, LAST_SAVED_TEMP))
+			compare();
+
+		return;
+	}
+
+	HANDLE hFile = ::CreateFile(file, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		::MessageBox(nppData._nppHandle, TEXT("Cannot read the saved file - operation aborted."), PLUGIN_NAME, MB_OK);
+		return;
+	}
+
+	LARGE_INTEGER fileSize;
+
+	if (!::GetFileSizeEx(hFile, &fileSize))
+		fileSize.QuadPart = 0;
+
+	bool isLoaded = false;
+
+	if (createTempFile(nullptr, LAST_SAVED_TEMP))
+	{
+		ContentLoader loader(static_cast<size_t>(fileSize.QuadPart));
+
+		// Skip the BOM - it is not part of the document text
+		isLoaded = loader.addFile(hFile, (encoding == uniUTF8) ? 3 : 0);
+
+		if (!isLoaded)
+			::MessageBox(nppData._nppHandle, TEXT("Cannot read the saved file - operation aborted."), PLUGIN_NAME,
+					MB_OK);
+	}
+
+	::CloseHandle(hFile);
+
+	if (isLoaded)
 		compare();
 }
 
 
 void ClipboardDiff()
 {
+	if (refuseWhileComparing())
+		return;
+
 	const int view = getCurrentViewId();
 
 	if (CallScintilla(view, SCI_GETLENGTH, 0, 0) == 0)
@@ -3026,19 +4143,27 @@ void ClipboardDiff()
 
 	const bool isSel = isSelection(view);
 
-	std::vector<char> content = getClipboard(isSel);
-
-	if (content.empty())
 	{
-		::MessageBox(nppData._nppHandle, TEXT("Clipboard does not contain any text to compare."), PLUGIN_NAME, MB_OK);
-		return;
-	}
+		ClipboardText clipboard;
 
-	if (!createTempFile(nullptr, CLIPBOARD_TEMP))
-		return;
+		if (clipboard.length() == 0)
+		{
+			::MessageBox(nppData._nppHandle, TEXT("Clipboard does not contain any text to compare."), PLUGIN_NAME,
+					MB_OK);
+			return;
+		}
+
+		if (!createTempFile(nullptr, CLIPBOARD_TEMP))
+			return;
 
-	setContent(content.data());
-	content.clear();
+		ContentLoader loader(clipboard.length() + 1);
+
+		// Needed for selections alignment after comparing
+		if (isSel)
+			loader.add("\n", 1);
+
+		loader.add(clipboard.text(), clipboard.length());
+	}
 
 	compare(isSel);
 }
@@ -3046,41 +4171,428 @@ void ClipboardDiff()
 
 void SvnDiff()
 {
+	if (refuseWhileComparing())
+		return;
+
 	TCHAR file[MAX_PATH];
-	TCHAR svnFile[MAX_PATH];
 
 	::SendMessage(nppData._nppHandle, NPPM_GETFULLCURRENTPATH, _countof(file), (LPARAM)file);
 
 	if (!checkFileExists(file))
 		return;
 
-	if (!GetSvnFile(file, svnFile, _countof(svnFile)))
+	std::future<std::vector<char>> svnContent;
+
+	if (!GetSvnFileContent(file, svnContent))
+		return;
+
+	// The SVN base is read meanwhile
+	if (!createTempFile(nullptr, SVN_TEMP))
 		return;
 
-	if (createTempFile(svnFile, SVN_TEMP))
-		compare();
+	{
+		const std::vector<char> content = svnContent.get();
+
+		setContent(content.data(), content.size());
+	}
+
+	compare();
+}
+
+
+void GitDiff()
+{
+	if (refuseWhileComparing())
+		return;
+
+	TCHAR file[MAX_PATH];
+
+	::SendMessage(nppData._nppHandle, NPPM_GETFULLCURRENTPATH, _countof(file), (LPARAM)file);
+
+	if (!checkFileExists(file))
+		return;
+
+	std::shared_ptr<const GitFileContent> content = GetGitFileContent(file);
+
+	if (!content)
+		return;
+
+	if (!createTempFile(nullptr, GIT_TEMP))
+		return;
+
+	setContent(content->data(), content->size());
+	content = nullptr;
+
+	compare();
+}
+
+
+// Binary compare shows that many bytes of the differing ranges at most
+constexpr uint64_t cMaxHexDumpBytes = 4 * 1024 * 1024;
+
+
+// Writes the hex dump to a new temp file named after filePath and opens it read-only in the current view
+bool openHexDump(const std::wstring& filePath, const std::string& dump)
+{
+	TCHAR tempFile[MAX_PATH];
+
+	if (!::GetTempPath(_countof(tempFile), tempFile))
+		return false;
+
+	std::wstring tempBase(tempFile);
+
+	if (!tempBase.empty() && tempBase.back() != L'\\')
+		tempBase += L'\\';
+
+	{
+		std::wstring fileName(::PathFindFileName(filePath.c_str()));
+
+		const size_t extPos = fileName.rfind(L'.');
+
+		tempBase += fileName.substr(0, extPos) + tempMark[BINARY_TEMP].fileMark;
+	}
+
+	const TCHAR* fileExt = ::PathFindExtension(filePath.c_str());
+
+	std::wstring tempPath;
+
+	// Make sure temp file is unique
+	for (int i = 1; ; ++i)
+	{
+		tempPath = tempBase + std::to_wstring(i) + fileExt;
+
+		if (tempPath.size() >= MAX_PATH)
+			return false;
+
+		if (!::PathFileExists(tempPath.c_str()))
+			break;
+	}
+
+	HANDLE hFile = ::CreateFile(tempPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY,
+			NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD written = 0;
+
+	const BOOL success = ::WriteFile(hFile, dump.data(), static_cast<DWORD>(dump.size()), &written, NULL) &&
+			(written == dump.size());
+
+	::CloseHandle(hFile);
+
+	if (success && ::SendMessage(nppData._nppHandle, NPPM_DOOPEN, 0, (LPARAM)tempPath.c_str()))
+	{
+		::SendMessage(nppData._nppHandle, NPPM_SETBUFFERLANGTYPE, getCurrentBuffId(), L_TEXT);
+		::SendMessage(nppData._nppHandle, NPPM_MENUCOMMAND, 0, IDM_EDIT_SETREADONLY);
+
+		return true;
+	}
+
+	::DeleteFile(tempPath.c_str());
+
+	return false;
+}
+
+
+// Compares the saved files as binary data - the hex dumps of their differing ranges are opened as temp files and
+// compared as any other files
+void binaryCompare(const std::wstring& oldFile, const std::wstring& newFile)
+{
+	std::vector<BinaryDiffRange> diffs;
+
+	bool compared = false;
+	bool cancelled = false;
+
+	// The background re-compare must be done before the progress dialog is opened - as in runCompare()
+	backgroundRecompare.stop();
+
+	{
+		progress_ptr& progress = ProgressDlg::Open(TEXT("Comparing binary files..."));
+
+		bool maxCountSet = false;
+
+		compared = compareBinaryFiles(oldFile.c_str(), newFile.c_str(), diffs,
+				progress ? progress->CancelFlag() : nullptr,
+				[&progress, &maxCountSet](uint64_t done, uint64_t total)
+				{
+					if (!progress)
+						return;
+
+					// In KB so the counts fit in 32-bit builds as well
+					if (!maxCountSet)
+						maxCountSet = progress->SetMaxCount(static_cast<intptr_t>(total >> 10));
+
+					progress->SetCount(static_cast<intptr_t>(done >> 10));
+				});
+
+		cancelled = progress && progress->IsCancelled();
+
+		ProgressDlg::Close();
+	}
+
+	if (cancelled)
+		return;
+
+	const TCHAR* oldName = ::PathFindFileName(oldFile.c_str());
+	const TCHAR* newName = ::PathFindFileName(newFile.c_str());
+
+	TCHAR msg[2 * MAX_PATH];
+
+	if (!compared)
+	{
+		::MessageBox(nppData._nppHandle, TEXT("Cannot read the files - operation aborted."), PLUGIN_NAME, MB_OK);
+		return;
+	}
+
+	if (diffs.empty())
+	{
+		_sntprintf_s(msg, _countof(msg), _TRUNCATE, TEXT("Files \"%s\" and \"%s\" are binary identical."),
+				newName, oldName);
+		::MessageBox(nppData._nppHandle, msg, TEXT("Compare"), MB_OK);
+		return;
+	}
+
+	std::string oldDump;
+	std::string newDump;
+
+	if (!dumpBinaryDiffs(oldFile.c_str(), 0, diffs, cMaxHexDumpBytes, oldDump) ||
+		!dumpBinaryDiffs(newFile.c_str(), 1, diffs, cMaxHexDumpBytes, newDump))
+	{
+		::MessageBox(nppData._nppHandle, TEXT("Cannot read the files - operation aborted."), PLUGIN_NAME, MB_OK);
+		return;
+	}
+
+	{
+		ScopedIncrementerInt incr(notificationsLock);
+
+		if (!openHexDump(oldFile, oldDump))
+		{
+			::MessageBox(nppData._nppHandle, TEXT("Creating temp file failed - operation aborted."), PLUGIN_NAME,
+					MB_OK);
+			return;
+		}
+
+		if (!setFirst(false))
+			return;
+
+		newCompare->pair.file[0].isTemp = BINARY_TEMP;
+
+		if (!openHexDump(newFile, newDump))
+		{
+			::MessageBox(nppData._nppHandle, TEXT("Creating temp file failed - operation aborted."), PLUGIN_NAME,
+					MB_OK);
+
+			newCompare->pair.file[0].close();
+			newCompare = nullptr;
+			return;
+		}
+
+		newCompare->pair.file[1].isTemp = BINARY_TEMP;
+	}
+
+	compare();
+}
+
+
+// Gets the file to compare with the current one the way compare() picks it - the file set as first, the file in the
+// other view or the next / previous tab in single view mode
+bool getBinaryCompareFiles(std::wstring& oldFile, std::wstring& newFile)
+{
+	const LRESULT currentBuffId = getCurrentBuffId();
+
+	LRESULT otherBuffId = -1;
+	bool currentIsNew = true;
+
+	if (newCompare && (newCompare->pair.file[0].buffId != currentBuffId))
+	{
+		otherBuffId = newCompare->pair.file[0].buffId;
+		currentIsNew = !newCompare->pair.file[0].isNew;
+	}
+	else if (!isSingleView())
+	{
+		const int otherView = getOtherViewId();
+
+		const LRESULT otherPos = ::SendMessage(nppData._nppHandle, NPPM_GETCURRENTDOCINDEX, 0, otherView);
+
+		otherBuffId = ::SendMessage(nppData._nppHandle, NPPM_GETBUFFERIDFROMPOS, otherPos, otherView);
+		currentIsNew = (getCurrentViewId() == Settings.NewFileViewId);
+	}
+	else
+	{
+		const int view = getCurrentViewId();
+		const int filesCount = getNumberOfFiles(view);
+
+		if (filesCount < 2)
+		{
+			::MessageBox(nppData._nppHandle, TEXT("Only one file opened - operation ignored."), PLUGIN_NAME, MB_OK);
+			return false;
+		}
+
+		const int otherPos =
+				(posFromBuffId(currentBuffId) + (Settings.CompareToPrev ? filesCount - 1 : 1)) % filesCount;
+
+		otherBuffId = ::SendMessage(nppData._nppHandle, NPPM_GETBUFFERIDFROMPOS, otherPos, view);
+	}
+
+	if (otherBuffId == currentBuffId || otherBuffId <= 0)
+		return false;
+
+	TCHAR currentFile[MAX_PATH];
+	TCHAR otherFile[MAX_PATH];
+
+	if (::SendMessage(nppData._nppHandle, NPPM_GETFULLPATHFROMBUFFERID, currentBuffId, (LPARAM)currentFile) < 0 ||
+		::SendMessage(nppData._nppHandle, NPPM_GETFULLPATHFROMBUFFERID, otherBuffId, (LPARAM)otherFile) < 0)
+		return false;
+
+	if (!checkFileExists(currentFile) || !checkFileExists(otherFile))
+		return false;
+
+	oldFile = currentIsNew ? otherFile : currentFile;
+	newFile = currentIsNew ? currentFile : otherFile;
+
+	return true;
+}
+
+
+void BinaryCompare()
+{
+	if (refuseWhileComparing())
+		return;
+
+	std::wstring oldFile;
+	std::wstring newFile;
+
+	if (getBinaryCompareFiles(oldFile, newFile))
+		binaryCompare(oldFile, newFile);
 }
 
 
-void GitDiff()
-{
-	TCHAR file[MAX_PATH];
+void FolderCompare()
+{
+	if (refuseWhileComparing())
+		return;
+
+	static FolderCmpResults folderCmpResults;
+
+	FolderCompareDialog FolderCmpDlg(hInstance, nppData);
+
+	if (FolderCmpDlg.doDialog(&folderCmpResults) != IDOK || folderCmpResults.selected < 0)
+		return;
+
+	const FolderCmpEntry& entry = folderCmpResults.entries[folderCmpResults.selected];
+
+	auto filePath =
+		[&entry](const std::wstring& folder)
+		{
+			return (folder.back() == L'\\' || folder.back() == L'/') ?
+					folder + entry.relPath : folder + L'\\' + entry.relPath;
+		};
+
+	const std::wstring file1 = filePath(folderCmpResults.folder1);
+	const std::wstring file2 = filePath(folderCmpResults.folder2);
+
+	// Files present in one of the folders only are just opened
+	if (entry.status == FolderCmpStatus::ONLY_IN_1 || entry.status == FolderCmpStatus::ONLY_IN_2)
+	{
+		::SendMessage(nppData._nppHandle, NPPM_DOOPEN, 0,
+				(LPARAM)(entry.status == FolderCmpStatus::ONLY_IN_1 ? file1.c_str() : file2.c_str()));
+		return;
+	}
+
+	// Binary files are compared by content, not opened as text
+	if (isBinaryFile(file1.c_str()) || isBinaryFile(file2.c_str()))
+	{
+		binaryCompare(file1, file2);
+		return;
+	}
+
+	{
+		ScopedIncrementerInt incr(notificationsLock);
+
+		if (!::SendMessage(nppData._nppHandle, NPPM_DOOPEN, 0, (LPARAM)file1.c_str()) ||
+			!::SendMessage(nppData._nppHandle, NPPM_DOOPEN, 0, (LPARAM)file2.c_str()))
+			return;
+
+		// The file from the new folder is the new one
+		if (!setFirst(true))
+		{
+			newCompare = nullptr;
+			return;
+		}
+
+		::SendMessage(nppData._nppHandle, NPPM_SWITCHTOFILE, 0, (LPARAM)file1.c_str());
+	}
+
+	compare();
+}
+
+
+void BatchCompare()
+{
+	if (refuseWhileComparing())
+		return;
+
+	static BatchCmpResults batchCmpResults;
+
+	const int refView = getCurrentViewId();
+	const LRESULT refBuffId = getCurrentBuffId();
+
+	BatchCmpReference reference;
+
+	// The options and the views of the compare the candidates are opened in - the candidate is the new file so its
+	// results are found in the compare results cache when opened
+	getCompareOptions(reference.options);
+
+	reference.options.recompareOnChange = false;
+	reference.view = (reference.options.newFileViewId == MAIN_VIEW) ? SUB_VIEW : MAIN_VIEW;
+
+	TCHAR refName[MAX_PATH];
+
+	if (::SendMessage(nppData._nppHandle, NPPM_GETFULLPATHFROMBUFFERID, refBuffId, (LPARAM)refName) < 0)
+		return;
+
+	reference.name = refName;
+
+	{
+		const intptr_t len = CallScintilla(refView, SCI_GETLENGTH, 0, 0);
+		const char* text = reinterpret_cast<const char*>(CallScintilla(refView, SCI_GETCHARACTERPOINTER, 0, 0));
+
+		std::vector<char> refText;
+
+		if (text)
+			refText.assign(text, text + len);
+
+		reference.doc = std::make_unique<MemoryDocSource>(std::move(refText), getCodepage(refView));
+	}
 
-	::SendMessage(nppData._nppHandle, NPPM_GETFULLCURRENTPATH, _countof(file), (LPARAM)file);
+	BatchCompareDialog BatchCmpDlg(hInstance, nppData);
 
-	if (!checkFileExists(file))
+	if (BatchCmpDlg.doDialog(&reference, &batchCmpResults) != IDOK || batchCmpResults.selected < 0)
 		return;
 
-	std::vector<char> content = GetGitFileContent(file);
+	const std::wstring& file = batchCmpResults.entries[batchCmpResults.selected].file;
 
-	if (content.empty())
-		return;
+	{
+		ScopedIncrementerInt incr(notificationsLock);
 
-	if (!createTempFile(nullptr, GIT_TEMP))
-		return;
+		// The reference might be compared to the candidate opened the last time
+		if (isFileCompared(refView))
+		{
+			clearComparePair(refBuffId);
+			activateBufferID(refBuffId);
+		}
+
+		// The reference is the old file
+		if (!setFirst(false))
+			return;
 
-	setContent(content.data());
-	content.clear();
+		if (!::SendMessage(nppData._nppHandle, NPPM_DOOPEN, 0, (LPARAM)file.c_str()))
+		{
+			newCompare = nullptr;
+			return;
+		}
+	}
 
 	compare();
 }
@@ -3092,7 +4604,7 @@ void ActiveCompareSummary()
 	if (cmpPair == compareList.end())
 		return;
 
-	TCHAR info[1024];
+	TCHAR info[2048];
 
 	int infoCurrentPos = _sntprintf_s(info, _countof(info), _TRUNCATE, TEXT("%s Summary:\n\n"),
 			cmpPair->options.findUniqueMode ? TEXT("Find Unique") : TEXT("Compare"));
@@ -3179,10 +4691,125 @@ void ActiveCompareSummary()
 	else
 		_tcscpy_s(info + infoCurrentPos, _countof(info) - infoCurrentPos, TEXT("No specific options used."));
 
+	infoCurrentPos = static_cast<int>(_tcslen(info));
+
+	{
+		const CompareStats& stats = cmpPair->summary.stats;
+
+		TCHAR budgetInfo[256] = TEXT("");
+
+		if (stats.budgetDegraded())
+			_sntprintf_s(budgetInfo, _countof(budgetInfo), _TRUNCATE,
+					TEXT("Memory budget: %s%Id blocks matched in a band, %Id blocks compared by lines only, ")
+					TEXT("%Id char diffs skipped\n"),
+					stats.budgetBoundedDiff ? TEXT("lines diff cost bounded, ") : TEXT(""),
+					stats.budgetBandedBlocks, stats.budgetLinesOnlyBlocks, stats.budgetSkippedCharDiffs);
+
+		// Windows copies the message box text to the clipboard on Ctrl+C
+		_sntprintf_s(info + infoCurrentPos, _countof(info) - infoCurrentPos, _TRUNCATE,
+				TEXT("\n\nCompare statistics:\n\n")
+				TEXT("Lines hashing: %.1f ms (%Id lines)\n")
+				TEXT("Lines diff: %.1f ms (edit distance %Id%s)\n")
+				TEXT("Moves detection: %.1f ms\n")
+				TEXT("Changed blocks compare: %.1f ms (%Id lines pairs scored, %Id pruned)\n")
+				TEXT("Marking: %.1f ms\n")
+				TEXT("Total: %.1f ms, %Id diff runs%s\n")
+				TEXT("%s\n")
+				TEXT("Press Ctrl+C to copy this text."),
+				stats.phaseMs[CompareStats::HASHING], stats.linesHashed,
+				stats.phaseMs[CompareStats::LINES_DIFF], stats.linesEditDistance,
+				stats.diffApproximated ? TEXT(", approximated - diff cost limit reached") : TEXT(""),
+				stats.phaseMs[CompareStats::MOVES],
+				stats.phaseMs[CompareStats::BLOCKS_COMPARE], stats.convPairsScored, stats.convPairsPruned,
+				stats.phaseMs[CompareStats::MARKING],
+				stats.totalMs(), stats.diffCalcRuns,
+				stats.resultCached ? TEXT(" (cached diff results of the same contents reused)") : TEXT(""),
+				budgetInfo);
+	}
+
 	::MessageBox(nppData._nppHandle, info, PLUGIN_NAME, MB_OK);
 }
 
 
+bool getWorkloadsDir(std::wstring& workloadsDir)
+{
+	TCHAR configDir[MAX_PATH];
+
+	::SendMessage(nppData._nppHandle, NPPM_GETPLUGINSCONFIGDIR, (WPARAM)_countof(configDir), (LPARAM)configDir);
+
+	workloadsDir = configDir;
+	workloadsDir += TEXT("\\ComparePlus");
+
+	::CreateDirectory(workloadsDir.c_str(), NULL);
+
+	workloadsDir += TEXT("\\Workloads");
+
+	return (::CreateDirectory(workloadsDir.c_str(), NULL) || ::GetLastError() == ERROR_ALREADY_EXISTS);
+}
+
+
+// Re-compares the active pair storing the compare engine inputs to a workload file that can be replayed by
+// ComparePlusCli --replay for offline profiling
+void RecordCompareWorkload()
+{
+	CompareList_t::iterator	cmpPair = getCompare(getCurrentBuffId());
+	if (cmpPair == compareList.end())
+		return;
+
+	if (cmpPair->options.findUniqueMode)
+	{
+		::MessageBox(nppData._nppHandle, TEXT("Only compares can be recorded (Find Unique can't)."),
+				PLUGIN_NAME, MB_OK | MB_ICONINFORMATION);
+		return;
+	}
+
+	const int answer = ::MessageBox(nppData._nppHandle,
+			TEXT("The active compare will be re-run and its inputs (the lines hashes and lengths) stored ")
+			TEXT("to a workload file.\n\n")
+			TEXT("Store the changed lines text as well? It is scrambled - letters and digits are replaced ")
+			TEXT("so it is not readable but still differs the same way."),
+			PLUGIN_NAME, MB_YESNOCANCEL | MB_ICONQUESTION);
+
+	if (answer == IDCANCEL)
+		return;
+
+	std::wstring filePath;
+
+	if (!getWorkloadsDir(filePath))
+	{
+		::MessageBox(nppData._nppHandle, TEXT("Cannot create the workloads folder."), PLUGIN_NAME,
+				MB_OK | MB_ICONWARNING);
+		return;
+	}
+
+	SYSTEMTIME now;
+	::GetLocalTime(&now);
+
+	TCHAR fileName[64];
+
+	_sntprintf_s(fileName, _countof(fileName), _TRUNCATE, TEXT("\\workload_%04u%02u%02u_%02u%02u%02u.cpw"),
+			now.wYear, now.wMonth, now.wDay, now.wHour, now.wMinute, now.wSecond);
+
+	filePath += fileName;
+
+	recordNextCompare(filePath, (answer == IDYES));
+
+	compare(cmpPair->options.selectionCompare);
+
+	if (endCompareRecording())
+	{
+		const std::wstring info = TEXT("Compare workload stored to:\n\n") + filePath;
+
+		::MessageBox(nppData._nppHandle, info.c_str(), PLUGIN_NAME, MB_OK);
+	}
+	else
+	{
+		::MessageBox(nppData._nppHandle, TEXT("Compare workload has not been stored."), PLUGIN_NAME,
+				MB_OK | MB_ICONWARNING);
+	}
+}
+
+
 void DetectMoves()
 {
 	Settings.DetectMoves = !Settings.DetectMoves;
@@ -3284,6 +4911,9 @@ void IgnoreRegex()
 
 void ShowOnlyDiffs()
 {
+	if (refuseWhileComparing())
+		return;
+
 	Settings.ShowOnlyDiffs = !Settings.ShowOnlyDiffs;
 	::SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[CMD_SHOW_ONLY_DIFF]._cmdID,
 			(LPARAM)Settings.ShowOnlyDiffs);
@@ -3327,6 +4957,9 @@ void ShowOnlyDiffs()
 
 void ShowOnlySelections()
 {
+	if (refuseWhileComparing())
+		return;
+
 	Settings.ShowOnlySelections = !Settings.ShowOnlySelections;
 	::SendMessage(nppData._nppHandle, NPPM_SETMENUITEMCHECK, funcItem[CMD_SHOW_ONLY_SEL]._cmdID,
 			(LPARAM)Settings.ShowOnlySelections);
@@ -3578,9 +5211,21 @@ void createMenu()
 	funcItem[CMD_GIT_DIFF]._pShKey->_isShift		= false;
 	funcItem[CMD_GIT_DIFF]._pShKey->_key 			= 'G';
 
+	_tcscpy_s(funcItem[CMD_FOLDER_COMPARE]._itemName, nbChar, TEXT("Compare Folders..."));
+	funcItem[CMD_FOLDER_COMPARE]._pFunc 			= FolderCompare;
+
+	_tcscpy_s(funcItem[CMD_BATCH_COMPARE]._itemName, nbChar, TEXT("Compare to Reference..."));
+	funcItem[CMD_BATCH_COMPARE]._pFunc 				= BatchCompare;
+
+	_tcscpy_s(funcItem[CMD_BINARY_COMPARE]._itemName, nbChar, TEXT("Binary Compare"));
+	funcItem[CMD_BINARY_COMPARE]._pFunc 			= BinaryCompare;
+
 	_tcscpy_s(funcItem[CMD_COMPARE_SUMMARY]._itemName, nbChar, TEXT("Active Compare Summary"));
 	funcItem[CMD_COMPARE_SUMMARY]._pFunc = ActiveCompareSummary;
 
+	_tcscpy_s(funcItem[CMD_RECORD_WORKLOAD]._itemName, nbChar, TEXT("Record Compare Workload..."));
+	funcItem[CMD_RECORD_WORKLOAD]._pFunc = RecordCompareWorkload;
+
 	_tcscpy_s(funcItem[CMD_DETECT_MOVES]._itemName, nbChar, TEXT("Detect Moves"));
 	funcItem[CMD_DETECT_MOVES]._pFunc = DetectMoves;
 
@@ -3675,6 +5320,10 @@ void freeToolbarObjects(toolbarIconsWithDarkMode& tb)
 
 void deinitPlugin()
 {
+	backgroundRecompare.stop();
+
+	ClearVcsCaches();
+
 	// Always close it, else N++'s plugin manager would call 'ToggleNavigationBar'
 	// on startup, when N++ has been shut down before with opened navigation bar
 	if (NavDlg.isVisible())
@@ -3702,19 +5351,133 @@ void deinitPlugin()
 			funcItem[i]._pShKey = NULL;
 		}
 	}
+
+	unregisterTraceProvider();
+}
+
+
+bool ViewsSync::refresh(int view)
+{
+	Layout& layout = _layout[view];
+
+	const HWND hView = getView(view);
+
+	RECT rc;
+	::GetClientRect(hView, &rc);
+
+	const intptr_t doc			= CallScintilla(view, SCI_GETDOCPOINTER, 0, 0);
+	const intptr_t linesCount	= CallScintilla(view, SCI_GETLINECOUNT, 0, 0);
+	const int zoom				= static_cast<int>(CallScintilla(view, SCI_GETZOOM, 0, 0));
+	const int wrapMode			= static_cast<int>(CallScintilla(view, SCI_GETWRAPMODE, 0, 0));
+
+	if (layout.valid && layout.doc == doc && layout.linesCount == linesCount && layout.zoom == zoom &&
+			layout.wrapMode == wrapMode && layout.width == rc.right - rc.left && layout.height == rc.bottom - rc.top)
+		return false;
+
+	layout.valid		= true;
+	layout.doc			= doc;
+	layout.linesCount	= linesCount;
+	layout.zoom			= zoom;
+	layout.wrapMode		= wrapMode;
+	layout.width		= rc.right - rc.left;
+	layout.height		= rc.bottom - rc.top;
+
+	const intptr_t endLine = getPreviousUnhiddenLine(view, linesCount - 1);
+
+	layout.endVisible		= CallScintilla(view, SCI_VISIBLEFROMDOCLINE, endLine, 0) + getWrapCount(view, endLine);
+	layout.linesOnScreen	= CallScintilla(view, SCI_LINESONSCREEN, 0, 0);
+
+	_last.valid = false;
+
+	return true;
+}
+
+
+ViewsSync::Positions ViewsSync::getPositions(int biasView)
+{
+	Positions pos;
+
+	pos.valid		= true;
+	pos.biasView	= biasView;
+
+	for (int view: { MAIN_VIEW, SUB_VIEW })
+	{
+		pos.firstVisible[view]	= getFirstVisibleLine(view);
+		pos.currentLine[view]	= getCurrentLine(view);
+	}
+
+	return pos;
+}
+
+
+bool ViewsSync::isSynced(int biasView)
+{
+	// Layout changes invalidate the last positions
+	refresh(MAIN_VIEW);
+	refresh(SUB_VIEW);
+
+	if (!_last.valid)
+		return false;
+
+	const Positions pos = getPositions(biasView);
+
+	return (pos.biasView == _last.biasView &&
+			pos.firstVisible[MAIN_VIEW] == _last.firstVisible[MAIN_VIEW] &&
+			pos.firstVisible[SUB_VIEW] == _last.firstVisible[SUB_VIEW] &&
+			pos.currentLine[MAIN_VIEW] == _last.currentLine[MAIN_VIEW] &&
+			pos.currentLine[SUB_VIEW] == _last.currentLine[SUB_VIEW]);
+}
+
+
+void ViewsSync::setSynced(int biasView)
+{
+	_last = getPositions(biasView);
+
+	_frameSynced	= true;
+	_syncTime		= ::GetTickCount();
+}
+
+
+void DelayedSync::operator()()
+{
+	if (NppSettings::get().compareMode && (getCompare(getCurrentBuffId()) != compareList.end()))
+		syncViews(biasView);
+}
+
+
+// Syncs the views now or in the next frame if they have been synced in the current one already - used for the
+// scroll syncs that can come many times per frame
+void requestSyncViews(int biasView)
+{
+	if (!viewsSync.isFrameSynced())
+	{
+		delayedSync.cancel();
+		syncViews(biasView);
+
+		return;
+	}
+
+	delayedSync.biasView = biasView;
+
+	if (!delayedSync)
+		delayedSync.post(ViewsSync::cFrameInterval_ms);
 }
 
 
 void syncViews(int biasView)
 {
+	TraceScope trace("SyncViews", biasView);
+
+	// Nothing has moved since the last sync
+	if (viewsSync.isSynced(biasView))
+		return;
+
 	const int otherView = getOtherViewId(biasView);
 
 	intptr_t firstVisible				= getFirstVisibleLine(biasView);
 	const intptr_t otherFirstVisible	= getFirstVisibleLine(otherView);
 
-	const intptr_t endLine = getPreviousUnhiddenLine(biasView, CallScintilla(biasView, SCI_GETLINECOUNT, 0, 0) - 1);
-	const intptr_t endVisible =
-			CallScintilla(biasView, SCI_VISIBLEFROMDOCLINE, endLine, 0) + getWrapCount(biasView, endLine);
+	const intptr_t endVisible = viewsSync.endVisible(biasView);
 
 	intptr_t otherNewFirstVisible = otherFirstVisible;
 
@@ -3729,14 +5492,11 @@ void syncViews(int biasView)
 
 	if (firstVisible != otherFirstVisible)
 	{
-		const intptr_t otherEndLine =
-				getPreviousUnhiddenLine(otherView, CallScintilla(otherView, SCI_GETLINECOUNT, 0, 0) - 1);
-		const intptr_t otherEndVisible = CallScintilla(otherView, SCI_VISIBLEFROMDOCLINE,
-				otherEndLine, 0) + getWrapCount(otherView, otherEndLine);
+		const intptr_t otherEndVisible = viewsSync.endVisible(otherView);
 
 		if (firstVisible > otherEndVisible)
 		{
-			if (endVisible - firstVisible < CallScintilla(biasView, SCI_LINESONSCREEN, 0, 0))
+			if (endVisible - firstVisible < viewsSync.linesOnScreen(biasView))
 				otherNewFirstVisible = firstVisible;
 			else
 				otherNewFirstVisible = otherEndVisible;
@@ -3784,6 +5544,8 @@ void syncViews(int biasView)
 		}
 	}
 
+	viewsSync.setSynced(biasView);
+
 	NavDlg.Update();
 }
 
@@ -4270,6 +6032,9 @@ void onNppReady()
 		NppSettings::get().updatePluginMenu();
 
 		checkCmdLine();
+
+		if (Settings.PrewarmVcsLibs)
+			PrewarmVcsLibs();
 	}
 }
 
@@ -4335,7 +6100,7 @@ void DelayedAlign::operator()()
 		}
 		else if (storedLocation->restore())
 		{
-			syncViews(storedLocation->getView());
+			requestSyncViews(storedLocation->getView());
 			storedLocation = nullptr;
 		}
 
@@ -4349,7 +6114,7 @@ void DelayedAlign::operator()()
 			if (realign)
 				storedLocation->restore();
 
-			syncViews(storedLocation->getView());
+			requestSyncViews(storedLocation->getView());
 
 			storedLocation = nullptr;
 			cmpPair->setStatus();
@@ -4357,7 +6122,7 @@ void DelayedAlign::operator()()
 	}
 	else if (cmpPair->options.findUniqueMode)
 	{
-		syncViews(getCurrentViewId());
+		requestSyncViews(getCurrentViewId());
 	}
 }
 
@@ -4380,10 +6145,190 @@ void onSciUpdateUI(HWND view)
 
 void DelayedUpdate::operator()()
 {
+	CompareList_t::iterator cmpPair = getCompare(getCurrentBuffId());
+
+	if ((cmpPair != compareList.end()) && cmpPair->options.recompareOnChange)
+	{
+		const DWORD waitTime = cmpPair->recompareScheduler.idleWaitTime(cmpPair->incremental.state != nullptr);
+
+		if (waitTime)
+		{
+			post(waitTime);
+			return;
+		}
+	}
+
 	compare(false, false, true);
 }
 
 
+void BackgroundRecompare::operator()()
+{
+	if (_job)
+	{
+		if (!_job->done)
+		{
+			post(cPollTime_ms);
+			return;
+		}
+
+		finish();
+	}
+
+	if (!Settings.BackgroundCompare)
+		return;
+
+	LASTINPUTINFO lastInput;
+	lastInput.cbSize = sizeof(lastInput);
+
+	if (::GetLastInputInfo(&lastInput))
+	{
+		const DWORD idleTime = ::GetTickCount() - lastInput.dwTime;
+
+		if (idleTime < cIdleTime_ms)
+		{
+			post(cIdleTime_ms - idleTime);
+			return;
+		}
+	}
+
+	const LRESULT currentBuffId = getCurrentBuffId();
+
+	for (ComparedPair& cmpPair : compareList)
+	{
+		if (cmpPair.file[0].buffId == currentBuffId || cmpPair.file[1].buffId == currentBuffId || !isStale(cmpPair))
+			continue;
+
+		if (start(cmpPair))
+			post(cPollTime_ms);
+
+		return;
+	}
+}
+
+
+void BackgroundRecompare::stop()
+{
+	cancel();
+
+	if (_job)
+	{
+		_job->progress.Cancel();
+		finish();
+	}
+}
+
+
+bool BackgroundRecompare::isStale(const ComparedPair& cmpPair)
+{
+	if (cmpPair.precomputed || cmpPair.options.selectionCompare || cmpPair.options.findUniqueMode)
+		return false;
+
+	return (cmpPair.compareDirty || (cmpPair.options.recompareOnChange && cmpPair.autoUpdateDelay));
+}
+
+
+std::vector<char> BackgroundRecompare::getDocText(intptr_t sciDoc)
+{
+	::SendMessage(_hSci, SCI_SETDOCPOINTER, 0, sciDoc);
+
+	const intptr_t len = ::SendMessage(_hSci, SCI_GETLENGTH, 0, 0);
+	const char* text = reinterpret_cast<const char*>(::SendMessage(_hSci, SCI_GETCHARACTERPOINTER, 0, 0));
+
+	std::vector<char> docText;
+
+	if (text)
+		docText.assign(text, text + len);
+
+	// Release the document
+	::SendMessage(_hSci, SCI_SETDOCPOINTER, 0, 0);
+
+	return docText;
+}
+
+
+bool BackgroundRecompare::start(ComparedPair& cmpPair)
+{
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	if (!_hSci)
+		_hSci = reinterpret_cast<HWND>(::SendMessage(nppData._nppHandle, NPPM_CREATESCINTILLAHANDLE, 0,
+				reinterpret_cast<LPARAM>(nppData._nppHandle)));
+
+	if (!_hSci)
+		return false;
+
+	std::unique_ptr<Job> job = std::make_unique<Job>();
+
+	job->buffId		= cmpPair.file[0].buffId;
+	job->editsCount	= cmpPair.editsCount;
+
+	job->options.copyFrom(cmpPair.options);
+
+	for (int view = MAIN_VIEW; view <= SUB_VIEW; ++view)
+	{
+		const ComparedFile& cmpFile = cmpPair.getFileByViewId(view);
+
+		// The documents are not in the views - their codepages are the ones they were last compared in
+		job->docs[view] = std::make_unique<MemoryDocSource>(getDocText(cmpFile.sciDoc), cmpFile.lineHashes.codepage);
+		job->lineHashes[view] = cmpFile.lineHashes;
+	}
+
+	Job* const j = job.get();
+
+	try
+	{
+		job->worker = std::thread(
+			[j]()
+			{
+				j->result = precomputeCompare(j->options, *j->docs[MAIN_VIEW], *j->docs[SUB_VIEW], j->progress,
+						&j->lineHashes[MAIN_VIEW], &j->lineHashes[SUB_VIEW]);
+				j->done = true;
+			});
+	}
+	catch (...)
+	{
+		return false;
+	}
+
+	_job = std::move(job);
+
+	LOGDB(LOG_NOTIF, _job->buffId, "Background re-compare started\n");
+
+	return true;
+#else
+	return false;
+#endif // MULTITHREAD
+}
+
+
+void BackgroundRecompare::finish()
+{
+	_job->worker.join();
+
+	CompareList_t::iterator cmpPair = getCompare(_job->buffId);
+
+	// Apply the results only if the pair is still there and not edited meanwhile
+	if ((cmpPair != compareList.end()) && (cmpPair->editsCount == _job->editsCount) &&
+		(_job->result != CompareResult::COMPARE_CANCELLED))
+	{
+		cmpPair->precomputed = true;
+
+		if (_job->result == CompareResult::COMPARE_MISMATCH)
+		{
+			cmpPair->getFileByViewId(MAIN_VIEW).lineHashes	= std::move(_job->lineHashes[MAIN_VIEW]);
+			cmpPair->getFileByViewId(SUB_VIEW).lineHashes	= std::move(_job->lineHashes[SUB_VIEW]);
+
+			// Make the next re-compare a full one so it finds the cached line diffs instead of re-diffing the edits
+			cmpPair->incremental.clear();
+		}
+
+		LOGDB(LOG_NOTIF, _job->buffId, "Background re-compare done\n");
+	}
+
+	_job = nullptr;
+}
+
+
 void onMarginClick(HWND view, intptr_t pos, int keyMods)
 {
 	if (keyMods & SCMOD_ALT)
@@ -4464,6 +6409,9 @@ void onMarginClick(HWND view, intptr_t pos, int keyMods)
 		else
 		{
 			clearMarks(otherViewId, otherLine, 1);
+
+			// The incremental re-compare must not count on the other view marks there anymore
+			cmpPair->incremental.edited[otherViewId].add(otherLine, 0, 0);
 		}
 
 		CallScintilla(viewId, SCI_DELETERANGE, startPos, endPos - startPos);
@@ -4627,6 +6575,9 @@ void onMarginClick(HWND view, intptr_t pos, int keyMods)
 		else
 		{
 			clearMarks(otherViewId, otherStartLine, otherEndLine - otherStartLine);
+
+			cmpPair->incremental.edited[otherViewId].add(otherStartLine, 0, 0);
+			cmpPair->incremental.edited[otherViewId].add(otherEndLine, 0, 0);
 		}
 	}
 
@@ -4742,6 +6693,8 @@ void onSciModified(SCNotification* notifyCode)
 	if (cmpPair == compareList.end())
 		return;
 
+	viewsSync.invalidate();
+
 	std::shared_ptr<DeletedSection::UndoData> undo = nullptr;
 
 	if (notifyCode->modificationType & SC_MOD_BEFOREDELETE)
@@ -4773,7 +6726,7 @@ void onSciModified(SCNotification* notifyCode)
 			if (!undo)
 				undo = std::make_shared<DeletedSection::UndoData>();
 
-			undo->alignment = cmpPair->summary.alignmentInfo;
+			cmpPair->getAlignmentDelta(view, startLine, endLine - startLine, undo->alignment);
 
 			if (cmpPair->inEqualizeMode && !copiedSectionMarks.empty())
 				undo->otherViewMarks = std::move(copiedSectionMarks);
@@ -4792,7 +6745,7 @@ void onSciModified(SCNotification* notifyCode)
 					LOGD(LOG_NOTIF, "Selection stored.\n");
 				}
 
-				if (!undo->alignment.empty())
+				if (undo->alignment.stored)
 				{
 					LOGD(LOG_NOTIF, "Alignment stored.\n");
 				}
@@ -4840,9 +6793,18 @@ void onSciModified(SCNotification* notifyCode)
 
 			if (!cmpPair->options.recompareOnChange)
 			{
-				cmpPair->summary.alignmentInfo = std::move(undo->alignment);
+				if (cmpPair->restoreAlignment(view, undo->alignment))
+				{
+					LOGD(LOG_NOTIF, "Alignment restored.\n");
+				}
+				else
+				{
+					// The views have been changed in a way the deletion delta doesn't revert
+					cmpPair->setCompareDirty();
+					cmpPair->setStatus();
 
-				LOGD(LOG_NOTIF, "Alignment restored.\n");
+					LOGD(LOG_NOTIF, "Alignment cannot be restored.\n");
+				}
 
 				if (!undo->otherViewMarks.empty())
 				{
@@ -4867,6 +6829,18 @@ void onSciModified(SCNotification* notifyCode)
 		delayedAlignment.cancel();
 		delayedUpdate.cancel();
 
+		{
+			const intptr_t startLine	= CallScintilla(view, SCI_LINEFROMPOSITION, notifyCode->position, 0);
+			const intptr_t lengthAdded	=
+					(notifyCode->modificationType & SC_MOD_INSERTTEXT) ? notifyCode->length : -notifyCode->length;
+
+			cmpPair->incremental.edited[view].add(startLine, notifyCode->linesAdded, lengthAdded);
+			cmpPair->getFileByViewId(view).lineHashes.invalidate(startLine, notifyCode->linesAdded, lengthAdded);
+
+			++cmpPair->editsCount;
+			cmpPair->precomputed = false;
+		}
+
 		if (notifyCode->linesAdded == 0)
 			notReverting = true;
 
@@ -4969,12 +6943,8 @@ void onSciModified(SCNotification* notifyCode)
 
 		if (cmpPair->options.recompareOnChange)
 		{
-			if (notifyCode->linesAdded)
-				cmpPair->autoUpdateDelay = 500;
-			else
-				// Leave bigger delay before re-compare if change is on single line because the user might be typing
-				// and we shouldn't interrupt / interfere
-				cmpPair->autoUpdateDelay = 1000;
+			cmpPair->autoUpdateDelay = static_cast<int>(cmpPair->recompareScheduler.onEdit(notifyCode->linesAdded != 0,
+					cmpPair->incremental.state != nullptr));
 
 			return;
 		}
@@ -5105,6 +7075,9 @@ void onBufferActivated(LRESULT buffId)
 		delayedActivation.buffId = buffId;
 		delayedActivation.post(30);
 	}
+
+	// The pair left might need re-compare
+	backgroundRecompare.schedule();
 }
 
 
@@ -5327,6 +7300,8 @@ extern "C" __declspec(dllexport) void setInfo(NppData notpadPlusData)
 	Settings.load();
 
 	NavDlg.init(hInstance);
+
+	registerTraceProvider();
 }
 
 
@@ -5349,6 +7324,8 @@ extern "C" __declspec(dllexport) void beNotified(SCNotification* notifyCode)
 	{
 		// Handle wrap refresh
 		case SCN_PAINTED:
+			viewsSync.onPainted();
+
 			if (NppSettings::get().compareMode && !notificationsLock &&
 					!delayedActivation && !delayedClosure && !delayedUpdate)
 				onSciPaint();
@@ -5371,13 +7348,22 @@ extern "C" __declspec(dllexport) void beNotified(SCNotification* notifyCode)
 		break;
 
 		case NPPN_BUFFERACTIVATED:
-			if (!compareList.empty() && !notificationsLock && !delayedClosure)
+			if (runningCompare.isRunning())
+				runningCompare.onBufferActivated();
+			else if (!compareList.empty() && !notificationsLock && !delayedClosure)
 				onBufferActivated(notifyCode->nmhdr.idFrom);
 		break;
 
 		case NPPN_FILEBEFORECLOSE:
 			if (newCompare && (newCompare->pair.file[0].buffId == static_cast<LRESULT>(notifyCode->nmhdr.idFrom)))
 				newCompare = nullptr;
+			// Compared files closed while the compare runs in the background are handled as usual - the delayed
+			// closure comes after the compare
+			else if (runningCompare.isRunning())
+			{
+				runningCompare.onFileBeforeClose(notifyCode->nmhdr.idFrom);
+				onFileBeforeClose(notifyCode->nmhdr.idFrom);
+			}
 #ifdef DLOG
 			else if (dLogBuf == static_cast<LRESULT>(notifyCode->nmhdr.idFrom))
 				dLogBuf = -1;
@@ -5393,7 +7379,9 @@ extern "C" __declspec(dllexport) void beNotified(SCNotification* notifyCode)
 
 		// This is used to monitor deletion of lines to properly clear their compare markings
 		case SCN_MODIFIED:
-			if (NppSettings::get().compareMode && !notificationsLock)
+			if (runningCompare.isRunning())
+				runningCompare.onModified(notifyCode);
+			else if (NppSettings::get().compareMode && !notificationsLock)
 				onSciModified(notifyCode);
 		break;
 
@@ -5450,10 +7438,16 @@ extern "C" __declspec(dllexport) void beNotified(SCNotification* notifyCode)
 		break;
 
 		case NPPN_BEFORESHUTDOWN:
-			ClearAllCompares();
+			if (runningCompare.isRunning())
+				runningCompare.onNppClosing(false);
+			else
+				ClearAllCompares();
 		break;
 
 		case NPPN_SHUTDOWN:
+			if (runningCompare.isRunning())
+				runningCompare.onNppClosing(true);
+
 			Settings.save();
 			deinitPlugin();
 		break;
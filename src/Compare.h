@@ -126,8 +126,12 @@ enum MENU_COMMANDS
 	CMD_CLIPBOARD_DIFF,
 	CMD_SVN_DIFF,
 	CMD_GIT_DIFF,
+	CMD_FOLDER_COMPARE,
+	CMD_BATCH_COMPARE,
+	CMD_BINARY_COMPARE,
 	CMD_SEPARATOR_2,
 	CMD_COMPARE_SUMMARY,
+	CMD_RECORD_WORKLOAD,
 	CMD_SEPARATOR_3,
 	CMD_DETECT_MOVES,
 	CMD_DETECT_CHAR_DIFFS,
@@ -0,0 +1,217 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <exception>
+
+#include "BatchCompare.h"
+
+#if defined(__MINGW32__) && !defined(_GLIBCXX_HAS_GTHREADS)
+#include "../mingw-std-threads/mingw.thread.h"
+#include "../mingw-std-threads/mingw.mutex.h"
+#else
+#include <thread>
+#include <mutex>
+#endif // __MINGW32__ ...
+
+#ifndef MULTITHREAD
+#define MULTITHREAD		1
+#endif
+
+
+namespace // anonymous namespace
+{
+
+/**
+ *  \class  BatchProgress
+ *  \brief  Progress of a candidate compare - nobody watches it, it is cancelled by the batch cancel flag
+ */
+class BatchProgress : public CompareProgress
+{
+public:
+	explicit BatchProgress(const std::atomic<bool>& cancelled) : _cancelled(cancelled) {}
+
+	bool IsCancelled() const override
+	{
+		return _cancelled.load(std::memory_order_relaxed);
+	}
+
+	const std::atomic<bool>* CancelFlag() const override
+	{
+		return &_cancelled;
+	}
+
+	// The whole batch is cancelled by its owner
+	void Cancel() override {}
+
+	void Show() const override {}
+
+	unsigned NextPhase() override
+	{
+		return IsCancelled() ? 0 : 1;
+	}
+
+	bool SetMaxCount(intptr_t, unsigned = 0) override
+	{
+		return !IsCancelled();
+	}
+
+	bool Advance(intptr_t = 1, unsigned = 0) override
+	{
+		return !IsCancelled();
+	}
+
+private:
+	const std::atomic<bool>& _cancelled;
+};
+
+
+void compareCandidate(const CompareOptions& options, const DocSource& reference, int refView, int codepage,
+		const LineHashCache& refLineHashes, const std::atomic<bool>& cancelled, BatchCmpEntry& entry)
+{
+	MappedFileDocSource candidate;
+
+	if (!candidate.open(entry.file.c_str(), codepage))
+	{
+		entry.status = BatchCmpStatus::READ_ERROR;
+		return;
+	}
+
+	// The compare updates the cache - each candidate gets its own copy
+	LineHashCache refHashes = refLineHashes;
+
+	const bool refIsMain = (refView == MAIN_VIEW);
+
+	FilesCompareViews views(refIsMain ? reference : candidate, refIsMain ? candidate : reference);
+	BatchProgress progress(cancelled);
+
+	entry.summary.clear();
+
+	const CompareResult result = runCompare(options, views, progress, entry.summary, nullptr,
+			refIsMain ? &refHashes : nullptr, refIsMain ? nullptr : &refHashes);
+
+	switch (result)
+	{
+		case CompareResult::COMPARE_MATCH:
+			entry.status = BatchCmpStatus::MATCH;
+
+			// The engine doesn't count the lines of matching documents
+			entry.summary.match = reference.linesCount();
+		break;
+
+		case CompareResult::COMPARE_MISMATCH:
+			entry.status = BatchCmpStatus::MISMATCH;
+		break;
+
+		case CompareResult::COMPARE_CANCELLED:
+			entry.status = BatchCmpStatus::NOT_COMPARED;
+		break;
+
+		default:
+			entry.status = BatchCmpStatus::COMPARE_ERROR;
+	}
+}
+
+} // anonymous namespace
+
+
+bool compareToReference(const CompareOptions& options, const DocSource& reference, int refView, int codepage,
+		std::vector<BatchCmpEntry>& entries, const std::atomic<bool>* cancelled, const BatchCmpProgressFn& progress,
+		int threadsCount)
+{
+	const std::atomic<bool> notCancelled(false);
+	const std::atomic<bool>& cancelFlag = cancelled ? *cancelled : notCancelled;
+
+	for (auto& entry : entries)
+		entry.status = BatchCmpStatus::NOT_COMPARED;
+
+	// Room for all candidates results - none of them is pushed out of the cache by the others
+	reserveCompareResults(entries.size());
+
+	LineHashCache refLineHashes;
+
+	hashDocLines(options, reference, refLineHashes);
+
+	const intptr_t total = static_cast<intptr_t>(entries.size());
+
+	std::atomic<intptr_t> nextJob(0);
+	std::atomic<intptr_t> doneJobs(0);
+
+	std::exception_ptr error = nullptr;
+	std::mutex errorMutex;
+
+	auto workFn =
+		[&]()
+		{
+			try
+			{
+				for (intptr_t job = nextJob++; job < total && !cancelFlag; job = nextJob++)
+				{
+					compareCandidate(options, reference, refView, codepage, refLineHashes, cancelFlag,
+							entries[job]);
+
+					const intptr_t done = ++doneJobs;
+
+					if (progress)
+						progress(done, total);
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+
+				if (!error)
+					error = std::current_exception();
+
+				nextJob = total;
+			}
+		};
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	if (threadsCount <= 0)
+		threadsCount = static_cast<int>(std::thread::hardware_concurrency());
+
+	std::vector<std::thread> threads;
+
+	for (intptr_t i = 1; i < std::min(static_cast<intptr_t>(threadsCount), total); ++i)
+	{
+		try
+		{
+			threads.emplace_back(workFn);
+		}
+		catch (...)
+		{
+			// Remaining candidates will be compared by the threads already started
+			break;
+		}
+	}
+#else
+	(void)threadsCount;
+#endif // MULTITHREAD
+
+	workFn();
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	for (auto& th : threads)
+		th.join();
+#endif // MULTITHREAD
+
+	if (error)
+		std::rethrow_exception(error);
+
+	return !cancelFlag;
+}
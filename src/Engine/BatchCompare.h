@@ -0,0 +1,72 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* One to many compare - a reference document compared to each of the candidate files. The reference lines are hashed
+ * once, the candidates are read through memory mappings and compared to it by worker threads - each by the same
+ * engine compare the plugin runs on the views. The results stay in the compare results cache so opening any of the
+ * candidates compares in the editor has only to mark them.
+ */
+
+
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <functional>
+#include <atomic>
+
+#include "CompareOptions.h"
+#include "DocSource.h"
+#include "Engine.h"
+
+
+enum class BatchCmpStatus
+{
+	NOT_COMPARED = 0,
+	MATCH,
+	MISMATCH,
+	READ_ERROR,
+	COMPARE_ERROR
+};
+
+
+struct BatchCmpEntry
+{
+	std::wstring	file;
+
+	BatchCmpStatus	status {BatchCmpStatus::NOT_COMPARED};
+
+	// The engine compare summary of the candidate vs. the reference (valid if status is MATCH or MISMATCH)
+	CompareSummary	summary;
+};
+
+
+// Called by the worker threads with the candidates compared so far and the candidates to compare in total
+using BatchCmpProgressFn = std::function<void(intptr_t done, intptr_t total)>;
+
+
+/**
+ *  \brief  Compares each of the entries files (read as codepage text) to the reference document. The reference is
+ *          compared as the document of refView and the candidates as the documents of the other view - options are
+ *          the ones the compare in the views is run with so that its results are found in the compare results cache.
+ *          threadsCount 0 means as many threads as the CPU cores. Returns false if cancelled.
+ */
+bool compareToReference(const CompareOptions& options, const DocSource& reference, int refView, int codepage,
+		std::vector<BatchCmpEntry>& entries, const std::atomic<bool>* cancelled = nullptr,
+		const BatchCmpProgressFn& progress = nullptr, int threadsCount = 0);
@@ -0,0 +1,635 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#include "BinaryCompare.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define BINCMP_SSE2		1
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+
+namespace // anonymous namespace
+{
+
+// Views offsets must be multiples of the allocation granularity (64 KB)
+constexpr uint64_t cAllocGranularity = 64 * 1024;
+
+// Files are read through views of that size - keeps the address space use low enough for 32-bit builds whatever the
+// files sizes are. The biggest resync window and a granularity step must fit in a view.
+constexpr uint64_t cViewSize = 64 * 1024 * 1024;
+
+// Equal bytes are looked for in chunks of that size - progress and cancel are checked once per chunk
+constexpr size_t cChunkLen = 1024 * 1024;
+
+// Equal bytes needed to consider the files synchronized again after a mismatch
+constexpr size_t cMatchLen = 32;
+
+// Rolling hash multiplier
+constexpr uint32_t cHashMul = 0x01000193;
+
+
+/**
+ *  \class  MappedFile
+ *  \brief  Read-only file mapped one view at a time - the view is moved only when the requested bytes are not in it
+ */
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
+	{
+		unmap();
+
+		if (_hMapping != NULL)
+			::CloseHandle(_hMapping);
+
+		if (_hFile != INVALID_HANDLE_VALUE)
+			::CloseHandle(_hFile);
+	}
+
+	bool open(const wchar_t* filePath)
+	{
+		_hFile = ::CreateFileW(filePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+				NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+		if (_hFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+
+		if (!::GetFileSizeEx(_hFile, &fileSize))
+			return false;
+
+		_size = static_cast<uint64_t>(fileSize.QuadPart);
+
+		// Empty files cannot be mapped and there is nothing to read anyway
+		if (_size == 0)
+			return true;
+
+		_hMapping = ::CreateFileMappingW(_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+		return (_hMapping != NULL);
+	}
+
+	uint64_t size() const
+	{
+		return _size;
+	}
+
+	// Returns the file bytes [off, off + len) - valid until the next call
+	const uint8_t* data(uint64_t off, size_t len)
+	{
+		if (_view && off >= _viewOff && off + len <= _viewOff + _viewLen)
+			return _view + (off - _viewOff);
+
+		unmap();
+
+		if (off + len > _size)
+			return nullptr;
+
+		_viewOff = off & ~(cAllocGranularity - 1);
+		_viewLen = std::min(cViewSize, _size - _viewOff);
+
+		if (off + len > _viewOff + _viewLen)
+			return nullptr;
+
+		_view = static_cast<const uint8_t*>(::MapViewOfFile(_hMapping, FILE_MAP_READ,
+				static_cast<DWORD>(_viewOff >> 32), static_cast<DWORD>(_viewOff & 0xFFFFFFFF),
+				static_cast<size_t>(_viewLen)));
+
+		return _view ? _view + (off - _viewOff) : nullptr;
+	}
+
+private:
+	void unmap()
+	{
+		if (_view)
+			::UnmapViewOfFile(_view);
+
+		_view = nullptr;
+	}
+
+	HANDLE			_hFile {INVALID_HANDLE_VALUE};
+	HANDLE			_hMapping {NULL};
+	uint64_t		_size {0};
+	const uint8_t*	_view {nullptr};
+	uint64_t		_viewOff {0};
+	uint64_t		_viewLen {0};
+};
+
+
+#ifdef BINCMP_SSE2
+
+inline size_t firstBit(unsigned bits)
+{
+#if defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanForward(&idx, bits);
+	return static_cast<size_t>(idx);
+#else
+	return __builtin_ctz(bits);
+#endif
+}
+
+#endif // BINCMP_SSE2
+
+
+// Returns the count of the equal leading bytes of a and b
+size_t equalPrefix(const uint8_t* a, const uint8_t* b, size_t len)
+{
+	size_t n = 0;
+
+#ifdef BINCMP_SSE2
+#if defined(__AVX2__)
+	for (; n + 32 <= len; n += 32)
+	{
+		const __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + n)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + n)));
+
+		const unsigned notEq = ~static_cast<unsigned>(_mm256_movemask_epi8(eq));
+
+		if (notEq)
+			return n + firstBit(notEq);
+	}
+#else
+	// Four vectors at once - their masks are looked at only when some of the bytes differ
+	for (; n + 64 <= len; n += 64)
+	{
+		const __m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + n)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + n)));
+		const __m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + n + 16)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + n + 16)));
+		const __m128i eq2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + n + 32)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + n + 32)));
+		const __m128i eq3 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + n + 48)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + n + 48)));
+
+		const __m128i eq = _mm_and_si128(_mm_and_si128(eq0, eq1), _mm_and_si128(eq2, eq3));
+
+		if (_mm_movemask_epi8(eq) != 0xFFFF)
+			break;
+	}
+#endif
+
+	for (; n + 16 <= len; n += 16)
+	{
+		const __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + n)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + n)));
+
+		const unsigned notEq = ~static_cast<unsigned>(_mm_movemask_epi8(eq)) & 0xFFFF;
+
+		if (notEq)
+			return n + firstBit(notEq);
+	}
+#endif // BINCMP_SSE2
+
+	while (n < len && a[n] == b[n])
+		++n;
+
+	return n;
+}
+
+
+inline uint32_t mixHash(uint32_t h)
+{
+	h ^= h >> 15;
+	h *= 0x2C1B3C6D;
+	h ^= h >> 12;
+
+	return h;
+}
+
+
+/**
+ *  \class  Resyncer
+ *  \brief  Finds where two byte windows become equal again - the rolling hashes of all cMatchLen bytes sequences of
+ *          the second window are put in a table and the first window sequences are looked up in it
+ */
+class Resyncer
+{
+public:
+	// Finds the offsets of the equal bytes with the least bytes skipped in both windows in total. Only anchors (the
+	// sequences with hash bits matching anchorMask) are put in the table so big windows need small tables - equal
+	// sequences have equal hashes so the matching anchors are found in both windows anyway.
+	bool find(const uint8_t* a, size_t aLen, const uint8_t* b, size_t bLen, uint32_t anchorMask, size_t skip[2])
+	{
+		if (aLen < cMatchLen || bLen < cMatchLen)
+			return false;
+
+		const size_t seqCount = bLen - cMatchLen + 1;
+
+		size_t tableSize = 1024;
+
+		while (tableSize < 2 * (seqCount / (anchorMask + 1)) + 1024)
+			tableSize *= 2;
+
+		_table.assign(tableSize, 0);
+
+		const size_t tableMask	= tableSize - 1;
+		const size_t maxEntries	= tableSize * 3 / 4;
+
+		uint32_t outMul = 1;
+
+		for (size_t i = 0; i < cMatchLen; ++i)
+			outMul *= cHashMul;
+
+		// Table entry is the sequence hash in the high half and its offset + 1 in the low half, 0 is an empty entry
+		size_t entriesCount = 0;
+
+		uint32_t h = rollingHash(b);
+
+		for (size_t j = 0; entriesCount < maxEntries; ++j)
+		{
+			const uint32_t key = mixHash(h);
+
+			if (((key >> 24) & anchorMask) == 0)
+			{
+				for (size_t idx = key & tableMask; ; idx = (idx + 1) & tableMask)
+				{
+					if (_table[idx] == 0)
+					{
+						_table[idx] = (static_cast<uint64_t>(key) << 32) | static_cast<uint64_t>(j + 1);
+						++entriesCount;
+						break;
+					}
+
+					// The first (nearest) sequence of that hash is kept
+					if (static_cast<uint32_t>(_table[idx] >> 32) == key)
+						break;
+				}
+			}
+
+			if (j + 1 == seqCount)
+				break;
+
+			h = h * cHashMul - b[j] * outMul + b[j + cMatchLen];
+		}
+
+		// Equal bytes before the anchors are looked for that far back - a match that starts that far after the best
+		// match found so far might still reach back past it
+		const size_t anchorSlack = (anchorMask != 0) ? 4 * (static_cast<size_t>(anchorMask) + 1) : cMatchLen;
+
+		size_t bestCost = SIZE_MAX;
+
+		h = rollingHash(a);
+
+		for (size_t i = 0; i + cMatchLen <= aLen; ++i)
+		{
+			if (bestCost != SIZE_MAX && i > bestCost + anchorSlack)
+				break;
+
+			const uint32_t key = mixHash(h);
+
+			if (((key >> 24) & anchorMask) == 0)
+			{
+				for (size_t idx = key & tableMask; _table[idx] != 0; idx = (idx + 1) & tableMask)
+				{
+					if (static_cast<uint32_t>(_table[idx] >> 32) != key)
+						continue;
+
+					size_t j = static_cast<size_t>(_table[idx] & 0xFFFFFFFF) - 1;
+
+					if (!std::memcmp(a + i, b + j, cMatchLen))
+					{
+						size_t matchI = i;
+
+						// Equal bytes before the anchor are not to be skipped
+						for (const size_t minI = (i > anchorSlack) ? i - anchorSlack : 0;
+								matchI > minI && j > 0 && a[matchI - 1] == b[j - 1]; --matchI, --j);
+
+						if (matchI + j < bestCost)
+						{
+							bestCost	= matchI + j;
+							skip[0]		= matchI;
+							skip[1]		= j;
+						}
+					}
+
+					break;
+				}
+			}
+
+			if (i + cMatchLen < aLen)
+				h = h * cHashMul - a[i] * outMul + a[i + cMatchLen];
+		}
+
+		return (bestCost != SIZE_MAX);
+	}
+
+private:
+	static uint32_t rollingHash(const uint8_t* seq)
+	{
+		uint32_t h = 0;
+
+		for (size_t i = 0; i < cMatchLen; ++i)
+			h = h * cHashMul + seq[i];
+
+		return h;
+	}
+
+	std::vector<uint64_t> _table;
+};
+
+
+struct ResyncWindow
+{
+	size_t		len;
+	uint32_t	anchorMask;
+};
+
+
+// Most diffs are a few changed bytes so the files are tried to be re-synchronized in small windows first
+constexpr ResyncWindow cResyncWindows[] =
+{
+	{ 256,					0 },
+	{ 4096,					0 },
+	{ 64 * 1024,			0 },
+	{ 1024 * 1024,			15 },
+	{ 16 * 1024 * 1024,		255 }
+};
+
+
+// Finds how many bytes are to be skipped in both files from pos so they are equal again. If they don't get equal in
+// the biggest window its bytes are all considered different.
+bool resync(MappedFile files[2], const uint64_t pos[2], Resyncer& resyncer, uint64_t skip[2])
+{
+	size_t len[2] = { 0, 0 };
+
+	for (const auto& window: cResyncWindows)
+	{
+		const size_t len1 = static_cast<size_t>(std::min(static_cast<uint64_t>(window.len), files[0].size() - pos[0]));
+		const size_t len2 = static_cast<size_t>(std::min(static_cast<uint64_t>(window.len), files[1].size() - pos[1]));
+
+		// Files ends reached in the previous window
+		if (len1 == len[0] && len2 == len[1])
+			break;
+
+		len[0] = len1;
+		len[1] = len2;
+
+		const uint8_t* a = files[0].data(pos[0], len[0]);
+		const uint8_t* b = files[1].data(pos[1], len[1]);
+
+		if (!a || !b)
+			return false;
+
+		size_t found[2];
+
+		if (resyncer.find(a, len[0], b, len[1], window.anchorMask, found))
+		{
+			skip[0] = found[0];
+			skip[1] = found[1];
+
+			return true;
+		}
+	}
+
+	skip[0] = len[0];
+	skip[1] = len[1];
+
+	return true;
+}
+
+
+void addDiff(std::vector<BinaryDiffRange>& diffs, const uint64_t off[2], const uint64_t len[2])
+{
+	if (len[0] == 0 && len[1] == 0)
+		return;
+
+	if (!diffs.empty())
+	{
+		BinaryDiffRange& last = diffs.back();
+
+		if (last.off[0] + last.len[0] == off[0] && last.off[1] + last.len[1] == off[1])
+		{
+			last.len[0] += len[0];
+			last.len[1] += len[1];
+
+			return;
+		}
+	}
+
+	diffs.push_back({ { off[0], off[1] }, { len[0], len[1] } });
+}
+
+
+const char cHexDigits[] = "0123456789ABCDEF";
+
+constexpr size_t cDumpRowLen = 16;
+
+
+void appendDumpRow(std::string& dump, uint64_t off, int offDigits, const uint8_t* bytes, size_t len)
+{
+	for (int i = offDigits - 1; i >= 0; --i)
+		dump += cHexDigits[(off >> (4 * i)) & 0xF];
+
+	dump += ' ';
+
+	for (size_t i = 0; i < cDumpRowLen; ++i)
+	{
+		dump += ' ';
+
+		if (i < len)
+		{
+			dump += cHexDigits[bytes[i] >> 4];
+			dump += cHexDigits[bytes[i] & 0xF];
+		}
+		else
+		{
+			dump += "  ";
+		}
+	}
+
+	dump += "  |";
+
+	for (size_t i = 0; i < len; ++i)
+		dump += (bytes[i] >= 0x20 && bytes[i] < 0x7F) ? static_cast<char>(bytes[i]) : '.';
+
+	dump += "|\n";
+}
+
+} // anonymous namespace
+
+
+bool isBinaryFile(const wchar_t* filePath)
+{
+	HANDLE hFile = ::CreateFileW(filePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	uint8_t head[8192];
+	DWORD readLen = 0;
+
+	const BOOL isRead = ::ReadFile(hFile, head, sizeof(head), &readLen, NULL);
+
+	::CloseHandle(hFile);
+
+	if (!isRead || readLen == 0)
+		return false;
+
+	// UTF-16 text is full of zero bytes
+	if (readLen >= 2 && ((head[0] == 0xFF && head[1] == 0xFE) || (head[0] == 0xFE && head[1] == 0xFF)))
+		return false;
+
+	return (std::memchr(head, 0, readLen) != nullptr);
+}
+
+
+bool compareBinaryFiles(const wchar_t* file1, const wchar_t* file2, std::vector<BinaryDiffRange>& diffs,
+		const std::atomic<bool>* cancelled, const BinaryCmpProgressFn& progress)
+{
+	diffs.clear();
+
+	MappedFile files[2];
+
+	if (!files[0].open(file1) || !files[1].open(file2))
+		return false;
+
+	const uint64_t size[2]	= { files[0].size(), files[1].size() };
+	const uint64_t total	= size[0] + size[1];
+
+	uint64_t pos[2] = { 0, 0 };
+
+	Resyncer resyncer;
+
+	while (pos[0] < size[0] && pos[1] < size[1])
+	{
+		if (cancelled && *cancelled)
+			return false;
+
+		if (progress)
+			progress(pos[0] + pos[1], total);
+
+		const size_t len = static_cast<size_t>(std::min({ static_cast<uint64_t>(cChunkLen),
+				size[0] - pos[0], size[1] - pos[1] }));
+
+		const uint8_t* a = files[0].data(pos[0], len);
+		const uint8_t* b = files[1].data(pos[1], len);
+
+		if (!a || !b)
+			return false;
+
+		const size_t equalLen = equalPrefix(a, b, len);
+
+		pos[0] += equalLen;
+		pos[1] += equalLen;
+
+		if (equalLen == len)
+			continue;
+
+		uint64_t skip[2];
+
+		if (!resync(files, pos, resyncer, skip))
+			return false;
+
+		addDiff(diffs, pos, skip);
+
+		pos[0] += skip[0];
+		pos[1] += skip[1];
+	}
+
+	// The rest of the longer file
+	const uint64_t tailLen[2] = { size[0] - pos[0], size[1] - pos[1] };
+
+	addDiff(diffs, pos, tailLen);
+
+	if (progress)
+		progress(total, total);
+
+	return true;
+}
+
+
+bool dumpBinaryDiffs(const wchar_t* filePath, int side, const std::vector<BinaryDiffRange>& diffs,
+		uint64_t maxBytes, std::string& dump)
+{
+	dump.clear();
+
+	MappedFile file;
+
+	if (!file.open(filePath))
+		return false;
+
+	uint64_t maxEnd = 0;
+
+	for (const auto& diff: diffs)
+		maxEnd = std::max({ maxEnd, diff.off[0] + diff.len[0], diff.off[1] + diff.len[1] });
+
+	// Same offsets width in both dumps
+	const int offDigits = (maxEnd > 0xFFFFFFFF) ? 16 : 8;
+
+	uint64_t dumpedLen = 0;
+	size_t dumpedCount = 0;
+
+	for (const auto& diff: diffs)
+	{
+		if (dumpedLen >= maxBytes)
+			break;
+
+		// The longer side of the range decides how much of it is shown in both dumps
+		const uint64_t rangeLen	= std::max(diff.len[0], diff.len[1]);
+		const uint64_t shownLen	= std::min(rangeLen, maxBytes - dumpedLen);
+		const uint64_t len		= std::min(diff.len[side], shownLen);
+
+		dumpedLen += shownLen;
+		++dumpedCount;
+
+		char header[128];
+
+		snprintf(header, sizeof(header), "@@ -0x%0*llX,%llu +0x%0*llX,%llu @@\n",
+				offDigits, static_cast<unsigned long long>(diff.off[0]), static_cast<unsigned long long>(diff.len[0]),
+				offDigits, static_cast<unsigned long long>(diff.off[1]), static_cast<unsigned long long>(diff.len[1]));
+
+		dump += header;
+
+		for (uint64_t rowOff = 0; rowOff < len; rowOff += cDumpRowLen)
+		{
+			const size_t rowLen = static_cast<size_t>(std::min(static_cast<uint64_t>(cDumpRowLen), len - rowOff));
+
+			const uint8_t* bytes = file.data(diff.off[side] + rowOff, rowLen);
+
+			if (!bytes)
+				return false;
+
+			appendDumpRow(dump, diff.off[side] + rowOff, offDigits, bytes, rowLen);
+		}
+
+		if (shownLen < rangeLen)
+			dump += "@@ ... @@\n";
+	}
+
+	if (dumpedCount < diffs.size())
+		dump += "@@ " + std::to_string(diffs.size() - dumpedCount) + " more differing ranges not shown @@\n";
+
+	return true;
+}
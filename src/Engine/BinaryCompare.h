@@ -0,0 +1,67 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Binary files compare - finds the differing byte ranges of two files read through memory mappings. Equal regions are
+ * skipped by SIMD chunk compares and after a mismatch the files are re-synchronized by rolling hashes of the bytes
+ * ahead so inserted and deleted bytes don't make the rest of the files differ. The differing ranges are turned into
+ * hex dumps to be compared and shown in the editor. Nothing here depends on Notepad++ or Scintilla.
+ */
+
+
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <functional>
+#include <atomic>
+
+
+// Bytes [off, off + len) of the first file differ from bytes [off, off + len) of the second one - one of the lengths
+// is 0 for inserted / deleted bytes
+struct BinaryDiffRange
+{
+	uint64_t	off[2];
+	uint64_t	len[2];
+};
+
+
+// Called with the bytes of both files compared so far and the bytes of both files in total
+using BinaryCmpProgressFn = std::function<void(uint64_t done, uint64_t total)>;
+
+
+/**
+ *  \brief  Returns true if the file start looks like binary data (it contains zero bytes and is not UTF-16 text).
+ */
+bool isBinaryFile(const wchar_t* filePath);
+
+/**
+ *  \brief  Finds the differing ranges of file1 and file2 - no ranges means the files are the same.
+ *          Returns false if cancelled or if any of the files cannot be read.
+ */
+bool compareBinaryFiles(const wchar_t* file1, const wchar_t* file2, std::vector<BinaryDiffRange>& diffs,
+		const std::atomic<bool>* cancelled = nullptr, const BinaryCmpProgressFn& progress = nullptr);
+
+/**
+ *  \brief  Writes the hex dump of the file bytes of the diffs side (0 - file1, 1 - file2) - 16 bytes per line with
+ *          their file offset. Each range starts with a header line that is the same in both dumps so the ranges of
+ *          the two dumps line up when compared. Only up to maxBytes of the ranges are dumped.
+ *          Returns false if the file cannot be read.
+ */
+bool dumpBinaryDiffs(const wchar_t* filePath, int side, const std::vector<BinaryDiffRange>& diffs,
+		uint64_t maxBytes, std::string& dump);
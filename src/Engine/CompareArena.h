@@ -0,0 +1,286 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compare scoped monotonic arena - the short-lived buffers of the words and chars compares (one or more per compared
+ * line) are carved out of big blocks instead of going through the heap one by one. Each thread has its own arena that
+ * is active while a ScopedCompareArena lives on that thread and everything allocated from it is dropped at once
+ * when the scope ends - the blocks are kept for the next compare.
+ *
+ * ArenaVector containers must not outlive the scope they are created in and must not be grown by other threads than
+ * the one that created them (they can be read by any thread). Created where no arena is active they use the heap.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <memory>
+#include <vector>
+#include <type_traits>
+
+
+class CompareArena
+{
+public:
+	// Allocations are carved out of blocks of that size at least
+	static constexpr size_t cBlockSize = 256 * 1024;
+
+	// Blocks are kept for the next compares up to that size in total when the arena is reset
+	static constexpr size_t cRetainedSize = 8 * 1024 * 1024;
+
+	struct Mark
+	{
+		size_t	block;
+		size_t	used;
+	};
+
+	CompareArena() = default;
+	CompareArena(const CompareArena&) = delete;
+	CompareArena& operator=(const CompareArena&) = delete;
+
+	~CompareArena()
+	{
+		for (auto& block: _blocks)
+			::operator delete(block.data);
+	}
+
+	// The arena of the compare run by the calling thread, nullptr if none is active
+	static CompareArena* active()
+	{
+		return activeRef();
+	}
+
+	inline void* allocate(size_t bytes, size_t align)
+	{
+		if (_current < _blocks.size())
+		{
+			const size_t pos = (_used + align - 1) & ~(align - 1);
+
+			if (pos + bytes <= _blocks[_current].size)
+			{
+				_used = pos + bytes;
+
+				return _blocks[_current].data + pos;
+			}
+		}
+
+		return allocateInNextBlock(bytes, align);
+	}
+
+	inline Mark mark() const
+	{
+		return { _current, _used };
+	}
+
+	// Drops everything allocated after the mark in O(1) - marks are to be rewound in reverse order of taking them
+	inline void rewind(const Mark& mark)
+	{
+		_current	= mark.block;
+		_used		= mark.used;
+	}
+
+	// Drops everything allocated - releases the blocks over the retained size
+	void reset()
+	{
+		size_t retained = 0;
+		size_t keptCount = 0;
+
+		for (; keptCount < _blocks.size() && retained + _blocks[keptCount].size <= cRetainedSize; ++keptCount)
+			retained += _blocks[keptCount].size;
+
+		for (size_t i = keptCount; i < _blocks.size(); ++i)
+			::operator delete(_blocks[i].data);
+
+		_blocks.resize(keptCount);
+
+		_current	= 0;
+		_used		= 0;
+	}
+
+private:
+	friend class ScopedCompareArena;
+
+	struct Block
+	{
+		char*	data;
+		size_t	size;
+	};
+
+	static CompareArena*& activeRef()
+	{
+		thread_local CompareArena* arena = nullptr;
+
+		return arena;
+	}
+
+	static CompareArena& threadArena()
+	{
+		thread_local CompareArena arena;
+
+		return arena;
+	}
+
+	// Moves to the next kept block if it is big enough or puts a new block in its place - blocks after the current one
+	// are free as the marks are rewound in order
+	void* allocateInNextBlock(size_t bytes, size_t align)
+	{
+		const size_t next = _blocks.empty() ? 0 : _current + 1;
+		const size_t needed = bytes + align;
+
+		if (next >= _blocks.size() || _blocks[next].size < needed)
+		{
+			const size_t size = (needed > cBlockSize) ? needed : cBlockSize;
+
+			_blocks.insert(_blocks.begin() + next, Block { static_cast<char*>(::operator new(size)), size });
+		}
+
+		_current	= next;
+		_used		= 0;
+
+		return allocate(bytes, align);
+	}
+
+	std::vector<Block>	_blocks;
+	size_t				_current {0};
+	size_t				_used {0};
+};
+
+
+/**
+ *  \class  ScopedCompareArena
+ *  \brief  Activates the calling thread arena for the scope - the arena is reset when the outermost scope ends
+ */
+class ScopedCompareArena
+{
+public:
+	ScopedCompareArena()
+	{
+		if (!CompareArena::activeRef())
+		{
+			CompareArena::activeRef() = &CompareArena::threadArena();
+			_isOwner = true;
+		}
+	}
+
+	~ScopedCompareArena()
+	{
+		if (_isOwner)
+		{
+			CompareArena::activeRef()->reset();
+			CompareArena::activeRef() = nullptr;
+		}
+	}
+
+	ScopedCompareArena(const ScopedCompareArena&) = delete;
+	ScopedCompareArena& operator=(const ScopedCompareArena&) = delete;
+
+private:
+	bool _isOwner {false};
+};
+
+
+/**
+ *  \class  ScopedArenaRewind
+ *  \brief  Drops what the scope allocated from the active arena when it ends - keeps the arena from growing with
+ *          the count of the compared blocks / lines
+ */
+class ScopedArenaRewind
+{
+public:
+	ScopedArenaRewind() : _arena(CompareArena::active())
+	{
+		if (_arena)
+			_mark = _arena->mark();
+	}
+
+	~ScopedArenaRewind()
+	{
+		if (_arena)
+			_arena->rewind(_mark);
+	}
+
+	ScopedArenaRewind(const ScopedArenaRewind&) = delete;
+	ScopedArenaRewind& operator=(const ScopedArenaRewind&) = delete;
+
+private:
+	CompareArena*		_arena;
+	CompareArena::Mark	_mark {0, 0};
+};
+
+
+/**
+ *  \class  ArenaAllocator
+ *  \brief  Allocates from the arena active on the thread that constructs it (a copy constructed container gets the
+ *          arena of the copying thread) or from the heap if none is active. Arena memory is never freed one by one.
+ */
+template <typename T>
+class ArenaAllocator
+{
+public:
+	using value_type = T;
+
+	using propagate_on_container_move_assignment	= std::true_type;
+	using propagate_on_container_swap				= std::true_type;
+
+	ArenaAllocator() noexcept : _arena(CompareArena::active()) {}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) noexcept : _arena(other._arena) {}
+
+	ArenaAllocator select_on_container_copy_construction() const
+	{
+		return ArenaAllocator();
+	}
+
+	T* allocate(size_t n)
+	{
+		if (_arena)
+			return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T)));
+
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T* p, size_t n) noexcept
+	{
+		if (!_arena)
+			std::allocator<T>().deallocate(p, n);
+	}
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& rhs) const noexcept
+	{
+		return (_arena == rhs._arena);
+	}
+
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U>& rhs) const noexcept
+	{
+		return (_arena != rhs._arena);
+	}
+
+private:
+	template <typename U>
+	friend class ArenaAllocator;
+
+	CompareArena* _arena;
+};
+
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,138 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <memory>
+#include <string>
+#include <regex>
+
+#include "LinearRegex.h"
+#include "RegexCache.h"
+
+
+// Views of the compared documents - the same as Notepad++ ones
+#ifndef MAIN_VIEW
+#define MAIN_VIEW	0
+#define SUB_VIEW	1
+#endif
+
+
+struct CompareOptions
+{
+	CompareOptions()
+	{
+		selections[0] = std::make_pair(-1, -1);
+		selections[1] = std::make_pair(-1, -1);
+	}
+
+	inline void setIgnoreRegex(const std::wstring& regexStr)
+	{
+		if (!regexStr.empty())
+		{
+			CompiledIgnoreRegex compiled = getCompiledIgnoreRegex(regexStr);
+
+			ignoreRegex = std::move(compiled.regex);
+			ignoreLinearRegex = std::move(compiled.linearRegex);
+		}
+		else
+		{
+			ignoreRegex = nullptr;
+			ignoreLinearRegex = nullptr;
+		}
+
+		ignoreRegexStr = regexStr;
+	}
+
+	inline void clearIgnoreRegex()
+	{
+		ignoreRegex = nullptr;
+		ignoreLinearRegex = nullptr;
+		ignoreRegexStr.clear();
+	}
+
+	// The compiled regexes are shared with the other options
+	inline void copyFrom(const CompareOptions& other)
+	{
+		newFileViewId			= other.newFileViewId;
+		findUniqueMode			= other.findUniqueMode;
+		alignAllMatches			= other.alignAllMatches;
+		neverMarkIgnored		= other.neverMarkIgnored;
+		histogramDiff			= other.histogramDiff;
+		verifyLineMatches		= other.verifyLineMatches;
+		detectMoves				= other.detectMoves;
+		detectCharDiffs			= other.detectCharDiffs;
+		bestSeqChangedLines		= other.bestSeqChangedLines;
+		ignoreEmptyLines		= other.ignoreEmptyLines;
+		ignoreChangedSpaces		= other.ignoreChangedSpaces;
+		ignoreAllSpaces			= other.ignoreAllSpaces;
+		ignoreCase				= other.ignoreCase;
+		recompareOnChange		= other.recompareOnChange;
+		backgroundCompare		= other.backgroundCompare;
+		changedThresholdPercent	= other.changedThresholdPercent;
+		diffCostLimit			= other.diffCostLimit;
+		bandedMatchLines		= other.bandedMatchLines;
+		memoryBudgetMB			= other.memoryBudgetMB;
+		selectionCompare		= other.selectionCompare;
+		selections[0]			= other.selections[0];
+		selections[1]			= other.selections[1];
+
+		ignoreRegex				= other.ignoreRegex;
+		ignoreLinearRegex		= other.ignoreLinearRegex;
+		ignoreRegexStr			= other.ignoreRegexStr;
+	}
+
+	int		newFileViewId;
+
+	bool	findUniqueMode;
+
+	bool	alignAllMatches;
+	bool	neverMarkIgnored;
+	bool	histogramDiff;
+	bool	verifyLineMatches;
+	bool	detectMoves;
+	bool	detectCharDiffs;
+	bool	bestSeqChangedLines;
+	bool	ignoreEmptyLines;
+	bool	ignoreChangedSpaces;
+	bool	ignoreAllSpaces;
+	bool	ignoreCase;
+
+	bool	recompareOnChange;
+	bool	backgroundCompare;
+
+	std::shared_ptr<const std::wregex>	ignoreRegex;
+	std::shared_ptr<const LinearRegex>	ignoreLinearRegex;	// Linear time matcher of ignoreRegex if it supports it
+	std::wstring						ignoreRegexStr;
+
+	int		changedThresholdPercent;
+
+	// Max edit cost searched by the line diff for each split point, 0 means unlimited
+	int		diffCostLimit;
+
+	// Changed blocks lines are matched only to that many lines of the other block around the diagonal, 0 means all
+	int		bandedMatchLines;
+
+	// Memory budget of the compare in MB, 0 means no limit
+	int		memoryBudgetMB;
+
+	bool	selectionCompare;
+
+	std::pair<intptr_t, intptr_t>	selections[2];
+};
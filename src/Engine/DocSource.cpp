@@ -0,0 +1,238 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <algorithm>
+
+#include "DocSource.h"
+
+
+std::vector<char> DocSource::text(intptr_t startPos, intptr_t endPos) const
+{
+	if (endPos <= startPos)
+		return std::vector<char>(1, 0);
+
+	std::vector<char> txt(endPos - startPos + 1, 0);
+
+	const char* src = rangePointer(startPos, endPos - startPos);
+
+	if (src)
+		std::memcpy(txt.data(), src, endPos - startPos);
+
+	return txt;
+}
+
+
+intptr_t DocSource::lineFromPosition(intptr_t pos) const
+{
+	intptr_t first	= 0;
+	intptr_t last	= linesCount() - 1;
+
+	while (first < last)
+	{
+		const intptr_t mid = first + (last - first + 1) / 2;
+
+		if (lineStart(mid) <= pos)
+			first = mid;
+		else
+			last = mid - 1;
+	}
+
+	return first;
+}
+
+
+void BufferDocSource::setText(const char* text, intptr_t len, int codepage)
+{
+	_text		= text;
+	_length		= len;
+	_codepage	= codepage;
+
+	if (_codepage == CP_UTF8 && _length >= 3 && _text && std::memcmp(_text, "\xEF\xBB\xBF", 3) == 0)
+	{
+		_text	+= 3;
+		_length	-= 3;
+	}
+
+	findLineStarts();
+}
+
+
+void BufferDocSource::clearText()
+{
+	_text	= nullptr;
+	_length	= 0;
+
+	_lineStarts.assign(1, 0);
+}
+
+
+// Lines are split as Scintilla does it - by CR, LF or CRLF. Text ending with EOL has an empty last line.
+void BufferDocSource::findLineStarts()
+{
+	_lineStarts.assign(1, 0);
+
+	// Rough guess to avoid too many reallocations
+	_lineStarts.reserve(static_cast<size_t>(_length / 40) + 1);
+
+	for (intptr_t pos = 0; pos < _length; ++pos)
+	{
+		const char ch = _text[pos];
+
+		if ((ch == '\n') || ((ch == '\r') && (pos + 1 == _length || _text[pos + 1] != '\n')))
+			_lineStarts.push_back(pos + 1);
+	}
+}
+
+
+intptr_t BufferDocSource::linesCount() const
+{
+	return static_cast<intptr_t>(_lineStarts.size());
+}
+
+
+intptr_t BufferDocSource::length() const
+{
+	return _length;
+}
+
+
+int BufferDocSource::codepage() const
+{
+	return _codepage;
+}
+
+
+bool BufferDocSource::defaultLineEnds() const
+{
+	return true;
+}
+
+
+intptr_t BufferDocSource::lineStart(intptr_t line) const
+{
+	if (line < 0)
+		return 0;
+
+	return _lineStarts[std::min(line, static_cast<intptr_t>(_lineStarts.size()) - 1)];
+}
+
+
+intptr_t BufferDocSource::lineEnd(intptr_t line) const
+{
+	if (line < 0)
+		return 0;
+
+	if (line + 1 >= static_cast<intptr_t>(_lineStarts.size()))
+		return _length;
+
+	intptr_t end = _lineStarts[line + 1];
+
+	if (end > 0 && _text[end - 1] == '\n')
+		--end;
+
+	if (end > _lineStarts[line] && _text[end - 1] == '\r')
+		--end;
+
+	return end;
+}
+
+
+const char* BufferDocSource::rangePointer(intptr_t startPos, intptr_t len) const
+{
+	if (startPos < 0 || len < 0 || startPos + len > _length)
+		return nullptr;
+
+	// Empty texts might have no buffer
+	return _text ? _text + startPos : "";
+}
+
+
+intptr_t BufferDocSource::lineFromPosition(intptr_t pos) const
+{
+	if (pos <= 0)
+		return 0;
+
+	return static_cast<intptr_t>(std::upper_bound(_lineStarts.begin(), _lineStarts.end(), pos) -
+			_lineStarts.begin()) - 1;
+}
+
+
+bool MappedFileDocSource::open(const wchar_t* filePath, int codepage)
+{
+	close();
+
+	_hFile = ::CreateFileW(filePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+
+	if (!::GetFileSizeEx(_hFile, &fileSize) || (static_cast<uint64_t>(fileSize.QuadPart) > SIZE_MAX / 2))
+	{
+		close();
+		return false;
+	}
+
+	// Empty files cannot be mapped
+	if (fileSize.QuadPart == 0)
+	{
+		setText(nullptr, 0, codepage);
+		return true;
+	}
+
+	_hMapping = ::CreateFileMappingW(_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	if (_hMapping == NULL)
+	{
+		close();
+		return false;
+	}
+
+	_view = static_cast<const char*>(::MapViewOfFile(_hMapping, FILE_MAP_READ, 0, 0, 0));
+
+	if (_view == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	setText(_view, static_cast<intptr_t>(fileSize.QuadPart), codepage);
+
+	return true;
+}
+
+
+void MappedFileDocSource::close()
+{
+	clearText();
+
+	if (_view)
+		::UnmapViewOfFile(_view);
+
+	if (_hMapping != NULL)
+		::CloseHandle(_hMapping);
+
+	if (_hFile != INVALID_HANDLE_VALUE)
+		::CloseHandle(_hFile);
+
+	_hFile		= INVALID_HANDLE_VALUE;
+	_hMapping	= NULL;
+	_view		= nullptr;
+}
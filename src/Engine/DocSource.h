@@ -0,0 +1,148 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Read-only text source the compare engine reads the compared documents through.
+ * Positions and lines are the same as Scintilla's - byte positions in the document text and zero based lines, the
+ * line end excludes the EOL chars. Nothing here depends on Notepad++ or Scintilla - the plugin implements the
+ * interface for the Scintilla views itself.
+ */
+
+
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <utility>
+
+
+/**
+ *  \class  DocSource
+ *  \brief  Document text access interface
+ */
+class DocSource
+{
+public:
+	virtual ~DocSource() = default;
+
+	virtual intptr_t linesCount() const = 0;
+	virtual intptr_t length() const = 0;
+	virtual int codepage() const = 0;
+
+	// Are CR, LF and CRLF the only line ends (no Unicode line ends)?
+	virtual bool defaultLineEnds() const = 0;
+
+	virtual intptr_t lineStart(intptr_t line) const = 0;
+	virtual intptr_t lineEnd(intptr_t line) const = 0;
+
+	// Direct pointer to the text in [startPos, startPos + len) or nullptr if not available
+	virtual const char* rangePointer(intptr_t startPos, intptr_t len) const = 0;
+
+	// Returns the text in [startPos, endPos) with terminating zero
+	virtual std::vector<char> text(intptr_t startPos, intptr_t endPos) const;
+
+	// Line of the position - found by the line starts by default
+	virtual intptr_t lineFromPosition(intptr_t pos) const;
+};
+
+
+/**
+ *  \class  BufferDocSource
+ *  \brief  Reads a text buffer in memory (not owned) - the line starts are found once when the text is set
+ */
+class BufferDocSource : public DocSource
+{
+public:
+	BufferDocSource() = default;
+	BufferDocSource(const BufferDocSource&) = delete;
+	BufferDocSource& operator=(const BufferDocSource&) = delete;
+
+	intptr_t linesCount() const override;
+	intptr_t length() const override;
+	int codepage() const override;
+	bool defaultLineEnds() const override;
+
+	intptr_t lineStart(intptr_t line) const override;
+	intptr_t lineEnd(intptr_t line) const override;
+
+	const char* rangePointer(intptr_t startPos, intptr_t len) const override;
+
+	intptr_t lineFromPosition(intptr_t pos) const override;
+
+protected:
+	// The codepage is the one the text is in. UTF-8 BOM if present is skipped.
+	void setText(const char* text, intptr_t len, int codepage);
+	void clearText();
+
+	const char*	_text {nullptr};
+
+private:
+	void findLineStarts();
+
+	intptr_t	_length {0};
+	int			_codepage {CP_UTF8};
+
+	std::vector<intptr_t>	_lineStarts {0};
+};
+
+
+/**
+ *  \class  MemoryDocSource
+ *  \brief  Reads a text kept in memory by the source itself
+ */
+class MemoryDocSource : public BufferDocSource
+{
+public:
+	MemoryDocSource(std::vector<char>&& text, int codepage = CP_UTF8) : _buffer(std::move(text))
+	{
+		setText(_buffer.data(), static_cast<intptr_t>(_buffer.size()), codepage);
+	}
+
+private:
+	std::vector<char> _buffer;
+};
+
+
+/**
+ *  \class  MappedFileDocSource
+ *  \brief  Reads a file on disk through a read-only memory mapping - the file is not loaded as a whole
+ */
+class MappedFileDocSource : public BufferDocSource
+{
+public:
+	MappedFileDocSource() = default;
+
+	~MappedFileDocSource()
+	{
+		close();
+	}
+
+	// The codepage is the one the file text is in (UTF-8 by default)
+	bool open(const wchar_t* filePath, int codepage = CP_UTF8);
+	void close();
+
+	inline bool isOpen() const
+	{
+		return (_text != nullptr) || (_hFile != INVALID_HANDLE_VALUE);
+	}
+
+private:
+	HANDLE		_hFile {INVALID_HANDLE_VALUE};
+	HANDLE		_hMapping {NULL};
+	const char*	_view {nullptr};
+};
@@ -21,25 +21,30 @@
 
 #include <climits>
 #include <cstdint>
+#include <cstring>
 #include <exception>
 #include <utility>
 #include <vector>
-#include <unordered_set>
-#include <set>
-#include <unordered_map>
 #include <map>
+#include <list>
 #include <algorithm>
 #include <functional>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <random>
 
 #include <windows.h>
 
 #include "Engine.h"
+#include "DocSource.h"
+#include "LineHash.h"
 #include "diff.h"
-#include "ProgressDlg.h"
-
-#define MULTITHREAD		0
-
-#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+#include "histogram_diff.h"
+#include "Workload.h"
+#include "CompareArena.h"
+#include "Trace.h"
+#include "EngineLog.h"
 
 #if defined(__MINGW32__) && !defined(_GLIBCXX_HAS_GTHREADS)
 #include "../mingw-std-threads/mingw.thread.h"
@@ -49,7 +54,17 @@
 #include <mutex>
 #endif // __MINGW32__ ...
 
-#endif // MULTITHREAD
+#ifndef MULTITHREAD
+#define MULTITHREAD		1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define WORDS_SSE2		1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
 
 
 namespace {
@@ -119,35 +134,60 @@ struct Word
 };
 
 
-struct Char
-{
-	Char(wchar_t c, intptr_t p) : ch(c), pos(p) {}
+// Lines longer than that (in UTF-16 units) are not compared by chars and so not paired with similar lines - they are
+// just marked as changed. Keeps the lines convergence (quadratic in the lines lengths) from hanging on huge lines.
+constexpr intptr_t cMaxLineCharsLen = 128 * 1024;
 
-	wchar_t ch;
-	intptr_t pos;
+// Changed sections longer than that are char compared with limited diff cost - minified sources or encoded data
+// sections can have a lot of scattered differences
+constexpr intptr_t	cLongSectionLen				= 16 * 1024;
+constexpr int		cLongSectionDiffCostLimit	= 1024;
 
-	inline bool operator==(const Char& rhs) const
+
+/**
+ *  \class  SectionChars
+ *  \brief  Chars of a line section and their byte positions. Positions are kept as runs of consecutive positions
+ *          (mostly single byte text has few of them) so long sections take a little more than their text.
+ */
+class SectionChars
+{
+public:
+	inline void add(wchar_t ch, intptr_t pos)
 	{
-		return (ch == rhs.ch);
+		if (_runs.empty() || (_runs.back().pos + (size() - _runs.back().idx) != pos))
+			_runs.push_back({ size(), pos });
+
+		chars.push_back(ch);
 	}
 
-	inline bool operator!=(const Char& rhs) const
+	inline intptr_t size() const
 	{
-		return (ch != rhs.ch);
+		return static_cast<intptr_t>(chars.size());
 	}
 
-	inline bool operator==(wchar_t rhs) const
+	// Returns the byte position of the char at idx
+	inline intptr_t pos(intptr_t idx) const
 	{
-		return (ch == rhs);
+		auto run = std::upper_bound(_runs.begin(), _runs.end(), idx,
+				[](intptr_t i, const PosRun& r) { return i < r.idx; }) - 1;
+
+		return run->pos + (idx - run->idx);
 	}
 
-	inline bool operator!=(wchar_t rhs) const
+	ArenaVector<wchar_t> chars;
+
+private:
+	struct PosRun
 	{
-		return (ch != rhs);
-	}
+		intptr_t idx;
+		intptr_t pos;
+	};
+
+	ArenaVector<PosRun> _runs;
 };
 
 
+
 struct DocCmpInfo
 {
 	int			view;
@@ -155,8 +195,39 @@ struct DocCmpInfo
 
 	int			blockDiffMask;
 
-	std::vector<Line>				lines;
-	std::unordered_set<intptr_t>	nonUniqueLines;
+	std::vector<Line>	lines;
+
+	// Hash variants of each section line (ignored empty lines included) to be kept in the line hashes cache, empty if
+	// not computed
+	std::vector<LineHashVariants>	hashVariants;
+
+	// Bit per lines entry - set if the line occurs in the other document as well
+	std::vector<bool>	nonUniqueLines;
+
+	inline bool isNonUnique(intptr_t lineIdx) const
+	{
+		return (lineIdx < static_cast<intptr_t>(nonUniqueLines.size()) && nonUniqueLines[lineIdx]);
+	}
+};
+
+
+// Dense class IDs of the compared lines - lines with equal hashes get equal IDs, numbered from 0 in order of
+// appearance. The line diff compares the 32-bit IDs instead of the Line structs (half the memory traffic) and the
+// per-class data (occurrence counts, move candidates) is kept in plain arrays indexed by ID.
+struct LineClasses
+{
+	inline void clear()
+	{
+		ids[0].clear();
+		ids[1].clear();
+		count = 0;
+		valid = false;
+	}
+
+	// The class ID of each doc1 / doc2 line (the line numbers are in the parallel DocCmpInfo::lines)
+	std::vector<uint32_t>	ids[2];
+	uint32_t				count {0};
+	bool					valid {false};
 };
 
 
@@ -176,6 +247,19 @@ struct blockDiffInfo
 	std::vector<diffLine>	changedLines;
 	std::vector<section_t>	moves;
 
+	// Index in moves of the move containing each block line (-1 if the line is not moved)
+	std::vector<intptr_t>	lineMoves;
+
+	inline void addMove(intptr_t blockLen, intptr_t off, intptr_t len)
+	{
+		if (lineMoves.empty())
+			lineMoves.resize(blockLen, -1);
+
+		std::fill(lineMoves.begin() + off, lineMoves.begin() + off + len, static_cast<intptr_t>(moves.size()));
+
+		moves.emplace_back(off, len);
+	}
+
 	inline intptr_t movedCount() const
 	{
 		intptr_t count = 0;
@@ -186,29 +270,37 @@ struct blockDiffInfo
 		return count;
 	}
 
+	inline const section_t* getMove(intptr_t line) const
+	{
+		if (line < 0 || line >= static_cast<intptr_t>(lineMoves.size()) || lineMoves[line] < 0)
+			return nullptr;
+
+		return &moves[lineMoves[line]];
+	}
+
 	inline intptr_t movedSection(intptr_t line) const
 	{
-		for (const auto& move: moves)
-		{
-			if (line >= move.off && line < move.off + move.len)
-				return move.len;
-		}
+		const section_t* move = getMove(line);
 
-		return 0;
+		return move ? move->len : 0;
 	}
 
 	inline bool getNextUnmoved(intptr_t& line) const
 	{
-		for (const auto& move: moves)
+		const section_t* move = getMove(line);
+
+		if (!move)
+			return false;
+
+		// Moves can be adjacent - skip them all
+		do
 		{
-			if (line >= move.off && line < move.off + move.len)
-			{
-				line = move.off + move.len;
-				return true;
-			}
+			line = move->off + move->len;
+			move = getMove(line);
 		}
+		while (move);
 
-		return false;
+		return true;
 	}
 };
 
@@ -224,6 +316,56 @@ struct CompareInfo
 
 	// Output data - filled by the compare engine
 	std::vector<diffInfo>	blockDiffs;
+
+	// The documents lines classes - filled on demand, not kept for the incremental re-compare
+	LineClasses				classes;
+};
+
+} // anonymous namespace
+
+
+struct CompareState
+{
+	// The compared documents and their size at the time of the compare
+	intptr_t	docId[2];
+	intptr_t	linesCount[2];
+	intptr_t	length[2];
+
+	// Start of the line before the last one (-1 if none) and the hash of the text from there to the end - a document
+	// still having it at the same position has only been appended to
+	intptr_t	tailStart[2];
+	uint64_t	tailHash[2];
+
+	CompareInfo	cmpInfo;
+
+	// The marks set in the views
+	DiffMap_t									diffMap[2];
+	std::vector<std::pair<intptr_t, intptr_t>>	changedText[2];
+};
+
+
+namespace {
+
+
+// The changed blocks lines grouped by line class (in blocks and lines order within a class) - used to quickly find the
+// lines matching the one being looked up when detecting moves
+struct MoveCandidates
+{
+	struct Candidate
+	{
+		diffInfo*	matchDiff;
+		intptr_t	matchOff;
+	};
+
+	// The candidates of class ID are [start[ID], start[ID + 1])
+	struct Group
+	{
+		std::vector<Candidate>	candidates;
+		std::vector<intptr_t>	start;
+	};
+
+	Group in1;
+	Group in2;
 };
 
 
@@ -292,15 +434,34 @@ struct LinesConv
 		line1 = l1;
 		line2 = l2;
 	}
+};
+
+
+// The best converging lines pairs of two changed blocks grouped by line1 - the pairs of a group are of equal
+// convergence and ordered by line2
+struct OrderedConvergence
+{
+	inline intptr_t linesCount1() const
+	{
+		return start.empty() ? 0 : static_cast<intptr_t>(start.size()) - 1;
+	}
 
-	bool operator<(const LinesConv& rhs) const
+	inline const LinesConv* begin(intptr_t line1) const
 	{
-		return ((conv > rhs.conv) || ((conv == rhs.conv) && (line2 < rhs.line2)));
+		return pairs.data() + start[line1];
 	}
-};
 
+	inline const LinesConv* end(intptr_t line1) const
+	{
+		return pairs.data() + start[line1 + 1];
+	}
+
+	std::vector<LinesConv>	pairs;
+
+	// The pairs of line1 are [start[line1], start[line1 + 1])
+	std::vector<intptr_t>	start;
+};
 
-const uint64_t cHashSeed = 0x84222325;
 
 template<typename CharT>
 inline uint64_t Hash(uint64_t hval, CharT letter)
@@ -336,2162 +497,5617 @@ void swap(DocCmpInfo& lhs, DocCmpInfo& rhs)
 }
 
 
-inline uint64_t getSectionRangeHash(uint64_t hashSeed, std::vector<wchar_t>& sec, intptr_t pos, intptr_t endPos,
-		const CompareOptions& options)
+// Copy of the compared section text (and the Scintilla document info the engine needs) taken on the UI thread
+// so that the compare can be run by a worker thread without calling Scintilla
+struct DocSnapshot : public DocSource
 {
-	if (pos >= endPos)
-		return hashSeed;
+	intptr_t	docLinesCount {0};
+	intptr_t	docLength {0};
+	int			docCodepage {0};
+	bool		docDefaultLineEnds {true};
 
-	if (options.ignoreCase)
+	intptr_t	firstLine {0};
+	intptr_t	textStart {0};
+
+	std::vector<char>		docText;
+	std::vector<intptr_t>	lineStarts;
+	std::vector<intptr_t>	lineEnds;
+
+	inline intptr_t lineIdx(intptr_t line) const
 	{
-		const wchar_t storedChar = sec[endPos];
+		line -= firstLine;
 
-		sec[endPos] = L'\0';
+		if (line < 0)
+			return 0;
 
-		::CharLowerW((LPWSTR)sec.data() + pos);
+		return std::min(line, static_cast<intptr_t>(lineStarts.size()) - 1);
+	}
 
-		sec[endPos] = storedChar;
+	intptr_t linesCount() const override
+	{
+		return docLinesCount;
 	}
 
-	for (; pos < endPos; ++pos)
+	intptr_t length() const override
 	{
-		if (options.ignoreAllSpaces && (sec[pos] == L' ' || sec[pos] == L'\t'))
-			continue;
+		return docLength;
+	}
 
-		if (options.ignoreChangedSpaces && (sec[pos] == L' ' || sec[pos] == L'\t'))
-		{
-			hashSeed = Hash(hashSeed, L' ');
+	int codepage() const override
+	{
+		return docCodepage;
+	}
 
-			while (++pos < endPos && (sec[pos] == L' ' || sec[pos] == L'\t'));
+	bool defaultLineEnds() const override
+	{
+		return docDefaultLineEnds;
+	}
 
-			if (pos == endPos)
-				return hashSeed;
-		}
+	intptr_t lineStart(intptr_t line) const override
+	{
+		return lineStarts.empty() ? 0 : lineStarts[lineIdx(line)];
+	}
 
-		hashSeed = Hash(hashSeed, sec[pos]);
+	intptr_t lineEnd(intptr_t line) const override
+	{
+		return lineEnds.empty() ? 0 : lineEnds[lineIdx(line)];
 	}
 
-	return hashSeed;
-}
+	const char* rangePointer(intptr_t startPos, intptr_t) const override
+	{
+		return docText.data() + (startPos - textStart);
+	}
+};
 
 
-uint64_t getRegexIgnoreLineHash(uint64_t hashSeed, int codepage, const std::vector<char>& line,
-	const CompareOptions& options)
+/**
+ *  \class  StatsCounters
+ *  \brief  Collects the CompareStats of the running compare. Counters are updated by the worker threads too - they
+ *          should be added in bulk (once per chunk / block / thread) rather than per line to keep the cost negligible.
+ */
+class StatsCounters
 {
-	const int len = static_cast<int>(line.size());
-
-	if (len == 0)
-		return hashSeed;
-
-	const int wLen = ::MultiByteToWideChar(codepage, 0, line.data(), len, NULL, 0);
-
-	std::vector<wchar_t> wLine(wLen);
-
-	::MultiByteToWideChar(codepage, 0, line.data(), len, wLine.data(), wLen);
-
-#if !defined(MULTITHREAD) || (MULTITHREAD == 0)
-	LOGD(LOG_ALGO, "line len " + std::to_string(len) + " to wide char len " + std::to_string(wLen) + "\n");
-#endif
-
-	std::regex_iterator<std::vector<wchar_t>::iterator> rit(wLine.begin(), wLine.end(), *options.ignoreRegex);
-	std::regex_iterator<std::vector<wchar_t>::iterator> rend;
-
-	intptr_t pos = 0;
-	intptr_t endPos = wLen - 1;
-
-	if (options.ignoreChangedSpaces && (wLine[pos] == L' ' || wLine[pos] == L'\t'))
+public:
+	void reset()
 	{
-		while (++pos < endPos && (wLine[pos] == L' ' || wLine[pos] == L'\t'));
-
-		if (pos == endPos)
-			return hashSeed;
+		_phase = CompareStats::PHASES_COUNT;
+
+		for (double& ms : _phaseMs)
+			ms = 0.;
+
+		resultCached		= false;
+		diffApproximated	= false;
+		linesHashed			= 0;
+		diffCalcRuns		= 0;
+		linesEditDistance	= 0;
+		convPairsScored		= 0;
+		convPairsPruned		= 0;
+
+		budgetBoundedDiff		= false;
+		budgetBandedBlocks		= 0;
+		budgetLinesOnlyBlocks	= 0;
+		budgetSkippedCharDiffs	= 0;
 	}
 
-	while (rit != rend)
+	// Ends the timing of the current phase (if any) and starts the given one
+	void startPhase(CompareStats::Phase phase)
 	{
-#if !defined(MULTITHREAD) || (MULTITHREAD == 0)
-		LOGD(LOG_ALGO, "pos " + std::to_string(rit->position()) + ", len " + std::to_string(rit->length()) + "\n");
-#endif
+		const auto now = std::chrono::steady_clock::now();
 
-		hashSeed = getSectionRangeHash(hashSeed, wLine, pos, rit->position(), options);
+		if (_phase != CompareStats::PHASES_COUNT)
+			_phaseMs[_phase] += std::chrono::duration<double, std::milli>(now - _phaseStart).count();
 
-		pos = rit->position() + rit->length();
-		++rit;
+		_phase		= phase;
+		_phaseStart	= now;
 	}
 
-	--endPos;
-
-	if (options.ignoreChangedSpaces && (wLine[endPos] == L' ' || wLine[endPos] == L'\t'))
+	inline void endPhase()
 	{
-		while (--endPos >= pos && (wLine[endPos] == L' ' || wLine[endPos] == L'\t'));
+		startPhase(CompareStats::PHASES_COUNT);
+	}
 
-		if (endPos < pos)
-			return hashSeed;
+	void get(CompareStats& stats) const
+	{
+		for (int i = 0; i < CompareStats::PHASES_COUNT; ++i)
+			stats.phaseMs[i] = _phaseMs[i];
+
+		stats.resultCached		= resultCached;
+		stats.diffApproximated	= diffApproximated;
+		stats.linesHashed		= linesHashed;
+		stats.diffCalcRuns		= diffCalcRuns;
+		stats.linesEditDistance	= linesEditDistance;
+		stats.convPairsScored	= convPairsScored;
+		stats.convPairsPruned	= convPairsPruned;
+
+		stats.budgetBoundedDiff			= budgetBoundedDiff;
+		stats.budgetBandedBlocks		= budgetBandedBlocks;
+		stats.budgetLinesOnlyBlocks		= budgetLinesOnlyBlocks;
+		stats.budgetSkippedCharDiffs	= budgetSkippedCharDiffs;
 	}
 
-	hashSeed = getSectionRangeHash(hashSeed, wLine, pos, endPos + 1, options);
+	// Set by the compare thread only
+	bool					resultCached {false};
 
-	return hashSeed;
-}
+	std::atomic<bool>		diffApproximated {false};
 
+	std::atomic<intptr_t>	linesHashed {0};
+	std::atomic<intptr_t>	diffCalcRuns {0};
+	std::atomic<intptr_t>	linesEditDistance {0};
+	std::atomic<intptr_t>	convPairsScored {0};
+	std::atomic<intptr_t>	convPairsPruned {0};
 
-void getLines(DocCmpInfo& doc, const CompareOptions& options)
-{
-	static constexpr int monitorCancelEveryXLine = 500;
+	std::atomic<bool>		budgetBoundedDiff {false};
+	std::atomic<intptr_t>	budgetBandedBlocks {0};
+	std::atomic<intptr_t>	budgetLinesOnlyBlocks {0};
+	std::atomic<intptr_t>	budgetSkippedCharDiffs {0};
 
-	progress_ptr& progress = ProgressDlg::Get();
+private:
+	// Phases are switched by the compare thread only
+	CompareStats::Phase						_phase {CompareStats::PHASES_COUNT};
+	std::chrono::steady_clock::time_point	_phaseStart;
+	double									_phaseMs[CompareStats::PHASES_COUNT] {};
+};
 
-	doc.lines.clear();
 
-	intptr_t linesCount = CallScintilla(doc.view, SCI_GETLENGTH, 0, 0);
+/**
+ *  \class  CompareContext
+ *  \brief  State of the compare run by the thread - different threads can run different compares at the same time
+ *          (the command line tool compares many pairs in parallel). The engine worker threads get the context of the
+ *          compare they work for.
+ */
+struct CompareContext
+{
+	CompareContext(CompareViews* compareViews, CompareProgress& compareProgress) :
+		views(compareViews), progress(&compareProgress) {}
 
-	if (linesCount)
-		linesCount = CallScintilla(doc.view, SCI_GETLINECOUNT, 0, 0);
-	else
-		return;
+	CompareContext(const CompareContext&) = delete;
+	CompareContext& operator=(const CompareContext&) = delete;
 
-	if ((doc.section.len <= 0) || (doc.section.off + doc.section.len > linesCount))
-		doc.section.len = linesCount - doc.section.off;
+	// nullptr if the compared documents are not in views (precomputed compare)
+	CompareViews* const		views;
+	CompareProgress* const	progress;
 
-	progress->SetMaxCount((doc.section.len / monitorCancelEveryXLine) + 1);
+	// The documents read by the compare - the snapshots of the views documents while compared in the background
+	const DocSource*		docSources[2] { nullptr, nullptr };
 
-	doc.lines.reserve(doc.section.len);
+	StatsCounters			stats;
+};
 
-	int cancelCheckCount = monitorCancelEveryXLine;
 
-	const int codepage = getCodepage(doc.view);
+thread_local CompareContext* threadContext = nullptr;
 
-	for (intptr_t secLine = 0; secLine < doc.section.len; ++secLine)
-	{
-		if (!(--cancelCheckCount))
-		{
-			if (!progress->Advance())
-			{
-				doc.lines.clear();
-				return;
-			}
 
-			cancelCheckCount = monitorCancelEveryXLine;
-		}
+inline CompareContext& context()
+{
+	return *threadContext;
+}
 
-		const intptr_t docLine		= secLine + doc.section.off;
-		const intptr_t lineStart	= getLineStart(doc.view, docLine);
-		const intptr_t lineEnd		= getLineEnd(doc.view, docLine);
 
-		Line newLine;
-		newLine.hash = cHashSeed;
-		newLine.line = docLine;
+// Makes ctx the compare context of the calling thread while in scope
+class ScopedCompareContext
+{
+public:
+	explicit ScopedCompareContext(CompareContext* ctx) : _prevCtx(threadContext)
+	{
+		threadContext = ctx;
+	}
 
-		if (lineStart < lineEnd)
-		{
-			std::vector<char> line = getText(doc.view, lineStart, lineEnd);
+	~ScopedCompareContext()
+	{
+		threadContext = _prevCtx;
+	}
 
-			if (options.ignoreRegex)
-			{
-#if !defined(MULTITHREAD) || (MULTITHREAD == 0)
-				LOGD(LOG_ALGO, "Regex Ignore on line " + std::to_string(docLine + 1) +
-						", view " + std::to_string(doc.view) + "\n");
-#endif
+	ScopedCompareContext(const ScopedCompareContext&) = delete;
+	ScopedCompareContext& operator=(const ScopedCompareContext&) = delete;
 
-				newLine.hash = getRegexIgnoreLineHash(newLine.hash, codepage, line, options);
-			}
-			else
-			{
-				if (options.ignoreCase)
-					toLowerCase(line, codepage);
+private:
+	CompareContext* const _prevCtx;
+};
 
-				intptr_t pos = 0;
-				intptr_t endPos = lineEnd - lineStart;
 
-				if (options.ignoreChangedSpaces)
-				{
-					while (pos < endPos && (line[pos] == ' ' || line[pos] == '\t'))
-						++pos;
+inline const DocSource& docSource(int view)
+{
+	return *context().docSources[view];
+}
 
-					while (--endPos >= pos && (line[endPos] == ' ' || line[endPos] == '\t'));
 
-					++endPos;
-				}
+inline intptr_t docLinesCount(int view)
+{
+	return docSource(view).linesCount();
+}
 
-				for (; pos < endPos; ++pos)
-				{
-					if (options.ignoreAllSpaces && (line[pos] == ' ' || line[pos] == '\t'))
-						continue;
 
-					if (options.ignoreChangedSpaces && (line[pos] == ' ' || line[pos] == '\t'))
-					{
-						newLine.hash = Hash(newLine.hash, ' ');
+inline intptr_t docLength(int view)
+{
+	return docSource(view).length();
+}
 
-						while (++pos < endPos && (line[pos] == ' ' || line[pos] == '\t'));
 
-						if (pos == endPos)
-							break;
-					}
+inline int docCodepage(int view)
+{
+	return docSource(view).codepage();
+}
 
-					newLine.hash = Hash(newLine.hash, line[pos]);
-				}
-			}
-		}
 
-		if (!options.ignoreEmptyLines || newLine.hash != cHashSeed)
-			doc.lines.emplace_back(newLine);
-	}
+inline bool docDefaultLineEnds(int view)
+{
+	return docSource(view).defaultLineEnds();
 }
 
 
-charType getCharTypeW(wchar_t letter)
+inline intptr_t docLineStart(int view, intptr_t line)
 {
-	if (letter == L' ' || letter == L'\t')
-		return charType::SPACECHAR;
+	return docSource(view).lineStart(line);
+}
 
-	if (::IsCharAlphaNumericW(letter) || letter == L'_')
-		return charType::ALPHANUMCHAR;
 
-	return charType::OTHERCHAR;
+inline intptr_t docLineEnd(int view, intptr_t line)
+{
+	return docSource(view).lineEnd(line);
 }
 
 
-inline void recalculateWordPos(int codepage, std::vector<Word>& words, const std::vector<wchar_t>& line)
+// Returns the text in [startPos, endPos) with terminating zero
+inline std::vector<char> docText(int view, intptr_t startPos, intptr_t endPos)
 {
-	intptr_t bytePos = 0;
-	intptr_t currPos = 0;
+	return docSource(view).text(startPos, endPos);
+}
 
-	for (auto& word : words)
-	{
-		if (currPos < word.pos)
-			bytePos += ::WideCharToMultiByte(codepage, 0, line.data() + currPos, static_cast<int>(word.pos - currPos),
-					NULL, 0, NULL, NULL);
 
-		currPos = word.pos + word.len;
-		word.len = ::WideCharToMultiByte(codepage, 0, line.data() + word.pos, static_cast<int>(word.len),
-				NULL, 0, NULL, NULL);
-		word.pos = bytePos;
-		bytePos += word.len;
-	}
+inline const char* docRangePointer(int view, intptr_t startPos, intptr_t len)
+{
+	return docSource(view).rangePointer(startPos, len);
 }
 
 
-inline void getSectionRangeWords(std::vector<Word>& words, std::vector<wchar_t>& line, intptr_t pos, intptr_t endPos,
-		const CompareOptions& options)
+// Takes the document section snapshot - must be called by the thread running the compare (the views UI thread)
+void takeDocSnapshot(const DocCmpInfo& doc, DocSnapshot& snap)
 {
-	if (pos >= endPos)
+	snap.docLinesCount		= docLinesCount(doc.view);
+	snap.docLength			= docLength(doc.view);
+	snap.docCodepage		= docCodepage(doc.view);
+	snap.docDefaultLineEnds	= docDefaultLineEnds(doc.view);
+
+	if (snap.docLength == 0)
 		return;
 
-	if (options.ignoreCase)
-	{
-		const wchar_t storedChar = line[endPos];
+	// Same section adjustment as the one in getSectionLinesCount()
+	intptr_t secLen = doc.section.len;
+
+	if ((secLen <= 0) || (doc.section.off + secLen > snap.docLinesCount))
+		secLen = snap.docLinesCount - doc.section.off;
+
+	if (secLen <= 0)
+		return;
 
-		line[endPos] = L'\0';
+	snap.firstLine = doc.section.off;
 
-		::CharLowerW((LPWSTR)line.data() + pos);
+	snap.lineStarts.resize(secLen);
+	snap.lineEnds.resize(secLen);
 
-		line[endPos] = storedChar;
+	for (intptr_t i = 0; i < secLen; ++i)
+	{
+		snap.lineStarts[i]	= docLineStart(doc.view, doc.section.off + i);
+		snap.lineEnds[i]	= docLineEnd(doc.view, doc.section.off + i);
 	}
 
-	charType currentWordType = getCharTypeW(line[pos]);
+	snap.textStart	= snap.lineStarts.front();
+	snap.docText	= docText(doc.view, snap.textStart, snap.lineEnds.back());
+}
 
-	Word word;
-	word.pos = pos;
-	word.len = 1;
 
-	if (options.ignoreChangedSpaces && currentWordType == charType::SPACECHAR)
-		word.hash = Hash(cHashSeed, L' ');
-	else
-		word.hash = Hash(cHashSeed, line[pos]);
+// Makes the compare read the documents from the given sources (instead of the views ones) while in scope
+class ScopedDocSources
+{
+public:
+	ScopedDocSources(const DocSource& doc1, const DocSource& doc2) :
+		_prevSources { context().docSources[0], context().docSources[1] }
+	{
+		context().docSources[0] = &doc1;
+		context().docSources[1] = &doc2;
+	}
 
-	for (++pos; pos < endPos; ++pos)
+	~ScopedDocSources()
 	{
-		const charType newWordType = getCharTypeW(line[pos]);
+		context().docSources[0] = _prevSources[0];
+		context().docSources[1] = _prevSources[1];
+	}
 
-		if (newWordType == currentWordType)
-		{
-			++word.len;
+	ScopedDocSources(const ScopedDocSources&) = delete;
+	ScopedDocSources& operator=(const ScopedDocSources&) = delete;
 
-			if (currentWordType != charType::SPACECHAR || !options.ignoreChangedSpaces)
-				word.hash = Hash(word.hash, line[pos]);
-		}
-		else
-		{
-			if (!options.ignoreAllSpaces || currentWordType != charType::SPACECHAR)
-				words.emplace_back(word);
+private:
+	const DocSource* const _prevSources[2];
+};
 
-			currentWordType = newWordType;
 
-			word.pos = pos;
-			word.len = 1;
+// Collects the line bytes that would have been hashed - used to verify the lines matched by hash
+struct LineBytes
+{
+	std::vector<char> bytes;
 
-			if (options.ignoreChangedSpaces && currentWordType == charType::SPACECHAR)
-				word.hash = Hash(cHashSeed, L' ');
-			else
-				word.hash = Hash(cHashSeed, line[pos]);
-		}
+	inline void Add(const char* text, intptr_t len)
+	{
+		bytes.insert(bytes.end(), text, text + len);
 	}
 
-	if (!options.ignoreAllSpaces || currentWordType != charType::SPACECHAR)
-		words.emplace_back(word);
-}
+	template <typename CharT>
+	inline void Add(CharT ch)
+	{
+		Add(reinterpret_cast<const char*>(&ch), sizeof(ch));
+	}
+};
 
 
-std::vector<Word> getRegexIgnoreLineWords(std::vector<wchar_t>& line, const CompareOptions& options)
+// Adds the document line text to the sink applying all compare options, reads the text from Scintilla
+template <typename SinkT>
+void addDocLineText(SinkT& sink, int view, intptr_t docLine, int codepage, const CompareOptions& options)
 {
-	std::vector<Word> words;
+	const intptr_t lineStart	= docLineStart(view, docLine);
+	const intptr_t lineEnd		= docLineEnd(view, docLine);
 
-	const intptr_t len = static_cast<intptr_t>(line.size());
+	if (lineStart >= lineEnd)
+		return;
 
-	if (len == 0)
-		return words;
+	std::vector<char> line = docText(view, lineStart, lineEnd);
 
-	std::regex_iterator<std::vector<wchar_t>::iterator> rit(line.begin(), line.end(), *options.ignoreRegex);
-	std::regex_iterator<std::vector<wchar_t>::iterator> rend;
+#if !defined(MULTITHREAD) || (MULTITHREAD == 0)
+	if (options.ignoreRegex)
+		LOGD(LOG_ALGO, "Regex Ignore on line " + std::to_string(docLine + 1) +
+				", view " + std::to_string(view) + "\n");
+#endif
 
-	intptr_t pos = 0;
-	intptr_t endPos = len - 1;
+	addLineText(sink, line.data(), lineEnd - lineStart, codepage, options);
+}
 
-	if (options.ignoreChangedSpaces && (line[pos] == L' ' || line[pos] == L'\t'))
-	{
-		while (++pos < endPos && (line[pos] == L' ' || line[pos] == L'\t'));
 
-		if (pos == endPos)
-			return words;
-	}
+// Memory budget of the compare in bytes, 0 if there is none
+inline uint64_t memoryBudget(const CompareOptions& options)
+{
+	return (options.memoryBudgetMB > 0) ? (static_cast<uint64_t>(options.memoryBudgetMB) << 20) : 0;
+}
 
-	while (rit != rend)
-	{
-		getSectionRangeWords(words, line, pos, rit->position(), options);
 
-		pos = rit->position() + rit->length();
-		++rit;
-	}
+// The line hashes cache keeps the hash variants of all the ignore case and spaces options unless the Ignore Regex is
+// used (the variants can't be computed then) or they take more than a tenth of the memory budget
+inline bool useHashVariants(const CompareOptions& options, intptr_t linesCount)
+{
+	const uint64_t budget = memoryBudget(options);
 
-	--endPos;
+	return (!options.ignoreRegex &&
+			(budget == 0 || static_cast<uint64_t>(linesCount) * sizeof(LineHashVariants) * 10 <= budget));
+}
 
-	if (options.ignoreChangedSpaces && (line[endPos] == L' ' || line[endPos] == L'\t'))
-	{
-		while (--endPos >= pos && (line[endPos] == L' ' || line[endPos] == L'\t'));
 
-		if (endPos < pos)
-			return words;
-	}
+// Part of the section text to be split into lines and hashed
+struct LinesChunk
+{
+	const char*	text;
+	intptr_t	textLen;
+	intptr_t	firstLine;
+	intptr_t	linesCount;
+	int			codepage;
 
-	getSectionRangeWords(words, line, pos, endPos + 1, options);
+	std::vector<Line> lines;
 
-	return words;
-}
+	// Hash variants of each chunk line if requested
+	std::vector<LineHashVariants> variants;
+};
 
 
-std::vector<Word> getLineWords(int view, intptr_t docLine, const CompareOptions& options)
+// Adjusts the section length to the document size. Returns the section lines count (0 if document is empty).
+intptr_t getSectionLinesCount(DocCmpInfo& doc)
 {
-	std::vector<Word> words;
+	intptr_t linesCount = docLength(doc.view);
 
-	const intptr_t lineStart	= getLineStart(view, docLine);
-	const intptr_t lineEnd		= getLineEnd(view, docLine);
+	if (linesCount)
+		linesCount = docLinesCount(doc.view);
+	else
+		return 0;
 
-	if (lineStart >= lineEnd)
-		return words;
+	if ((doc.section.len <= 0) || (doc.section.off + doc.section.len > linesCount))
+		doc.section.len = linesCount - doc.section.off;
+
+	return doc.section.len;
+}
 
-	const int codepage = getCodepage(view);
 
-	std::vector<char> line = getText(view, lineStart, lineEnd);
+// Splits the section text in Scintilla's buffer in chunks of chunkLines lines each. The chunks text pointers are
+// valid until the document gets modified. Returns false if the buffer cannot be accessed directly.
+bool getSectionChunks(const DocCmpInfo& doc, intptr_t chunkLines, std::vector<LinesChunk>& chunks)
+{
+	if (!docDefaultLineEnds(doc.view))
+		return false;
 
-	const int len = static_cast<int>(line.size());
+	const intptr_t secStart	= docLineStart(doc.view, doc.section.off);
+	const intptr_t secEnd	= docLineEnd(doc.view, doc.section.off + doc.section.len - 1);
 
-	const int wLen = ::MultiByteToWideChar(codepage, 0, line.data(), len, NULL, 0);
+	// Get the whole section pointer at once - getting it per chunk might move the gap and invalidate previous chunks
+	const char* text = docRangePointer(doc.view, secStart, secEnd - secStart);
 
-	std::vector<wchar_t> wLine(wLen);
+	if (text == nullptr && secEnd > secStart)
+		return false;
 
-	::MultiByteToWideChar(codepage, 0, line.data(), len, wLine.data(), wLen);
+	const int codepage = docCodepage(doc.view);
 
-	if (options.ignoreRegex)
-	{
-		words = getRegexIgnoreLineWords(wLine, options);
-	}
-	else
+	for (intptr_t secLine = 0; secLine < doc.section.len; secLine += chunkLines)
 	{
-		intptr_t pos = 0;
-		intptr_t endPos = wLen - 1;
-
-		if (options.ignoreChangedSpaces)
-		{
-			while (pos < endPos && (wLine[pos] == L' ' || wLine[pos] == L'\t'))
-				++pos;
+		const intptr_t linesCount	= std::min(chunkLines, doc.section.len - secLine);
+		const intptr_t chunkStart	= docLineStart(doc.view, doc.section.off + secLine);
+		const intptr_t chunkEnd		= (secLine + linesCount < doc.section.len) ?
+				docLineStart(doc.view, doc.section.off + secLine + linesCount) : secEnd;
 
-			while (--endPos >= pos && (wLine[endPos] == L' ' || wLine[endPos] == L'\t'));
+		chunks.emplace_back();
 
-			++endPos;
-		}
+		LinesChunk& chunk = chunks.back();
 
-		getSectionRangeWords(words, wLine, pos, endPos, options);
+		chunk.text			= text + (chunkStart - secStart);
+		chunk.textLen		= chunkEnd - chunkStart;
+		chunk.firstLine		= doc.section.off + secLine;
+		chunk.linesCount	= linesCount;
+		chunk.codepage		= codepage;
 	}
 
-	// In case of UTF-16 or UTF-32 find words byte positions and lengths because Scintilla uses those
-	if (wLen != len)
-		recalculateWordPos(codepage, words, wLine);
-
-	return words;
+	return true;
 }
 
 
-inline void recalculateCharPos(int codepage, std::vector<Char>& chars, const std::vector<wchar_t>& sec)
+// Splits chunk text in lines and hashes them in a single pass. Doesn't call Scintilla so it can be run by any thread.
+// advance() is called every cancelCheckInterval lines and should return false if the operation is cancelled.
+// The line hashes are taken from the computed hash variants if withVariants is set.
+template <typename AdvanceFn>
+bool hashChunkLines(LinesChunk& chunk, const CompareOptions& options, int cancelCheckInterval, AdvanceFn advance,
+		bool withVariants = false)
 {
-	intptr_t bytePos = 0;
-	intptr_t currPos = 0;
+	const char* text = chunk.text;
 
-	for (auto& ch : chars)
-	{
-		if (currPos < ch.pos)
-			bytePos += ::WideCharToMultiByte(codepage, 0, sec.data() + currPos, static_cast<int>(ch.pos - currPos),
-					NULL, 0, NULL, NULL);
+	int cancelCheckCount = cancelCheckInterval;
 
-		currPos = ch.pos + 1;
-		const int charLen = ::WideCharToMultiByte(codepage, 0, sec.data() + ch.pos, 1, NULL, 0, NULL, NULL);
-		ch.pos = bytePos;
-		bytePos += charLen;
-	}
-}
+	intptr_t lineStart = 0;
 
+	chunk.lines.reserve(chunk.linesCount);
 
-inline void getSectionRangeChars(std::vector<Char>& chars, std::vector<wchar_t>& sec, intptr_t pos, intptr_t endPos,
-		const CompareOptions& options)
-{
-	if (pos >= endPos)
-		return;
+	if (withVariants)
+		chunk.variants.resize(chunk.linesCount);
 
-	if (options.ignoreCase)
-	{
-		const wchar_t storedChar = sec[endPos];
+	const int variant = hashVariant(options);
 
-		sec[endPos] = L'\0';
+	for (intptr_t chunkLine = 0; chunkLine < chunk.linesCount; ++chunkLine)
+	{
+		if (!(--cancelCheckCount))
+		{
+			if (!advance())
+				return false;
 
-		::CharLowerW((LPWSTR)sec.data() + pos);
+			cancelCheckCount = cancelCheckInterval;
+		}
 
-		sec[endPos] = storedChar;
-	}
+		intptr_t lineEnd = lineStart;
 
-	for (; pos < endPos; ++pos)
-	{
-		const charType typeOfChar = getCharTypeW(sec[pos]);
+		while (lineEnd < chunk.textLen && text[lineEnd] != '\n' && text[lineEnd] != '\r')
+			++lineEnd;
 
-		if (options.ignoreAllSpaces && typeOfChar == charType::SPACECHAR)
-			continue;
+		Line newLine;
+		newLine.line = chunk.firstLine + chunkLine;
 
-		if (options.ignoreChangedSpaces && typeOfChar == charType::SPACECHAR)
+		if (withVariants)
 		{
-			chars.emplace_back(L' ', pos);
+			LineHashVariants& variants = chunk.variants[chunkLine];
 
-			while (++pos < endPos && getCharTypeW(sec[pos]) == charType::SPACECHAR);
+			hashLineVariants(text + lineStart, lineEnd - lineStart, chunk.codepage, variants);
+			newLine.hash = variants.hash[variant];
+		}
+		else
+		{
+			LineHasher hasher;
+			addLineText(hasher, text + lineStart, lineEnd - lineStart, chunk.codepage, options);
 
-			if (pos == endPos)
-				break;
+			newLine.hash = hasher.Get();
 		}
 
-		chars.emplace_back(sec[pos], pos);
+		if (!options.ignoreEmptyLines || newLine.hash != cHashSeed)
+			chunk.lines.emplace_back(newLine);
+
+		lineStart = lineEnd + 1;
+
+		if (lineStart < chunk.textLen && text[lineEnd] == '\r' && text[lineStart] == '\n')
+			++lineStart;
 	}
+
+	context().stats.linesHashed += chunk.linesCount;
+
+	return true;
 }
 
 
-std::vector<Char> getSectionChars(int view, intptr_t secStart, intptr_t secEnd, const CompareOptions& options)
+// Fills the doc hash variants as well if withVariants is set (and the variants can be used)
+void getLines(DocCmpInfo& doc, const CompareOptions& options, bool withVariants = false)
 {
-	std::vector<Char> chars;
+	static constexpr int monitorCancelEveryXLine = 500;
 
-	if (secStart >= secEnd)
-		return chars;
+	CompareProgress* const progress = context().progress;
 
-	const int codepage = getCodepage(view);
+	doc.lines.clear();
+	doc.hashVariants.clear();
 
-	std::vector<char> sec = getText(view, secStart, secEnd);
+	if (!getSectionLinesCount(doc))
+		return;
 
-	const int len = static_cast<int>(sec.size());
+	TraceScope trace("GetLines", doc.section.len);
 
-	const int wLen = ::MultiByteToWideChar(codepage, 0, sec.data(), len, NULL, 0);
+	progress->SetMaxCount((doc.section.len / monitorCancelEveryXLine) + 1);
 
-	std::vector<wchar_t> wSec(wLen);
+	// Regex ignoring needs per-line text conversion so bulk buffer read is used only without it
+	if (!options.ignoreRegex)
+	{
+		std::vector<LinesChunk> chunks;
 
-	::MultiByteToWideChar(codepage, 0, sec.data(), len, wSec.data(), wLen);
+		if (getSectionChunks(doc, doc.section.len, chunks))
+		{
+			withVariants = withVariants && useHashVariants(options, doc.section.len);
 
-	chars.reserve(wLen - 1);
+			if (hashChunkLines(chunks[0], options, monitorCancelEveryXLine, [&progress]() { return progress->Advance(); },
+					withVariants))
+			{
+				doc.lines			= std::move(chunks[0].lines);
+				doc.hashVariants	= std::move(chunks[0].variants);
+			}
 
-	getSectionRangeChars(chars, wSec, 0, wLen - 1, options);
+			return;
+		}
+	}
 
-	// In case of UTF-16 or UTF-32 find chars byte positions because Scintilla uses those
-	if (wLen != len)
-		recalculateCharPos(codepage, chars, wSec);
+	doc.lines.reserve(doc.section.len);
 
-	return chars;
-}
+	int cancelCheckCount = monitorCancelEveryXLine;
 
+	const int codepage = docCodepage(doc.view);
 
-std::vector<Char> getRegexIgnoreLineChars(int view, intptr_t lineStart, intptr_t lineEnd,
-	const CompareOptions& options)
-{
-	std::vector<Char> chars;
+	for (intptr_t secLine = 0; secLine < doc.section.len; ++secLine)
+	{
+		if (!(--cancelCheckCount))
+		{
+			if (!progress->Advance())
+			{
+				doc.lines.clear();
+				return;
+			}
 
-	if (lineStart >= lineEnd)
-		return chars;
+			cancelCheckCount = monitorCancelEveryXLine;
+		}
 
-	const int codepage = getCodepage(view);
+		const intptr_t docLine = secLine + doc.section.off;
 
-	std::vector<char> line = getText(view, lineStart, lineEnd);
+		LineHasher hasher;
+		addDocLineText(hasher, doc.view, docLine, codepage, options);
 
-	const int len = static_cast<int>(line.size());
+		Line newLine;
+		newLine.hash = hasher.Get();
+		newLine.line = docLine;
 
-	const int wLen = ::MultiByteToWideChar(codepage, 0, line.data(), len, NULL, 0);
+		if (!options.ignoreEmptyLines || newLine.hash != cHashSeed)
+			doc.lines.emplace_back(newLine);
+	}
 
-	std::vector<wchar_t> wLine(wLen);
+	context().stats.linesHashed += doc.section.len;
+}
 
-	::MultiByteToWideChar(codepage, 0, line.data(), len, wLine.data(), wLen);
 
-	chars.reserve(wLen - 1);
+// Gets the doc lines from the line hashes cache re-hashing only the lines that are not cached. Returns false if
+// the cache cannot be used (it is not filled or too many lines are not cached) and getLines() should be used instead.
+bool getCachedLines(DocCmpInfo& doc, const CompareOptions& options, LineHashCache* cache)
+{
+	if (!cache)
+		return false;
 
-	std::regex_iterator<std::vector<wchar_t>::iterator> rit(wLine.begin(), wLine.end(), *options.ignoreRegex);
-	std::regex_iterator<std::vector<wchar_t>::iterator> rend;
+	const intptr_t linesCount	= docLinesCount(doc.view);
+	const intptr_t length		= docLength(doc.view);
+	const int codepage			= docCodepage(doc.view);
 
-	intptr_t pos = 0;
-	intptr_t endPos = wLen - 1;
+	const bool sameDoc = (static_cast<intptr_t>(cache->hashes.size()) == linesCount) &&
+			(cache->length == length) && (cache->codepage == codepage);
 
-	if (options.ignoreChangedSpaces && (wLine[pos] == L' ' || wLine[pos] == L'\t'))
+	if (!sameDoc || (cache->ignoreChangedSpaces != options.ignoreChangedSpaces) ||
+		(cache->ignoreAllSpaces != options.ignoreAllSpaces) || (cache->ignoreCase != options.ignoreCase) ||
+		(cache->ignoreRegexStr != options.ignoreRegexStr))
 	{
-		while (++pos < endPos && (wLine[pos] == L' ' || wLine[pos] == L'\t'));
+		cache->ignoreChangedSpaces	= options.ignoreChangedSpaces;
+		cache->ignoreAllSpaces		= options.ignoreAllSpaces;
+		cache->ignoreCase			= options.ignoreCase;
+		cache->ignoreRegexStr		= options.ignoreRegexStr;
+		cache->codepage				= codepage;
+		cache->length				= length;
+
+		// Only the hashing options changed - the hashes of the new options are among the kept variants
+		if (sameDoc && !options.ignoreRegex && (cache->variants.size() == cache->hashes.size()))
+		{
+			const int variant = hashVariant(options);
 
-		if (pos == endPos)
-			return chars;
-	}
+			for (size_t i = 0; i < cache->hashes.size(); ++i)
+				cache->hashes[i] = cache->variants[i].hash[variant];
 
-	while (rit != rend)
-	{
-		getSectionRangeChars(chars, wLine, pos, rit->position(), options);
+			LOGD(LOG_ALGO, "Lines hashes variant " + std::to_string(variant) + " taken from cache, view " +
+					std::to_string(doc.view) + "\n");
+		}
+		else
+		{
+			if (!sameDoc)
+				cache->variants.clear();
 
-		pos = rit->position() + rit->length();
-		++rit;
-	}
+			cache->hashes.assign(linesCount, 0);
 
-	--endPos;
+			return false;
+		}
+	}
 
-	if (options.ignoreChangedSpaces && (wLine[endPos] == L' ' || wLine[endPos] == L'\t'))
-		while (--endPos >= pos && (wLine[endPos] == L' ' || wLine[endPos] == L'\t'));
+	doc.lines.clear();
 
-	if (endPos >= pos)
-		getSectionRangeChars(chars, wLine, pos, endPos + 1, options);
+	if (!getSectionLinesCount(doc))
+		return true;
 
-	// In case of UTF-16 or UTF-32 find chars byte positions because Scintilla uses those
-	if (wLen != len)
-		recalculateCharPos(codepage, chars, wLine);
+	const auto secBegin	= cache->hashes.begin() + doc.section.off;
+	const auto secEnd	= secBegin + doc.section.len;
 
-	return chars;
-}
+	// Bulk hashing is faster when many lines are to be re-hashed
+	if (std::count(secBegin, secEnd, 0) * 4 > doc.section.len)
+		return false;
 
+	doc.lines.reserve(doc.section.len);
 
-std::vector<std::vector<Char>> getLinesChars(const DocCmpInfo& doc, const diffInfo& blockDiff,
-		const CompareOptions& options)
-{
-	std::vector<std::vector<Char>> chars(blockDiff.len);
+	intptr_t rehashedCount = 0;
 
-	for (intptr_t blockLine = 0; blockLine < blockDiff.len; ++blockLine)
+	for (intptr_t docLine = doc.section.off; docLine < doc.section.off + doc.section.len; ++docLine)
 	{
-		// Don't get moved lines
-		if (blockDiff.info.getNextUnmoved(blockLine))
+		uint64_t& hash = cache->hashes[docLine];
+
+		if (hash == 0)
 		{
-			--blockLine;
-			continue;
+			LineHasher hasher;
+			addDocLineText(hasher, doc.view, docLine, codepage, options);
+
+			hash = hasher.Get();
+			++rehashedCount;
 		}
 
-		const intptr_t docLine		= doc.lines[blockLine + blockDiff.off].line;
-		const intptr_t lineStart	= getLineStart(doc.view, docLine);
-		const intptr_t lineEnd		= getLineEnd(doc.view, docLine);
+		Line newLine;
+		newLine.hash = hash;
+		newLine.line = docLine;
 
-		if (lineStart < lineEnd)
-		{
-			if (options.ignoreRegex)
-			{
-				chars[blockLine] = getRegexIgnoreLineChars(doc.view, lineStart, lineEnd, options);
-			}
-			else
-			{
-				chars[blockLine] = getSectionChars(doc.view, lineStart, lineEnd, options);
+		if (!options.ignoreEmptyLines || newLine.hash != cHashSeed)
+			doc.lines.emplace_back(newLine);
+	}
 
-				if (options.ignoreChangedSpaces && !chars[blockLine].empty())
-				{
-					auto itr = chars[blockLine].begin();
+	context().stats.linesHashed += rehashedCount;
 
-					for (; itr != chars[blockLine].end() && (itr->ch == L' ' || itr->ch == L'\t'); ++itr);
+	LOGD(LOG_ALGO, "Lines hashes taken from cache, lines re-hashed: " + std::to_string(rehashedCount) +
+			", view " + std::to_string(doc.view) + "\n");
 
-					if (itr != chars[blockLine].begin())
-						chars[blockLine].erase(chars[blockLine].begin(), itr);
+	return true;
+}
 
-					size_t i = chars[blockLine].size() - 1;
 
-					for (; i >= 0 && (chars[blockLine][i] == L' ' || chars[blockLine][i] == L'\t'); --i);
+// Stores the doc lines hashes (got by getLines()) in the line hashes cache
+void fillLineHashCache(const DocCmpInfo& doc, LineHashCache* cache)
+{
+	if (!cache || (static_cast<intptr_t>(cache->hashes.size()) < doc.section.off + doc.section.len))
+		return;
 
-					if (++i != chars[blockLine].size())
-						chars[blockLine].erase(chars[blockLine].begin() + i, chars[blockLine].end());
-				}
-			}
-		}
-	}
+	// Lines missing in doc are the ignored empty lines
+	std::fill(cache->hashes.begin() + doc.section.off, cache->hashes.begin() + doc.section.off + doc.section.len,
+			cHashSeed);
 
-	return chars;
-}
+	for (const auto& line: doc.lines)
+		cache->hashes[line.line] = line.hash;
 
+	if (static_cast<intptr_t>(doc.hashVariants.size()) != doc.section.len)
+		return;
 
-// Scan for the best single matching block in the other file
-void findBestMatch(const CompareInfo& cmpInfo, const diffInfo& lookupDiff, intptr_t lookupOff, MatchInfo& mi)
-{
-	mi.matchLen		= 0;
-	mi.matchDiff	= nullptr;
+	if (cache->variants.size() != cache->hashes.size())
+		cache->variants.assign(cache->hashes.size(), LineHashVariants {});
 
-	const std::vector<Line>* pLookupLines;
-	const std::vector<Line>* pMatchLines;
-	diff_type matchType;
+	std::copy(doc.hashVariants.begin(), doc.hashVariants.end(), cache->variants.begin() + doc.section.off);
+}
 
-	if (lookupDiff.type == diff_type::DIFF_IN_1)
-	{
-		pLookupLines	= &cmpInfo.doc1.lines;
-		pMatchLines		= &cmpInfo.doc2.lines;
-		matchType		= diff_type::DIFF_IN_2;
-	}
-	else
-	{
-		pLookupLines	= &cmpInfo.doc2.lines;
-		pMatchLines		= &cmpInfo.doc1.lines;
-		matchType		= diff_type::DIFF_IN_1;
-	}
 
-	intptr_t minMatchLen = 1;
+// Runs jobFn(job) for jobs [0, jobsCount) by threadsCount threads (the calling one included) - each thread picks the
+// next job when it is done with the previous one. jobFn should return false to stop all the threads.
+// Returns false if any of the jobs failed. Exceptions thrown by jobFn are rethrown once all the threads are done.
+template <typename JobFn>
+bool runJobsConcurrently(size_t jobsCount, size_t threadsCount, JobFn jobFn)
+{
+	std::atomic<size_t>		nextJob(0);
+	std::atomic<bool>		failed(false);
 
-	for (const diffInfo& matchDiff: cmpInfo.blockDiffs)
-	{
-		if (matchDiff.type != matchType || matchDiff.len < minMatchLen)
-			continue;
+	std::exception_ptr error = nullptr;
+	std::mutex errorMutex;
 
-		for (intptr_t matchOff = 0; matchOff < matchDiff.len; ++matchOff)
+	CompareContext* const ctx = threadContext;
+
+	auto workFn =
+		[&]()
 		{
-			if ((*pLookupLines)[lookupDiff.off + lookupOff] != (*pMatchLines)[matchDiff.off + matchOff])
-				continue;
+			ScopedCompareContext useCtx(ctx);
 
-			if (matchDiff.info.getNextUnmoved(matchOff))
+			try
 			{
-				if (matchOff >= matchDiff.len)
-					break;
-
-				if ((*pLookupLines)[lookupDiff.off + lookupOff] != (*pMatchLines)[matchDiff.off + matchOff])
-					continue;
+				for (size_t i = nextJob++; i < jobsCount && !failed; i = nextJob++)
+				{
+					if (!jobFn(i))
+					{
+						failed = true;
+						break;
+					}
+				}
 			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
 
-			intptr_t lookupStart	= lookupOff - 1;
-			intptr_t matchStart		= matchOff - 1;
+				if (!error)
+					error = std::current_exception();
 
-			// Check for the beginning of the matched block (containing lookupOff element)
-			for (; lookupStart >= 0 && matchStart >= 0 &&
-					(*pLookupLines)[lookupDiff.off + lookupStart] == (*pMatchLines)[matchDiff.off + matchStart] &&
-					!lookupDiff.info.movedSection(lookupStart) && !matchDiff.info.movedSection(matchStart);
-					--lookupStart, --matchStart);
+				failed = true;
+			}
+		};
 
-			++lookupStart;
-			++matchStart;
+	const size_t workersCount = std::max(std::min(threadsCount, jobsCount), static_cast<size_t>(1)) - 1;
 
-			intptr_t lookupEnd	= lookupOff + 1;
-			intptr_t matchEnd	= matchOff + 1;
+	std::vector<std::thread> workers;
+	workers.reserve(workersCount);
 
-			// Check for the end of the matched block (containing lookupOff element)
-			for (; lookupEnd < lookupDiff.len && matchEnd < matchDiff.len &&
-					(*pLookupLines)[lookupDiff.off + lookupEnd] == (*pMatchLines)[matchDiff.off + matchEnd] &&
-					!lookupDiff.info.movedSection(lookupEnd) && !matchDiff.info.movedSection(matchEnd);
-					++lookupEnd, ++matchEnd);
+	for (size_t i = 0; i < workersCount; ++i)
+		workers.emplace_back(workFn);
 
-			const intptr_t matchLen = lookupEnd - lookupStart;
+	workFn();
 
-			if (mi.matchLen < matchLen)
-			{
-				mi.lookupOff	= lookupStart;
-				mi.matchDiff	= const_cast<diffInfo*>(&matchDiff);
-				mi.matchOff		= matchStart;
-				mi.matchLen		= matchLen;
+	for (auto& worker : workers)
+		worker.join();
 
-				minMatchLen		= matchLen;
-				matchOff		= matchEnd - 1;
-			}
-			else if (mi.matchLen == matchLen)
-			{
-				mi.matchDiff	= nullptr;
-				matchOff		= matchEnd - 1;
-			}
-		}
-	}
+	if (error)
+		std::rethrow_exception(error);
+
+	return !failed;
 }
 
 
-// Recursively resolve the best match
-bool resolveMatch(const CompareInfo& cmpInfo, diffInfo& lookupDiff, intptr_t lookupOff, MatchInfo& lookupMi)
+// Hashes both documents' lines at once splitting their texts in chunks processed by several threads.
+// Returns false if the documents cannot be processed that way and getLines() should be used instead.
+bool getLinesConcurrently(DocCmpInfo& doc1, DocCmpInfo& doc2, const CompareOptions& options, bool& cancelled,
+		bool withVariants = false)
 {
-	bool ret = false;
+	static constexpr int monitorCancelEveryXLine	= 500;
+	static constexpr intptr_t minLinesCount			= 100000;
+	static constexpr intptr_t minChunkLines			= 20000;
 
-	if (lookupMi.matchDiff)
-	{
-		lookupOff = lookupMi.matchOff + (lookupOff - lookupMi.lookupOff);
+	cancelled = false;
 
-		MatchInfo reverseMi;
-		findBestMatch(cmpInfo, *(lookupMi.matchDiff), lookupOff, reverseMi);
+	if (options.ignoreRegex)
+		return false;
 
-		if ((reverseMi.matchDiff == &lookupDiff) && (reverseMi.matchOff == lookupMi.lookupOff))
-		{
-			LOGD(LOG_ALGO, "Move match found, len: " + std::to_string(lookupMi.matchLen) + "\n");
+	const unsigned threadsCount = std::thread::hardware_concurrency();
 
-			lookupDiff.info.moves.emplace_back(lookupMi.lookupOff, lookupMi.matchLen);
-			lookupMi.matchDiff->info.moves.emplace_back(lookupMi.matchOff, lookupMi.matchLen);
-			ret = true;
-		}
-		else if (reverseMi.matchDiff)
-		{
-			ret = resolveMatch(cmpInfo, *(lookupMi.matchDiff), lookupOff, reverseMi);
-			lookupMi.matchLen = 0;
-		}
-	}
+	if (threadsCount < 2)
+		return false;
 
-	return ret;
-}
+	doc1.lines.clear();
+	doc2.lines.clear();
 
+	doc1.hashVariants.clear();
+	doc2.hashVariants.clear();
 
-void findMoves(CompareInfo& cmpInfo)
-{
-	LOGD(LOG_ALGO, "FIND MOVES\n");
+	const intptr_t linesCount = getSectionLinesCount(doc1) + getSectionLinesCount(doc2);
 
-	bool repeat = true;
+	if (linesCount < minLinesCount || doc1.section.len <= 0 || doc2.section.len <= 0)
+		return false;
 
-	while (repeat)
-	{
-		repeat = false;
+	TraceScope trace("GetLinesConcurrently", doc1.section.len, doc2.section.len);
 
-		for (diffInfo& lookupDiff: cmpInfo.blockDiffs)
-		{
-			if (lookupDiff.type != diff_type::DIFF_IN_1)
-				continue;
+	withVariants = withVariants && useHashVariants(options, linesCount);
 
-			LOGD(LOG_ALGO, "Check D1 with off: " + std::to_string(cmpInfo.doc1.lines[lookupDiff.off].line + 1) + "\n");
+	// A few chunks per thread so that threads finishing earlier can pick up the remaining work
+	const intptr_t chunkLines = std::max(linesCount / (threadsCount * 4), minChunkLines);
 
-			// Go through all lookupDiff's elements and check if each is matched
-			for (intptr_t lookupEi = 0; lookupEi < lookupDiff.len; ++lookupEi)
-			{
-				// Skip already detected moves
-				if (lookupDiff.info.getNextUnmoved(lookupEi))
-				{
-					if (lookupEi >= lookupDiff.len)
-						break;
-				}
+	std::vector<LinesChunk> chunks;
 
-				MatchInfo mi;
-				findBestMatch(cmpInfo, lookupDiff, lookupEi, mi);
+	if (!getSectionChunks(doc1, chunkLines, chunks))
+		return false;
 
-				if (resolveMatch(cmpInfo, lookupDiff, lookupEi, mi))
-				{
-					repeat = true;
+	const size_t doc2FirstChunk = chunks.size();
 
-					if (mi.matchLen)
-						lookupEi = mi.lookupOff + mi.matchLen - 1;
-					else
-						--lookupEi;
-				}
-			}
-		}
-	}
-}
+	if (!getSectionChunks(doc2, chunkLines, chunks))
+		return false;
 
+	CompareProgress* const progress = context().progress;
 
-void findUniqueLines(CompareInfo& cmpInfo)
-{
-	std::unordered_map<uint64_t, std::vector<intptr_t>> doc1LinesMap;
+	progress->SetMaxCount((linesCount / monitorCancelEveryXLine) + 1);
 
-	for (const auto& line: cmpInfo.doc1.lines)
-	{
-		auto insertPair = doc1LinesMap.emplace(line.hash, std::vector<intptr_t>{line.line});
-		if (!insertPair.second)
-			insertPair.first->second.emplace_back(line.line);
-	}
+	// The progress counter is atomic so all the threads advance it
+	auto advance = [&progress]() { return progress->Advance(); };
 
-	for (const auto& line: cmpInfo.doc2.lines)
+	if (!runJobsConcurrently(chunks.size(), threadsCount,
+			[&](size_t i) { return hashChunkLines(chunks[i], options, monitorCancelEveryXLine, advance, withVariants); }))
 	{
-		auto doc1it = doc1LinesMap.find(line.hash);
+		cancelled = true;
+		return true;
+	}
 
-		if (doc1it != doc1LinesMap.end())
+	auto joinChunks =
+		[&chunks, withVariants](DocCmpInfo& doc, size_t firstChunk, size_t endChunk)
 		{
-			cmpInfo.doc2.nonUniqueLines.emplace(line.line);
-
-			auto insertPair = cmpInfo.doc1.nonUniqueLines.emplace(doc1it->second[0]);
-			if (insertPair.second)
-			{
-				for (size_t j = 1; j < doc1it->second.size(); ++j)
-					cmpInfo.doc1.nonUniqueLines.emplace(doc1it->second[j]);
-			}
-		}
-	}
-}
+			size_t size = 0;
 
+			for (size_t i = firstChunk; i < endChunk; ++i)
+				size += chunks[i].lines.size();
 
-inline intptr_t matchBeginEnd(diffInfo& blockDiff1, diffInfo& blockDiff2,
-		const std::vector<Char>& sec1, const std::vector<Char>& sec2,
-		intptr_t off1, intptr_t off2, intptr_t end1, intptr_t end2,
-		std::function<bool(const wchar_t)>&& charFilter_fn)
-{
-	const intptr_t minSecSize = std::min(sec1.size(), sec2.size());
+			doc.lines.reserve(size);
 
-	intptr_t startMatch = 0;
-	while ((minSecSize > startMatch) && (sec1[startMatch] == sec2[startMatch]) && charFilter_fn(sec1[startMatch].ch))
-		++startMatch;
+			for (size_t i = firstChunk; i < endChunk; ++i)
+				doc.lines.insert(doc.lines.end(), chunks[i].lines.begin(), chunks[i].lines.end());
 
-	intptr_t endMatch = 0;
-	while ((minSecSize - startMatch > endMatch) &&
-			(sec1[sec1.size() - endMatch - 1] == sec2[sec2.size() - endMatch - 1]) &&
-			charFilter_fn(sec1[sec1.size() - endMatch - 1].ch))
-		++endMatch;
+			if (!withVariants)
+				return;
 
-	if (startMatch || endMatch)
-	{
-		section_t change;
+			doc.hashVariants.reserve(doc.section.len);
 
-		if ((intptr_t)sec1.size() > startMatch + endMatch)
-		{
-			change.off = off1;
-			if (startMatch)
-				change.off += sec1[startMatch].pos;
+			for (size_t i = firstChunk; i < endChunk; ++i)
+				doc.hashVariants.insert(doc.hashVariants.end(), chunks[i].variants.begin(), chunks[i].variants.end());
+		};
 
-			change.len = (endMatch ?
-					sec1[sec1.size() - endMatch - 1].pos + 1 + off1 : end1) - change.off;
+	joinChunks(doc1, 0, doc2FirstChunk);
+	joinChunks(doc2, doc2FirstChunk, chunks.size());
 
-			if (change.len > 0)
-				blockDiff1.info.changedLines.back().changes.emplace_back(change);
-		}
+	return true;
+}
 
-		if ((intptr_t)sec2.size() > startMatch + endMatch)
-		{
-			change.off = off2;
-			if (startMatch)
-				change.off += sec2[startMatch].pos;
 
-			change.len = (endMatch ?
-					sec2[sec2.size() - endMatch - 1].pos + 1 + off2 : end2) - change.off;
+// Finds the unique lines of both documents at once without the full lines arrays and a lines map - the texts chunks
+// are hashed by several threads into shards by the hashes top bits and each shard is then resolved on its own by
+// a flat hash set. The unique lines are flagged per document and the flags are collected in document order at the end
+// so they make up the longest marker runs. Progress phases are advanced as by getLines() and the lines classification.
+// Returns false if the documents cannot be processed that way and getLines() should be used instead.
+bool findUniqueConcurrently(DocCmpInfo& doc1, DocCmpInfo& doc2, const CompareOptions& options,
+		LineHashCache* const lineHashes[2], std::vector<intptr_t>& doc1Unique, std::vector<intptr_t>& doc2Unique,
+		intptr_t& matchCount, bool& cancelled)
+{
+	static constexpr int monitorCancelEveryXLine	= 500;
+	static constexpr intptr_t minLinesCount			= 100000;
+	static constexpr intptr_t minChunkLines			= 20000;
+	static constexpr int shardBits					= 6;
+	static constexpr size_t shardsCount				= static_cast<size_t>(1) << shardBits;
 
-			if (change.len > 0)
-				blockDiff2.info.changedLines.back().changes.emplace_back(change);
-		}
-	}
+	cancelled = false;
 
-	return (startMatch + endMatch);
-}
+	if (options.ignoreRegex)
+		return false;
 
+	const unsigned threadsCount = std::thread::hardware_concurrency();
 
-void compareLines(const DocCmpInfo& doc1, const DocCmpInfo& doc2, diffInfo& blockDiff1, diffInfo& blockDiff2,
-		const std::map<intptr_t, intptr_t>& lineMappings, const CompareOptions& options)
-{
-	for (const auto& lm: lineMappings)
-	{
-		intptr_t line1 = lm.second;
-		intptr_t line2 = lm.first;
+	if (threadsCount < 2)
+		return false;
 
-		LOGD(LOG_ALGO, "Compare Lines " + std::to_string(doc1.lines[blockDiff1.off + line1].line + 1) + " and " +
-				std::to_string(doc2.lines[blockDiff2.off + line2].line + 1) + "\n");
+	const intptr_t linesCount = getSectionLinesCount(doc1) + getSectionLinesCount(doc2);
 
-		const std::vector<Word> lineWords1 = getLineWords(doc1.view, doc1.lines[blockDiff1.off + line1].line, options);
-		const std::vector<Word> lineWords2 = getLineWords(doc2.view, doc2.lines[blockDiff2.off + line2].line, options);
+	if (linesCount < minLinesCount || doc1.section.len <= 0 || doc2.section.len <= 0)
+		return false;
 
-		const auto* pLine1 = &lineWords1;
-		const auto* pLine2 = &lineWords2;
+	const intptr_t chunkLines = std::max(linesCount / (threadsCount * 4), minChunkLines);
 
-		const DocCmpInfo* pDoc1 = &doc1;
-		const DocCmpInfo* pDoc2 = &doc2;
+	std::vector<LinesChunk> chunks;
 
-		diffInfo* pBlockDiff1 = &blockDiff1;
-		diffInfo* pBlockDiff2 = &blockDiff2;
+	if (!getSectionChunks(doc1, chunkLines, chunks))
+		return false;
 
-		// First use word granularity (find matching words) for better precision
-		auto wordDiffRes = DiffCalc<Word>(lineWords1, lineWords2)(!options.detectCharDiffs, true);
-		const std::vector<diff_info<void>> lineDiffs = std::move(wordDiffRes.first);
+	const size_t doc2FirstChunk = chunks.size();
 
-		if (wordDiffRes.second)
-		{
-			std::swap(pDoc1, pDoc2);
-			std::swap(pBlockDiff1, pBlockDiff2);
-			std::swap(pLine1, pLine2);
-			std::swap(line1, line2);
-		}
+	if (!getSectionChunks(doc2, chunkLines, chunks))
+		return false;
 
-		const intptr_t lineDiffsSize = static_cast<intptr_t>(lineDiffs.size());
+	doc1.lines.clear();
+	doc2.lines.clear();
 
-		PRINT_DIFFS("WORD DIFFS", lineDiffs);
+	DocCmpInfo* const docs[2] = { &doc1, &doc2 };
 
-		pBlockDiff1->info.changedLines.emplace_back(line1);
-		pBlockDiff2->info.changedLines.emplace_back(line2);
+	// The line hashes are stored in the caches by the hashing threads - each chunk fills its own lines range
+	LineHashCache* caches[2] = { lineHashes[doc1.view], lineHashes[doc2.view] };
 
-		const intptr_t lineOff1 = getLineStart(pDoc1->view, pDoc1->lines[line1 + pBlockDiff1->off].line);
-		const intptr_t lineOff2 = getLineStart(pDoc2->view, pDoc2->lines[line2 + pBlockDiff2->off].line);
+	for (int i = 0; i < 2; ++i)
+	{
+		if (caches[i] &&
+				(static_cast<intptr_t>(caches[i]->hashes.size()) < docs[i]->section.off + docs[i]->section.len))
+			caches[i] = nullptr;
+	}
 
-		intptr_t lineLen1 = 0;
-		intptr_t lineLen2 = 0;
+	CompareProgress* const progress = context().progress;
 
-		for (const auto& word: *pLine1)
-			lineLen1 += word.len;
+	progress->SetMaxCount((linesCount / monitorCancelEveryXLine) + 1);
 
-		for (const auto& word: *pLine2)
-			lineLen2 += word.len;
+	auto advance = [&progress]() { return progress->Advance(); };
 
-		intptr_t totalLineMatchLen = 0;
+	// The lines of each chunk split by shard - the chunk lines are freed once split so the lines are kept only once
+	std::vector<std::vector<Line>> chunkShards(chunks.size() * shardsCount);
 
-		for (intptr_t i = 0; i < lineDiffsSize; ++i)
+	if (!runJobsConcurrently(chunks.size(), threadsCount,
+		[&](size_t i)
 		{
-			const auto& ld = lineDiffs[i];
+			LinesChunk& chunk = chunks[i];
 
-			if (ld.type == diff_type::DIFF_MATCH)
-			{
-				for (intptr_t j = 0; j < ld.len; ++j)
-					totalLineMatchLen += (*pLine1)[ld.off + j].len;
-			}
-			else if (ld.type == diff_type::DIFF_IN_2)
-			{
-				section_t change;
+			if (!hashChunkLines(chunk, options, monitorCancelEveryXLine, advance))
+				return false;
 
-				change.off = (*pLine2)[ld.off].pos;
-				change.len = (*pLine2)[ld.off + ld.len - 1].pos + (*pLine2)[ld.off + ld.len - 1].len - change.off;
+			LineHashCache* const cache = caches[(i < doc2FirstChunk) ? 0 : 1];
 
-				pBlockDiff2->info.changedLines.back().changes.emplace_back(change);
-			}
-			else
+			if (cache)
 			{
-				// Resolve words mismatched DIFF_IN_1 / DIFF_IN_2 pairs to find possible sub-word similarities
-				if ((i + 1 < lineDiffsSize) && (lineDiffs[i + 1].type == diff_type::DIFF_IN_2))
-				{
-					const auto& ld2 = lineDiffs[i + 1];
+				// Lines missing in the chunk are the ignored empty lines
+				std::fill(cache->hashes.begin() + chunk.firstLine,
+						cache->hashes.begin() + chunk.firstLine + chunk.linesCount, cHashSeed);
 
-					intptr_t off1 = (*pLine1)[ld.off].pos;
-					intptr_t end1 = (*pLine1)[ld.off + ld.len - 1].pos + (*pLine1)[ld.off + ld.len - 1].len;
+				for (const auto& line: chunk.lines)
+					cache->hashes[line.line] = line.hash;
+			}
 
-					intptr_t off2 = (*pLine2)[ld2.off].pos;
-					intptr_t end2 = (*pLine2)[ld2.off + ld2.len - 1].pos + (*pLine2)[ld2.off + ld2.len - 1].len;
+			std::vector<Line>* const shards = &chunkShards[i * shardsCount];
 
-					const std::vector<Char> sec1 =
-							getSectionChars(pDoc1->view, off1 + lineOff1, end1 + lineOff1, options);
-					const std::vector<Char> sec2 =
-							getSectionChars(pDoc2->view, off2 + lineOff2, end2 + lineOff2, options);
+			for (const auto& line: chunk.lines)
+				shards[line.hash >> (64 - shardBits)].push_back(line);
 
-					if (options.detectCharDiffs)
-					{
-						LOGD(LOG_ALGO, "Compare Sections " +
-								std::to_string(off1 + 1) + " to " +
-								std::to_string(end1 + 1) + " and " +
-								std::to_string(off2 + 1) + " to " +
-								std::to_string(end2 + 1) + "\n");
+			std::vector<Line>().swap(chunk.lines);
 
-						const auto* pSec1 = &sec1;
-						const auto* pSec2 = &sec2;
+			return true;
+		}))
+	{
+		cancelled = true;
+		return true;
+	}
 
-						diffInfo* pBD1 = pBlockDiff1;
-						diffInfo* pBD2 = pBlockDiff2;
+	if (!progress->NextPhase() || !progress->NextPhase())
+	{
+		cancelled = true;
+		return true;
+	}
 
-						// Compare changed words
-						auto diffRes = DiffCalc<Char>(sec1, sec2)();
-						const std::vector<diff_info<void>> sectionDiffs = std::move(diffRes.first);
+	// Unique line flag per section line of each document - distinct bytes can be written by different threads
+	std::vector<uint8_t> uniqueFlags[2];
 
-						if (diffRes.second)
-						{
-							std::swap(pSec1, pSec2);
-							std::swap(pBD1, pBD2);
-							std::swap(off1, off2);
-							std::swap(end1, end2);
-						}
+	uniqueFlags[0].assign(doc1.section.len, 0);
+	uniqueFlags[1].assign(doc2.section.len, 0);
 
-						PRINT_DIFFS("CHAR DIFFS", sectionDiffs);
+	std::vector<intptr_t> shardMatches(shardsCount, 0);
 
-						intptr_t matchLen = 0;
-						intptr_t matchSections = 0;
+	if (!runJobsConcurrently(shardsCount, threadsCount,
+		[&](size_t shard)
+		{
+			if (progress->IsCancelled())
+				return false;
 
-						for (const auto& sd: sectionDiffs)
-						{
-							if (sd.type == diff_type::DIFF_MATCH)
-							{
-								matchLen += sd.len;
-								++matchSections;
-							}
-						}
+			size_t shardLinesCount = 0;
 
-						if (matchSections)
-						{
-							LOGD(LOG_ALGO, "Matching sections found: " + std::to_string(matchSections) +
-									", matched len: " + std::to_string(matchLen) + "\n");
+			for (size_t c = 0; c < chunks.size(); ++c)
+				shardLinesCount += chunkShards[c * shardsCount + shard].size();
 
-							// Are similarities a considerable portion of the diff?
-							if ((int)((matchLen * 100) / std::max(sec1.size(), sec2.size())) >=
-								options.changedThresholdPercent)
-							{
-								for (const auto& sd: sectionDiffs)
-								{
-									if (sd.type == diff_type::DIFF_IN_1)
-									{
-										section_t change;
+			if (shardLinesCount == 0)
+				return true;
 
-										change.off = (*pSec1)[sd.off].pos + off1;
-										change.len = (*pSec1)[sd.off + sd.len - 1].pos + off1 + 1 - change.off;
+			int tableBits = 4;
 
-										pBD1->info.changedLines.back().changes.emplace_back(change);
-									}
-									else if (sd.type == diff_type::DIFF_IN_2)
-									{
-										section_t change;
+			while ((static_cast<size_t>(1) << tableBits) < 2 * shardLinesCount)
+				++tableBits;
 
-										change.off = (*pSec2)[sd.off].pos + off2;
-										change.len = (*pSec2)[sd.off + sd.len - 1].pos + off2 + 1 - change.off;
+			const size_t tableMask = (static_cast<size_t>(1) << tableBits) - 1;
 
-										pBD2->info.changedLines.back().changes.emplace_back(change);
-									}
-								}
+			// Open addressing set of the shard line hashes - inDocs bit 0 is set for doc1 lines and bit 1 for doc2
+			// lines, 0 marks an empty slot
+			std::vector<uint64_t>	hashes(tableMask + 1);
+			std::vector<uint8_t>	inDocs(tableMask + 1, 0);
 
-								totalLineMatchLen += matchLen;
+			auto slotOf =
+				[&](uint64_t hash)
+				{
+					size_t slot = static_cast<size_t>((hash * 0x9E3779B97F4A7C15ULL) >> (64 - tableBits));
 
-								LOGD(LOG_ALGO, "Whole section checked for matches\n");
+					while (inDocs[slot] && hashes[slot] != hash)
+						slot = (slot + 1) & tableMask;
 
-								++i;
-								continue;
-							}
-							// If not, mark only beginning and ending diff section matches
-							else
-							{
-								const intptr_t matches =
-										matchBeginEnd(*pBD1, *pBD2, *pSec1, *pSec2, off1, off2, end1, end2,
-												[](const wchar_t) { return true; });
+					return slot;
+				};
 
-								if (matches)
-								{
-									totalLineMatchLen += matches;
+			for (size_t c = 0; c < chunks.size(); ++c)
+			{
+				const uint8_t docBit = (c < doc2FirstChunk) ? 1 : 2;
 
-									++i;
-									continue;
-								}
-							}
+				for (const auto& line: chunkShards[c * shardsCount + shard])
+				{
+					const size_t slot = slotOf(line.hash);
 
-							// No matching sections between the lines found - move to next lines
-							if (lineDiffsSize == 2)
-								break;
-						}
-					}
-					// Always match non-alphabetical characters in the beginning and at the end
-					else
-					{
-						const intptr_t matches =
-								matchBeginEnd(*pBlockDiff1, *pBlockDiff2, sec1, sec2, off1, off2, end1, end2,
-										[](const wchar_t ch) { return (getCharTypeW(ch) != charType::ALPHANUMCHAR); });
+					hashes[slot] = line.hash;
+					inDocs[slot] |= docBit;
+				}
+			}
 
-						if (matches)
-						{
-							totalLineMatchLen += matches;
+			for (size_t c = 0; c < chunks.size(); ++c)
+			{
+				const int doc = (c < doc2FirstChunk) ? 0 : 1;
+				const uint8_t uniqueIn = (doc == 0) ? 1 : 2;
 
-							++i;
-							continue;
-						}
+				std::vector<Line>& shardLines = chunkShards[c * shardsCount + shard];
 
-						// No matching sections between the lines found - move to next lines
-						if (lineDiffsSize == 2)
-							break;
-					}
+				for (const auto& line: shardLines)
+				{
+					if (inDocs[slotOf(line.hash)] == uniqueIn)
+						uniqueFlags[doc][line.line - docs[doc]->section.off] = 1;
 				}
 
-				section_t change;
-
-				change.off = (*pLine1)[ld.off].pos;
-				change.len = (*pLine1)[ld.off + ld.len - 1].pos + (*pLine1)[ld.off + ld.len - 1].len - change.off;
-
-				pBlockDiff1->info.changedLines.back().changes.emplace_back(change);
+				std::vector<Line>().swap(shardLines);
 			}
-		}
 
-		// Not enough portion of the lines matches - consider them totally different
-		if (((totalLineMatchLen * 100) / std::max(lineLen1, lineLen2)) < options.changedThresholdPercent)
-		{
-			pBlockDiff1->info.changedLines.pop_back();
-			pBlockDiff2->info.changedLines.pop_back();
-		}
+			shardMatches[shard] = std::count(inDocs.begin(), inDocs.end(), 3);
+
+			return true;
+		}) || !progress->NextPhase())
+	{
+		cancelled = true;
+		return true;
 	}
-}
 
+	matchCount = 0;
 
-std::vector<std::set<LinesConv>> getOrderedConvergence(const DocCmpInfo& doc1, const DocCmpInfo& doc2,
-		const diffInfo& blockDiff1, const diffInfo& blockDiff2, const CompareOptions& options)
-{
-	const std::vector<std::vector<Char>> chunk1 = getLinesChars(doc1, blockDiff1, options);
-	const std::vector<std::vector<Char>> chunk2 = getLinesChars(doc2, blockDiff2, options);
+	for (intptr_t matches: shardMatches)
+		matchCount += matches;
 
-	const intptr_t linesCount1 = static_cast<intptr_t>(chunk1.size());
-	const intptr_t linesCount2 = static_cast<intptr_t>(chunk2.size());
+	auto collectUnique =
+		[](const DocCmpInfo& doc, const std::vector<uint8_t>& flags, std::vector<intptr_t>& unique)
+		{
+			unique.clear();
 
-	std::vector<std::set<LinesConv>> lines1Convergence(linesCount1);
-	std::vector<std::set<LinesConv>> lines2Convergence(linesCount2);
+			for (size_t i = 0; i < flags.size(); ++i)
+			{
+				if (flags[i])
+					unique.emplace_back(doc.section.off + static_cast<intptr_t>(i));
+			}
+		};
 
-#if defined(MULTITHREAD) && (MULTITHREAD != 0)
-	std::mutex mtx;
-#endif
+	collectUnique(doc1, uniqueFlags[0], doc1Unique);
+	collectUnique(doc2, uniqueFlags[1], doc2Unique);
 
-	auto workFn =
-		[&](intptr_t startLine, intptr_t endLine)
-		{
-			progress_ptr& progress = ProgressDlg::Get();
+	if (!progress->NextPhase())
+		cancelled = true;
+
+	return true;
+}
+
+
+/**
+ *  \class  CharTypes
+ *  \brief  Character types of all UTF-16 code units - built once as IsCharAlphaNumericW() is too slow to be called
+ *          for each character of the compared words
+ */
+class CharTypes
+{
+public:
+	static const CharTypes& get()
+	{
+		static const CharTypes charTypes;
+
+		return charTypes;
+	}
 
-			intptr_t linesProgress = 0;
+	inline charType operator[](wchar_t letter) const
+	{
+		return static_cast<charType>(_types[static_cast<uint16_t>(letter)]);
+	}
 
-			for (intptr_t line1 = startLine; line1 < endLine; ++line1)
+	// Returns the end of the run of type chars starting at pos
+	inline intptr_t runEnd(const wchar_t* text, intptr_t pos, intptr_t endPos, charType type) const
+	{
+#ifdef WORDS_SSE2
+		// Mostly ASCII text - classify 16 chars at once and stop at the first char of another type or non-ASCII
+		if (_asciiSimd)
+		{
+			for (; pos + 16 <= endPos; pos += 16)
 			{
-				if (chunk1[line1].empty())
+				const __m128i mask1 = asciiTypeMask(text + pos, type);
+				const __m128i mask2 = asciiTypeMask(text + pos + 8, type);
+
+				const unsigned notMatched = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_packs_epi16(mask1, mask2)))
+						& 0xFFFF;
+
+				if (notMatched)
 				{
-					linesProgress += linesCount2;
-					continue;
+					pos += firstBit(notMatched);
+					break;
 				}
+			}
+		}
+#endif // WORDS_SSE2
 
-				std::vector<Word> words1;
+		while (pos < endPos && (*this)[text[pos]] == type)
+			++pos;
 
-				for (intptr_t line2 = 0; line2 < linesCount2; ++line2)
-				{
-					if (chunk2[line2].empty())
-					{
-						++linesProgress;
-						continue;
-					}
+		return pos;
+	}
 
-					const intptr_t minSize = std::min(chunk1[line1].size(), chunk2[line2].size());
-					const intptr_t maxSize = std::max(chunk1[line1].size(), chunk2[line2].size());
+private:
+	CharTypes()
+	{
+		for (uint32_t letter = 0; letter <= 0xFFFF; ++letter)
+		{
+			charType type = charType::OTHERCHAR;
 
-					if (((minSize * 100) / maxSize) < options.changedThresholdPercent)
-					{
-						++linesProgress;
-						continue;
-					}
+			if (letter == L' ' || letter == L'\t')
+				type = charType::SPACECHAR;
+			else if (::IsCharAlphaNumericW(static_cast<wchar_t>(letter)) || letter == L'_')
+				type = charType::ALPHANUMCHAR;
 
-					intptr_t matchesCount	= 0;
-					intptr_t diffsCount		= 0;
+			_types[letter] = static_cast<uint8_t>(type);
+		}
 
-					auto charDiffs = DiffCalc<Char>(chunk1[line1], chunk2[line2],
-							std::bind(&ProgressDlg::IsCancelled, progress))();
+		// The SIMD classification assumes the ASCII alphanumerics are [0-9A-Za-z_] - use it only if the system agrees
+		_asciiSimd = true;
 
-					if (progress->IsCancelled())
-						return;
+		for (uint32_t letter = 0; letter < 0x80; ++letter)
+		{
+			const bool alnum = (letter >= '0' && letter <= '9') || ((letter | 0x20) >= 'a' && (letter | 0x20) <= 'z') ||
+					letter == '_';
 
-					const intptr_t charDiffsSize = static_cast<intptr_t>(charDiffs.first.size());
+			if (alnum != (_types[letter] == static_cast<uint8_t>(charType::ALPHANUMCHAR)))
+				_asciiSimd = false;
+		}
+	}
 
-					for (intptr_t i = 0; i < charDiffsSize; ++i)
-					{
-						if (charDiffs.first[i].type == diff_type::DIFF_MATCH)
-						{
-							matchesCount += charDiffs.first[i].len;
-						}
-						else if (options.bestSeqChangedLines)
-						{
-							++diffsCount;
+#ifdef WORDS_SSE2
+	// Returns 0xFFFF for each of the 8 chars that is ASCII of the given type and 0 otherwise
+	static inline __m128i asciiTypeMask(const wchar_t* text, charType type)
+	{
+		const __m128i chars	= _mm_loadu_si128(reinterpret_cast<const __m128i*>(text));
+		const __m128i ascii	= _mm_cmpeq_epi16(_mm_and_si128(chars, _mm_set1_epi16(-0x80)), _mm_setzero_si128());
 
-							// Count replacement as a single diff
-							if ((i + 1 < charDiffsSize) && (charDiffs.first[i + 1].type == diff_type::DIFF_IN_2))
-								++i;
-						}
-					}
+		const __m128i space = _mm_or_si128(_mm_cmpeq_epi16(chars, _mm_set1_epi16(L' ')),
+				_mm_cmpeq_epi16(chars, _mm_set1_epi16(L'\t')));
 
-					if (((matchesCount * 100) / maxSize) >= options.changedThresholdPercent)
-					{
-						const float lineConvergence = (static_cast<float>(matchesCount) * 100) / maxSize;
+		if (type == charType::SPACECHAR)
+			return space;
 
-						Conv conv(lineConvergence, diffsCount);
+		// Non-ASCII chars have the sign bit set or are above 'z' so the signed compares to ASCII bounds are safe
+		const __m128i lower	= _mm_or_si128(chars, _mm_set1_epi16(0x20));
+		const __m128i alpha	= _mm_and_si128(_mm_cmpgt_epi16(lower, _mm_set1_epi16('a' - 1)),
+				_mm_cmplt_epi16(lower, _mm_set1_epi16('z' + 1)));
+		const __m128i digit	= _mm_and_si128(_mm_cmpgt_epi16(chars, _mm_set1_epi16('0' - 1)),
+				_mm_cmplt_epi16(chars, _mm_set1_epi16('9' + 1)));
+		const __m128i alnum	= _mm_or_si128(_mm_or_si128(alpha, digit), _mm_cmpeq_epi16(chars, _mm_set1_epi16('_')));
 
-#if defined(MULTITHREAD) && (MULTITHREAD != 0)
-						std::lock_guard<std::mutex> lock(mtx);
-#endif
+		if (type == charType::ALPHANUMCHAR)
+			return _mm_and_si128(alnum, ascii);
 
-						if (!progress->Advance(linesProgress + 1))
-							return;
+		return _mm_andnot_si128(_mm_or_si128(alnum, space), ascii);
+	}
 
-						linesProgress = 0;
+	static inline int firstBit(unsigned bits)
+	{
+#if defined(_MSC_VER)
+		unsigned long idx;
+		_BitScanForward(&idx, bits);
 
-						bool addL1C = false;
+		return static_cast<int>(idx);
+#else
+		return __builtin_ctz(bits);
+#endif
+	}
+#endif // WORDS_SSE2
 
-						if (lines2Convergence[line2].empty() || (conv == lines2Convergence[line2].begin()->conv))
-						{
-							lines2Convergence[line2].emplace(conv, line1, line2);
-							addL1C = true;
-						}
-						else if (conv > lines2Convergence[line2].begin()->conv)
-						{
-							for (const auto& l2c : lines2Convergence[line2])
-							{
-								auto& l1c = lines1Convergence[l2c.line1];
+	uint8_t	_types[0x10000];
+	bool	_asciiSimd;
+};
 
-								if (!l1c.empty())
-								{
-									for (auto l1cI = l1c.begin(); l1cI != l1c.end(); ++l1cI)
-									{
-										if (l1cI->line2 == line2)
-										{
-											l1c.erase(l1cI);
-											break;
-										}
-									}
-								}
-							}
 
-							lines2Convergence[line2].clear();
-							lines2Convergence[line2].emplace(conv, line1, line2);
-							addL1C = true;
-						}
+inline charType getCharTypeW(wchar_t letter)
+{
+	return CharTypes::get()[letter];
+}
 
-						if (addL1C)
-						{
-							if (lines1Convergence[line1].empty() || (conv == lines1Convergence[line1].begin()->conv))
-							{
-								lines1Convergence[line1].emplace(conv, line1, line2);
-							}
-							else if (conv > lines1Convergence[line1].begin()->conv)
-							{
-								lines1Convergence[line1].clear();
-								lines1Convergence[line1].emplace(conv, line1, line2);
-							}
-						}
-					}
-					else
-					{
-#if defined(MULTITHREAD) && (MULTITHREAD != 0)
-						std::lock_guard<std::mutex> lock(mtx);
-#endif
 
-						if (!progress->Advance(linesProgress + 1))
-							return;
+// UTF-16 text of the lines of a changed block - fetched and converted once and then shared by the lines
+// convergence, words and chars compare stages
+struct BlockText
+{
+	struct LineText
+	{
+		intptr_t	off;
+		intptr_t	len;		// Including the terminating null, 0 for moved and empty lines
+		bool		multiByte;	// Text byte positions differ from the UTF-16 ones
+	};
 
-						linesProgress = 0;
-					}
-				}
-			}
-		};
+	// Copies the block line text (null terminated) to buf - the compare stages modify it (lower case conversion)
+	inline void copyLine(intptr_t blockLine, std::vector<wchar_t>& buf) const
+	{
+		const LineText& line = lines[blockLine];
 
-#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+		buf.assign(text.begin() + line.off, text.begin() + line.off + line.len);
+	}
 
-	auto threadFn =
-		[&workFn](intptr_t startLine, intptr_t endLine)
-		{
-			try
-			{
-				workFn(startLine, endLine);
-			}
-			catch (std::exception& e)
-			{
-				char msg[128];
-				_snprintf_s(msg, _countof(msg), _TRUNCATE, "Exception occurred: %s", e.what());
-				::MessageBoxA(nppData._nppHandle, msg, "ComparePlus", MB_OK | MB_ICONWARNING);
-			}
-			catch (...)
-			{
-				::MessageBoxA(nppData._nppHandle, "Unknown exception occurred.", "ComparePlus",
-						MB_OK | MB_ICONWARNING);
-			}
-		};
+	int						codepage;
+	std::vector<wchar_t>	text;
+	std::vector<LineText>	lines;
+};
 
-	int threadsCount = std::thread::hardware_concurrency() - 1;
 
-	if (threadsCount < 1)
-		threadsCount = 1;
-	else if (static_cast<intptr_t>(threadsCount) > linesCount1)
-		threadsCount = static_cast<int>(linesCount1);
+void getBlockText(const DocCmpInfo& doc, const diffInfo& blockDiff, BlockText& blockText)
+{
+	blockText.codepage = docCodepage(doc.view);
 
-	if (threadsCount > 1)
+	blockText.text.clear();
+	blockText.lines.assign(blockDiff.len, { 0, 0, false });
+
+	for (intptr_t blockLine = 0; blockLine < blockDiff.len; ++blockLine)
 	{
-		constexpr intptr_t jobsPerThread = 50;
+		// Don't get moved lines
+		if (blockDiff.info.getNextUnmoved(blockLine))
+		{
+			--blockLine;
+			continue;
+		}
 
-		const intptr_t totalJobs		= linesCount1 * linesCount2;
-		const intptr_t threadsNeeded	= (totalJobs + jobsPerThread - 1) / jobsPerThread;
+		const intptr_t docLine		= doc.lines[blockLine + blockDiff.off].line;
+		const intptr_t lineStart	= docLineStart(doc.view, docLine);
+		const intptr_t lineEnd		= docLineEnd(doc.view, docLine);
 
-		if (static_cast<intptr_t>(threadsCount) > threadsNeeded)
-			threadsCount = static_cast<int>(threadsNeeded);
-	}
+		if (lineStart >= lineEnd)
+			continue;
 
-	if (threadsCount > 1)
-	{
-		const intptr_t linesPerThread = (linesCount1 + threadsCount - 1) / threadsCount;
+		const int len = static_cast<int>(lineEnd - lineStart);
 
-		LOGD(LOG_ALGO, "getOrderedConvergence(): threads to use: " + std::to_string(threadsCount) +
-				", jobs per thread: " + std::to_string(linesPerThread * linesCount2) + "\n");
+		const char* lineText = docRangePointer(doc.view, lineStart, len);
 
-		std::vector<std::thread> threads;
+		BlockText::LineText& line = blockText.lines[blockLine];
 
-		for (intptr_t startLine1 = 0; startLine1 < linesCount1; startLine1 += linesPerThread)
+		line.off = static_cast<intptr_t>(blockText.text.size());
+
+		// ASCII text is the same in all code pages - widen it directly, its byte and char positions are the same
+		if (isAsciiText(lineText, len))
 		{
-			const intptr_t endLine1 = std::min(startLine1 + linesPerThread, linesCount1);
+			line.len		= len + 1;
+			line.multiByte	= false;
 
-			LOGD(LOG_ALGO, "Thread line1 range: " + std::to_string(startLine1 + 1) +
-					" to " + std::to_string(endLine1) + "\n");
+			blockText.text.insert(blockText.text.end(), lineText, lineText + len);
+			blockText.text.push_back(L'\0');
 
-			try
-			{
-				threads.emplace_back(threadFn, startLine1, endLine1);
-			}
-			catch (...)
-			{
-				workFn(startLine1, linesCount1);
-				break;
-			}
+			continue;
 		}
 
-		for (auto& th : threads)
-			th.join();
-	}
-	else
-	{
-		LOGD(LOG_ALGO, "getOrderedConvergence(): using 1 thread\n");
+		const int wLen = ::MultiByteToWideChar(blockText.codepage, 0, lineText, len, NULL, 0);
 
-		workFn(0, linesCount1);
+		line.len		= wLen + 1;
+		line.multiByte	= (wLen != len);
+
+		blockText.text.resize(line.off + line.len, L'\0');
+
+		::MultiByteToWideChar(blockText.codepage, 0, lineText, len, blockText.text.data() + line.off, wLen);
 	}
+}
 
-#else
 
-	workFn(0, linesCount1);
+// Returns the byte length of the UTF-16 text in the given code page. UTF-8 (the usual documents encoding) is counted
+// directly without conversion - each unit of a surrogate pair counts for half of the pair 4 bytes.
+inline intptr_t codepageLen(int codepage, const wchar_t* text, intptr_t len)
+{
+	if (codepage != CP_UTF8)
+		return ::WideCharToMultiByte(codepage, 0, text, static_cast<int>(len), NULL, 0, NULL, NULL);
 
-#endif // MULTITHREAD
+	intptr_t bytes = len;
+
+	for (intptr_t i = 0; i < len; ++i)
+	{
+		const wchar_t ch = text[i];
 
-	return lines1Convergence;
+		if (ch >= 0x80)
+			bytes += (ch < 0x800 || (ch >= 0xD800 && ch < 0xE000)) ? 1 : 2;
+	}
+
+	return bytes;
 }
 
 
-bool compareBlocks(const DocCmpInfo& doc1, const DocCmpInfo& doc2, diffInfo& blockDiff1, diffInfo& blockDiff2,
-		const CompareOptions& options)
+inline void recalculateWordPos(int codepage, ArenaVector<Word>& words, const std::vector<wchar_t>& line)
 {
-	std::vector<std::set<LinesConv>> orderedLinesConvergence =
-			getOrderedConvergence(doc1, doc2, blockDiff1, blockDiff2, options);
+	intptr_t bytePos = 0;
+	intptr_t currPos = 0;
 
+	for (auto& word : words)
 	{
-		progress_ptr& progress = ProgressDlg::Get();
+		if (currPos < word.pos)
+			bytePos += codepageLen(codepage, line.data() + currPos, word.pos - currPos);
 
-		if (progress->IsCancelled())
-			return false;
+		currPos = word.pos + word.len;
+		word.len = codepageLen(codepage, line.data() + word.pos, word.len);
+		word.pos = bytePos;
+		bytePos += word.len;
 	}
+}
 
-#ifdef DLOG
-	for (const auto& oc: orderedLinesConvergence)
-	{
-		if (!oc.empty())
-			LOGD(LOG_ALGO, "Best Matching Lines: " +
-					std::to_string(doc1.lines[oc.begin()->line1 + blockDiff1.off].line + 1) + " and " +
-					std::to_string(doc2.lines[oc.begin()->line2 + blockDiff2.off].line + 1) + "\n");
-	}
-#endif
 
-	std::map<intptr_t, intptr_t> bestLineMappings; // line2 -> line1
+inline void getSectionRangeWords(ArenaVector<Word>& words, std::vector<wchar_t>& line, intptr_t pos, intptr_t endPos,
+		const CompareOptions& options)
+{
+	if (pos >= endPos)
+		return;
+
+	if (options.ignoreCase)
+		lowerCaseRange(line, pos, endPos);
+
+	const CharTypes& charTypes = CharTypes::get();
+	const wchar_t* text = line.data();
+
+	// Each word is a run of chars of the same type - find its end first and then hash it
+	while (pos < endPos)
 	{
-		std::vector<std::map<intptr_t, intptr_t>> groupedLines;
+		const charType wordType = charTypes[text[pos]];
+		const intptr_t wordEnd = charTypes.runEnd(text, pos + 1, endPos, wordType);
 
-		for (const auto& oc: orderedLinesConvergence)
+		if (wordType == charType::SPACECHAR && options.ignoreAllSpaces)
 		{
-			if (oc.empty())
-				continue;
+			pos = wordEnd;
+			continue;
+		}
 
-			if (groupedLines.empty())
-			{
-				auto ocItr = oc.begin();
+		Word word;
+		word.pos = pos;
+		word.len = wordEnd - pos;
 
-				groupedLines.emplace_back();
-				groupedLines.back().emplace(ocItr->line2, ocItr->line1);
+		if (wordType == charType::SPACECHAR && options.ignoreChangedSpaces)
+		{
+			word.hash = Hash(cHashSeed, L' ');
+		}
+		else
+		{
+			word.hash = cHashSeed;
 
-				continue;
-			}
+			for (; pos < wordEnd; ++pos)
+				word.hash = Hash(word.hash, text[pos]);
+		}
 
-			intptr_t addToIdx = -1;
+		words.emplace_back(word);
 
-			for (auto ocItr = oc.begin(); ocItr != oc.end(); ++ocItr)
-			{
-				for (intptr_t i = 0; i < static_cast<intptr_t>(groupedLines.size()); ++i)
-				{
-					const auto& gl = groupedLines[i];
+		pos = wordEnd;
+	}
+}
 
-					if ((ocItr->line2) > (gl.rbegin()->first))
-					{
-						if (addToIdx == -1)
-						{
-							addToIdx = i;
-						}
-						else if (groupedLines[addToIdx].size() < gl.size())
-						{
-							groupedLines.erase(groupedLines.begin() + addToIdx);
-							addToIdx = --i;
-						}
-						else
-						{
-							groupedLines.erase(groupedLines.begin() + i);
-							--i;
-						}
-					}
-				}
 
-				if (addToIdx != -1)
-				{
-					auto& gl = groupedLines[addToIdx];
-					gl.emplace_hint(gl.end(), ocItr->line2, ocItr->line1);
+ArenaVector<Word> getRegexIgnoreLineWords(std::vector<wchar_t>& line, const CompareOptions& options)
+{
+	ArenaVector<Word> words;
 
-					break;
-				}
-			}
+	const intptr_t len = static_cast<intptr_t>(line.size());
 
-			if (addToIdx != -1)
-				continue;
+	if (len == 0)
+		return words;
 
-			auto ocrItr = oc.rbegin();
+	intptr_t pos = 0;
+	intptr_t endPos = len - 1;
 
-			std::map<intptr_t, intptr_t> subGroup;
+	if (options.ignoreChangedSpaces && (line[pos] == L' ' || line[pos] == L'\t'))
+	{
+		while (++pos < endPos && (line[pos] == L' ' || line[pos] == L'\t'));
 
-			for (intptr_t i = 0; i < static_cast<intptr_t>(groupedLines.size()); ++i)
-			{
-				auto& gl = groupedLines[i];
+		if (pos == endPos)
+			return words;
+	}
 
-				auto glResItr = gl.emplace(ocrItr->line2, ocrItr->line1);
+	forEachIgnoreRegexMatch(line, options,
+		[&](intptr_t matchPos, intptr_t matchLen)
+		{
+			getSectionRangeWords(words, line, pos, matchPos, options);
 
-				if (glResItr.second)
-				{
-					std::map<intptr_t, intptr_t> newSubGroup;
-					auto sgEndItr = glResItr.first;
+			pos = matchPos + matchLen;
+		});
 
-					newSubGroup.insert(gl.begin(), ++sgEndItr);
-					gl.erase(glResItr.first);
+	--endPos;
 
-					if (newSubGroup.size() > subGroup.size())
-						subGroup = std::move(newSubGroup);
-				}
-			}
+	if (options.ignoreChangedSpaces && (line[endPos] == L' ' || line[endPos] == L'\t'))
+	{
+		while (--endPos >= pos && (line[endPos] == L' ' || line[endPos] == L'\t'));
 
-			if (!subGroup.empty())
-			{
-				groupedLines.emplace_back(std::move(subGroup));
+		if (endPos < pos)
+			return words;
+	}
 
-				LOGD(LOG_ALGO, "New lines group (" + std::to_string(groupedLines.size()) + " total). Last lines: " +
-						std::to_string(doc1.lines[ocrItr->line1 + blockDiff1.off].line + 1) + " - " +
-						std::to_string(doc2.lines[ocrItr->line2 + blockDiff2.off].line + 1) + "\n");
-			}
-		}
+	getSectionRangeWords(words, line, pos, endPos + 1, options);
 
-		if (groupedLines.empty())
-			return true;
+	return words;
+}
 
-		intptr_t	bestGroupIdx = 0;
-		size_t		bestSize = groupedLines[0].size();
 
-		for (intptr_t i = 1; i < static_cast<intptr_t>(groupedLines.size()); ++i)
+// Returns the words of the null terminated wLine with their UTF-16 positions and lengths
+ArenaVector<Word> getLineWords(std::vector<wchar_t>& wLine, const CompareOptions& options)
+{
+	ArenaVector<Word> words;
+
+	const intptr_t wLen = static_cast<intptr_t>(wLine.size());
+
+	if (wLen <= 1)
+		return words;
+
+	if (options.ignoreRegex)
+	{
+		words = getRegexIgnoreLineWords(wLine, options);
+	}
+	else
+	{
+		intptr_t pos = 0;
+		intptr_t endPos = wLen - 1;
+
+		if (options.ignoreChangedSpaces)
 		{
-			if (bestSize < groupedLines[i].size())
-			{
-				bestSize = groupedLines[i].size();
-				bestGroupIdx = i;
-			}
+			while (pos < endPos && (wLine[pos] == L' ' || wLine[pos] == L'\t'))
+				++pos;
+
+			while (--endPos >= pos && (wLine[endPos] == L' ' || wLine[endPos] == L'\t'));
+
+			++endPos;
 		}
 
-		bestLineMappings = std::move(groupedLines[bestGroupIdx]);
+		getSectionRangeWords(words, wLine, pos, endPos, options);
 	}
 
-	compareLines(doc1, doc2, blockDiff1, blockDiff2, bestLineMappings, options);
-
-	return true;
+	return words;
 }
 
 
-void markSection(const DocCmpInfo& doc, const diffInfo& bd, const CompareOptions& options)
+// Calls addFn(ch, pos) for each char of sec in [pos, endPos) applying the compare options - pos is the UTF-16 one
+template <typename AddFn>
+inline void getSectionRangeChars(std::vector<wchar_t>& sec, intptr_t pos, intptr_t endPos,
+		const CompareOptions& options, AddFn&& addFn)
 {
-	const intptr_t endOff = doc.section.off + doc.section.len;
+	if (pos >= endPos)
+		return;
 
-	for (intptr_t i = doc.section.off, line = bd.off + doc.section.off; i < endOff; ++i, ++line)
+	if (options.ignoreCase)
+		lowerCaseRange(sec, pos, endPos);
+
+	const CharTypes& charTypes = CharTypes::get();
+
+	for (; pos < endPos; ++pos)
 	{
-		intptr_t movedLen = bd.info.movedSection(i);
+		const charType typeOfChar = charTypes[sec[pos]];
 
-		if (movedLen > doc.section.len)
-			movedLen = doc.section.len;
+		if (options.ignoreAllSpaces && typeOfChar == charType::SPACECHAR)
+			continue;
 
-		if (movedLen == 0)
+		if (options.ignoreChangedSpaces && typeOfChar == charType::SPACECHAR)
 		{
-			intptr_t prevLine = doc.lines[line].line + 1;
+			addFn(L' ', pos);
 
-			for (; (i < endOff) && (bd.info.movedSection(i) == 0); ++i, ++line)
-			{
-				const intptr_t docLine = doc.lines[line].line;
-				const int mark = (doc.nonUniqueLines.find(docLine) == doc.nonUniqueLines.end()) ? doc.blockDiffMask :
-						(doc.blockDiffMask == MARKER_MASK_ADDED) ? MARKER_MASK_ADDED_LOCAL : MARKER_MASK_REMOVED_LOCAL;
+			while (++pos < endPos && charTypes[sec[pos]] == charType::SPACECHAR);
 
-				CallScintilla(doc.view, SCI_MARKERADDSET, docLine, mark);
+			if (pos == endPos)
+				break;
+		}
 
-				if (options.ignoreEmptyLines && !options.neverMarkIgnored)
-				{
-					for (; prevLine < docLine; ++prevLine)
-						CallScintilla(doc.view, SCI_MARKERADDSET, prevLine, doc.blockDiffMask & MARKER_MASK_LINE);
+		addFn(sec[pos], pos);
+	}
+}
 
-					prevLine = docLine + 1;
-				}
-			}
 
-			--i;
-			--line;
-		}
-		else if (movedLen == 1)
-		{
-			CallScintilla(doc.view, SCI_MARKERADDSET, doc.lines[line].line, MARKER_MASK_MOVED_LINE);
-		}
-		else
-		{
-			CallScintilla(doc.view, SCI_MARKERADDSET, doc.lines[line].line, MARKER_MASK_MOVED_BEGIN);
+template <typename AddFn>
+void getRegexIgnoreLineChars(std::vector<wchar_t>& wLine, const CompareOptions& options, AddFn&& addFn)
+{
+	const intptr_t wLen = static_cast<intptr_t>(wLine.size());
 
-			i += --movedLen;
+	if (wLen <= 1)
+		return;
 
-			intptr_t prevLine = doc.lines[line].line + 1;
-			intptr_t endLine = line + movedLen;
+	intptr_t pos = 0;
+	intptr_t endPos = wLen - 1;
 
-			for (++line; line < endLine; ++line)
-			{
-				const intptr_t docLine = doc.lines[line].line;
-				CallScintilla(doc.view, SCI_MARKERADDSET, docLine, MARKER_MASK_MOVED_MID);
+	if (options.ignoreChangedSpaces && (wLine[pos] == L' ' || wLine[pos] == L'\t'))
+	{
+		while (++pos < endPos && (wLine[pos] == L' ' || wLine[pos] == L'\t'));
 
-				if (options.ignoreEmptyLines && !options.neverMarkIgnored)
-				{
-					for (; prevLine < docLine; ++prevLine)
-						CallScintilla(doc.view, SCI_MARKERADDSET, prevLine, MARKER_MASK_MOVED_MID & MARKER_MASK_LINE);
+		if (pos == endPos)
+			return;
+	}
 
-					prevLine = docLine + 1;
-				}
-			}
+	forEachIgnoreRegexMatch(wLine, options,
+		[&](intptr_t matchPos, intptr_t matchLen)
+		{
+			getSectionRangeChars(wLine, pos, matchPos, options, addFn);
 
-			const intptr_t docLine = doc.lines[line].line;
-			CallScintilla(doc.view, SCI_MARKERADDSET, docLine, MARKER_MASK_MOVED_END);
+			pos = matchPos + matchLen;
+		});
 
-			if (options.ignoreEmptyLines && !options.neverMarkIgnored)
-			{
-				for (; prevLine < docLine; ++prevLine)
-					CallScintilla(doc.view, SCI_MARKERADDSET, prevLine, MARKER_MASK_MOVED_MID & MARKER_MASK_LINE);
-			}
-		}
-	}
+	--endPos;
+
+	if (options.ignoreChangedSpaces && (wLine[endPos] == L' ' || wLine[endPos] == L'\t'))
+		while (--endPos >= pos && (wLine[endPos] == L' ' || wLine[endPos] == L'\t'));
+
+	if (endPos >= pos)
+		getSectionRangeChars(wLine, pos, endPos + 1, options, addFn);
 }
 
 
-void markLineDiffs(const CompareInfo& cmpInfo, const diffInfo& bd, intptr_t lineIdx)
+// Returns the chars of the null terminated wSec with their byte positions (relative to wSec start)
+SectionChars getSectionChars(std::vector<wchar_t>& wSec, int codepage, bool multiByte,
+	const CompareOptions& options)
 {
-	intptr_t line = cmpInfo.doc1.lines[bd.off + bd.info.changedLines[lineIdx].line].line;
-	intptr_t linePos = getLineStart(cmpInfo.doc1.view, line);
-	int color = (cmpInfo.doc1.blockDiffMask == MARKER_MASK_ADDED) ?
-			Settings.colors().add_highlight : Settings.colors().rem_highlight;
+	SectionChars chars;
 
-	for (const auto& change: bd.info.changedLines[lineIdx].changes)
-		markTextAsChanged(cmpInfo.doc1.view, linePos + change.off, change.len, color);
+	const intptr_t wLen = static_cast<intptr_t>(wSec.size());
 
-	CallScintilla(cmpInfo.doc1.view, SCI_MARKERADDSET, line,
-			cmpInfo.doc1.nonUniqueLines.find(line) == cmpInfo.doc1.nonUniqueLines.end() ?
-			MARKER_MASK_CHANGED : MARKER_MASK_CHANGED_LOCAL);
+	if (wLen <= 1)
+		return chars;
 
-	line = cmpInfo.doc2.lines[bd.info.matchBlock->off + bd.info.matchBlock->info.changedLines[lineIdx].line].line;
-	linePos = getLineStart(cmpInfo.doc2.view, line);
-	color = (cmpInfo.doc2.blockDiffMask == MARKER_MASK_ADDED) ?
-			Settings.colors().add_highlight : Settings.colors().rem_highlight;
+	chars.chars.reserve(wLen - 1);
 
-	for (const auto& change: bd.info.matchBlock->info.changedLines[lineIdx].changes)
-		markTextAsChanged(cmpInfo.doc2.view, linePos + change.off, change.len, color);
+	if (!multiByte)
+	{
+		getSectionRangeChars(wSec, 0, wLen - 1, options, [&chars](wchar_t ch, intptr_t pos) { chars.add(ch, pos); });
 
-	CallScintilla(cmpInfo.doc2.view, SCI_MARKERADDSET, line,
-			cmpInfo.doc2.nonUniqueLines.find(line) == cmpInfo.doc2.nonUniqueLines.end() ?
-			MARKER_MASK_CHANGED : MARKER_MASK_CHANGED_LOCAL);
-}
+		return chars;
+	}
 
+	// In case of UTF-16 or UTF-32 find chars byte positions because Scintilla uses those
+	intptr_t bytePos = 0;
+	intptr_t currPos = 0;
 
-bool markAllDiffs(CompareInfo& cmpInfo, const CompareOptions& options, CompareSummary& summary)
-{
-	progress_ptr& progress = ProgressDlg::Get();
+	getSectionRangeChars(wSec, 0, wLen - 1, options,
+		[&](wchar_t ch, intptr_t pos)
+		{
+			if (currPos < pos)
+				bytePos += codepageLen(codepage, wSec.data() + currPos, pos - currPos);
 
-	summary.clear();
+			currPos = pos + 1;
 
-	const intptr_t blockDiffSize = static_cast<intptr_t>(cmpInfo.blockDiffs.size());
+			chars.add(ch, bytePos);
 
-	progress->SetMaxCount(blockDiffSize);
+			bytePos += codepageLen(codepage, wSec.data() + pos, 1);
+		});
 
-	std::pair<intptr_t, intptr_t> alignLines {0, 0};
+	return chars;
+}
 
-	AlignmentPair alignPair;
 
-	AlignmentViewData* pMainAlignData	= &alignPair.main;
-	AlignmentViewData* pSubAlignData	= &alignPair.sub;
+// Returns the compared chars of the block lines - their positions are not needed to find the lines convergence
+ArenaVector<ArenaVector<wchar_t>> getLinesChars(const BlockText& blockText, const CompareOptions& options)
+{
+	const intptr_t linesCount = static_cast<intptr_t>(blockText.lines.size());
 
-	// Make sure pMainAlignData is linked to doc1
-	if (cmpInfo.doc1.view == SUB_VIEW)
-		std::swap(pMainAlignData, pSubAlignData);
+	ArenaVector<ArenaVector<wchar_t>> chars(linesCount);
 
-	for (intptr_t i = 0; i < blockDiffSize; ++i)
-	{
-		const diffInfo& bd = cmpInfo.blockDiffs[i];
+	std::vector<wchar_t> wLine;
 
-		if (bd.type == diff_type::DIFF_MATCH)
-		{
-			pMainAlignData->diffMask	= 0;
-			pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
+	for (intptr_t blockLine = 0; blockLine < linesCount; ++blockLine)
+	{
+		// Moved and empty lines have no text, too long lines are left out
+		if (blockText.lines[blockLine].len == 0 || blockText.lines[blockLine].len - 1 > cMaxLineCharsLen)
+			continue;
 
-			pSubAlignData->diffMask		= 0;
-			pSubAlignData->line			= toAlignmentLine(cmpInfo.doc2, alignLines.second);
+		ArenaVector<wchar_t>& lineChars = chars[blockLine];
 
-			summary.alignmentInfo.emplace_back(alignPair);
+		blockText.copyLine(blockLine, wLine);
 
-			if (options.alignAllMatches)
-			{
-				// Align all pairs of matching lines
-				for (intptr_t j = bd.len - 1; j; --j)
-				{
-					++alignLines.first;
-					++alignLines.second;
+		lineChars.reserve(wLine.size() - 1);
 
-					pMainAlignData->line	= cmpInfo.doc1.lines[alignLines.first].line;
-					pSubAlignData->line		= cmpInfo.doc2.lines[alignLines.second].line;
+		auto addFn = [&lineChars](wchar_t ch, intptr_t) { lineChars.push_back(ch); };
 
-					summary.alignmentInfo.emplace_back(alignPair);
-				}
+		if (options.ignoreRegex)
+		{
+			getRegexIgnoreLineChars(wLine, options, addFn);
+		}
+		else
+		{
+			getSectionRangeChars(wLine, 0, static_cast<intptr_t>(wLine.size()) - 1, options, addFn);
 
-				++alignLines.first;
-				++alignLines.second;
-			}
-			else
+			if (options.ignoreChangedSpaces)
 			{
-				if (options.ignoreEmptyLines)
-				{
-					// Align pairs of matching lines after ignored lines sections
-					for (intptr_t j = bd.len - 1; j; --j)
-					{
-						++alignLines.first;
-						++alignLines.second;
+				auto isSpace = [](wchar_t ch) { return (ch == L' ' || ch == L'\t'); };
 
-						if ((++pMainAlignData->line != cmpInfo.doc1.lines[alignLines.first].line) ||
-							(++pSubAlignData->line != cmpInfo.doc2.lines[alignLines.second].line))
-						{
-							pMainAlignData->line	= cmpInfo.doc1.lines[alignLines.first].line;
-							pSubAlignData->line		= cmpInfo.doc2.lines[alignLines.second].line;
+				lineChars.erase(lineChars.begin(), std::find_if_not(lineChars.begin(), lineChars.end(), isSpace));
+				lineChars.erase(std::find_if_not(lineChars.rbegin(), lineChars.rend(), isSpace).base(),
+						lineChars.end());
+			}
+		}
+	}
 
-							summary.alignmentInfo.emplace_back(alignPair);
-						}
-					}
+	return chars;
+}
 
-					++alignLines.first;
-					++alignLines.second;
-				}
-				else
-				{
-					alignLines.first	+= bd.len;
-					alignLines.second	+= bd.len;
-				}
-			}
 
-			summary.match += bd.len;
-		}
-		else if (bd.type == diff_type::DIFF_IN_2)
-		{
-			cmpInfo.doc2.section.off = 0;
-			cmpInfo.doc2.section.len = bd.len;
-			markSection(cmpInfo.doc2, bd, options);
+// Assigns the lines dense class IDs through an open addressing table keyed by the line hash - sized for all lines
+// being distinct so that the probe sequences stay short
+void internLines(const Line* lines1, intptr_t len1, const Line* lines2, intptr_t len2, LineClasses& classes)
+{
+	struct Slot
+	{
+		uint64_t	hash;
+		uint32_t	id;
+	};
 
-			pMainAlignData->diffMask	= 0;
-			pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
+	static constexpr uint32_t cEmptySlot = UINT32_MAX;
 
-			pSubAlignData->diffMask		= cmpInfo.doc2.blockDiffMask;
-			pSubAlignData->line			= toAlignmentLine(cmpInfo.doc2, alignLines.second);
+	int tableBits = 1;
 
-			summary.alignmentInfo.emplace_back(alignPair);
+	while ((intptr_t(1) << tableBits) < (len1 + len2) * 2)
+		++tableBits;
 
-			const intptr_t movedLines = bd.info.movedCount();
+	const size_t tableMask = (size_t(1) << tableBits) - 1;
 
-			summary.diffLines	+= bd.len;
-			summary.moved		+= movedLines;
+	std::vector<Slot> table(tableMask + 1, Slot { 0, cEmptySlot });
 
-			if (cmpInfo.doc2.blockDiffMask == MARKER_MASK_ADDED)
-				summary.added += bd.len - movedLines;
-			else
-				summary.removed += bd.len - movedLines;
+	uint32_t count = 0;
 
-			alignLines.second += bd.len;
-		}
-		else if (bd.type == diff_type::DIFF_IN_1)
+	auto intern =
+		[&](const Line* lines, intptr_t len, std::vector<uint32_t>& ids)
 		{
-			if (bd.info.matchBlock)
+			ids.resize(len);
+
+			for (intptr_t i = 0; i < len; ++i)
 			{
-				const intptr_t changedLinesCount = static_cast<intptr_t>(bd.info.changedLines.size());
+				const uint64_t hash = lines[i].hash;
 
-				cmpInfo.doc1.section.off = 0;
-				cmpInfo.doc2.section.off = 0;
+				size_t slot = static_cast<size_t>((hash * 0x9E3779B97F4A7C15ULL) >> (64 - tableBits));
 
-				for (intptr_t j = 0; j < changedLinesCount; ++j)
+				while (table[slot].id != cEmptySlot && table[slot].hash != hash)
+					slot = (slot + 1) & tableMask;
+
+				if (table[slot].id == cEmptySlot)
 				{
-					cmpInfo.doc1.section.len = bd.info.changedLines[j].line - cmpInfo.doc1.section.off;
-					cmpInfo.doc2.section.len = bd.info.matchBlock->info.changedLines[j].line - cmpInfo.doc2.section.off;
+					table[slot].hash	= hash;
+					table[slot].id		= count++;
+				}
 
-					if (cmpInfo.doc1.section.len || cmpInfo.doc2.section.len)
-					{
-						pMainAlignData->diffMask	= cmpInfo.doc1.section.len ? cmpInfo.doc1.blockDiffMask : 0;
-						pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
+				ids[i] = table[slot].id;
+			}
+		};
 
-						pSubAlignData->diffMask		= cmpInfo.doc2.section.len ? cmpInfo.doc2.blockDiffMask : 0;
-						pSubAlignData->line			= toAlignmentLine(cmpInfo.doc2, alignLines.second);
+	intern(lines1, len1, classes.ids[0]);
+	intern(lines2, len2, classes.ids[1]);
 
-						summary.alignmentInfo.emplace_back(alignPair);
+	classes.count	= count;
+	classes.valid	= true;
+}
 
-						if (options.ignoreEmptyLines && options.neverMarkIgnored &&
-							cmpInfo.doc1.section.len && cmpInfo.doc2.section.len)
-						{
-							std::vector<intptr_t> alignLines1;
-							intptr_t maxLines = cmpInfo.doc1.section.len + alignLines.first;
 
-							for (intptr_t l = alignLines.first + 1; l < maxLines; ++l)
-							{
-								if (cmpInfo.doc1.lines[l].line - cmpInfo.doc1.lines[l - 1].line > 1)
-									alignLines1.emplace_back(l);
-							}
+// The whole documents lines classes - interned on first use
+const LineClasses& getLineClasses(CompareInfo& cmpInfo)
+{
+	if (!cmpInfo.classes.valid)
+		internLines(cmpInfo.doc1.lines.data(), static_cast<intptr_t>(cmpInfo.doc1.lines.size()),
+				cmpInfo.doc2.lines.data(), static_cast<intptr_t>(cmpInfo.doc2.lines.size()), cmpInfo.classes);
 
-							if (!alignLines1.empty())
-							{
-								std::vector<intptr_t> alignLines2;
-								maxLines = cmpInfo.doc2.section.len + alignLines.second;
+	return cmpInfo.classes;
+}
 
-								for (intptr_t l = alignLines.second + 1; l < maxLines; ++l)
-								{
-									if (cmpInfo.doc2.lines[l].line - cmpInfo.doc2.lines[l - 1].line > 1)
-										alignLines2.emplace_back(l);
-								}
 
-								maxLines = std::min(alignLines1.size(), alignLines2.size());
+// Scan for the best single matching block in the other file. Only the other file lines of the same class as the
+// looked up one are checked - they are visited in blocks and lines order as if all lines were scanned.
+void findBestMatch(const CompareInfo& cmpInfo, const MoveCandidates& candidates,
+		const diffInfo& lookupDiff, intptr_t lookupOff, MatchInfo& mi)
+{
+	mi.matchLen		= 0;
+	mi.matchDiff	= nullptr;
 
-								for (intptr_t l = 0; l < maxLines; ++l)
-								{
-									pMainAlignData->line	= toAlignmentLine(cmpInfo.doc1, alignLines1[l]);
-									pSubAlignData->line		= toAlignmentLine(cmpInfo.doc2, alignLines2[l]);
+	const uint32_t* lookupIds;
+	const uint32_t* matchIds;
+	const MoveCandidates::Group* pCandidates;
 
-									summary.alignmentInfo.emplace_back(alignPair);
-								}
-							}
-						}
+	if (lookupDiff.type == diff_type::DIFF_IN_1)
+	{
+		lookupIds	= cmpInfo.classes.ids[0].data();
+		matchIds	= cmpInfo.classes.ids[1].data();
+		pCandidates	= &candidates.in2;
+	}
+	else
+	{
+		lookupIds	= cmpInfo.classes.ids[1].data();
+		matchIds	= cmpInfo.classes.ids[0].data();
+		pCandidates	= &candidates.in1;
+	}
 
-						if (cmpInfo.doc1.section.len)
-						{
-							markSection(cmpInfo.doc1, bd, options);
-							alignLines.first += cmpInfo.doc1.section.len;
-						}
+	const uint32_t lookupId = lookupIds[lookupDiff.off + lookupOff];
 
-						if (cmpInfo.doc2.section.len)
-						{
-							markSection(cmpInfo.doc2, *bd.info.matchBlock, options);
-							alignLines.second += cmpInfo.doc2.section.len;
-						}
+	const auto first	= pCandidates->candidates.begin() + pCandidates->start[lookupId];
+	const auto last		= pCandidates->candidates.begin() + pCandidates->start[lookupId + 1];
 
-						summary.diffLines += std::max(cmpInfo.doc1.section.len, cmpInfo.doc2.section.len);
-					}
+	intptr_t minMatchLen = 1;
 
-					pMainAlignData->diffMask	= MARKER_MASK_CHANGED;
-					pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
+	const diffInfo* pMatchDiff = nullptr;
 
-					pSubAlignData->diffMask		= MARKER_MASK_CHANGED;
-					pSubAlignData->line			= toAlignmentLine(cmpInfo.doc2, alignLines.second);
+	// The first block line to be checked, the ones before were already skipped
+	intptr_t nextMatchOff = 0;
+	bool skipMatchDiff = false;
 
-					summary.alignmentInfo.emplace_back(alignPair);
+	for (auto candidateIt = first; candidateIt != last; ++candidateIt)
+	{
+		const diffInfo& matchDiff = *(candidateIt->matchDiff);
 
-					markLineDiffs(cmpInfo, bd, j);
+		if (&matchDiff != pMatchDiff)
+		{
+			pMatchDiff		= &matchDiff;
+			nextMatchOff	= 0;
+			skipMatchDiff	= (matchDiff.len < minMatchLen);
+		}
 
-					cmpInfo.doc1.section.off = bd.info.changedLines[j].line + 1;
-					cmpInfo.doc2.section.off = bd.info.matchBlock->info.changedLines[j].line + 1;
+		if (skipMatchDiff || candidateIt->matchOff < nextMatchOff)
+			continue;
 
-					++alignLines.first;
-					++alignLines.second;
+		intptr_t matchOff = candidateIt->matchOff;
+
+		if (matchDiff.info.getNextUnmoved(matchOff))
+		{
+			if (matchOff >= matchDiff.len)
+			{
+				skipMatchDiff = true;
+				continue;
+			}
+
+			if (matchIds[matchDiff.off + matchOff] != lookupId)
+			{
+				nextMatchOff = matchOff + 1;
+				continue;
+			}
+		}
+
+		intptr_t lookupStart	= lookupOff - 1;
+		intptr_t matchStart		= matchOff - 1;
+
+		// Check for the beginning of the matched block (containing lookupOff element)
+		for (; lookupStart >= 0 && matchStart >= 0 &&
+				lookupIds[lookupDiff.off + lookupStart] == matchIds[matchDiff.off + matchStart] &&
+				!lookupDiff.info.movedSection(lookupStart) && !matchDiff.info.movedSection(matchStart);
+				--lookupStart, --matchStart);
+
+		++lookupStart;
+		++matchStart;
+
+		intptr_t lookupEnd	= lookupOff + 1;
+		intptr_t matchEnd	= matchOff + 1;
+
+		// Check for the end of the matched block (containing lookupOff element)
+		for (; lookupEnd < lookupDiff.len && matchEnd < matchDiff.len &&
+				lookupIds[lookupDiff.off + lookupEnd] == matchIds[matchDiff.off + matchEnd] &&
+				!lookupDiff.info.movedSection(lookupEnd) && !matchDiff.info.movedSection(matchEnd);
+				++lookupEnd, ++matchEnd);
+
+		const intptr_t matchLen = lookupEnd - lookupStart;
+
+		if (mi.matchLen < matchLen)
+		{
+			mi.lookupOff	= lookupStart;
+			mi.matchDiff	= candidateIt->matchDiff;
+			mi.matchOff		= matchStart;
+			mi.matchLen		= matchLen;
+
+			minMatchLen		= matchLen;
+			matchOff		= matchEnd - 1;
+		}
+		else if (mi.matchLen == matchLen)
+		{
+			mi.matchDiff	= nullptr;
+			matchOff		= matchEnd - 1;
+		}
+
+		nextMatchOff = matchOff + 1;
+	}
+}
+
+
+// Recursively resolve the best match
+bool resolveMatch(const CompareInfo& cmpInfo, const MoveCandidates& candidates,
+		diffInfo& lookupDiff, intptr_t lookupOff, MatchInfo& lookupMi)
+{
+	bool ret = false;
+
+	if (lookupMi.matchDiff)
+	{
+		lookupOff = lookupMi.matchOff + (lookupOff - lookupMi.lookupOff);
+
+		MatchInfo reverseMi;
+		findBestMatch(cmpInfo, candidates, *(lookupMi.matchDiff), lookupOff, reverseMi);
+
+		if ((reverseMi.matchDiff == &lookupDiff) && (reverseMi.matchOff == lookupMi.lookupOff))
+		{
+			LOGD(LOG_ALGO, "Move match found, len: " + std::to_string(lookupMi.matchLen) + "\n");
+
+			lookupDiff.info.addMove(lookupDiff.len, lookupMi.lookupOff, lookupMi.matchLen);
+			lookupMi.matchDiff->info.addMove(lookupMi.matchDiff->len, lookupMi.matchOff, lookupMi.matchLen);
+			ret = true;
+		}
+		else if (reverseMi.matchDiff)
+		{
+			ret = resolveMatch(cmpInfo, candidates, *(lookupMi.matchDiff), lookupOff, reverseMi);
+			lookupMi.matchLen = 0;
+		}
+	}
+
+	return ret;
+}
+
+
+void getMoveCandidates(CompareInfo& cmpInfo, MoveCandidates& candidates)
+{
+	const LineClasses& classes = getLineClasses(cmpInfo);
+
+	// Counting sort by class ID - keeps blocks and lines order within a class
+	auto group =
+		[&](diff_type type, const std::vector<uint32_t>& ids, MoveCandidates::Group& grp)
+		{
+			grp.start.assign(classes.count + 1, 0);
+
+			for (const diffInfo& bd: cmpInfo.blockDiffs)
+			{
+				if (bd.type == type)
+				{
+					for (intptr_t i = 0; i < bd.len; ++i)
+						++grp.start[ids[bd.off + i] + 1];
 				}
+			}
 
-				cmpInfo.doc1.section.len = bd.len - cmpInfo.doc1.section.off;
-				cmpInfo.doc2.section.len = bd.info.matchBlock->len - cmpInfo.doc2.section.off;
+			for (uint32_t id = 0; id < classes.count; ++id)
+				grp.start[id + 1] += grp.start[id];
 
-				if (cmpInfo.doc1.section.len || cmpInfo.doc2.section.len)
+			grp.candidates.resize(grp.start.back());
+
+			std::vector<intptr_t> next(grp.start.begin(), grp.start.end() - 1);
+
+			for (diffInfo& bd: cmpInfo.blockDiffs)
+			{
+				if (bd.type == type)
 				{
-					pMainAlignData->diffMask	= cmpInfo.doc1.section.len ? cmpInfo.doc1.blockDiffMask : 0;
-					pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
+					for (intptr_t i = 0; i < bd.len; ++i)
+						grp.candidates[next[ids[bd.off + i]]++] = { &bd, i };
+				}
+			}
+		};
 
-					pSubAlignData->diffMask		= cmpInfo.doc2.section.len ? cmpInfo.doc2.blockDiffMask : 0;
-					pSubAlignData->line			= toAlignmentLine(cmpInfo.doc2, alignLines.second);
+	group(diff_type::DIFF_IN_1, classes.ids[0], candidates.in1);
+	group(diff_type::DIFF_IN_2, classes.ids[1], candidates.in2);
+}
 
-					summary.alignmentInfo.emplace_back(alignPair);
 
-					if (options.ignoreEmptyLines && options.neverMarkIgnored &&
-						cmpInfo.doc1.section.len && cmpInfo.doc2.section.len)
-					{
-						std::vector<intptr_t> alignLines1;
-						intptr_t maxLines = cmpInfo.doc1.section.len + alignLines.first;
+void findMoves(CompareInfo& cmpInfo)
+{
+	TraceScope trace("FindMoves", static_cast<int64_t>(cmpInfo.blockDiffs.size()));
 
-						for (intptr_t l = alignLines.first + 1; l < maxLines; ++l)
-						{
-							if (cmpInfo.doc1.lines[l].line - cmpInfo.doc1.lines[l - 1].line > 1)
-								alignLines1.emplace_back(l);
-						}
+	LOGD(LOG_ALGO, "FIND MOVES\n");
 
-						if (!alignLines1.empty())
-						{
-							std::vector<intptr_t> alignLines2;
-							maxLines = cmpInfo.doc2.section.len + alignLines.second;
+	MoveCandidates candidates;
 
-							for (intptr_t l = alignLines.second + 1; l < maxLines; ++l)
-							{
-								if (cmpInfo.doc2.lines[l].line - cmpInfo.doc2.lines[l - 1].line > 1)
-									alignLines2.emplace_back(l);
-							}
+	getMoveCandidates(cmpInfo, candidates);
 
-							maxLines = std::min(alignLines1.size(), alignLines2.size());
+	bool repeat = true;
 
-							for (intptr_t l = 0; l < maxLines; ++l)
-							{
-								pMainAlignData->line	= toAlignmentLine(cmpInfo.doc1, alignLines1[l]);
-								pSubAlignData->line		= toAlignmentLine(cmpInfo.doc2, alignLines2[l]);
+	while (repeat)
+	{
+		repeat = false;
 
-								summary.alignmentInfo.emplace_back(alignPair);
-							}
-						}
-					}
+		for (diffInfo& lookupDiff: cmpInfo.blockDiffs)
+		{
+			if (lookupDiff.type != diff_type::DIFF_IN_1)
+				continue;
 
-					if (cmpInfo.doc1.section.len)
-					{
-						markSection(cmpInfo.doc1, bd, options);
-						alignLines.first += cmpInfo.doc1.section.len;
-					}
+			LOGD(LOG_ALGO, "Check D1 with off: " + std::to_string(cmpInfo.doc1.lines[lookupDiff.off].line + 1) + "\n");
 
-					if (cmpInfo.doc2.section.len)
-					{
-						markSection(cmpInfo.doc2, *bd.info.matchBlock, options);
-						alignLines.second += cmpInfo.doc2.section.len;
-					}
+			// Go through all lookupDiff's elements and check if each is matched
+			for (intptr_t lookupEi = 0; lookupEi < lookupDiff.len; ++lookupEi)
+			{
+				// Skip already detected moves
+				if (lookupDiff.info.getNextUnmoved(lookupEi))
+				{
+					if (lookupEi >= lookupDiff.len)
+						break;
+				}
 
-					summary.diffLines += std::max(cmpInfo.doc1.section.len, cmpInfo.doc2.section.len);
+				MatchInfo mi;
+				findBestMatch(cmpInfo, candidates, lookupDiff, lookupEi, mi);
+
+				if (resolveMatch(cmpInfo, candidates, lookupDiff, lookupEi, mi))
+				{
+					repeat = true;
+
+					if (mi.matchLen)
+						lookupEi = mi.lookupOff + mi.matchLen - 1;
+					else
+						--lookupEi;
 				}
+			}
+		}
+	}
+}
+
+
+// Per class: bit 0 set if it occurs in doc1, bit 1 set if it occurs in doc2
+std::vector<uint8_t> getClassesDocs(const LineClasses& classes)
+{
+	std::vector<uint8_t> inDocs(classes.count, 0);
+
+	for (uint32_t id: classes.ids[0])
+		inDocs[id] |= 1;
+
+	for (uint32_t id: classes.ids[1])
+		inDocs[id] |= 2;
+
+	return inDocs;
+}
+
+
+void findUniqueLines(CompareInfo& cmpInfo)
+{
+	const LineClasses& classes = getLineClasses(cmpInfo);
+
+	const std::vector<uint8_t> inDocs = getClassesDocs(classes);
+
+	const size_t size1 = classes.ids[0].size();
+	const size_t size2 = classes.ids[1].size();
+
+	cmpInfo.doc1.nonUniqueLines.assign(size1, false);
+	cmpInfo.doc2.nonUniqueLines.assign(size2, false);
+
+	for (size_t i = 0; i < size1; ++i)
+	{
+		if (inDocs[classes.ids[0][i]] & 2)
+			cmpInfo.doc1.nonUniqueLines[i] = true;
+	}
+
+	for (size_t i = 0; i < size2; ++i)
+	{
+		if (inDocs[classes.ids[1][i]] & 1)
+			cmpInfo.doc2.nonUniqueLines[i] = true;
+	}
+}
+
+
+inline intptr_t matchBeginEnd(diffInfo& blockDiff1, diffInfo& blockDiff2,
+		const SectionChars& sec1, const SectionChars& sec2,
+		intptr_t off1, intptr_t off2, intptr_t end1, intptr_t end2,
+		std::function<bool(const wchar_t)>&& charFilter_fn)
+{
+	const auto& chars1 = sec1.chars;
+	const auto& chars2 = sec2.chars;
+
+	const intptr_t minSecSize = std::min(sec1.size(), sec2.size());
+
+	intptr_t startMatch = 0;
+	while ((minSecSize > startMatch) && (chars1[startMatch] == chars2[startMatch]) && charFilter_fn(chars1[startMatch]))
+		++startMatch;
+
+	intptr_t endMatch = 0;
+	while ((minSecSize - startMatch > endMatch) &&
+			(chars1[sec1.size() - endMatch - 1] == chars2[sec2.size() - endMatch - 1]) &&
+			charFilter_fn(chars1[sec1.size() - endMatch - 1]))
+		++endMatch;
+
+	if (startMatch || endMatch)
+	{
+		section_t change;
+
+		if (sec1.size() > startMatch + endMatch)
+		{
+			change.off = off1;
+			if (startMatch)
+				change.off += sec1.pos(startMatch);
+
+			change.len = (endMatch ?
+					sec1.pos(sec1.size() - endMatch - 1) + 1 + off1 : end1) - change.off;
+
+			if (change.len > 0)
+				blockDiff1.info.changedLines.back().changes.emplace_back(change);
+		}
+
+		if (sec2.size() > startMatch + endMatch)
+		{
+			change.off = off2;
+			if (startMatch)
+				change.off += sec2.pos(startMatch);
+
+			change.len = (endMatch ?
+					sec2.pos(sec2.size() - endMatch - 1) + 1 + off2 : end2) - change.off;
+
+			if (change.len > 0)
+				blockDiff2.info.changedLines.back().changes.emplace_back(change);
+		}
+	}
+
+	return (startMatch + endMatch);
+}
+
+
+// Bytes of the DiffCalc V arrays searching a diff of up to maxCost between sequences of len1 and len2 items
+inline uint64_t diffCalcBytes(intptr_t len1, intptr_t len2, intptr_t maxCost)
+{
+	const intptr_t absDelta = (len1 > len2) ? len1 - len2 : len2 - len1;
+
+	return (4 * static_cast<uint64_t>(absDelta + maxCost + 1) + 2) * sizeof(intptr_t);
+}
+
+
+// Returns the diff cost limit the V arrays of diffsCount diffs running at once fit in the memory budget with - the
+// given costLimit (0 means unlimited) if they fit with it
+intptr_t budgetDiffCostLimit(intptr_t len1, intptr_t len2, intptr_t costLimit, int diffsCount,
+		const CompareOptions& options)
+{
+	const uint64_t budget = memoryBudget(options);
+
+	if (!budget)
+		return costLimit;
+
+	const intptr_t maxCost = (costLimit > 0) ? std::min(costLimit, len1 + len2) : len1 + len2;
+
+	if (diffCalcBytes(len1, len2, maxCost) * diffsCount <= budget)
+		return costLimit;
+
+	const uint64_t baseBytes	= diffCalcBytes(len1, len2, 0) * diffsCount;
+	const uint64_t costBytes	= 4 * sizeof(intptr_t) * diffsCount;
+
+	context().stats.budgetBoundedDiff = true;
+
+	return (budget > baseBytes) ? std::max<intptr_t>(static_cast<intptr_t>((budget - baseBytes) / costBytes), 1) : 1;
+}
+
+
+// Can the changed words chars be diffed within the memory budget?
+inline bool charsDiffFits(intptr_t len1, intptr_t len2, const CompareOptions& options)
+{
+	const uint64_t budget = memoryBudget(options);
+
+	if (!budget)
+		return true;
+
+	const intptr_t maxCost = (std::max(len1, len2) > cLongSectionLen) ? cLongSectionDiffCostLimit : len1 + len2;
+
+	if (diffCalcBytes(len1, len2, maxCost) <= budget)
+		return true;
+
+	++context().stats.budgetSkippedCharDiffs;
+
+	return false;
+}
+
+
+void compareLines(const DocCmpInfo& doc1, const DocCmpInfo& doc2, const BlockText& blockText1,
+		const BlockText& blockText2, diffInfo& blockDiff1, diffInfo& blockDiff2,
+		const std::map<intptr_t, intptr_t>& lineMappings, const CompareOptions& options)
+{
+	DiffWorkspace workspace;
+
+	std::vector<wchar_t> wLine1;
+	std::vector<wchar_t> wLine2;
+	std::vector<wchar_t> wSec;
+
+	for (const auto& lm: lineMappings)
+	{
+		// The line words and sections chars are dropped from the arena once the line pair is compared
+		ScopedArenaRewind lineArenaRewind;
+
+		intptr_t line1 = lm.second;
+		intptr_t line2 = lm.first;
+
+		LOGD(LOG_ALGO, "Compare Lines " + std::to_string(doc1.lines[blockDiff1.off + line1].line + 1) + " and " +
+				std::to_string(doc2.lines[blockDiff2.off + line2].line + 1) + "\n");
+
+		blockText1.copyLine(line1, wLine1);
+		blockText2.copyLine(line2, wLine2);
+
+		ArenaVector<Word> lineWords1 = getLineWords(wLine1, options);
+		ArenaVector<Word> lineWords2 = getLineWords(wLine2, options);
+
+		// Words UTF-16 positions are needed to get the sections chars from the lines text
+		ArenaVector<Word> wideWords1;
+		ArenaVector<Word> wideWords2;
+
+		// In case of UTF-16 or UTF-32 find words byte positions and lengths because Scintilla uses those
+		if (blockText1.lines[line1].multiByte)
+		{
+			wideWords1 = lineWords1;
+			recalculateWordPos(blockText1.codepage, lineWords1, wLine1);
+		}
+
+		if (blockText2.lines[line2].multiByte)
+		{
+			wideWords2 = lineWords2;
+			recalculateWordPos(blockText2.codepage, lineWords2, wLine2);
+		}
+
+		const auto* pLine1 = &lineWords1;
+		const auto* pLine2 = &lineWords2;
+
+		const auto* pWideLine1 = blockText1.lines[line1].multiByte ? &wideWords1 : &lineWords1;
+		const auto* pWideLine2 = blockText2.lines[line2].multiByte ? &wideWords2 : &lineWords2;
+
+		const std::vector<wchar_t>* pText1 = &wLine1;
+		const std::vector<wchar_t>* pText2 = &wLine2;
+
+		const BlockText* pBlockText1 = &blockText1;
+		const BlockText* pBlockText2 = &blockText2;
+
+		diffInfo* pBlockDiff1 = &blockDiff1;
+		diffInfo* pBlockDiff2 = &blockDiff2;
+
+		// First use word granularity (find matching words) for better precision
+		auto wordDiffRes = DiffCalc<Word>(lineWords1, lineWords2, nullptr, &workspace)(!options.detectCharDiffs, true);
+		++context().stats.diffCalcRuns;
+		const std::vector<diff_info<void>> lineDiffs = std::move(wordDiffRes.first);
+
+		if (wordDiffRes.second)
+		{
+			std::swap(pBlockDiff1, pBlockDiff2);
+			std::swap(pLine1, pLine2);
+			std::swap(pWideLine1, pWideLine2);
+			std::swap(pText1, pText2);
+			std::swap(pBlockText1, pBlockText2);
+			std::swap(line1, line2);
+		}
+
+		const intptr_t lineDiffsSize = static_cast<intptr_t>(lineDiffs.size());
+
+		PRINT_DIFFS("WORD DIFFS", lineDiffs);
+
+		pBlockDiff1->info.changedLines.emplace_back(line1);
+		pBlockDiff2->info.changedLines.emplace_back(line2);
+
+		intptr_t lineLen1 = 0;
+		intptr_t lineLen2 = 0;
+
+		for (const auto& word: *pLine1)
+			lineLen1 += word.len;
+
+		for (const auto& word: *pLine2)
+			lineLen2 += word.len;
+
+		intptr_t totalLineMatchLen = 0;
+
+		for (intptr_t i = 0; i < lineDiffsSize; ++i)
+		{
+			const auto& ld = lineDiffs[i];
+
+			if (ld.type == diff_type::DIFF_MATCH)
+			{
+				for (intptr_t j = 0; j < ld.len; ++j)
+					totalLineMatchLen += (*pLine1)[ld.off + j].len;
+			}
+			else if (ld.type == diff_type::DIFF_IN_2)
+			{
+				section_t change;
+
+				change.off = (*pLine2)[ld.off].pos;
+				change.len = (*pLine2)[ld.off + ld.len - 1].pos + (*pLine2)[ld.off + ld.len - 1].len - change.off;
+
+				pBlockDiff2->info.changedLines.back().changes.emplace_back(change);
+			}
+			else
+			{
+				// Resolve words mismatched DIFF_IN_1 / DIFF_IN_2 pairs to find possible sub-word similarities
+				if ((i + 1 < lineDiffsSize) && (lineDiffs[i + 1].type == diff_type::DIFF_IN_2))
+				{
+					const auto& ld2 = lineDiffs[i + 1];
+
+					intptr_t off1 = (*pLine1)[ld.off].pos;
+					intptr_t end1 = (*pLine1)[ld.off + ld.len - 1].pos + (*pLine1)[ld.off + ld.len - 1].len;
+
+					intptr_t off2 = (*pLine2)[ld2.off].pos;
+					intptr_t end2 = (*pLine2)[ld2.off + ld2.len - 1].pos + (*pLine2)[ld2.off + ld2.len - 1].len;
+
+					const auto getWordsChars = [&](const std::vector<wchar_t>& wLine, const ArenaVector<Word>& wideWords,
+							const diff_info<void>& wordsDiff, const BlockText& blockText, intptr_t blockLine)
+					{
+						const Word& lastWord = wideWords[wordsDiff.off + wordsDiff.len - 1];
+
+						wSec.assign(wLine.begin() + wideWords[wordsDiff.off].pos,
+								wLine.begin() + lastWord.pos + lastWord.len);
+						wSec.push_back(L'\0');
+
+						return getSectionChars(wSec, blockText.codepage, blockText.lines[blockLine].multiByte, options);
+					};
+
+					const SectionChars sec1 = getWordsChars(*pText1, *pWideLine1, ld, *pBlockText1, line1);
+					const SectionChars sec2 = getWordsChars(*pText2, *pWideLine2, ld2, *pBlockText2, line2);
+
+					if (options.detectCharDiffs && charsDiffFits(static_cast<intptr_t>(sec1.size()),
+							static_cast<intptr_t>(sec2.size()), options))
+					{
+						LOGD(LOG_ALGO, "Compare Sections " +
+								std::to_string(off1 + 1) + " to " +
+								std::to_string(end1 + 1) + " and " +
+								std::to_string(off2 + 1) + " to " +
+								std::to_string(end2 + 1) + "\n");
+
+						const auto* pSec1 = &sec1;
+						const auto* pSec2 = &sec2;
+
+						diffInfo* pBD1 = pBlockDiff1;
+						diffInfo* pBD2 = pBlockDiff2;
+
+						// Compare changed words
+						DiffCalc<wchar_t> charsDiff(sec1.chars, sec2.chars, nullptr, &workspace);
+
+						if (std::max(sec1.size(), sec2.size()) > cLongSectionLen)
+							charsDiff.setCostLimit(cLongSectionDiffCostLimit);
+
+						auto diffRes = charsDiff();
+						++context().stats.diffCalcRuns;
+						const std::vector<diff_info<void>> sectionDiffs = std::move(diffRes.first);
+
+						if (diffRes.second)
+						{
+							std::swap(pSec1, pSec2);
+							std::swap(pBD1, pBD2);
+							std::swap(off1, off2);
+							std::swap(end1, end2);
+						}
+
+						PRINT_DIFFS("CHAR DIFFS", sectionDiffs);
+
+						intptr_t matchLen = 0;
+						intptr_t matchSections = 0;
+
+						for (const auto& sd: sectionDiffs)
+						{
+							if (sd.type == diff_type::DIFF_MATCH)
+							{
+								matchLen += sd.len;
+								++matchSections;
+							}
+						}
+
+						if (matchSections)
+						{
+							LOGD(LOG_ALGO, "Matching sections found: " + std::to_string(matchSections) +
+									", matched len: " + std::to_string(matchLen) + "\n");
+
+							// Are similarities a considerable portion of the diff?
+							if ((int)((matchLen * 100) / std::max(sec1.size(), sec2.size())) >=
+								options.changedThresholdPercent)
+							{
+								for (const auto& sd: sectionDiffs)
+								{
+									if (sd.type == diff_type::DIFF_IN_1)
+									{
+										section_t change;
+
+										change.off = pSec1->pos(sd.off) + off1;
+										change.len = pSec1->pos(sd.off + sd.len - 1) + off1 + 1 - change.off;
+
+										pBD1->info.changedLines.back().changes.emplace_back(change);
+									}
+									else if (sd.type == diff_type::DIFF_IN_2)
+									{
+										section_t change;
+
+										change.off = pSec2->pos(sd.off) + off2;
+										change.len = pSec2->pos(sd.off + sd.len - 1) + off2 + 1 - change.off;
+
+										pBD2->info.changedLines.back().changes.emplace_back(change);
+									}
+								}
+
+								totalLineMatchLen += matchLen;
+
+								LOGD(LOG_ALGO, "Whole section checked for matches\n");
+
+								++i;
+								continue;
+							}
+							// If not, mark only beginning and ending diff section matches
+							else
+							{
+								const intptr_t matches =
+										matchBeginEnd(*pBD1, *pBD2, *pSec1, *pSec2, off1, off2, end1, end2,
+												[](const wchar_t) { return true; });
+
+								if (matches)
+								{
+									totalLineMatchLen += matches;
+
+									++i;
+									continue;
+								}
+							}
+
+							// No matching sections between the lines found - move to next lines
+							if (lineDiffsSize == 2)
+								break;
+						}
+					}
+					// Always match non-alphabetical characters in the beginning and at the end
+					else
+					{
+						const intptr_t matches =
+								matchBeginEnd(*pBlockDiff1, *pBlockDiff2, sec1, sec2, off1, off2, end1, end2,
+										[](const wchar_t ch) { return (getCharTypeW(ch) != charType::ALPHANUMCHAR); });
+
+						if (matches)
+						{
+							totalLineMatchLen += matches;
+
+							++i;
+							continue;
+						}
+
+						// No matching sections between the lines found - move to next lines
+						if (lineDiffsSize == 2)
+							break;
+					}
+				}
+
+				section_t change;
+
+				change.off = (*pLine1)[ld.off].pos;
+				change.len = (*pLine1)[ld.off + ld.len - 1].pos + (*pLine1)[ld.off + ld.len - 1].len - change.off;
+
+				pBlockDiff1->info.changedLines.back().changes.emplace_back(change);
+			}
+		}
+
+		// Not enough portion of the lines matches - consider them totally different
+		if (((totalLineMatchLen * 100) / std::max(lineLen1, lineLen2)) < options.changedThresholdPercent)
+		{
+			pBlockDiff1->info.changedLines.pop_back();
+			pBlockDiff2->info.changedLines.pop_back();
+		}
+	}
+}
+
+
+// Best convergence found for a line of the second block and all lines of the first block reaching it
+// The best converging first block lines of each second block line. All lines of equal best convergence are kept - the
+// first one in place and the others in a tie list of the table arena (its nodes are reused once the line2 gets a better
+// converging line). Entries are of fixed size so filling and merging the per thread tables doesn't allocate per line.
+class BestConvTable
+{
+public:
+	struct Entry
+	{
+		Conv		conv;
+		intptr_t	line1 {-1};
+		intptr_t	ties {-1};
+	};
+
+	BestConvTable(intptr_t linesCount2) : _entries(linesCount2) {}
+
+	inline const Entry& operator[](intptr_t line2) const
+	{
+		return _entries[line2];
+	}
+
+	void Add(intptr_t line2, const Conv& c, intptr_t line1)
+	{
+		Entry& e = _entries[line2];
+
+		if (e.line1 < 0 || (c > e.conv))
+		{
+			freeTies(e.ties);
+
+			e.conv	= c;
+			e.line1	= line1;
+			e.ties	= -1;
+		}
+		else if (c == e.conv)
+		{
+			e.ties = newTie(line1, e.ties);
+		}
+	}
+
+	template <typename Fn>
+	void forEachLine1(const Entry& e, Fn&& fn) const
+	{
+		if (e.line1 < 0)
+			return;
+
+		fn(e.line1);
+
+		for (intptr_t i = e.ties; i >= 0; i = _arena[i].next)
+			fn(_arena[i].line1);
+	}
+
+private:
+	struct Tie
+	{
+		intptr_t	line1;
+		intptr_t	next;
+	};
+
+	intptr_t newTie(intptr_t line1, intptr_t next)
+	{
+		if (_free < 0)
+		{
+			_arena.push_back({ line1, next });
+			return static_cast<intptr_t>(_arena.size()) - 1;
+		}
+
+		const intptr_t i = _free;
+
+		_free = _arena[i].next;
+		_arena[i] = { line1, next };
+
+		return i;
+	}
+
+	void freeTies(intptr_t i)
+	{
+		while (i >= 0)
+		{
+			const intptr_t next = _arena[i].next;
+
+			_arena[i].next = _free;
+			_free = i;
+			i = next;
+		}
+	}
+
+	std::vector<Entry>	_entries;
+	std::vector<Tie>	_arena;
+	intptr_t			_free {-1};
+};
+
+
+// Line chars histogram folded into a few buckets. The sum of the buckets minimums of two lines is an upper bound
+// of their LCS length (chars sharing a bucket can only add to it) so it cheaply rejects non-converging lines
+struct CharsSignature
+{
+	static constexpr int cBuckets = 64;
+
+	uint32_t counts[cBuckets];
+
+	CharsSignature(const ArenaVector<wchar_t>& chars)
+	{
+		std::fill(std::begin(counts), std::end(counts), 0);
+
+		for (wchar_t ch: chars)
+			++counts[static_cast<size_t>(ch) % cBuckets];
+	}
+
+	inline intptr_t MaxMatches(const CharsSignature& rhs) const
+	{
+		intptr_t matches = 0;
+
+		for (int i = 0; i < cBuckets; ++i)
+			matches += std::min(counts[i], rhs.counts[i]);
+
+		return matches;
+	}
+};
+
+
+/**
+ *  \class  CharsLcs
+ *  \brief  Bit-parallel LCS length (Allison-Dix / Hyyro) of a pattern line chars against other lines chars.
+ *          The pattern bit masks are built once and reused for all lines it is compared to.
+ */
+class CharsLcs
+{
+public:
+	void SetPattern(const ArenaVector<wchar_t>& pattern);
+
+	// Returns the LCS length of the pattern and the given chars - the same as the matches count of DiffCalc
+	intptr_t operator()(const ArenaVector<wchar_t>& chars);
+
+private:
+	struct charSlot
+	{
+		wchar_t		ch;
+		intptr_t	row;
+	};
+
+	inline size_t findSlot(wchar_t ch) const;
+
+	intptr_t	_len {0};
+	size_t		_words {0};
+
+	size_t					_slotsMask {0};
+	std::vector<charSlot>	_slots;
+
+	// A row of _words bit masks for each distinct pattern char (bit is set on char positions)
+	std::vector<uint64_t>	_peq;
+	std::vector<uint64_t>	_v;
+};
+
+
+inline size_t CharsLcs::findSlot(wchar_t ch) const
+{
+	size_t i = (static_cast<size_t>(ch) * 2654435761U) & _slotsMask;
+
+	while (_slots[i].row >= 0 && _slots[i].ch != ch)
+		i = (i + 1) & _slotsMask;
+
+	return i;
+}
+
+
+void CharsLcs::SetPattern(const ArenaVector<wchar_t>& pattern)
+{
+	_len	= static_cast<intptr_t>(pattern.size());
+	_words	= (pattern.size() + 63) / 64;
+
+	size_t slotsCount = 16;
+
+	while (slotsCount < pattern.size() * 2)
+		slotsCount <<= 1;
+
+	_slotsMask = slotsCount - 1;
+	_slots.assign(slotsCount, charSlot { 0, -1 });
+
+	_peq.clear();
+
+	for (size_t i = 0; i < pattern.size(); ++i)
+	{
+		charSlot& slot = _slots[findSlot(pattern[i])];
+
+		if (slot.row < 0)
+		{
+			slot.ch		= pattern[i];
+			slot.row	= static_cast<intptr_t>(_peq.size() / _words);
+
+			_peq.resize(_peq.size() + _words, 0);
+		}
+
+		_peq[slot.row * _words + i / 64] |= uint64_t(1) << (i % 64);
+	}
+}
+
+
+intptr_t CharsLcs::operator()(const ArenaVector<wchar_t>& chars)
+{
+	if (_len == 0)
+		return 0;
+
+	_v.assign(_words, ~uint64_t(0));
+
+	for (wchar_t ch: chars)
+	{
+		const charSlot& slot = _slots[findSlot(ch)];
+
+		if (slot.row < 0)
+			continue;
+
+		const uint64_t* peq = &_peq[slot.row * _words];
+
+		uint64_t carry = 0;
+
+		// V = (V + U) | (V - U) where U = V & PEq[c], the addition is carried over the words
+		for (size_t w = 0; w < _words; ++w)
+		{
+			const uint64_t v = _v[w];
+			const uint64_t u = v & peq[w];
+			const uint64_t sum = v + u;
+			const uint64_t res = sum + carry;
+
+			carry = (sum < v) || (res < sum);
+
+			_v[w] = res | (v - u);
+		}
+	}
+
+	// Zero bits in V (within the pattern length) count the matches
+	intptr_t ones = 0;
+
+	for (size_t w = 0; w < _words; ++w)
+	{
+		uint64_t v = _v[w];
+
+		if (w == _words - 1 && (_len % 64))
+			v &= (uint64_t(1) << (_len % 64)) - 1;
+
+		ones += static_cast<intptr_t>(std::bitset<64>(v).count());
+	}
+
+	return _len - ones;
+}
+
+
+// Gets the range [from, to) of the second block lines the first block line is matched to. Unless the banded match
+// is on and the second block is bigger than the band these are all lines. The band follows the blocks diagonal as the
+// edits keep the lines relative order so the matching cost becomes linear in the blocks sizes.
+inline void getMatchBand(intptr_t line1, intptr_t linesCount1, intptr_t linesCount2, const CompareOptions& options,
+		intptr_t& from, intptr_t& to)
+{
+	const intptr_t band = options.bandedMatchLines;
+
+	if (band <= 0 || linesCount2 <= band)
+	{
+		from	= 0;
+		to		= linesCount2;
+
+		return;
+	}
+
+	const intptr_t center = (linesCount1 > 1) ?
+			static_cast<intptr_t>(static_cast<int64_t>(line1) * (linesCount2 - 1) / (linesCount1 - 1)) : 0;
+
+	from	= std::min(std::max<intptr_t>(center - band / 2, 0), linesCount2 - band);
+	to		= from + band;
+}
+
+
+// Returns the count of the lines pairs getOrderedConvergence() matches
+inline intptr_t matchedPairsCount(intptr_t linesCount1, intptr_t linesCount2, const CompareOptions& options)
+{
+	if (options.bandedMatchLines > 0 && linesCount2 > options.bandedMatchLines)
+		return linesCount1 * options.bandedMatchLines;
+
+	return linesCount1 * linesCount2;
+}
+
+
+// Upper bound of the memory the changed blocks compare needs but for the matched lines pairs
+uint64_t blocksCompareBaseBytes(const BlockText& blockText1, const BlockText& blockText2)
+{
+	// Node of the lines grouping maps
+	constexpr uint64_t cMapNodeBytes = 6 * sizeof(intptr_t);
+
+	const uint64_t linesCount1 = blockText1.lines.size();
+	const uint64_t linesCount2 = blockText2.lines.size();
+
+	uint64_t threadsCount = 1;
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	threadsCount = std::max(std::thread::hardware_concurrency(), 1U);
+#endif // MULTITHREAD
+
+	// Lines chars and their signatures
+	uint64_t bytes = (blockText1.text.size() + blockText2.text.size()) * sizeof(wchar_t) +
+			(linesCount1 + linesCount2) * (sizeof(ArenaVector<wchar_t>) + sizeof(CharsSignature));
+
+	// Best convergence tables of the threads and the lines grouping
+	bytes += threadsCount * linesCount2 * sizeof(BestConvTable::Entry) + (linesCount1 + linesCount2) * cMapNodeBytes;
+
+	return bytes;
+}
+
+
+// Every matched lines pair can end up an equally converging one (a tie)
+constexpr uint64_t cMatchedPairBytes = sizeof(LinesConv) + 2 * sizeof(intptr_t);
+
+
+// Narrowest band the lines are matched in to fit the memory budget
+constexpr intptr_t cMinBudgetBand = 16;
+
+
+// Returns the band of lines the changed blocks compare fits the memory budget with - the options one if it fits,
+// -1 if it doesn't fit even with the narrowest band
+intptr_t budgetMatchBand(const BlockText& blockText1, const BlockText& blockText2, const CompareOptions& options)
+{
+	const uint64_t budget = memoryBudget(options);
+
+	if (!budget)
+		return options.bandedMatchLines;
+
+	const intptr_t linesCount1 = static_cast<intptr_t>(blockText1.lines.size());
+	const intptr_t linesCount2 = static_cast<intptr_t>(blockText2.lines.size());
+
+	const uint64_t baseBytes = blocksCompareBaseBytes(blockText1, blockText2);
+
+	if (baseBytes + matchedPairsCount(linesCount1, linesCount2, options) * cMatchedPairBytes <= budget)
+		return options.bandedMatchLines;
+
+	if (baseBytes >= budget || linesCount1 == 0)
+		return -1;
+
+	const intptr_t band = static_cast<intptr_t>((budget - baseBytes) / (linesCount1 * cMatchedPairBytes));
+
+	return (band >= cMinBudgetBand) ? band : -1;
+}
+
+
+OrderedConvergence getOrderedConvergence(const BlockText& blockText1, const BlockText& blockText2,
+		const CompareOptions& options)
+{
+	const ArenaVector<ArenaVector<wchar_t>> chunk1 = getLinesChars(blockText1, options);
+	const ArenaVector<ArenaVector<wchar_t>> chunk2 = getLinesChars(blockText2, options);
+
+	const intptr_t linesCount1 = static_cast<intptr_t>(chunk1.size());
+	const intptr_t linesCount2 = static_cast<intptr_t>(chunk2.size());
+
+	OrderedConvergence linesConvergence;
+
+	const std::vector<CharsSignature> signatures1(chunk1.begin(), chunk1.end());
+	const std::vector<CharsSignature> signatures2(chunk2.begin(), chunk2.end());
+
+	int threadsCount = 1;
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	threadsCount = static_cast<int>(std::thread::hardware_concurrency());
+
+	if (threadsCount < 1)
+		threadsCount = 1;
+	else if (static_cast<intptr_t>(threadsCount) > linesCount1)
+		threadsCount = static_cast<int>(linesCount1);
+
+	if (threadsCount > 1)
+	{
+		constexpr intptr_t jobsPerThread = 50;
+
+		const intptr_t totalJobs		= matchedPairsCount(linesCount1, linesCount2, options);
+		const intptr_t threadsNeeded	= (totalJobs + jobsPerThread - 1) / jobsPerThread;
+
+		if (static_cast<intptr_t>(threadsCount) > threadsNeeded)
+			threadsCount = static_cast<int>(threadsNeeded);
+	}
+#endif // MULTITHREAD
+
+	LOGD(LOG_ALGO, "getOrderedConvergence(): threads to use: " + std::to_string(threadsCount) + "\n");
+
+	CompareProgress* const progress = context().progress;
+
+	// Each thread keeps its own best convergence table, tables are merged when all lines are processed
+	std::vector<BestConvTable> threadsBestConv(threadsCount, BestConvTable(linesCount2));
+
+	const CancelFlag cancelled = progress->CancelFlag();
+
+	// Lines of the first block are handed out one at a time so threads that get shorter lines take more of them
+	std::atomic<intptr_t> nextLine1(0);
+	std::atomic<bool> failed(false);
+
+	std::exception_ptr error = nullptr;
+	std::mutex errorMutex;
+
+	CompareContext* const ctx = threadContext;
+
+	auto workFn =
+		[&](int threadId)
+		{
+			ScopedCompareContext useCtx(ctx);
+
+			BestConvTable& bestConv = threadsBestConv[threadId];
+
+			// Reused by all char compares of the thread
+			DiffWorkspace workspace;
+			CharsLcs lcs;
+
+			// Added to the compare stats once when the thread is done
+			struct ThreadStats
+			{
+				~ThreadStats()
+				{
+					context().stats.convPairsScored	+= scored;
+					context().stats.convPairsPruned	+= pruned;
+					context().stats.diffCalcRuns		+= diffRuns;
+				}
+
+				intptr_t scored {0};
+				intptr_t pruned {0};
+				intptr_t diffRuns {0};
+			} threadStats;
+
+			try
+			{
+				for (intptr_t line1 = nextLine1++; line1 < linesCount1 && !failed; line1 = nextLine1++)
+				{
+					intptr_t fromLine2;
+					intptr_t toLine2;
+
+					getMatchBand(line1, linesCount1, linesCount2, options, fromLine2, toLine2);
+
+					// Progress is reported once per line of the first block
+					if (!progress->Advance(toLine2 - fromLine2))
+					{
+						failed = true;
+						return;
+					}
+
+					if (chunk1[line1].empty())
+					{
+						threadStats.pruned += toLine2 - fromLine2;
+						continue;
+					}
+
+					lcs.SetPattern(chunk1[line1]);
+
+					for (intptr_t line2 = fromLine2; line2 < toLine2; ++line2)
+					{
+						if (cancelled->load(std::memory_order_relaxed))
+						{
+							failed = true;
+							return;
+						}
+
+						if (chunk2[line2].empty())
+						{
+							++threadStats.pruned;
+							continue;
+						}
+
+						const intptr_t minSize = std::min(chunk1[line1].size(), chunk2[line2].size());
+						const intptr_t maxSize = std::max(chunk1[line1].size(), chunk2[line2].size());
+
+						if ((((minSize * 100) / maxSize) >= options.changedThresholdPercent) &&
+							(((signatures1[line1].MaxMatches(signatures2[line2]) * 100) / maxSize) >=
+								options.changedThresholdPercent))
+						{
+							++threadStats.scored;
+
+							// The LCS length is the matches count of the char diff - get it the fast way and run the real
+							// char diff only if the lines converge enough and its diffs count is needed
+							const intptr_t matchesCount = lcs(chunk2[line2]);
+
+							if (((matchesCount * 100) / maxSize) >= options.changedThresholdPercent)
+							{
+								intptr_t diffsCount = 0;
+
+								if (options.bestSeqChangedLines)
+								{
+									auto charDiffs = DiffCalc<wchar_t>(chunk1[line1], chunk2[line2],
+											cancelled, &workspace)();
+									++threadStats.diffRuns;
+
+									if (cancelled->load(std::memory_order_relaxed))
+									{
+										failed = true;
+										return;
+									}
+
+									const intptr_t charDiffsSize = static_cast<intptr_t>(charDiffs.first.size());
+
+									for (intptr_t i = 0; i < charDiffsSize; ++i)
+									{
+										if (charDiffs.first[i].type != diff_type::DIFF_MATCH)
+										{
+											++diffsCount;
+
+											// Count replacement as a single diff
+											if ((i + 1 < charDiffsSize) &&
+													(charDiffs.first[i + 1].type == diff_type::DIFF_IN_2))
+												++i;
+										}
+									}
+								}
+
+								const float lineConvergence = (static_cast<float>(matchesCount) * 100) / maxSize;
+
+								bestConv.Add(line2, Conv(lineConvergence, diffsCount), line1);
+							}
+						}
+						else
+						{
+							++threadStats.pruned;
+						}
+					}
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+
+				if (!error)
+					error = std::current_exception();
+
+				failed = true;
+			}
+		};
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	std::vector<std::thread> threads;
+
+	for (int i = 1; i < threadsCount; ++i)
+	{
+		try
+		{
+			threads.emplace_back(workFn, i);
+		}
+		catch (...)
+		{
+			// Remaining lines will be processed by the threads already started
+			break;
+		}
+	}
+#endif // MULTITHREAD
+
+	workFn(0);
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	for (auto& th : threads)
+		th.join();
+#endif // MULTITHREAD
+
+	if (error)
+		std::rethrow_exception(error);
+
+	if (failed || progress->IsCancelled())
+		return linesConvergence;
+
+	// Merge threads tables - for each line of the second block keep only its best converging lines and among those
+	// assign to each line of the first block its own best ones. Result doesn't depend on the lines processing order.
+	std::vector<LinesConv>& pairs = linesConvergence.pairs;
+
+	for (intptr_t line2 = 0; line2 < linesCount2; ++line2)
+	{
+		const BestConvTable::Entry* best = nullptr;
+
+		for (const auto& bestConv : threadsBestConv)
+		{
+			const BestConvTable::Entry& e = bestConv[line2];
+
+			if (e.line1 >= 0 && (!best || (e.conv > best->conv)))
+				best = &e;
+		}
+
+		if (!best)
+			continue;
+
+		const Conv conv = best->conv;
+
+		for (const auto& bestConv : threadsBestConv)
+		{
+			const BestConvTable::Entry& e = bestConv[line2];
+
+			if (e.line1 >= 0 && (e.conv == conv))
+				bestConv.forEachLine1(e, [&](intptr_t line1) { pairs.emplace_back(conv, line1, line2); });
+		}
+	}
+
+	std::vector<Conv>		bestConv1(linesCount1);
+	std::vector<uint8_t>	hasConv1(linesCount1, 0);
+
+	for (const auto& lc : pairs)
+	{
+		if (!hasConv1[lc.line1] || (lc.conv > bestConv1[lc.line1]))
+		{
+			bestConv1[lc.line1]	= lc.conv;
+			hasConv1[lc.line1]	= 1;
+		}
+	}
+
+	pairs.erase(std::remove_if(pairs.begin(), pairs.end(),
+			[&bestConv1](const LinesConv& lc) { return !(lc.conv == bestConv1[lc.line1]); }), pairs.end());
+
+	// Group the pairs by line1 (counting sort - keeps the line2 order within a group)
+	std::vector<intptr_t>& start = linesConvergence.start;
+
+	start.assign(linesCount1 + 1, 0);
+
+	for (const auto& lc : pairs)
+		++start[lc.line1 + 1];
+
+	for (intptr_t line1 = 0; line1 < linesCount1; ++line1)
+		start[line1 + 1] += start[line1];
+
+	std::vector<LinesConv> grouped(pairs.size());
+	std::vector<intptr_t> next(start.begin(), start.end() - 1);
+
+	for (const auto& lc : pairs)
+		grouped[next[lc.line1]++] = lc;
+
+	pairs = std::move(grouped);
+
+	return linesConvergence;
+}
+
+
+bool compareBlocks(const DocCmpInfo& doc1, const DocCmpInfo& doc2, diffInfo& blockDiff1, diffInfo& blockDiff2,
+		const CompareOptions& options)
+{
+	TraceScope trace("CompareBlocks", blockDiff1.len, blockDiff2.len);
+
+	// The arena memory used by the blocks compare is bounded by the largest block
+	ScopedArenaRewind blockArenaRewind;
+
+	BlockText blockText1;
+	BlockText blockText2;
+
+	getBlockText(doc1, blockDiff1, blockText1);
+	getBlockText(doc2, blockDiff2, blockText2);
+
+	const intptr_t band = budgetMatchBand(blockText1, blockText2, options);
+
+	const intptr_t pairsCount = matchedPairsCount(blockDiff1.len, blockDiff2.len, options);
+
+	// Over the memory budget - the blocks lines are not matched, they are all shown as removed / added
+	if (band < 0)
+	{
+		++context().stats.budgetLinesOnlyBlocks;
+
+		return context().progress->Advance(pairsCount);
+	}
+
+	CompareOptions bandedOptions;
+
+	const CompareOptions* matchOptions = &options;
+
+	if (band != options.bandedMatchLines)
+	{
+		bandedOptions.copyFrom(options);
+		bandedOptions.bandedMatchLines = static_cast<int>(band);
+
+		matchOptions = &bandedOptions;
+
+		++context().stats.budgetBandedBlocks;
+
+		if (!context().progress->Advance(
+				pairsCount - matchedPairsCount(blockDiff1.len, blockDiff2.len, bandedOptions)))
+			return false;
+	}
+
+	const OrderedConvergence orderedLinesConvergence = getOrderedConvergence(blockText1, blockText2, *matchOptions);
+
+	{
+		CompareProgress* const progress = context().progress;
+
+		if (progress->IsCancelled())
+			return false;
+	}
+
+#ifdef DLOG
+	for (intptr_t line1 = 0; line1 < orderedLinesConvergence.linesCount1(); ++line1)
+	{
+		const LinesConv* oc = orderedLinesConvergence.begin(line1);
+
+		if (oc != orderedLinesConvergence.end(line1))
+			LOGD(LOG_ALGO, "Best Matching Lines: " +
+					std::to_string(doc1.lines[oc->line1 + blockDiff1.off].line + 1) + " and " +
+					std::to_string(doc2.lines[oc->line2 + blockDiff2.off].line + 1) + "\n");
+	}
+#endif
+
+	std::map<intptr_t, intptr_t> bestLineMappings; // line2 -> line1
+	{
+		std::vector<std::map<intptr_t, intptr_t>> groupedLines;
+
+		for (intptr_t line1 = 0; line1 < orderedLinesConvergence.linesCount1(); ++line1)
+		{
+			const LinesConv* ocBegin	= orderedLinesConvergence.begin(line1);
+			const LinesConv* ocEnd		= orderedLinesConvergence.end(line1);
+
+			if (ocBegin == ocEnd)
+				continue;
+
+			if (groupedLines.empty())
+			{
+				const LinesConv* ocItr = ocBegin;
+
+				groupedLines.emplace_back();
+				groupedLines.back().emplace(ocItr->line2, ocItr->line1);
+
+				continue;
+			}
+
+			intptr_t addToIdx = -1;
+
+			for (const LinesConv* ocItr = ocBegin; ocItr != ocEnd; ++ocItr)
+			{
+				for (intptr_t i = 0; i < static_cast<intptr_t>(groupedLines.size()); ++i)
+				{
+					const auto& gl = groupedLines[i];
+
+					if ((ocItr->line2) > (gl.rbegin()->first))
+					{
+						if (addToIdx == -1)
+						{
+							addToIdx = i;
+						}
+						else if (groupedLines[addToIdx].size() < gl.size())
+						{
+							groupedLines.erase(groupedLines.begin() + addToIdx);
+							addToIdx = --i;
+						}
+						else
+						{
+							groupedLines.erase(groupedLines.begin() + i);
+							--i;
+						}
+					}
+				}
+
+				if (addToIdx != -1)
+				{
+					auto& gl = groupedLines[addToIdx];
+					gl.emplace_hint(gl.end(), ocItr->line2, ocItr->line1);
+
+					break;
+				}
+			}
+
+			if (addToIdx != -1)
+				continue;
+
+			const LinesConv* ocrItr = ocEnd - 1;
+
+			std::map<intptr_t, intptr_t> subGroup;
+
+			for (intptr_t i = 0; i < static_cast<intptr_t>(groupedLines.size()); ++i)
+			{
+				auto& gl = groupedLines[i];
+
+				auto glResItr = gl.emplace(ocrItr->line2, ocrItr->line1);
+
+				if (glResItr.second)
+				{
+					std::map<intptr_t, intptr_t> newSubGroup;
+					auto sgEndItr = glResItr.first;
+
+					newSubGroup.insert(gl.begin(), ++sgEndItr);
+					gl.erase(glResItr.first);
+
+					if (newSubGroup.size() > subGroup.size())
+						subGroup = std::move(newSubGroup);
+				}
+			}
+
+			if (!subGroup.empty())
+			{
+				groupedLines.emplace_back(std::move(subGroup));
+
+				LOGD(LOG_ALGO, "New lines group (" + std::to_string(groupedLines.size()) + " total). Last lines: " +
+						std::to_string(doc1.lines[ocrItr->line1 + blockDiff1.off].line + 1) + " - " +
+						std::to_string(doc2.lines[ocrItr->line2 + blockDiff2.off].line + 1) + "\n");
+			}
+		}
+
+		if (groupedLines.empty())
+			return true;
+
+		intptr_t	bestGroupIdx = 0;
+		size_t		bestSize = groupedLines[0].size();
+
+		for (intptr_t i = 1; i < static_cast<intptr_t>(groupedLines.size()); ++i)
+		{
+			if (bestSize < groupedLines[i].size())
+			{
+				bestSize = groupedLines[i].size();
+				bestGroupIdx = i;
+			}
+		}
+
+		bestLineMappings = std::move(groupedLines[bestGroupIdx]);
+	}
+
+	compareLines(doc1, doc2, blockText1, blockText2, blockDiff1, blockDiff2, bestLineMappings, options);
+
+	return true;
+}
+
+
+void markSection(const DocCmpInfo& doc, const diffInfo& bd, const CompareOptions& options, ViewMarks& marks)
+{
+	const intptr_t endOff = doc.section.off + doc.section.len;
+
+	for (intptr_t i = doc.section.off, line = bd.off + doc.section.off; i < endOff; ++i, ++line)
+	{
+		intptr_t movedLen = bd.info.movedSection(i);
+
+		if (movedLen > doc.section.len)
+			movedLen = doc.section.len;
+
+		if (movedLen == 0)
+		{
+			intptr_t prevLine = doc.lines[line].line + 1;
+
+			for (; (i < endOff) && (bd.info.movedSection(i) == 0); ++i, ++line)
+			{
+				const intptr_t docLine = doc.lines[line].line;
+				const int mark = !doc.isNonUnique(line) ? doc.blockDiffMask :
+						(doc.blockDiffMask == MARKER_MASK_ADDED) ? MARKER_MASK_ADDED_LOCAL : MARKER_MASK_REMOVED_LOCAL;
+
+				marks.addMarker(docLine, mark);
+
+				if (options.ignoreEmptyLines && !options.neverMarkIgnored)
+				{
+					for (; prevLine < docLine; ++prevLine)
+						marks.addMarker(prevLine, doc.blockDiffMask & MARKER_MASK_LINE);
+
+					prevLine = docLine + 1;
+				}
+			}
+
+			--i;
+			--line;
+		}
+		else if (movedLen == 1)
+		{
+			marks.addMarker(doc.lines[line].line, MARKER_MASK_MOVED_LINE);
+		}
+		else
+		{
+			marks.addMarker(doc.lines[line].line, MARKER_MASK_MOVED_BEGIN);
+
+			i += --movedLen;
+
+			intptr_t prevLine = doc.lines[line].line + 1;
+			intptr_t endLine = line + movedLen;
+
+			for (++line; line < endLine; ++line)
+			{
+				const intptr_t docLine = doc.lines[line].line;
+				marks.addMarker(docLine, MARKER_MASK_MOVED_MID);
+
+				if (options.ignoreEmptyLines && !options.neverMarkIgnored)
+				{
+					for (; prevLine < docLine; ++prevLine)
+						marks.addMarker(prevLine, MARKER_MASK_MOVED_MID & MARKER_MASK_LINE);
+
+					prevLine = docLine + 1;
+				}
+			}
+
+			const intptr_t docLine = doc.lines[line].line;
+			marks.addMarker(docLine, MARKER_MASK_MOVED_END);
+
+			if (options.ignoreEmptyLines && !options.neverMarkIgnored)
+			{
+				for (; prevLine < docLine; ++prevLine)
+					marks.addMarker(prevLine, MARKER_MASK_MOVED_MID & MARKER_MASK_LINE);
+			}
+		}
+	}
+}
+
+
+void markLineDiffs(const CompareInfo& cmpInfo, const diffInfo& bd, intptr_t lineIdx, ViewMarks viewMarks[2])
+{
+	ViewMarks& marks1 = viewMarks[cmpInfo.doc1.view];
+
+	const intptr_t lineIdx1 = bd.off + bd.info.changedLines[lineIdx].line;
+	intptr_t line = cmpInfo.doc1.lines[lineIdx1].line;
+	intptr_t linePos = docLineStart(cmpInfo.doc1.view, line);
+
+	for (const auto& change: bd.info.changedLines[lineIdx].changes)
+		marks1.addChangedText(linePos + change.off, change.len);
+
+	marks1.addMarker(line, !cmpInfo.doc1.isNonUnique(lineIdx1) ? MARKER_MASK_CHANGED : MARKER_MASK_CHANGED_LOCAL);
+
+	ViewMarks& marks2 = viewMarks[cmpInfo.doc2.view];
+
+	const intptr_t lineIdx2 = bd.info.matchBlock->off + bd.info.matchBlock->info.changedLines[lineIdx].line;
+	line = cmpInfo.doc2.lines[lineIdx2].line;
+	linePos = docLineStart(cmpInfo.doc2.view, line);
+
+	for (const auto& change: bd.info.matchBlock->info.changedLines[lineIdx].changes)
+		marks2.addChangedText(linePos + change.off, change.len);
+
+	marks2.addMarker(line, !cmpInfo.doc2.isNonUnique(lineIdx2) ? MARKER_MASK_CHANGED : MARKER_MASK_CHANGED_LOCAL);
+}
+
+
+// Each run of alignment points of diffs (not interrupted by a match point) is a single diff for the navigation
+void fillDiffIndex(CompareSummary& summary)
+{
+	summary.diffIndex.clear();
+
+	bool inDiff = false;
+
+	const intptr_t alignSize = summary.alignmentInfo.size();
+
+	for (intptr_t i = 0; i < alignSize; ++i)
+	{
+		const AlignmentPair alignPair = summary.alignmentInfo[i];
+
+		const bool isDiff = (alignPair.main.diffMask || alignPair.sub.diffMask);
+
+		if (isDiff && !inDiff)
+			summary.diffIndex.emplace_back(alignPair);
+
+		inDiff = isDiff;
+	}
+}
+
+
+// Moves the collected markers runs to the view's diff map - sorted by line with adjacent equal runs joined
+void fillDiffMap(ViewMarks& marks, DiffMap_t& diffMap)
+{
+	diffMap = std::move(marks.markers);
+	marks.markers.clear();
+
+	if (diffMap.empty())
+		return;
+
+	std::stable_sort(diffMap.begin(), diffMap.end(),
+			[](const DiffMapRun& a, const DiffMapRun& b) { return (a.line < b.line); });
+
+	size_t last = 0;
+
+	for (size_t i = 1; i < diffMap.size(); ++i)
+	{
+		if ((diffMap[last].mask == diffMap[i].mask) && (diffMap[last].line + diffMap[last].len == diffMap[i].line))
+			diffMap[last].len += diffMap[i].len;
+		else
+			diffMap[++last] = diffMap[i];
+	}
+
+	diffMap.resize(last + 1);
+}
+
+
+// Collects all diffs marks in viewMarks and fills the summary and the alignment info. Returns false if cancelled.
+bool markAllDiffs(CompareInfo& cmpInfo, const CompareOptions& options, CompareSummary& summary,
+		ViewMarks viewMarks[2])
+{
+	TraceScope trace("MarkAllDiffs", static_cast<int64_t>(cmpInfo.blockDiffs.size()));
+
+	CompareProgress* const progress = context().progress;
+
+	summary.clear();
+
+	const intptr_t blockDiffSize = static_cast<intptr_t>(cmpInfo.blockDiffs.size());
+
+	progress->SetMaxCount(blockDiffSize);
+
+	ViewMarks& marks1 = viewMarks[cmpInfo.doc1.view];
+	ViewMarks& marks2 = viewMarks[cmpInfo.doc2.view];
+
+	marks1.changedTextMask = cmpInfo.doc1.blockDiffMask;
+	marks2.changedTextMask = cmpInfo.doc2.blockDiffMask;
+
+	std::pair<intptr_t, intptr_t> alignLines {0, 0};
+
+	AlignmentPair alignPair;
+
+	AlignmentViewData* pMainAlignData	= &alignPair.main;
+	AlignmentViewData* pSubAlignData	= &alignPair.sub;
+
+	// Make sure pMainAlignData is linked to doc1
+	if (cmpInfo.doc1.view == SUB_VIEW)
+		std::swap(pMainAlignData, pSubAlignData);
+
+	for (intptr_t i = 0; i < blockDiffSize; ++i)
+	{
+		const diffInfo& bd = cmpInfo.blockDiffs[i];
+
+		if (bd.type == diff_type::DIFF_MATCH)
+		{
+			pMainAlignData->diffMask	= 0;
+			pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
+
+			pSubAlignData->diffMask		= 0;
+			pSubAlignData->line			= toAlignmentLine(cmpInfo.doc2, alignLines.second);
+
+			summary.alignmentInfo.emplace_back(alignPair);
+
+			if (options.alignAllMatches)
+			{
+				// Align all pairs of matching lines
+				for (intptr_t j = bd.len - 1; j; --j)
+				{
+					++alignLines.first;
+					++alignLines.second;
+
+					pMainAlignData->line	= cmpInfo.doc1.lines[alignLines.first].line;
+					pSubAlignData->line		= cmpInfo.doc2.lines[alignLines.second].line;
+
+					summary.alignmentInfo.emplace_back(alignPair);
+				}
+
+				++alignLines.first;
+				++alignLines.second;
+			}
+			else
+			{
+				if (options.ignoreEmptyLines)
+				{
+					// Align pairs of matching lines after ignored lines sections
+					for (intptr_t j = bd.len - 1; j; --j)
+					{
+						++alignLines.first;
+						++alignLines.second;
+
+						if ((++pMainAlignData->line != cmpInfo.doc1.lines[alignLines.first].line) ||
+							(++pSubAlignData->line != cmpInfo.doc2.lines[alignLines.second].line))
+						{
+							pMainAlignData->line	= cmpInfo.doc1.lines[alignLines.first].line;
+							pSubAlignData->line		= cmpInfo.doc2.lines[alignLines.second].line;
+
+							summary.alignmentInfo.emplace_back(alignPair);
+						}
+					}
+
+					++alignLines.first;
+					++alignLines.second;
+				}
+				else
+				{
+					alignLines.first	+= bd.len;
+					alignLines.second	+= bd.len;
+				}
+			}
+
+			summary.match += bd.len;
+		}
+		else if (bd.type == diff_type::DIFF_IN_2)
+		{
+			cmpInfo.doc2.section.off = 0;
+			cmpInfo.doc2.section.len = bd.len;
+			markSection(cmpInfo.doc2, bd, options, marks2);
+
+			pMainAlignData->diffMask	= 0;
+			pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
+
+			pSubAlignData->diffMask		= cmpInfo.doc2.blockDiffMask;
+			pSubAlignData->line			= toAlignmentLine(cmpInfo.doc2, alignLines.second);
+
+			summary.alignmentInfo.emplace_back(alignPair);
+
+			const intptr_t movedLines = bd.info.movedCount();
+
+			summary.diffLines	+= bd.len;
+			summary.moved		+= movedLines;
+
+			if (cmpInfo.doc2.blockDiffMask == MARKER_MASK_ADDED)
+				summary.added += bd.len - movedLines;
+			else
+				summary.removed += bd.len - movedLines;
+
+			alignLines.second += bd.len;
+		}
+		else if (bd.type == diff_type::DIFF_IN_1)
+		{
+			if (bd.info.matchBlock)
+			{
+				const intptr_t changedLinesCount = static_cast<intptr_t>(bd.info.changedLines.size());
+
+				cmpInfo.doc1.section.off = 0;
+				cmpInfo.doc2.section.off = 0;
+
+				for (intptr_t j = 0; j < changedLinesCount; ++j)
+				{
+					cmpInfo.doc1.section.len = bd.info.changedLines[j].line - cmpInfo.doc1.section.off;
+					cmpInfo.doc2.section.len = bd.info.matchBlock->info.changedLines[j].line - cmpInfo.doc2.section.off;
+
+					if (cmpInfo.doc1.section.len || cmpInfo.doc2.section.len)
+					{
+						pMainAlignData->diffMask	= cmpInfo.doc1.section.len ? cmpInfo.doc1.blockDiffMask : 0;
+						pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
+
+						pSubAlignData->diffMask		= cmpInfo.doc2.section.len ? cmpInfo.doc2.blockDiffMask : 0;
+						pSubAlignData->line			= toAlignmentLine(cmpInfo.doc2, alignLines.second);
+
+						summary.alignmentInfo.emplace_back(alignPair);
+
+						if (options.ignoreEmptyLines && options.neverMarkIgnored &&
+							cmpInfo.doc1.section.len && cmpInfo.doc2.section.len)
+						{
+							std::vector<intptr_t> alignLines1;
+							intptr_t maxLines = cmpInfo.doc1.section.len + alignLines.first;
+
+							for (intptr_t l = alignLines.first + 1; l < maxLines; ++l)
+							{
+								if (cmpInfo.doc1.lines[l].line - cmpInfo.doc1.lines[l - 1].line > 1)
+									alignLines1.emplace_back(l);
+							}
+
+							if (!alignLines1.empty())
+							{
+								std::vector<intptr_t> alignLines2;
+								maxLines = cmpInfo.doc2.section.len + alignLines.second;
+
+								for (intptr_t l = alignLines.second + 1; l < maxLines; ++l)
+								{
+									if (cmpInfo.doc2.lines[l].line - cmpInfo.doc2.lines[l - 1].line > 1)
+										alignLines2.emplace_back(l);
+								}
+
+								maxLines = std::min(alignLines1.size(), alignLines2.size());
+
+								for (intptr_t l = 0; l < maxLines; ++l)
+								{
+									pMainAlignData->line	= toAlignmentLine(cmpInfo.doc1, alignLines1[l]);
+									pSubAlignData->line		= toAlignmentLine(cmpInfo.doc2, alignLines2[l]);
+
+									summary.alignmentInfo.emplace_back(alignPair);
+								}
+							}
+						}
+
+						if (cmpInfo.doc1.section.len)
+						{
+							markSection(cmpInfo.doc1, bd, options, marks1);
+							alignLines.first += cmpInfo.doc1.section.len;
+						}
+
+						if (cmpInfo.doc2.section.len)
+						{
+							markSection(cmpInfo.doc2, *bd.info.matchBlock, options, marks2);
+							alignLines.second += cmpInfo.doc2.section.len;
+						}
+
+						summary.diffLines += std::max(cmpInfo.doc1.section.len, cmpInfo.doc2.section.len);
+					}
+
+					pMainAlignData->diffMask	= MARKER_MASK_CHANGED;
+					pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
+
+					pSubAlignData->diffMask		= MARKER_MASK_CHANGED;
+					pSubAlignData->line			= toAlignmentLine(cmpInfo.doc2, alignLines.second);
+
+					summary.alignmentInfo.emplace_back(alignPair);
+
+					markLineDiffs(cmpInfo, bd, j, viewMarks);
+
+					cmpInfo.doc1.section.off = bd.info.changedLines[j].line + 1;
+					cmpInfo.doc2.section.off = bd.info.matchBlock->info.changedLines[j].line + 1;
+
+					++alignLines.first;
+					++alignLines.second;
+				}
+
+				cmpInfo.doc1.section.len = bd.len - cmpInfo.doc1.section.off;
+				cmpInfo.doc2.section.len = bd.info.matchBlock->len - cmpInfo.doc2.section.off;
+
+				if (cmpInfo.doc1.section.len || cmpInfo.doc2.section.len)
+				{
+					pMainAlignData->diffMask	= cmpInfo.doc1.section.len ? cmpInfo.doc1.blockDiffMask : 0;
+					pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
+
+					pSubAlignData->diffMask		= cmpInfo.doc2.section.len ? cmpInfo.doc2.blockDiffMask : 0;
+					pSubAlignData->line			= toAlignmentLine(cmpInfo.doc2, alignLines.second);
+
+					summary.alignmentInfo.emplace_back(alignPair);
+
+					if (options.ignoreEmptyLines && options.neverMarkIgnored &&
+						cmpInfo.doc1.section.len && cmpInfo.doc2.section.len)
+					{
+						std::vector<intptr_t> alignLines1;
+						intptr_t maxLines = cmpInfo.doc1.section.len + alignLines.first;
+
+						for (intptr_t l = alignLines.first + 1; l < maxLines; ++l)
+						{
+							if (cmpInfo.doc1.lines[l].line - cmpInfo.doc1.lines[l - 1].line > 1)
+								alignLines1.emplace_back(l);
+						}
+
+						if (!alignLines1.empty())
+						{
+							std::vector<intptr_t> alignLines2;
+							maxLines = cmpInfo.doc2.section.len + alignLines.second;
+
+							for (intptr_t l = alignLines.second + 1; l < maxLines; ++l)
+							{
+								if (cmpInfo.doc2.lines[l].line - cmpInfo.doc2.lines[l - 1].line > 1)
+									alignLines2.emplace_back(l);
+							}
+
+							maxLines = std::min(alignLines1.size(), alignLines2.size());
+
+							for (intptr_t l = 0; l < maxLines; ++l)
+							{
+								pMainAlignData->line	= toAlignmentLine(cmpInfo.doc1, alignLines1[l]);
+								pSubAlignData->line		= toAlignmentLine(cmpInfo.doc2, alignLines2[l]);
+
+								summary.alignmentInfo.emplace_back(alignPair);
+							}
+						}
+					}
+
+					if (cmpInfo.doc1.section.len)
+					{
+						markSection(cmpInfo.doc1, bd, options, marks1);
+						alignLines.first += cmpInfo.doc1.section.len;
+					}
+
+					if (cmpInfo.doc2.section.len)
+					{
+						markSection(cmpInfo.doc2, *bd.info.matchBlock, options, marks2);
+						alignLines.second += cmpInfo.doc2.section.len;
+					}
+
+					summary.diffLines += std::max(cmpInfo.doc1.section.len, cmpInfo.doc2.section.len);
+				}
+
+				const intptr_t movedLines1 = bd.info.movedCount();
+				const intptr_t movedLines2 = bd.info.matchBlock->info.movedCount();
+
+				const intptr_t newLines1 = bd.len - changedLinesCount - movedLines1;
+				const intptr_t newLines2 = bd.info.matchBlock->len - changedLinesCount - movedLines2;
+
+				summary.diffLines	+= changedLinesCount;
+				summary.changed		+= changedLinesCount;
+				summary.moved		+= movedLines1 + movedLines2;
+
+				if (cmpInfo.doc1.blockDiffMask == MARKER_MASK_ADDED)
+				{
+					summary.added	+= newLines1;
+					summary.removed	+= newLines2;
+				}
+				else
+				{
+					summary.added	+= newLines2;
+					summary.removed	+= newLines1;
+				}
+
+				++i;
+			}
+			else
+			{
+				cmpInfo.doc1.section.off = 0;
+				cmpInfo.doc1.section.len = bd.len;
+				markSection(cmpInfo.doc1, bd, options, marks1);
+
+				pMainAlignData->diffMask	= cmpInfo.doc1.blockDiffMask;
+				pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
+
+				pSubAlignData->diffMask		= 0;
+				pSubAlignData->line			= toAlignmentLine(cmpInfo.doc2, alignLines.second);
+
+				summary.alignmentInfo.emplace_back(alignPair);
+
+				const intptr_t movedLines = bd.info.movedCount();
+
+				summary.diffLines	+= bd.len;
+				summary.moved		+= movedLines;
+
+				if (cmpInfo.doc1.blockDiffMask == MARKER_MASK_ADDED)
+					summary.added += bd.len - movedLines;
+				else
+					summary.removed += bd.len - movedLines;
+
+				alignLines.first += bd.len;
+			}
+		}
+
+		if (!progress->Advance())
+			return false;
+	}
+
+	summary.moved /= 2;
+
+	if (!progress->NextPhase())
+		return false;
+
+	return true;
+}
+
+
+// Adds line diff to the list merging it with the last one if they are of the same type
+inline void addLinesDiff(std::vector<diffInfo>& diffs, diff_type type, intptr_t off, intptr_t len)
+{
+	if (len == 0)
+		return;
+
+	if (!diffs.empty() && diffs.back().type == type)
+	{
+		diffs.back().len += len;
+		return;
+	}
+
+	diffInfo newDiff;
+
+	newDiff.type	= type;
+	newDiff.off		= off;
+	newDiff.len		= len;
+
+	diffs.emplace_back(std::move(newDiff));
+}
+
+
+// Lines that are unique and matched in both compared ranges, in order (longest increasing sequence of the matches)
+std::vector<std::pair<intptr_t, intptr_t>> getUniqueAnchors(const LineClasses& classes, intptr_t off1, intptr_t end1,
+		intptr_t off2, intptr_t end2)
+{
+	const uint32_t* ids1 = classes.ids[0].data();
+	const uint32_t* ids2 = classes.ids[1].data();
+
+	// Occurrences per class (saturated at 2) and the doc1 index of its first occurrence
+	std::vector<uint8_t>	count1(classes.count, 0);
+	std::vector<uint8_t>	count2(classes.count, 0);
+	std::vector<intptr_t>	idx1(classes.count);
+
+	for (intptr_t i = off1; i < end1; ++i)
+	{
+		const uint32_t id = ids1[i];
+
+		if (count1[id] == 0)
+			idx1[id] = i;
+
+		if (count1[id] < 2)
+			++count1[id];
+	}
+
+	for (intptr_t i = off2; i < end2; ++i)
+	{
+		const uint32_t id = ids2[i];
+
+		if (count1[id] && count2[id] < 2)
+			++count2[id];
+	}
+
+	// Matches in doc2 order with their doc1 indexes
+	std::vector<std::pair<intptr_t, intptr_t>> matches;
+
+	for (intptr_t i = off2; i < end2; ++i)
+	{
+		const uint32_t id = ids2[i];
+
+		if (count1[id] == 1 && count2[id] == 1)
+			matches.emplace_back(idx1[id], i);
+	}
+
+	std::vector<std::pair<intptr_t, intptr_t>> anchors;
+
+	if (matches.empty())
+		return anchors;
+
+	const intptr_t matchesCount = static_cast<intptr_t>(matches.size());
+
+	std::vector<intptr_t> tails;
+	std::vector<intptr_t> prev(matchesCount, -1);
+
+	for (intptr_t i = 0; i < matchesCount; ++i)
+	{
+		auto it = std::lower_bound(tails.begin(), tails.end(), matches[i].first,
+				[&matches](intptr_t t, intptr_t idx1) { return matches[t].first < idx1; });
+
+		if (it != tails.begin())
+			prev[i] = *(it - 1);
+
+		if (it == tails.end())
+			tails.emplace_back(i);
+		else
+			*it = i;
+	}
+
+	anchors.resize(tails.size());
+
+	for (intptr_t i = tails.back(), j = static_cast<intptr_t>(anchors.size()) - 1; i >= 0; i = prev[i], --j)
+		anchors[j] = matches[i];
+
+	return anchors;
+}
+
+
+struct LinesGap
+{
+	intptr_t off1;
+	intptr_t len1;
+	intptr_t off2;
+	intptr_t len2;
+
+	// Count of the anchor lines matching right after the gap
+	intptr_t matchLen;
+
+	std::vector<diffInfo> diffs;
+
+	LinesGap(intptr_t o1, intptr_t l1, intptr_t o2, intptr_t l2) :
+		off1(o1), len1(l1), off2(o2), len2(l2), matchLen(0)
+	{}
+};
+
+
+// Diffs the gap lines classes putting the results in gap.diffs with offsets into doc1 and doc2 lines
+// (the results are never swapped). The classes IDs arrays start at doc1 / doc2 lines base1 / base2.
+// The diff recursion can use up to threadsCount threads. Returns false if cancelled
+bool diffLinesGap(const LineClasses& classes, intptr_t base1, intptr_t base2, LinesGap& gap,
+		const CompareOptions& options, CancelFlag cancelled, DiffWorkspace& workspace, int threadsCount = 1)
+{
+	if (gap.len1 == 0 || gap.len2 == 0)
+	{
+		addLinesDiff(gap.diffs, diff_type::DIFF_IN_1, gap.off1, gap.len1);
+		addLinesDiff(gap.diffs, diff_type::DIFF_IN_2, gap.off2, gap.len2);
+
+		return true;
+	}
+
+	const uint32_t* ids1 = classes.ids[0].data() + (gap.off1 - base1);
+	const uint32_t* ids2 = classes.ids[1].data() + (gap.off2 - base2);
+
+	std::pair<std::vector<diffInfo>, bool> diffRes;
+
+	// Each of the diff threads has its own V arrays
+	const intptr_t costLimit =
+			budgetDiffCostLimit(gap.len1, gap.len2, options.diffCostLimit, std::max(threadsCount, 1), options);
+
+	if (options.histogramDiff)
+	{
+		HistogramDiffCalc<uint32_t, blockDiffInfo> diffCalc(ids1, gap.len1, ids2, gap.len2, cancelled, &workspace);
+
+		diffCalc.setCostLimit(costLimit);
+		diffCalc.setParallel(threadsCount);
+		diffRes = diffCalc(true, true);
+
+		if (diffCalc.isApproximated())
+			context().stats.diffApproximated = true;
+	}
+	else
+	{
+		DiffCalc<uint32_t, blockDiffInfo> diffCalc(ids1, gap.len1, ids2, gap.len2, cancelled, &workspace);
+
+		diffCalc.setCostLimit(costLimit);
+		diffCalc.setParallel(threadsCount);
+		diffRes = diffCalc(true, true);
+
+		if (diffCalc.isApproximated())
+			context().stats.diffApproximated = true;
+	}
+
+	++context().stats.diffCalcRuns;
+
+	std::vector<diffInfo>& diffs = diffRes.first;
+
+	if (diffs.empty())
+		return false;
+
+	const intptr_t diffsSize = static_cast<intptr_t>(diffs.size());
+
+	intptr_t pos1 = gap.off1;
+	intptr_t pos2 = gap.off2;
+
+	auto add =
+		[&](diff_type type, intptr_t len)
+		{
+			if (type == diff_type::DIFF_MATCH)
+			{
+				addLinesDiff(gap.diffs, type, pos1, len);
+				pos1 += len;
+				pos2 += len;
+			}
+			else if (type == diff_type::DIFF_IN_1)
+			{
+				addLinesDiff(gap.diffs, type, pos1, len);
+				pos1 += len;
+			}
+			else
+			{
+				addLinesDiff(gap.diffs, type, pos2, len);
+				pos2 += len;
+			}
+		};
+
+	for (intptr_t i = 0; i < diffsSize; ++i)
+	{
+		if (!diffRes.second)
+		{
+			add(diffs[i].type, diffs[i].len);
+		}
+		else if (diffs[i].type == diff_type::DIFF_MATCH)
+		{
+			add(diffs[i].type, diffs[i].len);
+		}
+		// Keep the replacement order (DIFF_IN_1 followed by DIFF_IN_2) when un-swapping
+		else if (diffs[i].type == diff_type::DIFF_IN_1 && i + 1 < diffsSize &&
+				diffs[i + 1].type == diff_type::DIFF_IN_2)
+		{
+			add(diff_type::DIFF_IN_1, diffs[i + 1].len);
+			add(diff_type::DIFF_IN_2, diffs[i].len);
+			++i;
+		}
+		else
+		{
+			add((diffs[i].type == diff_type::DIFF_IN_1) ? diff_type::DIFF_IN_2 : diff_type::DIFF_IN_1, diffs[i].len);
+		}
+	}
+
+	return true;
+}
+
+
+// Trims the identical head and tail of the compared lines and cuts the rest at the lines that are unique and
+// matched in both documents. The gaps between those anchors are diffed as independent jobs and the results are
+// stitched back in cmpInfo.blockDiffs. Returns false if cancelled
+bool diffLines(CompareInfo& cmpInfo, const CompareOptions& options)
+{
+	TraceScope trace("LinesDiff",
+			static_cast<int64_t>(cmpInfo.doc1.lines.size()), static_cast<int64_t>(cmpInfo.doc2.lines.size()));
+
+	static constexpr intptr_t minAnchorLinesCount = 10000;
+
+	CompareProgress* const progress = context().progress;
+
+	const CancelFlag cancelled = progress->CancelFlag();
+
+	const LineClasses& classes = getLineClasses(cmpInfo);
+
+	const uint32_t* ids1 = classes.ids[0].data();
+	const uint32_t* ids2 = classes.ids[1].data();
+
+	const intptr_t size1 = static_cast<intptr_t>(classes.ids[0].size());
+	const intptr_t size2 = static_cast<intptr_t>(classes.ids[1].size());
+
+	intptr_t head = 0;
+
+	while (head < size1 && head < size2 && ids1[head] == ids2[head])
+		++head;
+
+	intptr_t tail = 0;
+
+	while (tail < size1 - head && tail < size2 - head && ids1[size1 - 1 - tail] == ids2[size2 - 1 - tail])
+		++tail;
+
+	const intptr_t end1 = size1 - tail;
+	const intptr_t end2 = size2 - tail;
+
+	std::vector<LinesGap> gaps;
+
+	if (head < end1 || head < end2)
+	{
+		std::vector<std::pair<intptr_t, intptr_t>> anchors;
+
+		if ((end1 - head) + (end2 - head) >= minAnchorLinesCount)
+			anchors = getUniqueAnchors(classes, head, end1, head, end2);
+
+		LOGD(LOG_ALGO, "diffLines(): head " + std::to_string(head) + ", tail " + std::to_string(tail) +
+				", anchors " + std::to_string(anchors.size()) + "\n");
+
+		intptr_t pos1 = head;
+		intptr_t pos2 = head;
+
+		for (const auto& anchor: anchors)
+		{
+			if (gaps.empty() || anchor.first != pos1 || anchor.second != pos2)
+				gaps.emplace_back(pos1, anchor.first - pos1, pos2, anchor.second - pos2);
+
+			++gaps.back().matchLen;
+
+			pos1 = anchor.first + 1;
+			pos2 = anchor.second + 1;
+		}
+
+		if (pos1 < end1 || pos2 < end2)
+			gaps.emplace_back(pos1, end1 - pos1, pos2, end2 - pos2);
+	}
+
+	const intptr_t gapsCount = static_cast<intptr_t>(gaps.size());
+
+	// A single gap is diffed by one job - its diff recursion is run in parallel instead
+	int gapThreadsCount = 1;
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	static constexpr intptr_t minParallelLinesCount = 10000;
+
+	int threadsCount = 1;
+
+	if ((end1 - head) + (end2 - head) >= minParallelLinesCount)
+	{
+		threadsCount = static_cast<int>(std::thread::hardware_concurrency());
+
+		if (threadsCount < 1)
+			threadsCount = 1;
+
+		if (gapsCount == 1)
+			std::swap(threadsCount, gapThreadsCount);
+		else if (static_cast<intptr_t>(threadsCount) > gapsCount)
+			threadsCount = static_cast<int>(gapsCount);
+	}
+
+	LOGD(LOG_ALGO, "diffLines(): gaps " + std::to_string(gapsCount) +
+			", threads to use: " + std::to_string(std::max(threadsCount, gapThreadsCount)) + "\n");
+#endif // MULTITHREAD
+
+	std::atomic<intptr_t>	nextGap(0);
+	std::atomic<bool>		failed(false);
+
+	std::exception_ptr error = nullptr;
+	std::mutex errorMutex;
+
+	CompareContext* const ctx = threadContext;
+
+	auto workFn =
+		[&]()
+		{
+			ScopedCompareContext useCtx(ctx);
+
+			DiffWorkspace workspace;
+
+			try
+			{
+				for (intptr_t i = nextGap++; i < gapsCount && !failed; i = nextGap++)
+				{
+					if (!diffLinesGap(classes, 0, 0, gaps[i], options, cancelled, workspace, gapThreadsCount))
+						failed = true;
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+
+				if (!error)
+					error = std::current_exception();
+
+				failed = true;
+			}
+		};
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	std::vector<std::thread> threads;
+
+	for (int i = 1; i < threadsCount; ++i)
+	{
+		try
+		{
+			threads.emplace_back(workFn);
+		}
+		catch (...)
+		{
+			// Remaining gaps will be processed by the threads already started
+			break;
+		}
+	}
+#endif // MULTITHREAD
+
+	workFn();
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	for (auto& th : threads)
+		th.join();
+#endif // MULTITHREAD
+
+	if (error)
+		std::rethrow_exception(error);
+
+	if (failed || progress->IsCancelled())
+		return false;
+
+	std::vector<diffInfo>& diffs = cmpInfo.blockDiffs;
+
+	diffs.clear();
+
+	addLinesDiff(diffs, diff_type::DIFF_MATCH, 0, head);
+
+	for (auto& gap: gaps)
+	{
+		for (auto& gapDiff: gap.diffs)
+			addLinesDiff(diffs, gapDiff.type, gapDiff.off, gapDiff.len);
+
+		addLinesDiff(diffs, diff_type::DIFF_MATCH, gap.off1 + gap.len1, gap.matchLen);
+	}
+
+	addLinesDiff(diffs, diff_type::DIFF_MATCH, end1, tail);
+
+	return true;
+}
+
+
+// Re-checks the lines matched by hash comparing their actual (option-normalized) text. Lines that only collide by
+// hash are turned into changed lines. off2 is the doc2 lines offset of the first diff.
+// Returns false if the operation is cancelled.
+bool verifyLineMatches(const CompareInfo& cmpInfo, std::vector<diffInfo>& lineDiffs, intptr_t off2,
+		const CompareOptions& options)
+{
+	static constexpr int monitorCancelEveryXLine = 500;
+
+	CompareProgress* const progress = context().progress;
+
+	const int codepage1 = docCodepage(cmpInfo.doc1.view);
+	const int codepage2 = docCodepage(cmpInfo.doc2.view);
+
+	std::vector<diffInfo> diffs;
+	diffs.reserve(lineDiffs.size());
+
+	diffInfo pending1;
+	diffInfo pending2;
+
+	pending1.type	= diff_type::DIFF_IN_1;
+	pending1.off	= 0;
+	pending1.len	= 0;
+	pending2.type	= diff_type::DIFF_IN_2;
+	pending2.off	= 0;
+	pending2.len	= 0;
+
+	auto addPending = [](diffInfo& pending, intptr_t off, intptr_t len)
+	{
+		if (pending.len == 0)
+			pending.off = off;
+
+		pending.len += len;
+	};
+
+	auto flushPending = [&]()
+	{
+		addLinesDiff(diffs, pending1.type, pending1.off, pending1.len);
+		addLinesDiff(diffs, pending2.type, pending2.off, pending2.len);
+
+		pending1.len = 0;
+		pending2.len = 0;
+	};
+
+	int cancelCheckCount = monitorCancelEveryXLine;
+
+	intptr_t collisionsCount = 0;
+
+	for (const diffInfo& bd: lineDiffs)
+	{
+		if (bd.type == diff_type::DIFF_IN_1)
+		{
+			addPending(pending1, bd.off, bd.len);
+			continue;
+		}
+
+		if (bd.type == diff_type::DIFF_IN_2)
+		{
+			addPending(pending2, bd.off, bd.len);
+			off2 += bd.len;
+			continue;
+		}
+
+		for (intptr_t i = 0; i < bd.len; ++i)
+		{
+			if (!(--cancelCheckCount))
+			{
+				if (progress->IsCancelled())
+					return false;
+
+				cancelCheckCount = monitorCancelEveryXLine;
+			}
+
+			LineBytes text1;
+			LineBytes text2;
+
+			addDocLineText(text1, cmpInfo.doc1.view, cmpInfo.doc1.lines[bd.off + i].line, codepage1, options);
+			addDocLineText(text2, cmpInfo.doc2.view, cmpInfo.doc2.lines[off2 + i].line, codepage2, options);
+
+			if (text1.bytes == text2.bytes)
+			{
+				flushPending();
+				addLinesDiff(diffs, diff_type::DIFF_MATCH, bd.off + i, 1);
+			}
+			else
+			{
+				addPending(pending1, bd.off + i, 1);
+				addPending(pending2, off2 + i, 1);
+				++collisionsCount;
+			}
+		}
+
+		off2 += bd.len;
+	}
+
+	flushPending();
+
+	LOGD(LOG_ALGO, "Hash matched lines verified, collisions found: " + std::to_string(collisionsCount) + "\n");
+
+	if (collisionsCount)
+		lineDiffs = std::move(diffs);
+
+	return true;
+}
+
+
+// Checks if the documents are the same (and only edited as recorded) since the last compare
+bool isIncrementalPossible(const IncrementalCompare* incremental, const CompareOptions& options)
+{
+	if (!incremental || !incremental->state || options.selectionCompare)
+		return false;
+
+	const CompareState& state = *incremental->state;
+
+	for (int view: { MAIN_VIEW, SUB_VIEW })
+	{
+		if ((state.docId[view] != context().views->docId(view)) ||
+			(state.linesCount[view] + incremental->edited[view].linesDelta != docLinesCount(view)) ||
+			(state.length[view] + incremental->edited[view].lengthDelta != docLength(view)))
+			return false;
+	}
+
+	return true;
+}
+
+
+// Tail mode - a document that was only appended to since the last compare (a growing log reloaded for example) is
+// re-compared as if only its last line was edited, whatever its edits were recorded as
+void detectAppend(IncrementalCompare& incremental, int view)
+{
+	const CompareState& state	= *incremental.state;
+	EditedLines& edited			= incremental.edited[view];
+
+	const intptr_t tailLine = state.linesCount[view] - 2;
+
+	if (edited.empty() || (state.tailStart[view] < 0) || (edited.first > tailLine) ||
+			(state.docId[view] != context().views->docId(view)))
+		return;
+
+	const intptr_t linesCount	= docLinesCount(view);
+	const intptr_t length		= docLength(view);
+
+	if ((linesCount < state.linesCount[view]) || (length < state.length[view]) ||
+			(docLineStart(view, tailLine) != state.tailStart[view]))
+		return;
+
+	const intptr_t tailLen = state.length[view] - state.tailStart[view];
+
+	LineHasher hasher;
+	hasher.Add(docRangePointer(view, state.tailStart[view], tailLen), tailLen);
+
+	if (hasher.Get() != state.tailHash[view])
+		return;
+
+	edited.first		= tailLine + 1;
+	edited.last			= linesCount - 1;
+	edited.linesDelta	= linesCount - state.linesCount[view];
+	edited.lengthDelta	= length - state.length[view];
+
+	LOGD(LOG_ALGO, "Only lines from " + std::to_string(edited.first + 1) + " appended in view " +
+			std::to_string(view) + "\n");
+}
+
+
+// The first line from which the view marks differ from the ones set by the last compare (endLine at most)
+intptr_t sameMarksEnd(const CompareState& state, int view, const DiffMap_t& diffMap,
+		const std::vector<std::pair<intptr_t, intptr_t>>& changedText, intptr_t endLine)
+{
+	const DiffMap_t& oldDiffMap = state.diffMap[view];
+
+	size_t i = 0;
+
+	for (; (i < oldDiffMap.size()) && (i < diffMap.size()); ++i)
+	{
+		if ((oldDiffMap[i].line != diffMap[i].line) || (oldDiffMap[i].len != diffMap[i].len) ||
+				(oldDiffMap[i].mask != diffMap[i].mask))
+			break;
+	}
+
+	// The diff maps are sorted by line
+	if (i < oldDiffMap.size())
+		endLine = std::min(endLine, oldDiffMap[i].line);
+
+	if (i < diffMap.size())
+		endLine = std::min(endLine, diffMap[i].line);
+
+	const auto& oldChangedText = state.changedText[view];
+
+	size_t j = 0;
+
+	for (; (j < oldChangedText.size()) && (j < changedText.size()) && (oldChangedText[j] == changedText[j]); ++j);
+
+	// The changed text ranges are not necessarily sorted
+	intptr_t endPos = INTPTR_MAX;
+
+	for (size_t k = j; k < oldChangedText.size(); ++k)
+		endPos = std::min(endPos, oldChangedText[k].first);
+
+	for (size_t k = j; k < changedText.size(); ++k)
+		endPos = std::min(endPos, changedText[k].first);
+
+	if (endPos != INTPTR_MAX)
+		endLine = std::min(endLine, docSource(view).lineFromPosition(endPos));
+
+	LOGD(LOG_ALGO, "Marks of lines 1 - " + std::to_string(endLine) + " kept in view " + std::to_string(view) + "\n");
+
+	return endLine;
+}
+
+
+// Stores the compare results to be used by the next incremental re-compare
+void saveCompareState(CompareInfo& cmpInfo, const CompareSummary& summary, ViewMarks viewMarks[2],
+		IncrementalCompare* incremental)
+{
+	if (!incremental)
+		return;
+
+	incremental->clear();
+
+	if (cmpInfo.doc1.section.off || cmpInfo.doc2.section.off)
+		return;
+
+	std::shared_ptr<CompareState> state = std::make_shared<CompareState>();
+
+	for (int view: { MAIN_VIEW, SUB_VIEW })
+	{
+		state->docId[view]		= context().views->docId(view);
+		state->linesCount[view]	= docLinesCount(view);
+		state->length[view]		= docLength(view);
+
+		state->tailStart[view]	= (state->linesCount[view] > 1) ? docLineStart(view, state->linesCount[view] - 2) : -1;
+		state->tailHash[view]	= 0;
+
+		if (state->tailStart[view] >= 0)
+		{
+			const intptr_t tailLen = state->length[view] - state->tailStart[view];
+
+			LineHasher hasher;
+			hasher.Add(docRangePointer(view, state->tailStart[view], tailLen), tailLen);
+
+			state->tailHash[view] = hasher.Get();
+		}
+
+		state->diffMap[view]		= summary.diffMap[view];
+		state->changedText[view]	= std::move(viewMarks[view].changedText);
+	}
+
+	state->cmpInfo.doc1.view			= cmpInfo.doc1.view;
+	state->cmpInfo.doc1.blockDiffMask	= cmpInfo.doc1.blockDiffMask;
+	state->cmpInfo.doc1.lines			= std::move(cmpInfo.doc1.lines);
+	state->cmpInfo.doc2.view			= cmpInfo.doc2.view;
+	state->cmpInfo.doc2.blockDiffMask	= cmpInfo.doc2.blockDiffMask;
+	state->cmpInfo.doc2.lines			= std::move(cmpInfo.doc2.lines);
+	state->cmpInfo.blockDiffs			= std::move(cmpInfo.blockDiffs);
+
+	incremental->state = std::move(state);
+
+	LOGD(LOG_ALGO, "Compare state stored for incremental re-compare\n");
+}
+
+
+// Lines (indexes in the old doc lines) that cannot be reused by the incremental re-compare
+struct DirtyLines
+{
+	bool		edited {false};
+	intptr_t	off {0};
+	intptr_t	end {0};
+};
+
+
+// Gets the doc lines reusing the unedited lines from the last compare and re-hashing only the edited ones
+DirtyLines updateLines(DocCmpInfo& doc, const std::vector<Line>& oldLines, const EditedLines& edited,
+		const CompareOptions& options)
+{
+	DirtyLines dirty;
+
+	if (edited.empty())
+	{
+		doc.lines = oldLines;
+		return dirty;
+	}
+
+	const intptr_t linesCount	= docLinesCount(doc.view);
+	const intptr_t firstLine	= std::min(edited.first, linesCount - 1);
+	const intptr_t lastLine		= std::min(edited.last, linesCount - 1);
+
+	auto firstOldLine = std::lower_bound(oldLines.begin(), oldLines.end(), firstLine,
+			[](const Line& l, intptr_t line) { return l.line < line; });
+	auto endOldLine = std::upper_bound(firstOldLine, oldLines.end(), lastLine - edited.linesDelta,
+			[](intptr_t line, const Line& l) { return line < l.line; });
+
+	dirty.edited	= true;
+	dirty.off		= firstOldLine - oldLines.begin();
+	dirty.end		= endOldLine - oldLines.begin();
+
+	doc.lines.clear();
+	doc.lines.reserve(oldLines.size() + std::max<intptr_t>(edited.linesDelta, 0));
+
+	doc.lines.insert(doc.lines.end(), oldLines.begin(), firstOldLine);
+
+	const int codepage = docCodepage(doc.view);
+
+	for (intptr_t docLine = firstLine; docLine <= lastLine; ++docLine)
+	{
+		LineHasher hasher;
+		addDocLineText(hasher, doc.view, docLine, codepage, options);
+
+		Line newLine;
+		newLine.hash = hasher.Get();
+		newLine.line = docLine;
+
+		if (!options.ignoreEmptyLines || newLine.hash != cHashSeed)
+			doc.lines.emplace_back(newLine);
+	}
+
+	for (auto lineIt = endOldLine; lineIt != oldLines.end(); ++lineIt)
+	{
+		doc.lines.emplace_back(*lineIt);
+		doc.lines.back().line += edited.linesDelta;
+	}
+
+	context().stats.linesHashed += lastLine - firstLine + 1;
+
+	LOGD(LOG_ALGO, "Lines " + std::to_string(firstLine + 1) + " - " + std::to_string(lastLine + 1) +
+			" re-hashed in view " + std::to_string(doc.view) + "\n");
+
+	return dirty;
+}
+
+
+// Re-diffs only the lines between the last matches surrounding the dirty lines and stitches the results with the
+// unaffected line diffs of the last compare. origins are set to the old block diff index for each unaffected one
+// (-1 for the new or modified ones). Returns false if cancelled.
+bool diffLinesIncrementally(CompareInfo& cmpInfo, const CompareInfo& oldInfo,
+		const DirtyLines& dirty1, const DirtyLines& dirty2, const CompareOptions& options,
+		std::vector<intptr_t>& origins)
+{
+	TraceScope trace("LinesDiffIncremental",
+			static_cast<int64_t>(cmpInfo.doc1.lines.size()), static_cast<int64_t>(cmpInfo.doc2.lines.size()));
+
+	const std::vector<diffInfo>& oldDiffs = oldInfo.blockDiffs;
+
+	const intptr_t oldDiffsSize = static_cast<intptr_t>(oldDiffs.size());
+
+	// Start of the window - the last match point before any dirty line
+	const intptr_t maxOff1 = dirty1.edited ? dirty1.off : INTPTR_MAX;
+	const intptr_t maxOff2 = dirty2.edited ? dirty2.off : INTPTR_MAX;
+
+	intptr_t startBlock	= 0;
+	intptr_t startLen	= 0;
+	intptr_t start1		= 0;
+	intptr_t start2		= 0;
+
+	std::vector<std::pair<intptr_t, intptr_t>> blockOffs(oldDiffsSize);
+
+	{
+		intptr_t off1 = 0;
+		intptr_t off2 = 0;
+
+		for (intptr_t i = 0; i < oldDiffsSize; ++i)
+		{
+			const diffInfo& bd = oldDiffs[i];
+
+			blockOffs[i] = std::make_pair(off1, off2);
+
+			if (bd.type == diff_type::DIFF_MATCH)
+			{
+				if (off1 <= maxOff1 && off2 <= maxOff2)
+				{
+					startBlock	= i;
+					startLen	= std::min(bd.len, std::min(maxOff1 - off1, maxOff2 - off2));
+					start1		= off1 + startLen;
+					start2		= off2 + startLen;
+				}
+
+				off1 += bd.len;
+				off2 += bd.len;
+			}
+			else if (bd.type == diff_type::DIFF_IN_1)
+			{
+				off1 += bd.len;
+			}
+			else
+			{
+				off2 += bd.len;
+			}
+		}
+	}
+
+	// End of the window - the first match point after all dirty lines (and not before the window start)
+	const intptr_t minEnd1 = std::max(dirty1.edited ? dirty1.end : 0, start1);
+	const intptr_t minEnd2 = std::max(dirty2.edited ? dirty2.end : 0, start2);
+
+	intptr_t endBlock	= oldDiffsSize;
+	intptr_t endOff		= 0;
+	intptr_t end1		= static_cast<intptr_t>(oldInfo.doc1.lines.size());
+	intptr_t end2		= static_cast<intptr_t>(oldInfo.doc2.lines.size());
+
+	for (intptr_t i = oldDiffsSize - 1; i >= 0; --i)
+	{
+		const diffInfo& bd = oldDiffs[i];
+
+		if (bd.type != diff_type::DIFF_MATCH)
+			continue;
+
+		const intptr_t off1 = blockOffs[i].first;
+		const intptr_t off2 = blockOffs[i].second;
+
+		if (off1 + bd.len < minEnd1 || off2 + bd.len < minEnd2)
+			break;
+
+		endBlock	= i;
+		endOff		= std::max<intptr_t>(0, std::max(minEnd1 - off1, minEnd2 - off2));
+		end1		= off1 + endOff;
+		end2		= off2 + endOff;
+	}
+
+	const intptr_t delta1 = static_cast<intptr_t>(cmpInfo.doc1.lines.size() - oldInfo.doc1.lines.size());
+	const intptr_t delta2 = static_cast<intptr_t>(cmpInfo.doc2.lines.size() - oldInfo.doc2.lines.size());
+
+	LinesGap window(start1, end1 + delta1 - start1, start2, end2 + delta2 - start2);
+
+	LOGD(LOG_ALGO, "Incremental re-diff of lines window " + std::to_string(window.len1) + " x " +
+			std::to_string(window.len2) + "\n");
+
+	CompareProgress* const progress = context().progress;
+
+	const CancelFlag cancelled = progress->CancelFlag();
+
+	DiffWorkspace workspace;
+
+	// Only the window lines are interned - the rest of the documents are not diffed
+	LineClasses windowClasses;
+
+	internLines(cmpInfo.doc1.lines.data() + window.off1, window.len1,
+			cmpInfo.doc2.lines.data() + window.off2, window.len2, windowClasses);
+
+	if (!diffLinesGap(windowClasses, window.off1, window.off2, window, options, cancelled, workspace))
+		return false;
+
+	if (options.verifyLineMatches && !verifyLineMatches(cmpInfo, window.diffs, window.off2, options))
+		return false;
+
+	std::vector<diffInfo>& diffs = cmpInfo.blockDiffs;
+
+	diffs.clear();
+	origins.clear();
+
+	auto addDiff = [&diffs, &origins](const diffInfo& bd, intptr_t off, intptr_t len, intptr_t origin)
+	{
+		if (len == 0)
+			return;
+
+		if (!diffs.empty() && diffs.back().type == bd.type)
+		{
+			diffs.back().len += len;
+			diffs.back().info = blockDiffInfo();
+			origins.back() = -1;
+			return;
+		}
+
+		diffs.emplace_back(bd);
+
+		diffInfo& newDiff = diffs.back();
+
+		newDiff.off		= off;
+		newDiff.len		= len;
+
+		// Moves and changed blocks pairing are re-calculated
+		newDiff.info.matchBlock = nullptr;
+		newDiff.info.moves.clear();
+		newDiff.info.lineMoves.clear();
+
+		origins.emplace_back(origin);
+	};
+
+	for (intptr_t i = 0; i < startBlock; ++i)
+		addDiff(oldDiffs[i], oldDiffs[i].off, oldDiffs[i].len, i);
+
+	if (startBlock < oldDiffsSize)
+		addDiff(oldDiffs[startBlock], oldDiffs[startBlock].off, startLen, -1);
+
+	for (const auto& bd: window.diffs)
+		addDiff(bd, bd.off, bd.len, -1);
+
+	if (endBlock < oldDiffsSize)
+		addDiff(oldDiffs[endBlock], oldDiffs[endBlock].off + endOff + delta1, oldDiffs[endBlock].len - endOff, -1);
+
+	for (intptr_t i = endBlock + 1; i < oldDiffsSize; ++i)
+	{
+		const diffInfo& bd = oldDiffs[i];
+
+		addDiff(bd, bd.off + (bd.type == diff_type::DIFF_IN_2 ? delta2 : delta1), bd.len, i);
+	}
+
+	return true;
+}
+
+
+// Identifies the line diff results of a documents pair - the documents contents plus the options the results depend on
+struct CompareResultKey
+{
+	inline bool operator==(const CompareResultKey& rhs) const
+	{
+		return (docHash[0] == rhs.docHash[0] && docHash[1] == rhs.docHash[1] && optionsHash == rhs.optionsHash);
+	}
+
+	uint64_t	docHash[2];
+	uint64_t	optionsHash;
+};
+
+
+// Cheap as the lines are already hashed. The ignored text (spaces, case, regex matches) is not part of the lines hashes
+// though and the changed sections positions depend on it so in that case the compared text is hashed as well.
+uint64_t docContentHash(const DocCmpInfo& doc, const CompareOptions& options)
+{
+	LineHasher hasher;
+
+	hasher.Add(docCodepage(doc.view));
+	hasher.Add(static_cast<intptr_t>(doc.lines.size()));
+
+	for (const Line& line: doc.lines)
+	{
+		hasher.Add(line.line);
+		hasher.Add(line.hash);
+	}
+
+	if (!doc.lines.empty() &&
+		(options.ignoreChangedSpaces || options.ignoreAllSpaces || options.ignoreCase || options.ignoreRegex))
+	{
+		const intptr_t startPos	= docLineStart(doc.view, doc.lines.front().line);
+		const intptr_t endPos	= docLineEnd(doc.view, doc.lines.back().line);
+
+		if (endPos > startPos)
+			hasher.Add(docRangePointer(doc.view, startPos, endPos - startPos), endPos - startPos);
+	}
+
+	return hasher.Get();
+}
+
+
+CompareResultKey getCompareResultKey(const CompareInfo& cmpInfo, const CompareOptions& options)
+{
+	CompareResultKey key;
+
+	key.docHash[0] = docContentHash(cmpInfo.doc1, options);
+	key.docHash[1] = docContentHash(cmpInfo.doc2, options);
+
+	// The options the marking only depends on are left out - it is always redone
+	const bool flags[] = {
+		options.neverMarkIgnored, options.histogramDiff, options.verifyLineMatches, options.detectMoves,
+		options.detectCharDiffs, options.bestSeqChangedLines, options.ignoreEmptyLines, options.ignoreChangedSpaces,
+		options.ignoreAllSpaces, options.ignoreCase
+	};
+
+	LineHasher hasher;
+
+	hasher.Add(reinterpret_cast<const char*>(flags), sizeof(flags));
+	hasher.Add(options.changedThresholdPercent);
+	hasher.Add(options.diffCostLimit);
+	hasher.Add(options.bandedMatchLines);
+	hasher.Add(options.memoryBudgetMB);
+	hasher.Add(reinterpret_cast<const char*>(options.ignoreRegexStr.data()),
+			static_cast<intptr_t>(options.ignoreRegexStr.size() * sizeof(wchar_t)));
+
+	key.optionsHash = hasher.Get();
+
+	return key;
+}
+
+
+/**
+ *  \class  CompareResultCache
+ *  \brief  Keeps the last compares results (block diffs with their moves and changed lines) by documents contents so
+ *          re-comparing unchanged documents goes straight to the marking. Least recently used results are dropped.
+ */
+class CompareResultCache
+{
+public:
+	static constexpr size_t cMaxEntries = 8;
+
+	// The results of more compares can be kept but never less than cMaxEntries
+	void reserve(size_t count)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_capacity = (count > cMaxEntries) ? count : cMaxEntries;
+
+		while (_entries.size() > _capacity)
+			_entries.pop_back();
+	}
+
+	bool get(const CompareResultKey& key, std::vector<diffInfo>& blockDiffs)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		for (auto entry = _entries.begin(); entry != _entries.end(); ++entry)
+		{
+			if (entry->key == key)
+			{
+				_entries.splice(_entries.begin(), _entries, entry);
+
+				copyBlockDiffs(_entries.front().blockDiffs, blockDiffs);
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void put(const CompareResultKey& key, const std::vector<diffInfo>& blockDiffs)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		for (auto entry = _entries.begin(); entry != _entries.end(); ++entry)
+		{
+			if (entry->key == key)
+			{
+				_entries.erase(entry);
+				break;
+			}
+		}
+
+		if (_entries.size() >= _capacity)
+			_entries.pop_back();
+
+		_entries.emplace_front();
+		_entries.front().key = key;
+
+		copyBlockDiffs(blockDiffs, _entries.front().blockDiffs);
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_entries.clear();
+	}
+
+private:
+	struct Entry
+	{
+		CompareResultKey		key;
+		std::vector<diffInfo>	blockDiffs;
+	};
+
+	// Changed blocks point to their pair block - the pointers are re-targeted to the copy
+	static void copyBlockDiffs(const std::vector<diffInfo>& src, std::vector<diffInfo>& dst)
+	{
+		dst = src;
+
+		for (auto& bd: dst)
+		{
+			if (bd.info.matchBlock)
+				bd.info.matchBlock = &dst[bd.info.matchBlock - src.data()];
+		}
+	}
+
+	// Most recently used first
+	std::list<Entry>	_entries;
+	size_t				_capacity {cMaxEntries};
+	std::mutex			_mutex;
+};
+
+
+CompareResultCache compareResultCache;
+
+
+// Compare workload recording requested by recordNextCompare() - taken by the next findDiffs() run
+struct WorkloadRecording
+{
+	std::wstring		filePath;
+	bool				withText {false};
+	std::atomic<bool>	pending {false};
+	std::atomic<bool>	saved {false};
+};
+
+
+WorkloadRecording workloadRecording;
+
+
+// Stores the compare inputs - the lines hashes and lengths and (if requested) the scrambled changed blocks lines text.
+// The moves are left out of the changed blocks text so it is all there for the replay.
+void recordWorkload(const CompareInfo& cmpInfo, const CompareOptions& options)
+{
+	if (!workloadRecording.pending.exchange(false))
+		return;
+
+	CompareWorkload workload;
+
+	workload.options.copyFrom(options);
+
+	const DocCmpInfo* docs[2] = { &cmpInfo.doc1, &cmpInfo.doc2 };
+
+	for (int i = 0; i < 2; ++i)
+	{
+		const DocCmpInfo& doc = *docs[i];
+		WorkloadDoc& wDoc = workload.docs[i];
+
+		wDoc.codepage = docCodepage(doc.view);
+
+		wDoc.hashes.reserve(doc.lines.size());
+		wDoc.lines.reserve(doc.lines.size());
+		wDoc.lengths.reserve(doc.lines.size());
+
+		for (const auto& line: doc.lines)
+		{
+			wDoc.hashes.push_back(line.hash);
+			wDoc.lines.push_back(line.line);
+			wDoc.lengths.push_back(
+					static_cast<uint32_t>(docLineEnd(doc.view, line.line) - docLineStart(doc.view, line.line)));
+		}
+	}
+
+	if (workloadRecording.withText)
+	{
+		std::random_device rd;
+
+		// New key for each recording - the scrambled text of different workloads can't be correlated
+		const TextScrambler scrambler((static_cast<uint64_t>(rd()) << 32) | rd());
+
+		BlockText blockText;
+
+		for (size_t i = 1; i < cmpInfo.blockDiffs.size(); ++i)
+		{
+			if ((cmpInfo.blockDiffs[i].type != diff_type::DIFF_IN_2) ||
+					(cmpInfo.blockDiffs[i - 1].type != diff_type::DIFF_IN_1))
+				continue;
+
+			WorkloadBlockPair pair;
+
+			for (int d = 0; d < 2; ++d)
+			{
+				diffInfo blockDiff;
+
+				blockDiff.type	= cmpInfo.blockDiffs[i - 1 + d].type;
+				blockDiff.off	= cmpInfo.blockDiffs[i - 1 + d].off;
+				blockDiff.len	= cmpInfo.blockDiffs[i - 1 + d].len;
+
+				getBlockText(*docs[d], blockDiff, blockText);
+
+				pair.off[d] = blockDiff.off;
+				pair.len[d] = blockDiff.len;
+
+				pair.text[d].resize(blockDiff.len);
+
+				for (intptr_t line = 0; line < blockDiff.len; ++line)
+				{
+					const BlockText::LineText& lineText = blockText.lines[line];
+
+					if (lineText.len == 0)
+						continue;
+
+					pair.text[d][line].assign(blockText.text.data() + lineText.off, lineText.len - 1);
+					scrambler.scramble(pair.text[d][line]);
+				}
+			}
+
+			workload.changedBlocks.emplace_back(std::move(pair));
+			++i;
+		}
+	}
+
+	workloadRecording.saved = saveWorkload(workloadRecording.filePath.c_str(), workload);
+}
+
+
+// Finds the documents' line diffs, moves and changed lines. Doesn't modify the views so it can be run by a worker
+// thread (on documents snapshots).
+CompareResult findDiffs(CompareInfo& cmpInfo, const CompareOptions& options, const CompareState* lastState,
+		const IncrementalCompare* incremental, LineHashCache* const lineHashes[2])
+{
+	TraceScope trace("FindDiffs");
+
+	// The transient words / chars buffers of the blocks compares are taken from the thread arena
+	ScopedCompareArena arena;
+
+	CompareProgress* const progress = context().progress;
+
+	LOGD_GET_TIME;
+
+	context().stats.startPhase(CompareStats::HASHING);
+
+	// Old block diff index for each block diff that is unaffected by the edits (incremental re-compare only)
+	std::vector<intptr_t> origins;
+
+	// Full compare results are cached by the documents contents
+	CompareResultKey	resultKey;
+	bool				useResultCache = false;
+
+	if (lastState)
+	{
+		const DirtyLines dirty1 = updateLines(cmpInfo.doc1, lastState->cmpInfo.doc1.lines,
+				incremental->edited[cmpInfo.doc1.view], options);
+
+		if (!progress->NextPhase())
+			return CompareResult::COMPARE_CANCELLED;
+
+		const DirtyLines dirty2 = updateLines(cmpInfo.doc2, lastState->cmpInfo.doc2.lines,
+				incremental->edited[cmpInfo.doc2.view], options);
+
+		if (!progress->NextPhase())
+			return CompareResult::COMPARE_CANCELLED;
+
+		context().stats.startPhase(CompareStats::LINES_DIFF);
+
+		if (!diffLinesIncrementally(cmpInfo, lastState->cmpInfo, dirty1, dirty2, options, origins))
+			return CompareResult::COMPARE_CANCELLED;
+	}
+	else
+	{
+		LineHashCache* const cache1 = lineHashes[cmpInfo.doc1.view];
+		LineHashCache* const cache2 = lineHashes[cmpInfo.doc2.view];
+
+		const bool cached1 = getCachedLines(cmpInfo.doc1, options, cache1);
+		const bool cached2 = getCachedLines(cmpInfo.doc2, options, cache2);
+
+		bool cancelled = false;
+
+		if (!cached1 && !cached2 &&
+				getLinesConcurrently(cmpInfo.doc1, cmpInfo.doc2, options, cancelled, cache1 && cache2))
+		{
+			if (cancelled || !progress->NextPhase() || !progress->NextPhase())
+				return CompareResult::COMPARE_CANCELLED;
+		}
+		else
+		{
+			if (!cached1)
+				getLines(cmpInfo.doc1, options, cache1 != nullptr);
+
+			if (!progress->NextPhase())
+				return CompareResult::COMPARE_CANCELLED;
+
+			if (!cached2)
+				getLines(cmpInfo.doc2, options, cache2 != nullptr);
+
+			if (!progress->NextPhase())
+				return CompareResult::COMPARE_CANCELLED;
+		}
+
+		if (!cached1)
+			fillLineHashCache(cmpInfo.doc1, cache1);
+
+		if (!cached2)
+			fillLineHashCache(cmpInfo.doc2, cache2);
+
+		resultKey = getCompareResultKey(cmpInfo, options);
+
+		// Unchanged documents compared with the same options already - only the marking is left to be done
+		if (compareResultCache.get(resultKey, cmpInfo.blockDiffs))
+		{
+			context().stats.resultCached = true;
+
+			recordWorkload(cmpInfo, options);
+
+			findUniqueLines(cmpInfo);
+
+			return CompareResult::COMPARE_MISMATCH;
+		}
+
+		useResultCache = true;
+
+		context().stats.startPhase(CompareStats::LINES_DIFF);
+
+		if (!diffLines(cmpInfo, options))
+			return CompareResult::COMPARE_CANCELLED;
+
+		if (options.verifyLineMatches && !verifyLineMatches(cmpInfo, cmpInfo.blockDiffs, 0, options))
+			return CompareResult::COMPARE_CANCELLED;
+	}
+
+	LOGD_GET_TIME;
+	PRINT_DIFFS("COMPARE START - LINE DIFFS", cmpInfo.blockDiffs);
+
+	recordWorkload(cmpInfo, options);
+
+	const intptr_t blockDiffsSize = static_cast<intptr_t>(cmpInfo.blockDiffs.size());
+
+	if (blockDiffsSize == 0 || (blockDiffsSize == 1 && cmpInfo.blockDiffs[0].type == diff_type::DIFF_MATCH))
+		return CompareResult::COMPARE_MATCH;
+
+	for (const auto& bd: cmpInfo.blockDiffs)
+	{
+		if (bd.type != diff_type::DIFF_MATCH)
+			context().stats.linesEditDistance += bd.len;
+	}
+
+	context().stats.startPhase(CompareStats::MOVES);
+
+	findUniqueLines(cmpInfo);
+
+	if (options.detectMoves)
+		findMoves(cmpInfo);
+
+	if (!progress->NextPhase())
+		return CompareResult::COMPARE_CANCELLED;
+
+	context().stats.startPhase(CompareStats::BLOCKS_COMPARE);
+
+	std::vector<intptr_t> changedBlockIdx;
+
+	intptr_t changedProgressCount = 0;
+
+	// Get changed blocks to sub-compare
+	for (intptr_t i = 1; i < blockDiffsSize; ++i)
+	{
+		if ((cmpInfo.blockDiffs[i].type == diff_type::DIFF_IN_2) &&
+				(cmpInfo.blockDiffs[i - 1].type == diff_type::DIFF_IN_1))
+		{
+			changedProgressCount +=
+					matchedPairsCount(cmpInfo.blockDiffs[i - 1].len, cmpInfo.blockDiffs[i].len, options);
+			changedBlockIdx.emplace_back(i++);
+		}
+	}
+
+	progress->SetMaxCount(changedProgressCount);
+
+	if (changedProgressCount > 10000)
+		progress->Show();
+
+	// Do block compares
+	for (intptr_t i: changedBlockIdx)
+	{
+		diffInfo& blockDiff1 = cmpInfo.blockDiffs[i - 1];
+		diffInfo& blockDiff2 = cmpInfo.blockDiffs[i];
+
+		blockDiff1.info.matchBlock = &blockDiff2;
+		blockDiff2.info.matchBlock = &blockDiff1;
+
+		// Blocks pair unaffected by the edits (and with the same moves) - reuse its last compare results
+		if (!origins.empty() && (origins[i - 1] >= 0) && (origins[i] == origins[i - 1] + 1))
+		{
+			auto sameMoves = [](const diffInfo& bd, const diffInfo& oldBd)
+			{
+				return std::equal(bd.info.moves.begin(), bd.info.moves.end(),
+						oldBd.info.moves.begin(), oldBd.info.moves.end(),
+						[](const section_t& m1, const section_t& m2) { return (m1.off == m2.off && m1.len == m2.len); });
+			};
+
+			if (sameMoves(blockDiff1, lastState->cmpInfo.blockDiffs[origins[i - 1]]) &&
+				sameMoves(blockDiff2, lastState->cmpInfo.blockDiffs[origins[i]]))
+				continue;
+		}
+
+		blockDiff1.info.changedLines.clear();
+		blockDiff2.info.changedLines.clear();
+
+		if (!compareBlocks(cmpInfo.doc1, cmpInfo.doc2, blockDiff1, blockDiff2, options))
+			return CompareResult::COMPARE_CANCELLED;
+	}
+
+	if (!progress->NextPhase())
+		return CompareResult::COMPARE_CANCELLED;
+
+	if (useResultCache)
+		compareResultCache.put(resultKey, cmpInfo.blockDiffs);
+
+	return CompareResult::COMPARE_MISMATCH;
+}
+
+
+CompareResult compareDocs(const CompareOptions& options, CompareSummary& summary, IncrementalCompare* incremental,
+		LineHashCache* const lineHashes[2])
+{
+	TraceScope trace("Compare");
+
+	CompareInfo cmpInfo;
+
+	cmpInfo.doc1.view	= MAIN_VIEW;
+	cmpInfo.doc2.view	= SUB_VIEW;
+
+	if (options.selectionCompare)
+	{
+		cmpInfo.doc1.section.off	= options.selections[MAIN_VIEW].first;
+		cmpInfo.doc1.section.len	= options.selections[MAIN_VIEW].second - options.selections[MAIN_VIEW].first + 1;
+
+		cmpInfo.doc2.section.off	= options.selections[SUB_VIEW].first;
+		cmpInfo.doc2.section.len	= options.selections[SUB_VIEW].second - options.selections[SUB_VIEW].first + 1;
+	}
+
+	cmpInfo.doc1.blockDiffMask = (options.newFileViewId == MAIN_VIEW) ? MARKER_MASK_ADDED : MARKER_MASK_REMOVED;
+	cmpInfo.doc2.blockDiffMask = (options.newFileViewId == MAIN_VIEW) ? MARKER_MASK_REMOVED : MARKER_MASK_ADDED;
+
+	// Marks of the lines above these ones are still in the views as the last compare set them (incremental only)
+	intptr_t keptMarksEnd[2] = { 0, 0 };
+
+	if (incremental && incremental->state && !options.selectionCompare)
+	{
+		for (int view: { MAIN_VIEW, SUB_VIEW })
+		{
+			keptMarksEnd[view] = incremental->edited[view].empty() ? INTPTR_MAX : incremental->edited[view].first;
+
+			detectAppend(*incremental, view);
+		}
+	}
+
+	const std::shared_ptr<CompareState> lastState =
+			isIncrementalPossible(incremental, options) ? incremental->state : nullptr;
+
+	if (!lastState)
+	{
+		keptMarksEnd[MAIN_VIEW]	= 0;
+		keptMarksEnd[SUB_VIEW]	= 0;
+	}
+
+	CompareResult result = CompareResult::COMPARE_CANCELLED;
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	if (options.backgroundCompare)
+	{
+		DocSnapshot snapshots[2];
+
+		takeDocSnapshot(cmpInfo.doc1, snapshots[cmpInfo.doc1.view]);
+		takeDocSnapshot(cmpInfo.doc2, snapshots[cmpInfo.doc2.view]);
+
+		ScopedDocSources useSnapshots(snapshots[0], snapshots[1]);
+
+		CompareContext* const ctx = threadContext;
+
+		result = context().views->runInBackground(
+				[&]()
+				{
+					ScopedCompareContext useCtx(ctx);
+
+					return findDiffs(cmpInfo, options, lastState.get(), incremental, lineHashes);
+				});
+	}
+	else
+#endif // MULTITHREAD
+	{
+		result = findDiffs(cmpInfo, options, lastState.get(), incremental, lineHashes);
+	}
+
+	if (result != CompareResult::COMPARE_MISMATCH)
+		return result;
+
+	context().stats.startPhase(CompareStats::MARKING);
+
+	ViewMarks viewMarks[2];
+
+	if (!markAllDiffs(cmpInfo, options, summary, viewMarks))
+		return CompareResult::COMPARE_CANCELLED;
+
+	fillDiffMap(viewMarks[MAIN_VIEW], summary.diffMap[MAIN_VIEW]);
+	fillDiffMap(viewMarks[SUB_VIEW], summary.diffMap[SUB_VIEW]);
+
+	fillDiffIndex(summary);
+
+	// Only the marks that changed since the last compare are set anew - appended lines of a growing log for example
+	for (int view: { MAIN_VIEW, SUB_VIEW })
+	{
+		if (keptMarksEnd[view] > 0)
+			keptMarksEnd[view] = sameMarksEnd(*lastState, view, summary.diffMap[view], viewMarks[view].changedText,
+					std::min(keptMarksEnd[view], docLinesCount(view)));
+
+		context().views->clearMarksFrom(view, keptMarksEnd[view]);
+	}
+
+	if (!context().views->applyMarks(summary.diffMap, viewMarks, options, keptMarksEnd))
+		return CompareResult::COMPARE_CANCELLED;
+
+	summary.keptMarksEnd[MAIN_VIEW]	= keptMarksEnd[MAIN_VIEW];
+	summary.keptMarksEnd[SUB_VIEW]	= keptMarksEnd[SUB_VIEW];
+
+	context().stats.endPhase();
+	context().stats.get(summary.stats);
+
+	saveCompareState(cmpInfo, summary, viewMarks, incremental);
+
+	return CompareResult::COMPARE_MISMATCH;
+}
+
+
+CompareResult runFindUnique(const CompareOptions& options, CompareSummary& summary, LineHashCache* const lineHashes[2])
+{
+	TraceScope trace("FindUnique");
+
+	CompareProgress* const progress = context().progress;
+
+	summary.clear();
+
+	context().stats.startPhase(CompareStats::HASHING);
+
+	DocCmpInfo doc1;
+	DocCmpInfo doc2;
+
+	doc1.view	= MAIN_VIEW;
+	doc2.view	= SUB_VIEW;
+
+	if (options.selectionCompare)
+	{
+		doc1.section.off	= options.selections[MAIN_VIEW].first;
+		doc1.section.len	= options.selections[MAIN_VIEW].second - options.selections[MAIN_VIEW].first + 1;
+
+		doc2.section.off	= options.selections[SUB_VIEW].first;
+		doc2.section.len	= options.selections[SUB_VIEW].second - options.selections[SUB_VIEW].first + 1;
+	}
+
+	if (options.newFileViewId == MAIN_VIEW)
+	{
+		doc1.blockDiffMask = MARKER_MASK_ADDED;
+		doc2.blockDiffMask = MARKER_MASK_REMOVED;
+	}
+	else
+	{
+		doc1.blockDiffMask = MARKER_MASK_REMOVED;
+		doc2.blockDiffMask = MARKER_MASK_ADDED;
+	}
+
+	// The unique lines in document order (makes up longer marker runs) and the count of distinct matched lines
+	std::vector<intptr_t> doc1Unique;
+	std::vector<intptr_t> doc2Unique;
+
+	intptr_t matchCount = 0;
+
+	// Doesn't call Scintilla when the documents snapshots are used - can be run by a worker thread
+	auto findLines =
+		[&]()
+		{
+			const bool cached1 = getCachedLines(doc1, options, lineHashes[doc1.view]);
+			const bool cached2 = getCachedLines(doc2, options, lineHashes[doc2.view]);
+
+			bool cancelled = false;
+
+			if (!cached1 && !cached2 &&
+					findUniqueConcurrently(doc1, doc2, options, lineHashes, doc1Unique, doc2Unique, matchCount,
+							cancelled))
+				return cancelled ? CompareResult::COMPARE_CANCELLED : CompareResult::COMPARE_MISMATCH;
+
+			if (!cached1)
+			{
+				getLines(doc1, options);
+
+				if (!progress->NextPhase())
+					return CompareResult::COMPARE_CANCELLED;
+
+				fillLineHashCache(doc1, lineHashes[doc1.view]);
+			}
+			else if (!progress->NextPhase())
+			{
+				return CompareResult::COMPARE_CANCELLED;
+			}
+
+			if (!cached2)
+			{
+				getLines(doc2, options);
+
+				if (!progress->NextPhase())
+					return CompareResult::COMPARE_CANCELLED;
+
+				fillLineHashCache(doc2, lineHashes[doc2.view]);
+			}
+			else if (!progress->NextPhase())
+			{
+				return CompareResult::COMPARE_CANCELLED;
+			}
 
-				const intptr_t movedLines1 = bd.info.movedCount();
-				const intptr_t movedLines2 = bd.info.matchBlock->info.movedCount();
+			LineClasses classes;
 
-				const intptr_t newLines1 = bd.len - changedLinesCount - movedLines1;
-				const intptr_t newLines2 = bd.info.matchBlock->len - changedLinesCount - movedLines2;
+			internLines(doc1.lines.data(), static_cast<intptr_t>(doc1.lines.size()),
+					doc2.lines.data(), static_cast<intptr_t>(doc2.lines.size()), classes);
 
-				summary.diffLines	+= changedLinesCount;
-				summary.changed		+= changedLinesCount;
-				summary.moved		+= movedLines1 + movedLines2;
+			if (!progress->NextPhase())
+				return CompareResult::COMPARE_CANCELLED;
 
-				if (cmpInfo.doc1.blockDiffMask == MARKER_MASK_ADDED)
-				{
-					summary.added	+= newLines1;
-					summary.removed	+= newLines2;
-				}
-				else
-				{
-					summary.added	+= newLines2;
-					summary.removed	+= newLines1;
-				}
+			const std::vector<uint8_t> inDocs = getClassesDocs(classes);
 
-				++i;
+			for (size_t i = 0; i < doc1.lines.size(); ++i)
+			{
+				if (inDocs[classes.ids[0][i]] == 1)
+					doc1Unique.emplace_back(doc1.lines[i].line);
 			}
-			else
+
+			for (size_t i = 0; i < doc2.lines.size(); ++i)
 			{
-				cmpInfo.doc1.section.off = 0;
-				cmpInfo.doc1.section.len = bd.len;
-				markSection(cmpInfo.doc1, bd, options);
+				if (inDocs[classes.ids[1][i]] == 2)
+					doc2Unique.emplace_back(doc2.lines[i].line);
+			}
 
-				pMainAlignData->diffMask	= cmpInfo.doc1.blockDiffMask;
-				pMainAlignData->line		= toAlignmentLine(cmpInfo.doc1, alignLines.first);
+			for (uint8_t in: inDocs)
+			{
+				if (in == 3)
+					++matchCount;
+			}
 
-				pSubAlignData->diffMask		= 0;
-				pSubAlignData->line			= toAlignmentLine(cmpInfo.doc2, alignLines.second);
+			doc1.lines.clear();
+			doc2.lines.clear();
 
-				summary.alignmentInfo.emplace_back(alignPair);
+			if (!progress->NextPhase())
+				return CompareResult::COMPARE_CANCELLED;
 
-				const intptr_t movedLines = bd.info.movedCount();
+			return CompareResult::COMPARE_MISMATCH;
+		};
 
-				summary.diffLines	+= bd.len;
-				summary.moved		+= movedLines;
+	CompareResult result = CompareResult::COMPARE_CANCELLED;
 
-				if (cmpInfo.doc1.blockDiffMask == MARKER_MASK_ADDED)
-					summary.added += bd.len - movedLines;
-				else
-					summary.removed += bd.len - movedLines;
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	if (options.backgroundCompare)
+	{
+		DocSnapshot snapshots[2];
 
-				alignLines.first += bd.len;
-			}
-		}
+		takeDocSnapshot(doc1, snapshots[doc1.view]);
+		takeDocSnapshot(doc2, snapshots[doc2.view]);
 
-		if (!progress->Advance())
-			return false;
-	}
+		ScopedDocSources useSnapshots(snapshots[0], snapshots[1]);
 
-	summary.moved /= 2;
+		CompareContext* const ctx = threadContext;
 
-	if (!progress->NextPhase())
-		return false;
+		result = context().views->runInBackground(
+				[&]()
+				{
+					ScopedCompareContext useCtx(ctx);
 
-	return true;
-}
+					return findLines();
+				});
+	}
+	else
+#endif // MULTITHREAD
+	{
+		result = findLines();
+	}
 
+	if (result != CompareResult::COMPARE_MISMATCH)
+		return result;
 
-CompareResult runCompare(const CompareOptions& options, CompareSummary& summary)
-{
-	progress_ptr& progress = ProgressDlg::Get();
+	context().stats.startPhase(CompareStats::MARKING);
 
-	CompareInfo cmpInfo;
+	summary.match = matchCount;
 
-	cmpInfo.doc1.view	= MAIN_VIEW;
-	cmpInfo.doc2.view	= SUB_VIEW;
+	if (doc1Unique.empty() && doc2Unique.empty())
+		return CompareResult::COMPARE_MATCH;
 
-	if (options.selectionCompare)
+	if (doc1.blockDiffMask == MARKER_MASK_ADDED)
 	{
-		cmpInfo.doc1.section.off	= options.selections[MAIN_VIEW].first;
-		cmpInfo.doc1.section.len	= options.selections[MAIN_VIEW].second - options.selections[MAIN_VIEW].first + 1;
-
-		cmpInfo.doc2.section.off	= options.selections[SUB_VIEW].first;
-		cmpInfo.doc2.section.len	= options.selections[SUB_VIEW].second - options.selections[SUB_VIEW].first + 1;
+		summary.added	= doc1Unique.size();
+		summary.removed	= doc2Unique.size();
+	}
+	else
+	{
+		summary.added	= doc2Unique.size();
+		summary.removed	= doc1Unique.size();
 	}
 
-	cmpInfo.doc1.blockDiffMask = (options.newFileViewId == MAIN_VIEW) ? MARKER_MASK_ADDED : MARKER_MASK_REMOVED;
-	cmpInfo.doc2.blockDiffMask = (options.newFileViewId == MAIN_VIEW) ? MARKER_MASK_REMOVED : MARKER_MASK_ADDED;
+	ViewMarks viewMarks[2];
 
-	LOGD_GET_TIME;
+	for (intptr_t line: doc1Unique)
+		viewMarks[doc1.view].addMarker(line, doc1.blockDiffMask);
 
-	getLines(cmpInfo.doc1, options);
+	for (intptr_t line: doc2Unique)
+		viewMarks[doc2.view].addMarker(line, doc2.blockDiffMask);
 
 	if (!progress->NextPhase())
 		return CompareResult::COMPARE_CANCELLED;
 
-	getLines(cmpInfo.doc2, options);
+	fillDiffMap(viewMarks[MAIN_VIEW], summary.diffMap[MAIN_VIEW]);
+	fillDiffMap(viewMarks[SUB_VIEW], summary.diffMap[SUB_VIEW]);
 
-	if (!progress->NextPhase())
+	context().views->clearMarksFrom(MAIN_VIEW, 0);
+	context().views->clearMarksFrom(SUB_VIEW, 0);
+
+	if (!context().views->applyMarks(summary.diffMap, viewMarks, options, nullptr))
 		return CompareResult::COMPARE_CANCELLED;
 
-	auto diffRes = DiffCalc<Line, blockDiffInfo>(cmpInfo.doc1.lines, cmpInfo.doc2.lines,
-			std::bind(&ProgressDlg::IsCancelled, progress))(true, true);
+	AlignmentPair align;
+	align.main.line	= doc1.section.off;
+	align.sub.line	= doc2.section.off;
 
-	if (progress->IsCancelled())
-		return CompareResult::COMPARE_CANCELLED;
+	summary.alignmentInfo.push_back(align);
 
-	cmpInfo.blockDiffs = std::move(diffRes.first);
+	context().stats.endPhase();
+	context().stats.get(summary.stats);
 
-	if (diffRes.second)
-		swap(cmpInfo.doc1, cmpInfo.doc2);
+	return CompareResult::COMPARE_MISMATCH;
+}
 
-	LOGD_GET_TIME;
-	PRINT_DIFFS("COMPARE START - LINE DIFFS", cmpInfo.blockDiffs);
+}
 
-	const intptr_t blockDiffsSize = static_cast<intptr_t>(cmpInfo.blockDiffs.size());
 
-	if (blockDiffsSize == 0 || (blockDiffsSize == 1 && cmpInfo.blockDiffs[0].type == diff_type::DIFF_MATCH))
-		return CompareResult::COMPARE_MATCH;
+AlignmentPair AlignmentInfo::operator[](intptr_t idx) const
+{
+	const Run& run = _runs[findRun(idx)];
 
-	findUniqueLines(cmpInfo);
+	const intptr_t offset = idx - run.idx;
 
-	if (options.detectMoves)
-		findMoves(cmpInfo);
+	AlignmentPair point;
 
-	if (!progress->NextPhase())
-		return CompareResult::COMPARE_CANCELLED;
+	point.main.line		= run.line[MAIN_VIEW] + offset;
+	point.main.diffMask	= run.diffMask[MAIN_VIEW];
+	point.sub.line		= run.line[SUB_VIEW] + offset;
+	point.sub.diffMask	= run.diffMask[SUB_VIEW];
 
-	std::vector<intptr_t> changedBlockIdx;
+	return point;
+}
 
-	intptr_t changedProgressCount = 0;
 
-	// Get changed blocks to sub-compare
-	for (intptr_t i = 1; i < blockDiffsSize; ++i)
+void AlignmentInfo::push_back(const AlignmentPair& point)
+{
+	if (!_runs.empty())
 	{
-		if ((cmpInfo.blockDiffs[i].type == diff_type::DIFF_IN_2) &&
-				(cmpInfo.blockDiffs[i - 1].type == diff_type::DIFF_IN_1))
+		const Run& last = _runs.back();
+
+		const intptr_t offset = _size - last.idx;
+
+		if ((point.main.line == last.line[MAIN_VIEW] + offset) && (point.sub.line == last.line[SUB_VIEW] + offset) &&
+				(point.main.diffMask == last.diffMask[MAIN_VIEW]) && (point.sub.diffMask == last.diffMask[SUB_VIEW]))
 		{
-			changedProgressCount += cmpInfo.blockDiffs[i].len * cmpInfo.blockDiffs[i - 1].len;
-			changedBlockIdx.emplace_back(i++);
+			++_size;
+			return;
 		}
 	}
 
-	progress->SetMaxCount(changedProgressCount);
+	Run run;
 
-	if (changedProgressCount > 10000)
-		progress->Show();
+	run.idx					= _size;
+	run.line[MAIN_VIEW]		= point.main.line;
+	run.line[SUB_VIEW]		= point.sub.line;
+	run.diffMask[MAIN_VIEW]	= point.main.diffMask;
+	run.diffMask[SUB_VIEW]	= point.sub.diffMask;
 
-	// Do block compares
-	for (intptr_t i: changedBlockIdx)
-	{
-		diffInfo& blockDiff1 = cmpInfo.blockDiffs[i - 1];
-		diffInfo& blockDiff2 = cmpInfo.blockDiffs[i];
+	_runs.emplace_back(run);
 
-		blockDiff1.info.matchBlock = &blockDiff2;
-		blockDiff2.info.matchBlock = &blockDiff1;
+	++_size;
+}
 
-		if (!compareBlocks(cmpInfo.doc1, cmpInfo.doc2, blockDiff1, blockDiff2, options))
-			return CompareResult::COMPARE_CANCELLED;
-	}
 
-	if (!progress->NextPhase())
-		return CompareResult::COMPARE_CANCELLED;
+intptr_t AlignmentInfo::idxAfter(int view, intptr_t line) const
+{
+	// The first run whose last point line is not less than line - the view lines never decrease
+	auto runIt = std::partition_point(_runs.begin(), _runs.end(),
+		[this, view, line](const Run& run)
+		{
+			const intptr_t lastOffset = runEnd(&run - _runs.data()) - run.idx - 1;
 
-	clearWindow(MAIN_VIEW);
-	clearWindow(SUB_VIEW);
+			return (run.line[view] + lastOffset < line);
+		});
 
-	if (!markAllDiffs(cmpInfo, options, summary))
-		return CompareResult::COMPARE_CANCELLED;
+	if (runIt == _runs.end())
+		return _size;
 
-	return CompareResult::COMPARE_MISMATCH;
+	if (runIt->line[view] >= line)
+		return runIt->idx;
+
+	return runIt->idx + (line - runIt->line[view]);
 }
 
 
-CompareResult runFindUnique(const CompareOptions& options, CompareSummary& summary)
+void AlignmentInfo::erase(intptr_t first, intptr_t last)
 {
-	progress_ptr& progress = ProgressDlg::Get();
+	if (first >= last)
+		return;
 
-	summary.alignmentInfo.clear();
+	const intptr_t firstRun	= splitRun(first);
+	const intptr_t lastRun	= splitRun(last);
 
-	summary.diffLines	= 0;
-	summary.added		= 0;
-	summary.removed		= 0;
-	summary.moved		= 0;
-	summary.changed		= 0;
-	summary.match		= 0;
+	_runs.erase(_runs.begin() + firstRun, _runs.begin() + lastRun);
 
-	DocCmpInfo doc1;
-	DocCmpInfo doc2;
+	const intptr_t count = last - first;
 
-	doc1.view	= MAIN_VIEW;
-	doc2.view	= SUB_VIEW;
+	for (auto runIt = _runs.begin() + firstRun; runIt != _runs.end(); ++runIt)
+		runIt->idx -= count;
 
-	if (options.selectionCompare)
-	{
-		doc1.section.off	= options.selections[MAIN_VIEW].first;
-		doc1.section.len	= options.selections[MAIN_VIEW].second - options.selections[MAIN_VIEW].first + 1;
+	_size -= count;
+	_hint = 0;
+}
 
-		doc2.section.off	= options.selections[SUB_VIEW].first;
-		doc2.section.len	= options.selections[SUB_VIEW].second - options.selections[SUB_VIEW].first + 1;
-	}
 
-	if (options.newFileViewId == MAIN_VIEW)
-	{
-		doc1.blockDiffMask = MARKER_MASK_ADDED;
-		doc2.blockDiffMask = MARKER_MASK_REMOVED;
-	}
-	else
-	{
-		doc1.blockDiffMask = MARKER_MASK_REMOVED;
-		doc2.blockDiffMask = MARKER_MASK_ADDED;
-	}
+void AlignmentInfo::slice(intptr_t first, intptr_t last, AlignmentInfo& points) const
+{
+	points.clear();
 
-	getLines(doc1, options);
+	if (first >= last)
+		return;
 
-	if (!progress->NextPhase())
-		return CompareResult::COMPARE_CANCELLED;
+	const intptr_t runsCount = static_cast<intptr_t>(_runs.size());
 
-	getLines(doc2, options);
+	for (intptr_t run = findRun(first); run < runsCount && _runs[run].idx < last; ++run)
+	{
+		Run part = _runs[run];
 
-	if (!progress->NextPhase())
-		return CompareResult::COMPARE_CANCELLED;
+		if (part.idx < first)
+		{
+			const intptr_t offset = first - part.idx;
 
-	std::unordered_map<uint64_t, std::vector<intptr_t>> doc1UniqueLines;
+			part.line[MAIN_VIEW]	+= offset;
+			part.line[SUB_VIEW]		+= offset;
+			part.idx				= first;
+		}
 
-	for (const auto& line: doc1.lines)
-	{
-		auto insertPair = doc1UniqueLines.emplace(line.hash, std::vector<intptr_t>{line.line});
-		if (!insertPair.second)
-			insertPair.first->second.emplace_back(line.line);
+		part.idx -= first;
+
+		points._runs.emplace_back(part);
 	}
 
-	doc1.lines.clear();
+	points._size = last - first;
+}
 
-	if (!progress->NextPhase())
-		return CompareResult::COMPARE_CANCELLED;
 
-	std::unordered_map<uint64_t, std::vector<intptr_t>> doc2UniqueLines;
+void AlignmentInfo::insert(intptr_t idx, const AlignmentInfo& points)
+{
+	if (points.empty())
+		return;
 
-	for (const auto& line: doc2.lines)
-	{
-		auto insertPair = doc2UniqueLines.emplace(line.hash, std::vector<intptr_t>{line.line});
-		if (!insertPair.second)
-			insertPair.first->second.emplace_back(line.line);
-	}
+	const intptr_t run = splitRun(idx);
 
-	doc2.lines.clear();
+	auto runIt = _runs.insert(_runs.begin() + run, points._runs.begin(), points._runs.end());
 
-	if (!progress->NextPhase())
-		return CompareResult::COMPARE_CANCELLED;
+	for (auto insEnd = runIt + points._runs.size(); runIt != insEnd; ++runIt)
+		runIt->idx += idx;
 
-	clearWindow(MAIN_VIEW);
-	clearWindow(SUB_VIEW);
+	for (; runIt != _runs.end(); ++runIt)
+		runIt->idx += points._size;
 
-	intptr_t doc1UniqueLinesCount = 0;
+	_size += points._size;
+	_hint = 0;
+}
 
-	for (const auto& uniqueLine: doc1UniqueLines)
-	{
-		auto doc2it = doc2UniqueLines.find(uniqueLine.first);
 
-		if (doc2it != doc2UniqueLines.end())
-		{
-			doc2UniqueLines.erase(doc2it);
-			++summary.match;
-		}
-		else
-		{
-			for (const auto& line: uniqueLine.second)
-			{
-				CallScintilla(doc1.view, SCI_MARKERADDSET, line, doc1.blockDiffMask);
-				++doc1UniqueLinesCount;
-			}
-		}
-	}
+void AlignmentInfo::shiftLines(int view, intptr_t fromIdx, intptr_t offset)
+{
+	for (auto runIt = _runs.begin() + splitRun(fromIdx); runIt != _runs.end(); ++runIt)
+		runIt->line[view] += offset;
+}
 
-	if (doc1UniqueLinesCount == 0 && doc2UniqueLines.empty())
-		return CompareResult::COMPARE_MATCH;
 
-	if (doc1.blockDiffMask == MARKER_MASK_ADDED)
-		summary.added = doc1UniqueLinesCount;
-	else
-		summary.removed = doc1UniqueLinesCount;
+intptr_t AlignmentInfo::findRun(intptr_t idx) const
+{
+	const intptr_t runsCount = static_cast<intptr_t>(_runs.size());
 
-	for (const auto& uniqueLine: doc2UniqueLines)
+	if (_hint < runsCount && _runs[_hint].idx <= idx)
 	{
-		for (const auto& line: uniqueLine.second)
-			CallScintilla(doc2.view, SCI_MARKERADDSET, line, doc2.blockDiffMask);
+		if (idx < runEnd(_hint))
+			return _hint;
 
-		if (doc2.blockDiffMask == MARKER_MASK_ADDED)
-			summary.added += uniqueLine.second.size();
-		else
-			summary.removed += uniqueLine.second.size();
+		if (_hint + 1 < runsCount && idx < runEnd(_hint + 1))
+			return ++_hint;
 	}
 
-	AlignmentPair align;
-	align.main.line	= doc1.section.off;
-	align.sub.line	= doc2.section.off;
+	auto runIt = std::upper_bound(_runs.begin(), _runs.end(), idx,
+			[](intptr_t i, const Run& run) { return (i < run.idx); });
 
-	summary.alignmentInfo.push_back(align);
+	_hint = static_cast<intptr_t>(runIt - _runs.begin()) - 1;
 
-	return CompareResult::COMPARE_MISMATCH;
+	return _hint;
 }
 
+
+intptr_t AlignmentInfo::splitRun(intptr_t idx)
+{
+	if (idx >= _size)
+		return static_cast<intptr_t>(_runs.size());
+
+	const intptr_t run = findRun(idx);
+
+	if (_runs[run].idx == idx)
+		return run;
+
+	Run split = _runs[run];
+
+	const intptr_t offset = idx - split.idx;
+
+	split.idx				= idx;
+	split.line[MAIN_VIEW]	+= offset;
+	split.line[SUB_VIEW]	+= offset;
+
+	_runs.insert(_runs.begin() + run + 1, split);
+
+	return run + 1;
 }
 
 
-CompareResult compareViews(const CompareOptions& options, const TCHAR* progressInfo, CompareSummary& summary)
+CompareResult runCompare(const CompareOptions& options, CompareViews& views, CompareProgress& progress,
+		CompareSummary& summary, IncrementalCompare* incremental,
+		LineHashCache* mainLineHashes, LineHashCache* subLineHashes)
 {
-	CompareResult result = CompareResult::COMPARE_ERROR;
+	LineHashCache* const lineHashes[2] = { mainLineHashes, subLineHashes };
 
-	if (!progressInfo || !ProgressDlg::Open(progressInfo))
-		return CompareResult::COMPARE_ERROR;
+	CompareContext ctx(&views, progress);
 
-	try
-	{
-		if (options.findUniqueMode)
-			result = runFindUnique(options, summary);
-		else
-			result = runCompare(options, summary);
+	ctx.docSources[MAIN_VIEW]	= &views.doc(MAIN_VIEW);
+	ctx.docSources[SUB_VIEW]	= &views.doc(SUB_VIEW);
 
-		ProgressDlg::Close();
+	ScopedCompareContext useCtx(&ctx);
 
-		if (result != CompareResult::COMPARE_MISMATCH)
-		{
-			clearWindow(MAIN_VIEW);
-			clearWindow(SUB_VIEW);
-		}
-	}
-	catch (std::exception& e)
+	if (options.findUniqueMode)
 	{
-		ProgressDlg::Close();
+		if (incremental)
+			incremental->clear();
+
+		return runFindUnique(options, summary, lineHashes);
+	}
+
+	return compareDocs(options, summary, incremental, lineHashes);
+}
+
+
+CompareResult precomputeCompare(const CompareOptions& options, const DocSource& mainDoc, const DocSource& subDoc,
+		CompareProgress& progress, LineHashCache* mainLineHashes, LineHashCache* subLineHashes)
+{
+	if (options.selectionCompare || options.findUniqueMode)
+		return CompareResult::COMPARE_ERROR;
+
+	LineHashCache* const lineHashes[2] = { mainLineHashes, subLineHashes };
+
+	CompareInfo cmpInfo;
+
+	cmpInfo.doc1.view	= MAIN_VIEW;
+	cmpInfo.doc2.view	= SUB_VIEW;
+
+	cmpInfo.doc1.blockDiffMask = (options.newFileViewId == MAIN_VIEW) ? MARKER_MASK_ADDED : MARKER_MASK_REMOVED;
+	cmpInfo.doc2.blockDiffMask = (options.newFileViewId == MAIN_VIEW) ? MARKER_MASK_REMOVED : MARKER_MASK_ADDED;
+
+	CompareContext ctx(nullptr, progress);
 
-		clearWindow(MAIN_VIEW);
-		clearWindow(SUB_VIEW);
+	ctx.docSources[MAIN_VIEW]	= &mainDoc;
+	ctx.docSources[SUB_VIEW]	= &subDoc;
 
-		char msg[128];
-		_snprintf_s(msg, _countof(msg), _TRUNCATE, "Exception occurred: %s", e.what());
-		::MessageBoxA(nppData._nppHandle, msg, "ComparePlus", MB_OK | MB_ICONWARNING);
+	ScopedCompareContext useCtx(&ctx);
+
+	try
+	{
+		// The results are kept in the compare results cache by findDiffs()
+		return findDiffs(cmpInfo, options, nullptr, nullptr, lineHashes);
 	}
 	catch (...)
 	{
-		ProgressDlg::Close();
+		return CompareResult::COMPARE_ERROR;
+	}
+}
+
+
+void hashDocLines(const CompareOptions& options, const DocSource& doc, LineHashCache& lineHashes)
+{
+	SilentProgress progress;
+
+	CompareContext ctx(nullptr, progress);
 
-		::MessageBoxA(nppData._nppHandle, "Unknown exception occurred.", "ComparePlus", MB_OK | MB_ICONWARNING);
+	ctx.docSources[MAIN_VIEW]	= &doc;
+	ctx.docSources[SUB_VIEW]	= &doc;
+
+	ScopedCompareContext useCtx(&ctx);
+
+	DocCmpInfo docInfo;
+	docInfo.view = MAIN_VIEW;
+
+	if (!getCachedLines(docInfo, options, &lineHashes))
+	{
+		getLines(docInfo, options, true);
+		fillLineHashCache(docInfo, &lineHashes);
 	}
+}
+
+
+void reserveCompareResults(size_t count)
+{
+	compareResultCache.reserve(count);
+}
+
+
+void recordNextCompare(const std::wstring& filePath, bool withText)
+{
+	workloadRecording.filePath	= filePath;
+	workloadRecording.withText	= withText;
+	workloadRecording.saved		= false;
+	workloadRecording.pending	= true;
+}
+
+
+bool endCompareRecording()
+{
+	workloadRecording.pending = false;
 
-	return result;
+	return workloadRecording.saved.exchange(false);
 }
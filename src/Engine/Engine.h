@@ -23,12 +23,17 @@
 #include <cstdint>
 #include <vector>
 #include <utility>
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <regex>
+#include <atomic>
+#include <functional>
 
-#include "Compare.h"
-#include "NppHelpers.h"
+#include "CompareOptions.h"
+#include "DiffMarkers.h"
+#include "DocSource.h"
+#include "LineHash.h"
 
 
 enum class CompareResult
@@ -50,68 +55,235 @@ struct section_t
 };
 
 
-struct CompareOptions
+struct AlignmentViewData
+{
+	intptr_t	line {0};
+	int			diffMask {0};
+};
+
+
+struct AlignmentPair
+{
+	AlignmentViewData main;
+	AlignmentViewData sub;
+};
+
+
+/**
+ *  \class  AlignmentInfo
+ *  \brief  Alignment points sorted by line in both views kept as runs - consecutive points whose lines advance by one
+ *          in both views and that have the same diff masks (like aligned matching lines) are stored once. The points
+ *          are accessed by their index as if they were all stored.
+ */
+class AlignmentInfo
 {
-	CompareOptions()
+public:
+	inline intptr_t size() const
 	{
-		selections[0] = std::make_pair(-1, -1);
-		selections[1] = std::make_pair(-1, -1);
+		return _size;
 	}
 
-	inline void setIgnoreRegex(const std::wstring& regexStr)
+	inline bool empty() const
 	{
-		if (!regexStr.empty())
-			ignoreRegex = std::make_unique<std::wregex>(regexStr, std::regex::ECMAScript | std::regex::optimize);
-		else
-			ignoreRegex = nullptr;
+		return (_size == 0);
+	}
+
+	inline void clear()
+	{
+		_runs.clear();
+		_size = 0;
+		_hint = 0;
+	}
+
+	inline intptr_t runsCount() const
+	{
+		return static_cast<intptr_t>(_runs.size());
+	}
+
+	AlignmentPair operator[](intptr_t idx) const;
+
+	inline AlignmentPair back() const
+	{
+		return (*this)[_size - 1];
 	}
 
-	inline void clearIgnoreRegex()
+	// Extends the last run if the point continues it
+	void push_back(const AlignmentPair& point);
+
+	inline void emplace_back(const AlignmentPair& point)
 	{
-		ignoreRegex = nullptr;
+		push_back(point);
 	}
 
-	int		newFileViewId;
+	// Index of the first point whose view line is not less than line, size() if there is none
+	intptr_t idxAfter(int view, intptr_t line) const;
 
-	bool	findUniqueMode;
+	// Removes the points [first, last)
+	void erase(intptr_t first, intptr_t last);
 
-	bool	alignAllMatches;
-	bool	neverMarkIgnored;
-	bool	detectMoves;
-	bool	detectCharDiffs;
-	bool	bestSeqChangedLines;
-	bool	ignoreEmptyLines;
-	bool	ignoreChangedSpaces;
-	bool	ignoreAllSpaces;
-	bool	ignoreCase;
+	// Copies the points [first, last) to points
+	void slice(intptr_t first, intptr_t last, AlignmentInfo& points) const;
 
-	bool	recompareOnChange;
+	// Inserts the points before the point idx (at the end if idx is size())
+	void insert(intptr_t idx, const AlignmentInfo& points);
 
-	std::unique_ptr<std::wregex>	ignoreRegex;
+	// Moves the view lines of the points from fromIdx on by offset
+	void shiftLines(int view, intptr_t fromIdx, intptr_t offset);
+
+private:
+	struct Run
+	{
+		intptr_t	idx;			// Index of the run first point
+		intptr_t	line[2];		// Lines of the run first point in MAIN_VIEW and SUB_VIEW
+		int			diffMask[2];
+	};
+
+	inline intptr_t runEnd(intptr_t run) const
+	{
+		return (run + 1 < static_cast<intptr_t>(_runs.size())) ? _runs[run + 1].idx : _size;
+	}
 
-	int		changedThresholdPercent;
+	// Index of the run the point idx is in
+	intptr_t findRun(intptr_t idx) const;
 
-	bool	selectionCompare;
+	// Makes the point idx the first one of a run and returns that run index
+	intptr_t splitRun(intptr_t idx);
 
-	std::pair<intptr_t, intptr_t>	selections[2];
+	std::vector<Run>	_runs;
+	intptr_t			_size {0};
+
+	// Run of the last accessed point - going through the points one by one needs no search
+	mutable intptr_t	_hint {0};
 };
 
 
-struct AlignmentViewData
+using AlignmentInfo_t = AlignmentInfo;
+
+
+// Run of consecutive document lines having the same diff markers mask
+struct DiffMapRun
 {
-	intptr_t	line {0};
-	int			diffMask {0};
+	intptr_t	line;
+	intptr_t	len;
+	int			mask;
 };
 
+// Run-length map of the diff marked lines of a document sorted by line
+using DiffMap_t = std::vector<DiffMapRun>;
 
-struct AlignmentPair
+
+// Compact list of the marks to be set in a view - consecutive lines with the same markers are kept as a single run
+// and adjacent changed text ranges are merged
+struct ViewMarks
 {
-	AlignmentViewData main;
-	AlignmentViewData sub;
+	inline void addMarker(intptr_t line, int mask)
+	{
+		if (!markers.empty())
+		{
+			DiffMapRun& last = markers.back();
+
+			if ((last.mask == mask) && (last.line + last.len == line))
+			{
+				++last.len;
+				return;
+			}
+		}
+
+		markers.push_back({ line, 1, mask });
+	}
+
+	inline void addChangedText(intptr_t pos, intptr_t len)
+	{
+		if (len <= 0)
+			return;
+
+		if (!changedText.empty() && (changedText.back().first + changedText.back().second == pos))
+			changedText.back().second += len;
+		else
+			changedText.emplace_back(pos, len);
+	}
+
+	DiffMap_t	markers;
+
+	// Pairs of text start position and length - highlighted in the color of changedTextMask (MARKER_MASK_ADDED or
+	// MARKER_MASK_REMOVED - the mask of the view document lines missing in the other one)
+	std::vector<std::pair<intptr_t, intptr_t>>	changedText;
+	int											changedTextMask {0};
 };
 
 
-using AlignmentInfo_t = std::vector<AlignmentPair>;
+// Compare phases wall times and work counters - collected in release builds as well, they cost next to nothing
+struct CompareStats
+{
+	enum Phase
+	{
+		HASHING = 0,
+		LINES_DIFF,
+		MOVES,
+		BLOCKS_COMPARE,
+		MARKING,
+		PHASES_COUNT
+	};
+
+	inline void clear()
+	{
+		for (double& ms : phaseMs)
+			ms = 0.;
+
+		resultCached		= false;
+		diffApproximated	= false;
+		linesHashed			= 0;
+		diffCalcRuns		= 0;
+		linesEditDistance	= 0;
+		convPairsScored		= 0;
+		convPairsPruned		= 0;
+
+		budgetBoundedDiff		= false;
+		budgetBandedBlocks		= 0;
+		budgetLinesOnlyBlocks	= 0;
+		budgetSkippedCharDiffs	= 0;
+	}
+
+	inline bool budgetDegraded() const
+	{
+		return (budgetBoundedDiff || budgetBandedBlocks || budgetLinesOnlyBlocks || budgetSkippedCharDiffs);
+	}
+
+	inline double totalMs() const
+	{
+		double ms = 0.;
+
+		for (double phase : phaseMs)
+			ms += phase;
+
+		return ms;
+	}
+
+	double		phaseMs[PHASES_COUNT] {};
+
+	// The line diff results are the cached ones of the same documents compared before
+	bool		resultCached {false};
+
+	// The line diff cost limit has been reached - the lines diff is valid but might not be minimal
+	bool		diffApproximated {false};
+
+	intptr_t	linesHashed {0};
+	intptr_t	diffCalcRuns {0};
+
+	// Lines added plus removed by the line diff (Myers' D)
+	intptr_t	linesEditDistance {0};
+
+	// Changed lines pairs whose convergence has been calculated / skipped by the quick pre-checks
+	intptr_t	convPairsScored {0};
+	intptr_t	convPairsPruned {0};
+
+	// Cheaper compare strategies used to fit the memory budget - lines diff cost bounded, changed blocks pairs matched
+	// in a narrower band or not matched at all (compared by lines only) and changed words not diffed by chars
+	bool		budgetBoundedDiff {false};
+	intptr_t	budgetBandedBlocks {0};
+	intptr_t	budgetLinesOnlyBlocks {0};
+	intptr_t	budgetSkippedCharDiffs {0};
+};
 
 
 struct CompareSummary
@@ -126,6 +298,15 @@ struct CompareSummary
 		match		= 0;
 
 		alignmentInfo.clear();
+		diffIndex.clear();
+
+		keptMarksEnd[MAIN_VIEW]	= 0;
+		keptMarksEnd[SUB_VIEW]	= 0;
+
+		diffMap[MAIN_VIEW].clear();
+		diffMap[SUB_VIEW].clear();
+
+		stats.clear();
 	}
 
 	intptr_t	diffLines;
@@ -136,7 +317,322 @@ struct CompareSummary
 	intptr_t	match;
 
 	AlignmentInfo_t	alignmentInfo;
+
+	// The first alignment point of each diff (in alignment order) - lets the diffs be counted and found by line
+	AlignmentInfo_t	diffIndex;
+
+	// Per view marked lines - lets the navigation bar be drawn without scanning the documents
+	DiffMap_t		diffMap[2];
+
+	// Lines above these ones kept their marks from the last compare (incremental re-compare), 0 if all were marked anew
+	intptr_t		keptMarksEnd[2] {};
+
+	CompareStats	stats;
 };
 
 
-CompareResult compareViews(const CompareOptions& options, const TCHAR* progressInfo, CompareSummary& summary);
+// Range of document lines edited since the last compare (in current document line numbers)
+struct EditedLines
+{
+	inline void clear()
+	{
+		first		= -1;
+		last		= -1;
+		linesDelta	= 0;
+		lengthDelta	= 0;
+	}
+
+	inline bool empty() const
+	{
+		return (first < 0);
+	}
+
+	inline void add(intptr_t startLine, intptr_t linesAdded, intptr_t lengthAdded)
+	{
+		const intptr_t endLine = (linesAdded > 0) ? startLine + linesAdded : startLine;
+
+		if (empty())
+		{
+			first	= startLine;
+			last	= endLine;
+		}
+		else
+		{
+			// Shift the already edited range if it is after the change
+			if (first > startLine)
+				first = std::max(startLine, first + linesAdded);
+
+			if (last > startLine)
+				last = std::max(startLine, last + linesAdded);
+
+			first	= std::min(first, startLine);
+			last	= std::max(last, endLine);
+		}
+
+		linesDelta	+= linesAdded;
+		lengthDelta	+= lengthAdded;
+	}
+
+	intptr_t	first {-1};
+	intptr_t	last {-1};
+	intptr_t	linesDelta {0};
+	intptr_t	lengthDelta {0};
+};
+
+
+// Document line hashes kept between compares - only the lines edited since the last compare are re-hashed
+struct LineHashCache
+{
+	inline void clear()
+	{
+		hashes.clear();
+		variants.clear();
+		length = 0;
+	}
+
+	inline void invalidate(intptr_t startLine, intptr_t linesAdded, intptr_t lengthAdded)
+	{
+		const intptr_t linesCount = static_cast<intptr_t>(hashes.size());
+
+		// Not filled yet or out of sync
+		if (startLine >= linesCount || startLine - linesAdded >= linesCount)
+		{
+			clear();
+			return;
+		}
+
+		if (linesAdded > 0)
+			hashes.insert(hashes.begin() + startLine + 1, linesAdded, 0);
+		else if (linesAdded < 0)
+			hashes.erase(hashes.begin() + startLine + 1, hashes.begin() + startLine + 1 - linesAdded);
+
+		hashes[startLine] = 0;
+		length += lengthAdded;
+
+		if (variants.empty())
+			return;
+
+		if (linesAdded > 0)
+			variants.insert(variants.begin() + startLine + 1, linesAdded, LineHashVariants {});
+		else if (linesAdded < 0)
+			variants.erase(variants.begin() + startLine + 1, variants.begin() + startLine + 1 - linesAdded);
+
+		variants[startLine] = LineHashVariants {};
+	}
+
+	// The hashing options and the document state the hashes are valid for
+	bool			ignoreChangedSpaces {false};
+	bool			ignoreAllSpaces {false};
+	bool			ignoreCase {false};
+	std::wstring	ignoreRegexStr;
+	int				codepage {0};
+	intptr_t		length {0};
+
+	// Hash of each document line, 0 if not cached
+	std::vector<uint64_t>	hashes;
+
+	// All the ignore case and spaces hash variants of each document line (all 0 if not cached), empty if not kept -
+	// toggling these options only takes the other variant instead of re-hashing the lines
+	std::vector<LineHashVariants>	variants;
+};
+
+
+// Defined by the compare engine
+struct CompareState;
+
+
+// The last compare results and the edits made since then - used to re-compare only the edited lines
+struct IncrementalCompare
+{
+	inline void clear()
+	{
+		state = nullptr;
+
+		edited[MAIN_VIEW].clear();
+		edited[SUB_VIEW].clear();
+	}
+
+	std::shared_ptr<CompareState>	state;
+	EditedLines						edited[2];
+};
+
+
+/**
+ *  \class  CompareProgress
+ *  \brief  Progress of the running compare split in phases and its cancelling (the plugin shows it in the progress
+ *          dialog). The counters are advanced and the cancel flag is checked by the engine worker threads as well.
+ */
+class CompareProgress
+{
+public:
+	virtual ~CompareProgress() = default;
+
+	virtual bool IsCancelled() const = 0;
+	virtual const std::atomic<bool>* CancelFlag() const = 0;
+	virtual void Cancel() = 0;
+
+	// Shows the progress right away - the compare is going to take long
+	virtual void Show() const = 0;
+
+	// Return 0 / false if cancelled
+	virtual unsigned NextPhase() = 0;
+	virtual bool SetMaxCount(intptr_t max, unsigned phase = 0) = 0;
+	virtual bool Advance(intptr_t cnt = 1, unsigned phase = 0) = 0;
+};
+
+
+/**
+ *  \class  SilentProgress
+ *  \brief  Progress nobody watches - the compare can still be cancelled by another thread
+ */
+class SilentProgress : public CompareProgress
+{
+public:
+	bool IsCancelled() const override
+	{
+		return _cancelled.load(std::memory_order_relaxed);
+	}
+
+	const std::atomic<bool>* CancelFlag() const override
+	{
+		return &_cancelled;
+	}
+
+	void Cancel() override
+	{
+		_cancelled = true;
+	}
+
+	void Show() const override {}
+
+	unsigned NextPhase() override
+	{
+		return IsCancelled() ? 0 : 1;
+	}
+
+	bool SetMaxCount(intptr_t, unsigned = 0) override
+	{
+		return !IsCancelled();
+	}
+
+	bool Advance(intptr_t = 1, unsigned = 0) override
+	{
+		return !IsCancelled();
+	}
+
+private:
+	std::atomic<bool> _cancelled {false};
+};
+
+
+/**
+ *  \class  CompareViews
+ *  \brief  The documents compared by runCompare() and the views its results are marked in - the plugin implements it
+ *          for the Scintilla views, the command line tool for the compared files (they are not marked then).
+ *          Called by the thread running the compare only.
+ */
+class CompareViews
+{
+public:
+	virtual ~CompareViews() = default;
+
+	virtual const DocSource& doc(int view) const = 0;
+
+	// Identity of the document in the view - the incremental re-compare state is valid for the same documents only
+	virtual intptr_t docId(int view) const = 0;
+
+	// Clears the view marks from fromLine on - all of them if that's the first line
+	virtual void clearMarksFrom(int view, intptr_t fromLine) = 0;
+
+	// Sets the diff maps line markers and the changed text marks in both views. If fromLines are given only the marks
+	// from these lines on are set - the ones above are left in the views from the last compare. Returns false if
+	// cancelled.
+	virtual bool applyMarks(const DiffMap_t diffMaps[2], const ViewMarks viewMarks[2], const CompareOptions& options,
+			const intptr_t* fromLines) = 0;
+
+	// Runs compareFn (background compare) - it reads the snapshots of the documents so it can be run by a worker
+	// thread while the views are in use
+	virtual CompareResult runInBackground(const std::function<CompareResult()>& compareFn)
+	{
+		return compareFn();
+	}
+};
+
+
+/**
+ *  \class  FilesCompareViews
+ *  \brief  The compared files in place of the plugin views (the command line tool and the batch compare) - nothing is
+ *          marked, the results are the compare summary
+ */
+class FilesCompareViews : public CompareViews
+{
+public:
+	FilesCompareViews(const DocSource& doc1, const DocSource& doc2) : _docs { &doc1, &doc2 } {}
+
+	const DocSource& doc(int view) const override
+	{
+		return *_docs[view];
+	}
+
+	intptr_t docId(int view) const override
+	{
+		return reinterpret_cast<intptr_t>(_docs[view]);
+	}
+
+	void clearMarksFrom(int, intptr_t) override {}
+
+	bool applyMarks(const DiffMap_t[2], const ViewMarks[2], const CompareOptions&, const intptr_t*) override
+	{
+		return true;
+	}
+
+private:
+	const DocSource* const _docs[2];
+};
+
+
+/**
+ *  \brief  Compares the documents of the views (their selections if options.selectionCompare is set) and marks the
+ *          results in the views - runs the find unique lines compare if options.findUniqueMode is set.
+ *          The documents are re-compared incrementally if they were only edited as recorded in incremental since its
+ *          last compare. The line hashes caches (if given) spare the hashing of the lines not changed since then.
+ *          Only one compare can be run by a thread at a time - different threads can run different compares.
+ */
+CompareResult runCompare(const CompareOptions& options, CompareViews& views, CompareProgress& progress,
+		CompareSummary& summary, IncrementalCompare* incremental = nullptr,
+		LineHashCache* mainLineHashes = nullptr, LineHashCache* subLineHashes = nullptr);
+
+
+/**
+ *  \brief  Runs the compare of mainDoc and subDoc up to the marking and keeps the results in the compare results
+ *          cache - the next compare of the same contents with the same options has only to mark them.
+ *          Doesn't touch the views so it is meant to be run by a worker thread.
+ */
+CompareResult precomputeCompare(const CompareOptions& options, const DocSource& mainDoc, const DocSource& subDoc,
+		CompareProgress& progress, LineHashCache* mainLineHashes = nullptr, LineHashCache* subLineHashes = nullptr);
+
+
+/**
+ *  \brief  Fills the line hashes cache of the document - the compares of the document given that cache don't hash
+ *          its lines again (a reference document compared to many others for example).
+ */
+void hashDocLines(const CompareOptions& options, const DocSource& doc, LineHashCache& lineHashes);
+
+
+/**
+ *  \brief  Keeps the results of the last count compares (at least) in the compare results cache - the batch compare
+ *          reserves room for all its candidates so any of them can be opened without being compared again.
+ */
+void reserveCompareResults(size_t count);
+
+
+/**
+ *  \brief  The next compare stores its engine inputs to filePath as a compare workload (see Workload.h) that the
+ *          command line tool can replay. The changed blocks lines text is stored (scrambled) only if withText is true.
+ */
+void recordNextCompare(const std::wstring& filePath, bool withText);
+
+/**
+ *  \brief  Cancels the recording if it is still pending. Returns true if the last requested workload has been stored.
+ */
+bool endCompareRecording();
@@ -0,0 +1,62 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Debug logging of the compare engine (DLOG builds only) - the same filter bits as the plugin's ones. The log lines
+ * are written by the engine host - the plugin adds them to its debug log, the command line tool prints them.
+ */
+
+
+#pragma once
+
+
+#ifdef DLOG
+
+	#include <string>
+
+	#define LOG_ALGO	(1 << 0)
+
+	// Defined by the engine host
+	void engineLog(const std::string& str);
+	void engineLogTime();
+
+	#define LOGD_GET_TIME \
+		if (1) { \
+			engineLogTime(); \
+		}
+
+	#define LOGD(LOG_FILTER, STR) \
+		if (DLOG & LOG_FILTER) { \
+			engineLog(STR); \
+		}
+
+	#define PRINT_DIFFS(INFO, DIFFS) \
+		if (DLOG & LOG_ALGO) { \
+			LOGD(LOG_ALGO, INFO "\n"); \
+			for (const auto& d: DIFFS) { \
+				LOGD(LOG_ALGO, "\t" + std::string((d.type == diff_type::DIFF_IN_1) ? "D1" : \
+						(d.type == diff_type::DIFF_IN_2 ? "D2" : "M")) + \
+						" off: " + std::to_string(d.off + 1) + " len: " + std::to_string(d.len) + "\n"); \
+			} \
+		}
+
+#else
+
+	#define LOGD_GET_TIME
+	#define LOGD(LOG_FILTER, STR)
+	#define PRINT_DIFFS(INFO, DIFFS)
+
+#endif
@@ -0,0 +1,370 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <exception>
+
+#include "FolderCompare.h"
+
+#if defined(__MINGW32__) && !defined(_GLIBCXX_HAS_GTHREADS)
+#include "../mingw-std-threads/mingw.thread.h"
+#include "../mingw-std-threads/mingw.mutex.h"
+#else
+#include <thread>
+#include <mutex>
+#endif // __MINGW32__ ...
+
+#ifndef MULTITHREAD
+#define MULTITHREAD		1
+#endif
+
+
+namespace // anonymous namespace
+{
+
+// Files are compared through views of that size - multiple of the allocation granularity (64 KB) as the views offsets
+// must be. Keeps the address space use low enough for 32-bit builds whatever the files sizes are.
+constexpr uint64_t cViewSize = 16 * 1024 * 1024;
+
+
+struct FoundFile
+{
+	std::wstring	relPath;
+	uint64_t		size;
+};
+
+
+/**
+ *  \class  MappedFile
+ *  \brief  Read-only file mapped one view at a time
+ */
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
+	{
+		unmap();
+
+		if (_hMapping != NULL)
+			::CloseHandle(_hMapping);
+
+		if (_hFile != INVALID_HANDLE_VALUE)
+			::CloseHandle(_hFile);
+	}
+
+	// Returns false if the file cannot be read or its size is no longer the expected one
+	bool open(const std::wstring& filePath, uint64_t expectedSize)
+	{
+		_hFile = ::CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+				NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+		if (_hFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+
+		if (!::GetFileSizeEx(_hFile, &fileSize) || (static_cast<uint64_t>(fileSize.QuadPart) != expectedSize))
+			return false;
+
+		_hMapping = ::CreateFileMappingW(_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+		return (_hMapping != NULL);
+	}
+
+	const char* map(uint64_t offset, size_t len)
+	{
+		unmap();
+
+		_view = static_cast<const char*>(::MapViewOfFile(_hMapping, FILE_MAP_READ,
+				static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset & 0xFFFFFFFF), len));
+
+		return _view;
+	}
+
+	void unmap()
+	{
+		if (_view)
+			::UnmapViewOfFile(_view);
+
+		_view = nullptr;
+	}
+
+private:
+	HANDLE		_hFile {INVALID_HANDLE_VALUE};
+	HANDLE		_hMapping {NULL};
+	const char*	_view {nullptr};
+};
+
+
+inline bool isDotDir(const wchar_t* name)
+{
+	return (name[0] == L'.' && (name[1] == L'\0' || (name[1] == L'.' && name[2] == L'\0')));
+}
+
+
+inline bool pathLess(const std::wstring& lhs, const std::wstring& rhs)
+{
+	return (::CompareStringOrdinal(lhs.c_str(), static_cast<int>(lhs.size()),
+			rhs.c_str(), static_cast<int>(rhs.size()), TRUE) == CSTR_LESS_THAN);
+}
+
+
+// Lists the files under rootDir (ending with '\') recursively. Sub-folders that cannot be read are skipped, linked
+// folders (junctions and symbolic links) are not followed to avoid cycles. Returns false if rootDir cannot be read.
+bool findFiles(const std::wstring& rootDir, std::vector<FoundFile>& files, const std::atomic<bool>* cancelled)
+{
+	std::vector<std::wstring> dirsToList { std::wstring() };
+
+	for (size_t i = 0; i < dirsToList.size(); ++i)
+	{
+		if (cancelled && *cancelled)
+			return false;
+
+		const std::wstring relDir = dirsToList[i];
+
+		WIN32_FIND_DATAW findData;
+
+		HANDLE hFind = ::FindFirstFileExW((rootDir + relDir + L"*").c_str(), FindExInfoBasic, &findData,
+				FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+
+		if (hFind == INVALID_HANDLE_VALUE)
+		{
+			if (i == 0)
+				return false;
+
+			continue;
+		}
+
+		do
+		{
+			if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			{
+				if (!isDotDir(findData.cFileName) && !(findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+					dirsToList.emplace_back(relDir + findData.cFileName + L"\\");
+			}
+			else
+			{
+				files.push_back({ relDir + findData.cFileName,
+						(static_cast<uint64_t>(findData.nFileSizeHigh) << 32) | findData.nFileSizeLow });
+			}
+		}
+		while (::FindNextFileW(hFind, &findData));
+
+		::FindClose(hFind);
+	}
+
+	std::sort(files.begin(), files.end(),
+			[](const FoundFile& lhs, const FoundFile& rhs) { return pathLess(lhs.relPath, rhs.relPath); });
+
+	return true;
+}
+
+
+FolderCmpStatus compareContents(const std::wstring& file1, const std::wstring& file2, uint64_t size,
+		const std::atomic<bool>* cancelled)
+{
+	if (size == 0)
+		return FolderCmpStatus::SAME;
+
+	MappedFile mapped1;
+	MappedFile mapped2;
+
+	if (!mapped1.open(file1, size) || !mapped2.open(file2, size))
+		return FolderCmpStatus::READ_ERROR;
+
+	for (uint64_t offset = 0; offset < size; offset += cViewSize)
+	{
+		if (cancelled && *cancelled)
+			return FolderCmpStatus::SAME;
+
+		const size_t len = static_cast<size_t>(std::min(cViewSize, size - offset));
+
+		const char* view1 = mapped1.map(offset, len);
+		const char* view2 = mapped2.map(offset, len);
+
+		if (!view1 || !view2)
+			return FolderCmpStatus::READ_ERROR;
+
+		if (std::memcmp(view1, view2, len))
+			return FolderCmpStatus::DIFFERENT;
+	}
+
+	return FolderCmpStatus::SAME;
+}
+
+
+inline std::wstring dirPath(const wchar_t* dir)
+{
+	std::wstring path(dir);
+
+	if (!path.empty() && path.back() != L'\\' && path.back() != L'/')
+		path += L'\\';
+
+	return path;
+}
+
+} // anonymous namespace
+
+
+bool compareFolders(const wchar_t* dir1, const wchar_t* dir2, std::vector<FolderCmpEntry>& entries,
+		const std::atomic<bool>* cancelled, const FolderCmpProgressFn& progress, int threadsCount)
+{
+	entries.clear();
+
+	const std::wstring root1 = dirPath(dir1);
+	const std::wstring root2 = dirPath(dir2);
+
+	std::vector<FoundFile> files1;
+	std::vector<FoundFile> files2;
+
+	bool found1 = false;
+	bool found2 = false;
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	if (threadsCount <= 0)
+		threadsCount = static_cast<int>(std::thread::hardware_concurrency());
+
+	if (threadsCount > 1)
+	{
+		std::thread lister([&]() { found2 = findFiles(root2, files2, cancelled); });
+
+		found1 = findFiles(root1, files1, cancelled);
+
+		lister.join();
+	}
+	else
+#endif // MULTITHREAD
+	{
+		found1 = findFiles(root1, files1, cancelled);
+		found2 = found1 && findFiles(root2, files2, cancelled);
+	}
+
+	if (!found1 || !found2)
+		return false;
+
+	entries.reserve(std::max(files1.size(), files2.size()));
+
+	// Entries of the files present in both folders with the same size - their contents are to be compared
+	std::vector<size_t> toCompare;
+
+	for (size_t i1 = 0, i2 = 0; i1 < files1.size() || i2 < files2.size();)
+	{
+		FolderCmpEntry entry;
+
+		if (i2 == files2.size() || (i1 < files1.size() && pathLess(files1[i1].relPath, files2[i2].relPath)))
+		{
+			entry.relPath	= std::move(files1[i1].relPath);
+			entry.size1		= files1[i1++].size;
+			entry.status	= FolderCmpStatus::ONLY_IN_1;
+		}
+		else if (i1 == files1.size() || pathLess(files2[i2].relPath, files1[i1].relPath))
+		{
+			entry.relPath	= std::move(files2[i2].relPath);
+			entry.size2		= files2[i2++].size;
+			entry.status	= FolderCmpStatus::ONLY_IN_2;
+		}
+		else
+		{
+			entry.relPath	= std::move(files1[i1].relPath);
+			entry.size1		= files1[i1++].size;
+			entry.size2		= files2[i2++].size;
+
+			if (entry.size1 != entry.size2)
+			{
+				entry.status = FolderCmpStatus::DIFFERENT;
+			}
+			else
+			{
+				entry.status = FolderCmpStatus::SAME;
+				toCompare.push_back(entries.size());
+			}
+		}
+
+		entries.emplace_back(std::move(entry));
+	}
+
+	const intptr_t total = static_cast<intptr_t>(toCompare.size());
+
+	std::atomic<intptr_t> nextJob(0);
+	std::atomic<intptr_t> doneJobs(0);
+
+	std::exception_ptr error = nullptr;
+	std::mutex errorMutex;
+
+	auto workFn =
+		[&]()
+		{
+			try
+			{
+				for (intptr_t job = nextJob++; job < total && !(cancelled && *cancelled); job = nextJob++)
+				{
+					FolderCmpEntry& entry = entries[toCompare[job]];
+
+					entry.status = compareContents(root1 + entry.relPath, root2 + entry.relPath, entry.size1,
+							cancelled);
+
+					const intptr_t done = ++doneJobs;
+
+					if (progress)
+						progress(done, total);
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+
+				if (!error)
+					error = std::current_exception();
+
+				nextJob = total;
+			}
+		};
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	std::vector<std::thread> threads;
+
+	for (intptr_t i = 1; i < std::min(static_cast<intptr_t>(threadsCount), total); ++i)
+	{
+		try
+		{
+			threads.emplace_back(workFn);
+		}
+		catch (...)
+		{
+			// Remaining files will be compared by the threads already started
+			break;
+		}
+	}
+#endif // MULTITHREAD
+
+	workFn();
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	for (auto& th : threads)
+		th.join();
+#endif // MULTITHREAD
+
+	if (error)
+		std::rethrow_exception(error);
+
+	return !(cancelled && *cancelled);
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Folders compare - finds the files of two directory trees and tells which of them differ by content.
+ * Nothing here depends on Notepad++ or Scintilla - files are read through memory mappings by worker threads and only
+ * the ones that differ are meant to be opened and compared in the editor.
+ */
+
+
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <functional>
+#include <atomic>
+
+
+enum class FolderCmpStatus
+{
+	SAME = 0,
+	DIFFERENT,
+	ONLY_IN_1,
+	ONLY_IN_2,
+	READ_ERROR
+};
+
+
+struct FolderCmpEntry
+{
+	// Path relative to the compared folders
+	std::wstring	relPath;
+
+	FolderCmpStatus	status {FolderCmpStatus::SAME};
+
+	uint64_t		size1 {0};
+	uint64_t		size2 {0};
+};
+
+
+// Called by the worker threads with the files compared so far and the files to compare in total
+using FolderCmpProgressFn = std::function<void(intptr_t done, intptr_t total)>;
+
+
+/**
+ *  \brief  Compares the file trees of dir1 and dir2 - entries are sorted by relative path.
+ *          threadsCount 0 means as many threads as the CPU cores. Returns false if cancelled or if any of the
+ *          folders cannot be read.
+ */
+bool compareFolders(const wchar_t* dir1, const wchar_t* dir2, std::vector<FolderCmpEntry>& entries,
+		const std::atomic<bool>* cancelled = nullptr, const FolderCmpProgressFn& progress = nullptr,
+		int threadsCount = 0);
@@ -0,0 +1,545 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Line text hashing shared by the plugin compare engine and the command line tool.
+ * The text is hashed as the compare options tell - spaces, case and the Ignore Regex matches are left out.
+ */
+
+
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <regex>
+
+#include "CompareOptions.h"
+
+
+constexpr uint64_t cHashSeed = 0x84222325;
+
+
+/**
+ *  \class  LineHasher
+ *  \brief  Streaming 64-bit line hash (xxHash64 mixing and avalanche) consuming the text 8 bytes at a time.
+ *          The result depends only on the bytes added and not on how they are split between Add() calls.
+ *          Nothing added gives back the seed (that is how empty lines are recognized).
+ */
+class LineHasher
+{
+public:
+	LineHasher(uint64_t seed = cHashSeed) : _seed(seed), _hash(seed + cPrime5) {}
+
+	inline void Add(const char* text, intptr_t len)
+	{
+		for (; len > 0 && _wordLen; --len)
+			addByte(static_cast<uint8_t>(*text++));
+
+		for (; len >= 8; len -= 8, text += 8)
+		{
+			uint64_t word;
+
+			memcpy(&word, text, sizeof(word));
+			addWord(word);
+			_len += 8;
+		}
+
+		for (; len > 0; --len)
+			addByte(static_cast<uint8_t>(*text++));
+	}
+
+	template <typename CharT>
+	inline void Add(CharT ch)
+	{
+		Add(reinterpret_cast<const char*>(&ch), sizeof(ch));
+	}
+
+	inline uint64_t Get() const
+	{
+		if (_len == 0)
+			return _seed;
+
+		uint64_t hash = _hash;
+
+		if (_wordLen)
+		{
+			hash ^= round(_word);
+			hash = rotl(hash, 27) * cPrime1 + cPrime4;
+		}
+
+		hash ^= static_cast<uint64_t>(_len);
+
+		hash ^= hash >> 33;
+		hash *= cPrime2;
+		hash ^= hash >> 29;
+		hash *= cPrime3;
+		hash ^= hash >> 32;
+
+		return hash;
+	}
+
+private:
+	static constexpr uint64_t cPrime1 = 0x9E3779B185EBCA87ULL;
+	static constexpr uint64_t cPrime2 = 0xC2B2AE3D27D4EB4FULL;
+	static constexpr uint64_t cPrime3 = 0x165667B19E3779F9ULL;
+	static constexpr uint64_t cPrime4 = 0x85EBCA77C2B2AE63ULL;
+	static constexpr uint64_t cPrime5 = 0x27D4EB2F165667C5ULL;
+
+	static inline uint64_t rotl(uint64_t val, int bits)
+	{
+		return (val << bits) | (val >> (64 - bits));
+	}
+
+	static inline uint64_t round(uint64_t word)
+	{
+		return rotl(word * cPrime2, 31) * cPrime1;
+	}
+
+	inline void addWord(uint64_t word)
+	{
+		_hash ^= round(word);
+		_hash = rotl(_hash, 27) * cPrime1 + cPrime4;
+	}
+
+	inline void addByte(uint8_t byte)
+	{
+		_word |= static_cast<uint64_t>(byte) << (_wordLen * 8);
+		++_len;
+
+		if (++_wordLen == 8)
+		{
+			addWord(_word);
+			_word		= 0;
+			_wordLen	= 0;
+		}
+	}
+
+	const uint64_t	_seed;
+	uint64_t		_hash;
+	uint64_t		_word {0};
+	int				_wordLen {0};
+	intptr_t		_len {0};
+};
+
+
+
+constexpr uint64_t cHighBits	= 0x8080808080808080ULL;
+constexpr uint64_t cLowBits		= 0x0101010101010101ULL;
+
+
+// Checks 8 bytes at a time if the text has only ASCII chars
+inline bool isAsciiText(const char* text, intptr_t len)
+{
+	uint64_t acc = 0;
+
+	for (; len >= 8; len -= 8, text += 8)
+	{
+		uint64_t word;
+
+		memcpy(&word, text, sizeof(word));
+		acc |= word;
+	}
+
+	for (; len > 0; --len)
+		acc |= static_cast<uint8_t>(*text++);
+
+	return !(acc & cHighBits);
+}
+
+
+inline bool isAsciiText(const wchar_t* text, intptr_t len)
+{
+	wchar_t acc = 0;
+
+	for (intptr_t i = 0; i < len; ++i)
+		acc |= text[i];
+
+	return (acc < 0x80);
+}
+
+
+// Lower-cases the ASCII text 8 bytes at a time - bytes in 'A'-'Z' get 0x20 added
+inline void asciiToLower(const char* src, char* dst, intptr_t len)
+{
+	for (; len >= 8; len -= 8, src += 8, dst += 8)
+	{
+		uint64_t word;
+
+		memcpy(&word, src, sizeof(word));
+
+		const uint64_t aboveA = word + cLowBits * (0x80 - 'A');
+		const uint64_t aboveZ = word + cLowBits * (0x80 - 'Z' - 1);
+
+		word |= ((aboveA ^ aboveZ) & cHighBits) >> 2;
+
+		memcpy(dst, &word, sizeof(word));
+	}
+
+	for (; len > 0; --len)
+	{
+		const char ch = *src++;
+		*dst++ = (ch >= 'A' && ch <= 'Z') ? (ch | 0x20) : ch;
+	}
+}
+
+
+// Lower-cases the wide text range [pos, endPos) in place - directly if ASCII, using the system locale otherwise
+inline void lowerCaseRange(std::vector<wchar_t>& text, intptr_t pos, intptr_t endPos)
+{
+	if (isAsciiText(text.data() + pos, endPos - pos))
+	{
+		for (; pos < endPos; ++pos)
+			if (text[pos] >= L'A' && text[pos] <= L'Z')
+				text[pos] |= 0x20;
+
+		return;
+	}
+
+	const wchar_t storedChar = text[endPos];
+
+	text[endPos] = L'\0';
+
+	::CharLowerW((LPWSTR)text.data() + pos);
+
+	text[endPos] = storedChar;
+}
+
+
+// Sink adapter lower-casing the ASCII text passed to the wrapped sink on the fly (no line copy needed)
+template <typename SinkT>
+struct AsciiLowerCaseSink
+{
+	explicit AsciiLowerCaseSink(SinkT& s) : sink(s) {}
+
+	inline void Add(const char* text, intptr_t len)
+	{
+		char folded[64];
+
+		while (len > 0)
+		{
+			const intptr_t foldLen = std::min(len, static_cast<intptr_t>(sizeof(folded)));
+
+			asciiToLower(text, folded, foldLen);
+			sink.Add(folded, foldLen);
+
+			text	+= foldLen;
+			len		-= foldLen;
+		}
+	}
+
+	template <typename CharT>
+	inline void Add(CharT ch)
+	{
+		sink.Add(ch);
+	}
+
+	SinkT& sink;
+};
+
+
+// Adds the text to the sink (LineHasher or LineBytes) in runs of non-space chars applying the spaces ignoring
+// options on the fly. If trimSpaces is set (and changed spaces are ignored) leading and trailing spaces are skipped.
+template <typename SinkT, typename CharT>
+inline void addText(SinkT& sink, const CharT* text, intptr_t len, const CompareOptions& options, bool trimSpaces)
+{
+	auto isSpace = [](CharT ch) { return (ch == static_cast<CharT>(' ') || ch == static_cast<CharT>('\t')); };
+
+	intptr_t pos = 0;
+	intptr_t endPos = len;
+
+	if (!options.ignoreAllSpaces && !options.ignoreChangedSpaces)
+	{
+		sink.Add(reinterpret_cast<const char*>(text), len * static_cast<intptr_t>(sizeof(CharT)));
+		return;
+	}
+
+	if (trimSpaces && options.ignoreChangedSpaces)
+	{
+		while (pos < endPos && isSpace(text[pos]))
+			++pos;
+
+		while (endPos > pos && isSpace(text[endPos - 1]))
+			--endPos;
+	}
+
+	while (pos < endPos)
+	{
+		intptr_t runEnd = pos;
+
+		while (runEnd < endPos && !isSpace(text[runEnd]))
+			++runEnd;
+
+		if (runEnd > pos)
+			sink.Add(reinterpret_cast<const char*>(text + pos), (runEnd - pos) * static_cast<intptr_t>(sizeof(CharT)));
+
+		if (runEnd == endPos)
+			break;
+
+		for (pos = runEnd + 1; pos < endPos && isSpace(text[pos]); ++pos);
+
+		// Changed spaces count as a single space
+		if (!options.ignoreAllSpaces)
+			sink.Add(static_cast<CharT>(' '));
+	}
+}
+
+
+template <typename SinkT>
+inline void addSectionRangeText(SinkT& sink, std::vector<wchar_t>& sec, intptr_t pos, intptr_t endPos,
+		const CompareOptions& options)
+{
+	if (pos >= endPos)
+		return;
+
+	if (options.ignoreCase)
+		lowerCaseRange(sec, pos, endPos);
+
+	addText(sink, sec.data() + pos, endPos - pos, options, false);
+}
+
+
+// Calls onMatch(matchPos, matchLen) for each ignore regex match in wLine in order. Uses the linear time matcher if
+// the regex is supported by it and skips the lines that lack the literal every match requires.
+template <typename MatchFuncT>
+void forEachIgnoreRegexMatch(std::vector<wchar_t>& wLine, const CompareOptions& options, MatchFuncT&& onMatch)
+{
+	const intptr_t wLen = static_cast<intptr_t>(wLine.size());
+
+	const LinearRegex* linearRegex = options.ignoreLinearRegex.get();
+
+	if (linearRegex)
+	{
+		if (!linearRegex->mayMatch(wLine.data(), wLen))
+			return;
+
+		if (linearRegex->isCompiled())
+		{
+			intptr_t matchPos;
+			intptr_t matchLen;
+
+			for (intptr_t pos = 0; linearRegex->search(wLine.data(), wLen, pos, matchPos, matchLen);
+					pos = matchPos + matchLen)
+				onMatch(matchPos, matchLen);
+
+			return;
+		}
+	}
+
+	std::regex_iterator<std::vector<wchar_t>::iterator> rit(wLine.begin(), wLine.end(), *options.ignoreRegex);
+	std::regex_iterator<std::vector<wchar_t>::iterator> rend;
+
+	for (; rit != rend; ++rit)
+		onMatch(static_cast<intptr_t>(rit->position()), static_cast<intptr_t>(rit->length()));
+}
+
+
+// Adds the line text (without EOL) to the sink leaving out the parts matched by the Ignore Regex. The line is
+// converted to UTF-16 zero terminated as the regex is matched over that and the hashed text is UTF-16 as well.
+template <typename SinkT>
+void addRegexIgnoreLineText(SinkT& sink, const char* text, intptr_t len, int codepage, const CompareOptions& options)
+{
+	// Reused for all lines hashed by the thread
+	thread_local std::vector<wchar_t> wLine;
+
+	// ASCII text is the same in all code pages - widen it directly
+	if (isAsciiText(text, len))
+	{
+		wLine.assign(text, text + len);
+	}
+	else
+	{
+		const int wLen = ::MultiByteToWideChar(codepage, 0, text, static_cast<int>(len), NULL, 0);
+
+		wLine.resize(wLen);
+
+		::MultiByteToWideChar(codepage, 0, text, static_cast<int>(len), wLine.data(), wLen);
+	}
+
+	wLine.push_back(L'\0');
+
+	const intptr_t wLen = static_cast<intptr_t>(wLine.size());
+
+	intptr_t pos = 0;
+	intptr_t endPos = wLen - 1;
+
+	if (options.ignoreChangedSpaces && (wLine[pos] == L' ' || wLine[pos] == L'\t'))
+	{
+		while (++pos < endPos && (wLine[pos] == L' ' || wLine[pos] == L'\t'));
+
+		if (pos == endPos)
+			return;
+	}
+
+	forEachIgnoreRegexMatch(wLine, options,
+		[&](intptr_t matchPos, intptr_t matchLen)
+		{
+			addSectionRangeText(sink, wLine, pos, matchPos, options);
+
+			pos = matchPos + matchLen;
+		});
+
+	--endPos;
+
+	if (options.ignoreChangedSpaces && (wLine[endPos] == L' ' || wLine[endPos] == L'\t'))
+	{
+		while (--endPos >= pos && (wLine[endPos] == L' ' || wLine[endPos] == L'\t'));
+
+		if (endPos < pos)
+			return;
+	}
+
+	addSectionRangeText(sink, wLine, pos, endPos + 1, options);
+}
+
+
+inline void toLowerCase(std::vector<char>& text, int codepage = CP_UTF8)
+{
+	const int len = static_cast<int>(text.size());
+
+	if (len == 0)
+		return;
+
+	const int wLen = ::MultiByteToWideChar(codepage, 0, text.data(), len, NULL, 0);
+
+	std::vector<wchar_t> wText(wLen);
+
+	::MultiByteToWideChar(codepage, 0, text.data(), len, wText.data(), wLen);
+
+	wText.push_back(L'\0');
+	::CharLowerW((LPWSTR)wText.data());
+	wText.pop_back();
+
+	::WideCharToMultiByte(codepage, 0, wText.data(), wLen, text.data(), len, NULL, NULL);
+}
+
+
+// Adds the line text (without EOL) to the sink (LineHasher or LineBytes) applying all the compare options
+template <typename SinkT>
+inline void addLineText(SinkT& sink, const char* text, intptr_t len, int codepage, const CompareOptions& options)
+{
+	if (len <= 0)
+		return;
+
+	if (options.ignoreRegex)
+	{
+		addRegexIgnoreLineText(sink, text, len, codepage, options);
+	}
+	else if (!options.ignoreCase)
+	{
+		addText(sink, text, len, options, true);
+	}
+	else if (isAsciiText(text, len))
+	{
+		AsciiLowerCaseSink<SinkT> lowerCaseSink(sink);
+		addText(lowerCaseSink, text, len, options, true);
+	}
+	else
+	{
+		std::vector<char> line(text, text + len);
+
+		toLowerCase(line, codepage);
+		addText(sink, line.data(), len, options, true);
+	}
+}
+
+
+// Combinations of the ignore case and spaces options the line hash variants are computed for
+constexpr int cHashVariantsCount = 6;
+
+
+// Index of the hash variant the options use (the Ignore Regex has no variants)
+inline int hashVariant(const CompareOptions& options)
+{
+	const int spacesVariant = options.ignoreAllSpaces ? 2 : (options.ignoreChangedSpaces ? 1 : 0);
+
+	return (options.ignoreCase ? 3 : 0) + spacesVariant;
+}
+
+
+struct LineHashVariants
+{
+	uint64_t hash[cHashVariantsCount];
+};
+
+
+// Hashes the line text (without EOL) as addLineText() does for each of the ignore case and spaces options
+// combinations. The text is scanned once per case variant - all spaces variants are hashed in the same scan.
+inline void hashLineVariants(const char* text, intptr_t len, int codepage, LineHashVariants& variants)
+{
+	// Reused for all lines hashed by the thread
+	thread_local std::vector<char> folded;
+
+	const char* caseTexts[2] = { text, text };
+
+	if (len > 0)
+	{
+		if (isAsciiText(text, len))
+		{
+			folded.resize(len);
+			asciiToLower(text, folded.data(), len);
+		}
+		else
+		{
+			folded.assign(text, text + len);
+			toLowerCase(folded, codepage);
+		}
+
+		caseTexts[1] = folded.data();
+	}
+
+	for (int caseVariant = 0; caseVariant < 2; ++caseVariant)
+	{
+		const char* caseText = caseTexts[caseVariant];
+
+		LineHasher rawHasher;
+		LineHasher changedSpacesHasher;
+		LineHasher allSpacesHasher;
+
+		if (len > 0)
+			rawHasher.Add(caseText, len);
+
+		// Leading and trailing spaces are left out and the spaces between the words count as a single space
+		bool spaceBefore = false;
+
+		for (intptr_t pos = 0; pos < len;)
+		{
+			intptr_t runEnd = pos;
+
+			while (runEnd < len && caseText[runEnd] != ' ' && caseText[runEnd] != '\t')
+				++runEnd;
+
+			if (runEnd > pos)
+			{
+				if (spaceBefore)
+					changedSpacesHasher.Add(' ');
+
+				changedSpacesHasher.Add(caseText + pos, runEnd - pos);
+				allSpacesHasher.Add(caseText + pos, runEnd - pos);
+			}
+
+			for (pos = runEnd; pos < len && (caseText[pos] == ' ' || caseText[pos] == '\t'); ++pos);
+
+			spaceBefore = (pos > runEnd) && (runEnd > 0);
+		}
+
+		variants.hash[caseVariant * 3]		= rawHasher.Get();
+		variants.hash[caseVariant * 3 + 1]	= changedSpacesHasher.Get();
+		variants.hash[caseVariant * 3 + 2]	= allSpacesHasher.Get();
+	}
+}
@@ -0,0 +1,271 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <cwchar>
+#include <algorithm>
+
+#include "LineHashIndex.h"
+#include "LineHash.h"
+
+
+namespace // anonymous namespace
+{
+
+constexpr uint32_t cIndexMagic		= 0x484C5043; // "CPLH"
+
+// Must be changed whenever the line hashing changes - indexes of other versions are ignored
+constexpr uint32_t cIndexVersion	= 1;
+
+
+// Index file layout: the header, the indexed file path (pathLen wide chars padded to 8 bytes), linesCount line hashes
+// and startsCount line starts
+struct IndexHeader
+{
+	uint32_t	magic;
+	uint32_t	version;
+	uint64_t	fileSize;
+	uint64_t	fileTime;
+	uint64_t	optionsHash;
+	int64_t		length;
+	int64_t		linesCount;
+	int64_t		startsCount;
+	int32_t		codepage;
+	uint32_t	pathLen;
+};
+
+
+inline size_t pathBytes(size_t pathLen)
+{
+	return ((pathLen * sizeof(wchar_t) + 7) / 8) * 8;
+}
+
+
+bool getFileState(const wchar_t* filePath, uint64_t& fileSize, uint64_t& fileTime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA fileData;
+
+	if (!::GetFileAttributesExW(filePath, GetFileExInfoStandard, &fileData) ||
+			(fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+		return false;
+
+	fileSize = (static_cast<uint64_t>(fileData.nFileSizeHigh) << 32) | fileData.nFileSizeLow;
+	fileTime = (static_cast<uint64_t>(fileData.ftLastWriteTime.dwHighDateTime) << 32) |
+			fileData.ftLastWriteTime.dwLowDateTime;
+
+	return true;
+}
+
+
+// The options the line hashes depend on (see LineHashCache)
+uint64_t optionsHash(const CompareOptions& options)
+{
+	const bool flags[] = { options.ignoreChangedSpaces, options.ignoreAllSpaces, options.ignoreCase };
+
+	LineHasher hasher;
+
+	hasher.Add(reinterpret_cast<const char*>(flags), sizeof(flags));
+	hasher.Add(reinterpret_cast<const char*>(options.ignoreRegexStr.data()),
+			static_cast<intptr_t>(options.ignoreRegexStr.size() * sizeof(wchar_t)));
+
+	return hasher.Get();
+}
+
+
+// The index file is named by the hash of the indexed file path (paths are case-insensitive)
+std::wstring indexFilePath(const wchar_t* indexDir, const wchar_t* filePath)
+{
+	std::wstring path(filePath);
+
+	if (!path.empty())
+		::CharUpperBuffW(&path[0], static_cast<DWORD>(path.size()));
+
+	LineHasher hasher;
+
+	hasher.Add(reinterpret_cast<const char*>(path.data()), static_cast<intptr_t>(path.size() * sizeof(wchar_t)));
+
+	wchar_t name[32];
+
+	_snwprintf_s(name, _countof(name), _TRUNCATE, L"%016llx.lhi", static_cast<unsigned long long>(hasher.Get()));
+
+	std::wstring indexPath(indexDir);
+
+	if (!indexPath.empty() && indexPath.back() != L'\\' && indexPath.back() != L'/')
+		indexPath += L'\\';
+
+	return indexPath + name;
+}
+
+
+bool writeAll(HANDLE hFile, const void* data, size_t len)
+{
+	const char* bytes = static_cast<const char*>(data);
+
+	while (len)
+	{
+		const DWORD toWrite = static_cast<DWORD>(std::min<size_t>(len, 64 * 1024 * 1024));
+		DWORD written = 0;
+
+		if (!::WriteFile(hFile, bytes, toWrite, &written, NULL) || written != toWrite)
+			return false;
+
+		bytes	+= written;
+		len		-= written;
+	}
+
+	return true;
+}
+
+} // anonymous namespace
+
+
+bool loadLineHashIndex(const wchar_t* indexDir, const wchar_t* filePath, const CompareOptions& options,
+		int codepage, LineHashIndexData& data)
+{
+	uint64_t fileSize;
+	uint64_t fileTime;
+
+	if (!getFileState(filePath, fileSize, fileTime))
+		return false;
+
+	const std::wstring indexPath = indexFilePath(indexDir, filePath);
+
+	HANDLE hFile = ::CreateFileW(indexPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	bool loaded = false;
+
+	LARGE_INTEGER indexSize;
+
+	if (::GetFileSizeEx(hFile, &indexSize) &&
+			static_cast<uint64_t>(indexSize.QuadPart) >= sizeof(IndexHeader) &&
+			static_cast<uint64_t>(indexSize.QuadPart) <= SIZE_MAX)
+	{
+		HANDLE hMapping = ::CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+		const char* view = (hMapping != NULL) ?
+				static_cast<const char*>(::MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+
+		if (view)
+		{
+			const size_t viewSize = static_cast<size_t>(indexSize.QuadPart);
+
+			IndexHeader header;
+			std::memcpy(&header, view, sizeof(header));
+
+			const size_t pathLen = static_cast<size_t>(header.pathLen);
+
+			const bool valid = (header.magic == cIndexMagic) && (header.version == cIndexVersion) &&
+					(header.fileSize == fileSize) && (header.fileTime == fileTime) &&
+					(header.optionsHash == optionsHash(options)) && (header.codepage == codepage) &&
+					(header.linesCount >= 0) && (header.startsCount >= 0) && (pathLen == std::wcslen(filePath)) &&
+					(static_cast<uint64_t>(sizeof(header) + pathBytes(pathLen)) +
+						(static_cast<uint64_t>(header.linesCount) + static_cast<uint64_t>(header.startsCount)) *
+							sizeof(uint64_t) == viewSize);
+
+			const char* pos = view + sizeof(header);
+
+			// Two files can have the same path hash
+			if (valid && ::CompareStringOrdinal(reinterpret_cast<const wchar_t*>(pos), static_cast<int>(pathLen),
+					filePath, static_cast<int>(pathLen), TRUE) == CSTR_EQUAL)
+			{
+				pos += pathBytes(pathLen);
+
+				data.codepage	= codepage;
+				data.length		= static_cast<intptr_t>(header.length);
+
+				data.hashes.resize(static_cast<size_t>(header.linesCount));
+				std::memcpy(data.hashes.data(), pos, data.hashes.size() * sizeof(uint64_t));
+
+				pos += data.hashes.size() * sizeof(uint64_t);
+
+				data.lineStarts.resize(static_cast<size_t>(header.startsCount));
+
+				for (auto& lineStart : data.lineStarts)
+				{
+					int64_t start;
+
+					std::memcpy(&start, pos, sizeof(start));
+					pos += sizeof(start);
+
+					lineStart = static_cast<intptr_t>(start);
+				}
+
+				loaded = true;
+			}
+
+			::UnmapViewOfFile(view);
+		}
+
+		if (hMapping != NULL)
+			::CloseHandle(hMapping);
+	}
+
+	::CloseHandle(hFile);
+
+	return loaded;
+}
+
+
+bool saveLineHashIndex(const wchar_t* indexDir, const wchar_t* filePath, const CompareOptions& options,
+		int codepage, intptr_t length, const std::vector<uint64_t>& hashes, const std::vector<intptr_t>& lineStarts)
+{
+	IndexHeader header = {};
+
+	if (!getFileState(filePath, header.fileSize, header.fileTime))
+		return false;
+
+	header.magic		= cIndexMagic;
+	header.version		= cIndexVersion;
+	header.optionsHash	= optionsHash(options);
+	header.length		= static_cast<int64_t>(length);
+	header.linesCount	= static_cast<int64_t>(hashes.size());
+	header.startsCount	= static_cast<int64_t>(lineStarts.size());
+	header.codepage		= codepage;
+	header.pathLen		= static_cast<uint32_t>(std::wcslen(filePath));
+
+	const std::wstring indexPath	= indexFilePath(indexDir, filePath);
+	const std::wstring tmpPath		= indexPath + L".tmp";
+
+	HANDLE hFile = ::CreateFileW(tmpPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	std::vector<char> path(pathBytes(header.pathLen), 0);
+	std::memcpy(path.data(), filePath, header.pathLen * sizeof(wchar_t));
+
+	const std::vector<int64_t> starts(lineStarts.begin(), lineStarts.end());
+
+	bool written = writeAll(hFile, &header, sizeof(header)) && writeAll(hFile, path.data(), path.size()) &&
+			writeAll(hFile, hashes.data(), hashes.size() * sizeof(uint64_t)) &&
+			writeAll(hFile, starts.data(), starts.size() * sizeof(int64_t));
+
+	::CloseHandle(hFile);
+
+	if (written)
+		written = (::MoveFileExW(tmpPath.c_str(), indexPath.c_str(), MOVEFILE_REPLACE_EXISTING) != 0);
+
+	if (!written)
+		::DeleteFileW(tmpPath.c_str());
+
+	return written;
+}
@@ -0,0 +1,66 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Persistent line hashes of big files - kept in an index file per compared file so the first compare after a restart
+ * doesn't have to hash the whole file again. The index is valid as long as the file size and last write time and the
+ * options the line hashes depend on are the same. Nothing here depends on Notepad++ or Scintilla.
+ */
+
+
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+
+#include "CompareOptions.h"
+
+
+// Every that many lines the line start is kept in the index - lets the user check the document lines are the same
+constexpr intptr_t cLineHashIndexStartsStep = 1024;
+
+
+struct LineHashIndexData
+{
+	int			codepage {0};
+
+	// Length of the document text the hashes are for
+	intptr_t	length {0};
+
+	// Hash of each document line
+	std::vector<uint64_t>	hashes;
+
+	// Start position of each cLineHashIndexStartsStep-th line
+	std::vector<intptr_t>	lineStarts;
+};
+
+
+/**
+ *  \brief  Loads the line hashes of filePath from its index in indexDir. Returns false if there is no index or it
+ *          is not valid for the file on disk, the options and the codepage anymore.
+ */
+bool loadLineHashIndex(const wchar_t* indexDir, const wchar_t* filePath, const CompareOptions& options,
+		int codepage, LineHashIndexData& data);
+
+/**
+ *  \brief  Writes the index of filePath line hashes to indexDir (the directory must exist). lineStarts are the starts
+ *          of each cLineHashIndexStartsStep-th line. The index replaces the old one at once so a partially written
+ *          index is never read.
+ */
+bool saveLineHashIndex(const wchar_t* indexDir, const wchar_t* filePath, const CompareOptions& options,
+		int codepage, intptr_t length, const std::vector<uint64_t>& hashes, const std::vector<intptr_t>& lineStarts);
@@ -0,0 +1,1133 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cwchar>
+#include <utility>
+
+#include "LinearRegex.h"
+
+
+struct LinearRegex::Node
+{
+	enum class Type
+	{
+		EMPTY,
+		CHAR,
+		ANY,
+		CLASS,
+		BOL,
+		EOL,
+		WORD_BOUNDARY,
+		NOT_WORD_BOUNDARY,
+		CONCAT,
+		ALT,
+		REPEAT,
+		UNSUPPORTED		// Back-reference or lookaround
+	};
+
+	Type	type;
+	wchar_t	ch {0};
+	int		classIdx {0};
+	int		min {0};
+	int		max {0};	// -1 if unbounded
+	bool	greedy {true};
+
+	std::vector<int>	children;
+};
+
+
+/**
+ *  \class  LinearRegex::Parser
+ *  \brief  Recursive descent parser of the ECMAScript pattern to a nodes tree
+ */
+class LinearRegex::Parser
+{
+public:
+	Parser(const std::wstring& pattern, const std::regex_traits<wchar_t>& traits, std::vector<Node>& nodes,
+			std::vector<CharClass>& classes) :
+		_pattern(pattern), _traits(traits), _nodes(nodes), _classes(classes) {}
+
+	// Returns the root node index or -1 if the pattern cannot be parsed
+	int parse()
+	{
+		const int root = parseDisjunction();
+
+		if (_failed || (_pos != _pattern.size()))
+			return -1;
+
+		return root;
+	}
+
+	// Can the node match empty text? Assertions and unsupported nodes are considered as such.
+	static bool isNullable(const std::vector<Node>& nodes, int n)
+	{
+		const Node& node = nodes[n];
+
+		switch (node.type)
+		{
+			case Type::CHAR:
+			case Type::ANY:
+			case Type::CLASS:
+			return false;
+
+			case Type::CONCAT:
+				for (int child : node.children)
+					if (!isNullable(nodes, child))
+						return false;
+			return true;
+
+			case Type::ALT:
+				for (int child : node.children)
+					if (isNullable(nodes, child))
+						return true;
+			return false;
+
+			case Type::REPEAT:
+			return (node.min == 0 || isNullable(nodes, node.children[0]));
+
+			default:
+			return true;
+		}
+	}
+
+	// Returns the longest literal that every match of the node must contain
+	static std::wstring requiredLiteral(const std::vector<Node>& nodes, int n)
+	{
+		const Node& node = nodes[n];
+
+		switch (node.type)
+		{
+			case Type::CHAR:
+			return std::wstring(1, node.ch);
+
+			case Type::REPEAT:
+			return (node.min > 0) ? requiredLiteral(nodes, node.children[0]) : std::wstring();
+
+			case Type::CONCAT:
+			{
+				std::wstring best;
+				std::wstring run;
+
+				for (int child : node.children)
+				{
+					const Type type = nodes[child].type;
+
+					if (type == Type::CHAR)
+					{
+						run += nodes[child].ch;
+						continue;
+					}
+
+					// Zero-width assertions do not break the literal chars sequence
+					if (type == Type::BOL || type == Type::EOL ||
+							type == Type::WORD_BOUNDARY || type == Type::NOT_WORD_BOUNDARY)
+						continue;
+
+					if (run.size() > best.size())
+						best = run;
+
+					run.clear();
+
+					std::wstring literal = requiredLiteral(nodes, child);
+
+					if (literal.size() > best.size())
+						best = std::move(literal);
+				}
+
+				if (run.size() > best.size())
+					best = std::move(run);
+
+				return best;
+			}
+
+			default:
+			return std::wstring();
+		}
+	}
+
+private:
+	using Type = Node::Type;
+
+	inline bool atEnd() const
+	{
+		return (_pos >= _pattern.size());
+	}
+
+	inline wchar_t peek(size_t offset = 0) const
+	{
+		return (_pos + offset < _pattern.size()) ? _pattern[_pos + offset] : L'\0';
+	}
+
+	int newNode(Type type, wchar_t ch = 0)
+	{
+		Node node;
+		node.type	= type;
+		node.ch		= ch;
+
+		_nodes.push_back(std::move(node));
+
+		return static_cast<int>(_nodes.size()) - 1;
+	}
+
+	int newClassNode(CharClass&& cc)
+	{
+		const int node = newNode(Type::CLASS);
+
+		_nodes[node].classIdx = static_cast<int>(_classes.size());
+		_classes.emplace_back(std::move(cc));
+
+		return node;
+	}
+
+	int newSeqNode(Type type, std::vector<int>&& children)
+	{
+		if (children.empty())
+			return newNode(Type::EMPTY);
+
+		if (children.size() == 1)
+			return children[0];
+
+		const int node = newNode(type);
+
+		_nodes[node].children = std::move(children);
+
+		return node;
+	}
+
+	int parseDisjunction()
+	{
+		std::vector<int> alternatives { parseAlternative() };
+
+		while (!_failed && (peek() == L'|'))
+		{
+			++_pos;
+			alternatives.push_back(parseAlternative());
+		}
+
+		return newSeqNode(Type::ALT, std::move(alternatives));
+	}
+
+	int parseAlternative()
+	{
+		std::vector<int> terms;
+
+		while (!_failed && !atEnd() && (peek() != L'|') && (peek() != L')'))
+			parseTerm(terms);
+
+		return newSeqNode(Type::CONCAT, std::move(terms));
+	}
+
+	void parseTerm(std::vector<int>& terms)
+	{
+		int atom = -1;
+
+		const wchar_t c = peek();
+
+		switch (c)
+		{
+			case L'^':
+				++_pos;
+				terms.push_back(newNode(Type::BOL));
+			return;
+
+			case L'$':
+				++_pos;
+				terms.push_back(newNode(Type::EOL));
+			return;
+
+			case L'\\':
+				if (peek(1) == L'b' || peek(1) == L'B')
+				{
+					terms.push_back(newNode((peek(1) == L'b') ? Type::WORD_BOUNDARY : Type::NOT_WORD_BOUNDARY));
+					_pos += 2;
+
+					return;
+				}
+
+				++_pos;
+				atom = parseAtomEscape();
+			break;
+
+			case L'(':
+				++_pos;
+
+				if (peek() == L'?')
+				{
+					const wchar_t groupType = peek(1);
+
+					_pos += 2;
+
+					// Lookarounds are parsed only to find where they end
+					if (groupType == L'=' || groupType == L'!')
+					{
+						parseDisjunction();
+
+						if (!expect(L')'))
+							return;
+
+						terms.push_back(newNode(Type::UNSUPPORTED));
+
+						return;
+					}
+
+					if (groupType != L':')
+					{
+						_failed = true;
+						return;
+					}
+				}
+
+				atom = parseDisjunction();
+
+				if (!expect(L')'))
+					return;
+			break;
+
+			case L'.':
+				++_pos;
+				atom = newNode(Type::ANY);
+			break;
+
+			case L'[':
+				++_pos;
+				atom = parseBracket();
+			break;
+
+			// Nothing to repeat or implementation specific chars
+			case L'*':
+			case L'+':
+			case L'?':
+			case L'{':
+			case L'}':
+			case L']':
+				_failed = true;
+			return;
+
+			default:
+				++_pos;
+				atom = newNode(Type::CHAR, c);
+		}
+
+		if (_failed)
+			return;
+
+		terms.push_back(parseQuantifier(atom));
+	}
+
+	int parseQuantifier(int atom)
+	{
+		int min = 0;
+		int max = -1;
+
+		switch (peek())
+		{
+			case L'*':
+				++_pos;
+			break;
+
+			case L'+':
+				++_pos;
+				min = 1;
+			break;
+
+			case L'?':
+				++_pos;
+				max = 1;
+			break;
+
+			case L'{':
+				++_pos;
+
+				if (!parseNumber(min))
+					return atom;
+
+				if (peek() == L',')
+				{
+					++_pos;
+
+					if (peek() != L'}' && !parseNumber(max))
+						return atom;
+				}
+				else
+				{
+					max = min;
+				}
+
+				if (!expect(L'}'))
+					return atom;
+
+				if (max >= 0 && max < min)
+				{
+					_failed = true;
+					return atom;
+				}
+			break;
+
+			default:
+			return atom;
+		}
+
+		const int node = newNode(Type::REPEAT);
+
+		_nodes[node].min		= min;
+		_nodes[node].max		= max;
+		_nodes[node].greedy		= (peek() != L'?');
+		_nodes[node].children	= { atom };
+
+		if (!_nodes[node].greedy)
+			++_pos;
+
+		return node;
+	}
+
+	bool parseNumber(int& num)
+	{
+		if (peek() < L'0' || peek() > L'9')
+		{
+			_failed = true;
+			return false;
+		}
+
+		num = 0;
+
+		for (; peek() >= L'0' && peek() <= L'9'; ++_pos)
+		{
+			// Huge repetition counts could only make the program too big
+			if (num < 1000000)
+				num = num * 10 + (peek() - L'0');
+		}
+
+		return true;
+	}
+
+	bool expect(wchar_t c)
+	{
+		if (peek() != c)
+		{
+			_failed = true;
+			return false;
+		}
+
+		++_pos;
+
+		return true;
+	}
+
+	// Parses the chars class escapes (\d, \w, \s and their negations). Returns false if not a class escape.
+	bool parseClassEscape(wchar_t c, CharClass& cc, bool& negated)
+	{
+		const wchar_t* name = nullptr;
+
+		switch (c)
+		{
+			case L'd': case L'D': name = L"d"; break;
+			case L'w': case L'W': name = L"w"; break;
+			case L's': case L'S': name = L"s"; break;
+			default: return false;
+		}
+
+		negated = (c == L'D' || c == L'W' || c == L'S');
+
+		const ClassType cls = _traits.lookup_classname(name, name + 1);
+
+		if (negated)
+			cc.negClasses.push_back(cls);
+		else
+			cc.classes.push_back(cls);
+
+		return true;
+	}
+
+	bool parseHex(int digits, wchar_t& ch)
+	{
+		int val = 0;
+
+		for (int i = 0; i < digits; ++i, ++_pos)
+		{
+			const wchar_t c = peek();
+
+			if (c >= L'0' && c <= L'9')
+				val = val * 16 + (c - L'0');
+			else if (c >= L'a' && c <= L'f')
+				val = val * 16 + (c - L'a' + 10);
+			else if (c >= L'A' && c <= L'F')
+				val = val * 16 + (c - L'A' + 10);
+			else
+				return false;
+		}
+
+		ch = static_cast<wchar_t>(val);
+
+		return true;
+	}
+
+	// Parses the escaped char after '\' (already consumed). Returns false if not supported.
+	bool parseCharEscape(wchar_t& ch)
+	{
+		const wchar_t c = peek();
+
+		++_pos;
+
+		switch (c)
+		{
+			case L't': ch = L'\t'; return true;
+			case L'n': ch = L'\n'; return true;
+			case L'v': ch = L'\v'; return true;
+			case L'f': ch = L'\f'; return true;
+			case L'r': ch = L'\r'; return true;
+
+			case L'0':
+				ch = L'\0';
+			return (peek() < L'0' || peek() > L'9');
+
+			case L'x':
+			return parseHex(2, ch);
+
+			case L'u':
+			return parseHex(4, ch);
+
+			case L'c':
+			{
+				const wchar_t letter = peek();
+
+				++_pos;
+
+				if ((letter < L'a' || letter > L'z') && (letter < L'A' || letter > L'Z'))
+					return false;
+
+				ch = static_cast<wchar_t>(letter % 32);
+			}
+			return true;
+
+			case L'\0':
+			return false;
+
+			default:
+				// Identity escapes of letters and digits are implementation specific (or back-references)
+				if ((c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z') || (c >= L'0' && c <= L'9'))
+					return false;
+
+				ch = c;
+			return true;
+		}
+	}
+
+	int parseAtomEscape()
+	{
+		const wchar_t c = peek();
+
+		if (c >= L'1' && c <= L'9')
+		{
+			while (peek() >= L'0' && peek() <= L'9')
+				++_pos;
+
+			return newNode(Type::UNSUPPORTED);
+		}
+
+		CharClass cc;
+		bool negated = false;
+
+		if (parseClassEscape(c, cc, negated))
+		{
+			++_pos;
+
+			// \D is kept as negated \d class for simpler matching
+			if (negated)
+			{
+				cc.classes	= std::move(cc.negClasses);
+				cc.negClasses.clear();
+				cc.negate	= true;
+			}
+
+			return newClassNode(std::move(cc));
+		}
+
+		wchar_t ch;
+
+		if (!parseCharEscape(ch))
+		{
+			_failed = true;
+			return -1;
+		}
+
+		return newNode(Type::CHAR, ch);
+	}
+
+	// Parses a class atom - returns false on error, isClass is set for class escapes that cannot form ranges
+	bool parseClassAtom(CharClass& cc, wchar_t& ch, bool& isClass)
+	{
+		isClass = false;
+
+		const wchar_t c = peek();
+
+		if (c == L'\\')
+		{
+			++_pos;
+
+			bool negated;
+
+			if (parseClassEscape(peek(), cc, negated))
+			{
+				++_pos;
+				isClass = true;
+
+				return true;
+			}
+
+			if (peek() == L'b')
+			{
+				++_pos;
+				ch = L'\b';
+
+				return true;
+			}
+
+			if (peek() == L'-')
+			{
+				++_pos;
+				ch = L'-';
+
+				return true;
+			}
+
+			return parseCharEscape(ch);
+		}
+
+		// POSIX classes, collating elements and equivalence classes are not supported
+		if (c == L'[' && (peek(1) == L':' || peek(1) == L'.' || peek(1) == L'='))
+			return false;
+
+		if (c == L'\0' && atEnd())
+			return false;
+
+		++_pos;
+		ch = c;
+
+		return true;
+	}
+
+	int parseBracket()
+	{
+		CharClass cc;
+
+		if (peek() == L'^')
+		{
+			++_pos;
+			cc.negate = true;
+		}
+
+		// Empty class handling differs between implementations
+		if (peek() == L']')
+		{
+			_failed = true;
+			return -1;
+		}
+
+		while (!atEnd() && peek() != L']')
+		{
+			wchar_t lo;
+			bool isClass;
+
+			if (!parseClassAtom(cc, lo, isClass))
+			{
+				_failed = true;
+				return -1;
+			}
+
+			if (isClass)
+			{
+				if (peek() == L'-' && peek(1) != L']')
+				{
+					_failed = true;
+					return -1;
+				}
+
+				continue;
+			}
+
+			wchar_t hi = lo;
+
+			if (peek() == L'-' && peek(1) != L']' && _pos + 1 < _pattern.size())
+			{
+				++_pos;
+
+				if (!parseClassAtom(cc, hi, isClass) || isClass || hi < lo)
+				{
+					_failed = true;
+					return -1;
+				}
+			}
+
+			cc.ranges.emplace_back(lo, hi);
+		}
+
+		if (!expect(L']'))
+			return -1;
+
+		return newClassNode(std::move(cc));
+	}
+
+	const std::wstring&					_pattern;
+	const std::regex_traits<wchar_t>&	_traits;
+	std::vector<Node>&					_nodes;
+	std::vector<CharClass>&				_classes;
+
+	size_t	_pos {0};
+	bool	_failed {false};
+};
+
+
+
+
+LinearRegex::LinearRegex(const std::wstring& pattern)
+{
+	static const wchar_t cWordClassName[] = L"w";
+
+	_wordClass = _traits.lookup_classname(cWordClassName, cWordClassName + 1);
+
+	// The line terminators '.' doesn't match are implementation specific
+	{
+		static const wchar_t cLineTerminators[] = { L'\0', L'\n', L'\r', 0x2028, 0x2029 };
+
+		const std::wregex anyRe(L".");
+
+		for (wchar_t ch : cLineTerminators)
+			if (!std::regex_match(std::wstring(1, ch), anyRe))
+				_anyExcluded.push_back(ch);
+	}
+
+	std::vector<Node> nodes;
+
+	const int root = Parser(pattern, _traits, nodes, _classes).parse();
+
+	if (root < 0)
+	{
+		_classes.clear();
+		return;
+	}
+
+	_requiredLiteral = Parser::requiredLiteral(nodes, root);
+
+	if (!compile(nodes, root))
+		_prog.clear();
+}
+
+
+bool LinearRegex::compile(const std::vector<Node>& nodes, int root)
+{
+	// Empty matches make std::regex_iterator step specially - leave those to std::wregex
+	if (Parser::isNullable(nodes, root))
+		return false;
+
+	if (!emit(nodes, root))
+		return false;
+
+	addInst(OpCode::MATCH);
+
+	return true;
+}
+
+
+bool LinearRegex::emit(const std::vector<Node>& nodes, int n)
+{
+	using Type = Node::Type;
+
+	if (_prog.size() > cMaxProgSize)
+		return false;
+
+	const Node& node = nodes[n];
+
+	switch (node.type)
+	{
+		case Type::EMPTY:
+		break;
+
+		case Type::CHAR:
+			addInst(OpCode::CHAR, node.ch);
+		break;
+
+		case Type::ANY:
+			addInst(OpCode::ANY);
+		break;
+
+		case Type::CLASS:
+			addInst(OpCode::CLASS, 0, node.classIdx);
+		break;
+
+		case Type::BOL:
+			addInst(OpCode::BOL);
+		break;
+
+		case Type::EOL:
+			addInst(OpCode::EOL);
+		break;
+
+		case Type::WORD_BOUNDARY:
+			addInst(OpCode::WORD_BOUNDARY);
+		break;
+
+		case Type::NOT_WORD_BOUNDARY:
+			addInst(OpCode::NOT_WORD_BOUNDARY);
+		break;
+
+		case Type::CONCAT:
+			for (int child : node.children)
+				if (!emit(nodes, child))
+					return false;
+		break;
+
+		case Type::ALT:
+		{
+			std::vector<int> jumps;
+
+			const int lastIdx = static_cast<int>(node.children.size()) - 1;
+
+			for (int i = 0; i < lastIdx; ++i)
+			{
+				const int split = addInst(OpCode::SPLIT);
+
+				_prog[split].x = static_cast<int>(_prog.size());
+
+				if (!emit(nodes, node.children[i]))
+					return false;
+
+				jumps.push_back(addInst(OpCode::JMP));
+
+				_prog[split].y = static_cast<int>(_prog.size());
+			}
+
+			if (!emit(nodes, node.children[lastIdx]))
+				return false;
+
+			for (int jump : jumps)
+				_prog[jump].x = static_cast<int>(_prog.size());
+		}
+		break;
+
+		case Type::REPEAT:
+		{
+			const int body = node.children[0];
+
+			// ECMAScript rejects empty iterations of optional repeats, the VM doesn't
+			if (node.min != node.max && Parser::isNullable(nodes, body))
+				return false;
+
+			for (int i = 0; i < node.min; ++i)
+				if (!emit(nodes, body))
+					return false;
+
+			if (node.max < 0)
+			{
+				const int split = addInst(OpCode::SPLIT);
+				const int bodyStart = static_cast<int>(_prog.size());
+
+				if (!emit(nodes, body))
+					return false;
+
+				addInst(OpCode::JMP, 0, split);
+
+				const int out = static_cast<int>(_prog.size());
+
+				_prog[split].x = node.greedy ? bodyStart : out;
+				_prog[split].y = node.greedy ? out : bodyStart;
+			}
+			else
+			{
+				std::vector<int> splits;
+
+				for (int i = node.min; i < node.max; ++i)
+				{
+					splits.push_back(addInst(OpCode::SPLIT));
+
+					_prog[splits.back()].x = static_cast<int>(_prog.size());
+
+					if (!emit(nodes, body))
+						return false;
+				}
+
+				const int out = static_cast<int>(_prog.size());
+
+				for (int split : splits)
+				{
+					if (node.greedy)
+					{
+						_prog[split].y = out;
+					}
+					else
+					{
+						_prog[split].y = _prog[split].x;
+						_prog[split].x = out;
+					}
+				}
+			}
+		}
+		break;
+
+		default:
+		return false;
+	}
+
+	return (_prog.size() <= cMaxProgSize);
+}
+
+
+int LinearRegex::addInst(OpCode op, wchar_t ch, int x, int y)
+{
+	_prog.push_back({ op, ch, x, y });
+
+	return static_cast<int>(_prog.size()) - 1;
+}
+
+
+bool LinearRegex::matchesClass(int classIdx, wchar_t ch) const
+{
+	const CharClass& cc = _classes[classIdx];
+
+	bool found = false;
+
+	for (const auto& range : cc.ranges)
+	{
+		if (ch >= range.first && ch <= range.second)
+		{
+			found = true;
+			break;
+		}
+	}
+
+	if (!found)
+	{
+		for (ClassType cls : cc.classes)
+		{
+			if (_traits.isctype(ch, cls))
+			{
+				found = true;
+				break;
+			}
+		}
+	}
+
+	if (!found)
+	{
+		for (ClassType cls : cc.negClasses)
+		{
+			if (!_traits.isctype(ch, cls))
+			{
+				found = true;
+				break;
+			}
+		}
+	}
+
+	return (found != cc.negate);
+}
+
+
+bool LinearRegex::mayMatch(const wchar_t* text, intptr_t len) const
+{
+	const intptr_t literalLen = static_cast<intptr_t>(_requiredLiteral.size());
+
+	if (literalLen == 0)
+		return true;
+
+	const wchar_t firstCh = _requiredLiteral[0];
+
+	for (intptr_t pos = 0; pos <= len - literalLen; ++pos)
+	{
+		const wchar_t* found = std::wmemchr(text + pos, firstCh, len - literalLen + 1 - pos);
+
+		if (!found)
+			return false;
+
+		pos = found - text;
+
+		if (std::wmemcmp(found + 1, _requiredLiteral.data() + 1, literalLen - 1) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+
+namespace // anonymous namespace
+{
+
+struct Thread
+{
+	int			pc;
+	intptr_t	start;
+};
+
+
+// Reused by all searches in the thread to avoid allocations per line
+struct VMState
+{
+	std::vector<Thread>		clist;
+	std::vector<Thread>		nlist;
+	std::vector<int>		stack;
+	std::vector<unsigned>	marks;
+	unsigned				gen {0};
+
+	void nextGen(size_t progSize)
+	{
+		if (marks.size() < progSize)
+			marks.resize(progSize, 0);
+
+		if (++gen == 0)
+		{
+			std::fill(marks.begin(), marks.end(), 0);
+			gen = 1;
+		}
+	}
+};
+
+thread_local VMState vmState;
+
+} // anonymous namespace
+
+
+bool LinearRegex::search(const wchar_t* text, intptr_t len, intptr_t start, intptr_t& matchPos,
+	intptr_t& matchLen) const
+{
+	if (_prog.empty() || start > len)
+		return false;
+
+	VMState& vm = vmState;
+
+	// Follows the jumps and assertions from pc in priority order, adds the consuming threads to the list
+	auto addThread = [&](std::vector<Thread>& list, int pc, intptr_t threadStart, intptr_t pos)
+	{
+		vm.stack.clear();
+		vm.stack.push_back(pc);
+
+		while (!vm.stack.empty())
+		{
+			const int cur = vm.stack.back();
+			vm.stack.pop_back();
+
+			if (vm.marks[cur] == vm.gen)
+				continue;
+
+			vm.marks[cur] = vm.gen;
+
+			const Inst& inst = _prog[cur];
+
+			switch (inst.op)
+			{
+				case OpCode::JMP:
+					vm.stack.push_back(inst.x);
+				break;
+
+				case OpCode::SPLIT:
+					vm.stack.push_back(inst.y);
+					vm.stack.push_back(inst.x);
+				break;
+
+				case OpCode::BOL:
+					if (pos == 0)
+						vm.stack.push_back(cur + 1);
+				break;
+
+				case OpCode::EOL:
+					if (pos == len)
+						vm.stack.push_back(cur + 1);
+				break;
+
+				case OpCode::WORD_BOUNDARY:
+					if (isWordBoundary(text, len, pos))
+						vm.stack.push_back(cur + 1);
+				break;
+
+				case OpCode::NOT_WORD_BOUNDARY:
+					if (!isWordBoundary(text, len, pos))
+						vm.stack.push_back(cur + 1);
+				break;
+
+				default:
+					list.push_back({ cur, threadStart });
+			}
+		}
+	};
+
+	vm.clist.clear();
+	vm.nextGen(_prog.size());
+
+	bool matched = false;
+
+	for (intptr_t pos = start; ; ++pos)
+	{
+		// New thread has the lowest priority - the leftmost match wins
+		if (!matched)
+			addThread(vm.clist, 0, pos, pos);
+
+		vm.nlist.clear();
+		vm.nextGen(_prog.size());
+
+		for (const Thread& thread : vm.clist)
+		{
+			const Inst& inst = _prog[thread.pc];
+
+			if (inst.op == OpCode::MATCH)
+			{
+				matched		= true;
+				matchPos	= thread.start;
+				matchLen	= pos - thread.start;
+
+				// Lower priority threads are cut off
+				break;
+			}
+
+			if (pos >= len)
+				continue;
+
+			const wchar_t ch = text[pos];
+
+			bool step = false;
+
+			switch (inst.op)
+			{
+				case OpCode::CHAR:
+					step = (ch == inst.ch);
+				break;
+
+				case OpCode::ANY:
+					step = matchesAny(ch);
+				break;
+
+				case OpCode::CLASS:
+					step = matchesClass(inst.x, ch);
+				break;
+
+				default:
+				break;
+			}
+
+			if (step)
+				addThread(vm.nlist, thread.pc + 1, thread.start, pos + 1);
+		}
+
+		if (pos >= len)
+			break;
+
+		vm.clist.swap(vm.nlist);
+
+		if (matched && vm.clist.empty())
+			break;
+	}
+
+	return matched;
+}
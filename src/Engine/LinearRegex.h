@@ -0,0 +1,135 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Linear time matcher for the subset of ECMAScript regular expressions that needs no backtracking.
+ * The pattern is compiled to a program that is run as a Pike VM - all alternatives are followed in parallel in their
+ * priority order so the leftmost match found is the same as the one std::wregex finds but the time is linear in the
+ * text length. Patterns with back-references, lookarounds, POSIX classes or sub-expressions that can repeatedly match
+ * empty text are not compiled - std::wregex is to be used for them. The literal every match must contain is found
+ * for those as well and can be used to skip the text that cannot match at all.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <regex>
+
+
+/**
+ *  \class  LinearRegex
+ *  \brief  Matches ECMAScript regex (without flags) the same way std::wregex does in linear time
+ */
+class LinearRegex
+{
+public:
+	// The pattern must be a valid ECMAScript regex (std::wregex must accept it)
+	explicit LinearRegex(const std::wstring& pattern);
+
+	// Is the pattern fully supported so search() can be used?
+	inline bool isCompiled() const
+	{
+		return !_prog.empty();
+	}
+
+	// Returns false if the text surely has no match (the literal required by any match is missing)
+	bool mayMatch(const wchar_t* text, intptr_t len) const;
+
+	// Finds the leftmost match in text starting at start. The text before start is considered for assertions as
+	// std::regex_iterator does with match_prev_avail when looking for the next match. Returns false if not found.
+	bool search(const wchar_t* text, intptr_t len, intptr_t start, intptr_t& matchPos, intptr_t& matchLen) const;
+
+private:
+	using ClassType = std::regex_traits<wchar_t>::char_class_type;
+
+	// Programs larger than that (because of counted repetitions) are not worth running in the VM
+	static constexpr size_t cMaxProgSize = 4096;
+
+	struct CharClass
+	{
+		bool										negate {false};
+		std::vector<std::pair<wchar_t, wchar_t>>	ranges;
+		std::vector<ClassType>						classes;
+		std::vector<ClassType>						negClasses;	// Negated classes like \D in [\D\s]
+	};
+
+	enum class OpCode
+	{
+		CHAR,
+		ANY,
+		CLASS,
+		BOL,
+		EOL,
+		WORD_BOUNDARY,
+		NOT_WORD_BOUNDARY,
+		SPLIT,
+		JMP,
+		MATCH
+	};
+
+	struct Inst
+	{
+		OpCode	op;
+		wchar_t	ch;
+		int		x;	// Class index or (preferred) jump target
+		int		y;	// Alternative jump target
+	};
+
+	struct Node;
+	class Parser;
+
+	bool compile(const std::vector<Node>& nodes, int root);
+	bool emit(const std::vector<Node>& nodes, int node);
+	int addInst(OpCode op, wchar_t ch = 0, int x = 0, int y = 0);
+
+	bool matchesClass(int classIdx, wchar_t ch) const;
+
+	inline bool isWordChar(wchar_t ch) const
+	{
+		return _traits.isctype(ch, _wordClass);
+	}
+
+	inline bool isWordBoundary(const wchar_t* text, intptr_t len, intptr_t pos) const
+	{
+		const bool leftIsWord	= (pos > 0) && isWordChar(text[pos - 1]);
+		const bool rightIsWord	= (pos < len) && isWordChar(text[pos]);
+
+		return (leftIsWord != rightIsWord);
+	}
+
+	inline bool matchesAny(wchar_t ch) const
+	{
+		for (wchar_t excluded : _anyExcluded)
+			if (ch == excluded)
+				return false;
+
+		return true;
+	}
+
+	std::regex_traits<wchar_t>	_traits;
+	ClassType					_wordClass;
+
+	// Chars that '.' doesn't match in the std::wregex implementation used
+	std::vector<wchar_t>		_anyExcluded;
+
+	std::vector<CharClass>		_classes;
+	std::vector<Inst>			_prog;
+
+	std::wstring				_requiredLiteral;
+};
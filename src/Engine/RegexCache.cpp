@@ -0,0 +1,76 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <map>
+#include <utility>
+
+#include "RegexCache.h"
+
+#if defined(__MINGW32__) && !defined(_GLIBCXX_HAS_GTHREADS)
+#include "../mingw-std-threads/mingw.mutex.h"
+#else
+#include <mutex>
+#endif // __MINGW32__ ...
+
+
+namespace // anonymous namespace
+{
+
+constexpr std::regex::flag_type cIgnoreRegexFlags = std::regex::ECMAScript | std::regex::optimize;
+
+// When that many regexes are cached the ones not used by any compare anymore are dropped
+constexpr size_t cMaxCachedRegexes = 16;
+
+
+std::mutex regexCacheMutex;
+
+std::map<std::pair<std::wstring, std::regex::flag_type>, CompiledIgnoreRegex> regexCache;
+
+} // anonymous namespace
+
+
+CompiledIgnoreRegex getCompiledIgnoreRegex(const std::wstring& regexStr)
+{
+	const auto key = std::make_pair(regexStr, cIgnoreRegexFlags);
+
+	std::lock_guard<std::mutex> lock(regexCacheMutex);
+
+	auto found = regexCache.find(key);
+
+	if (found != regexCache.end())
+		return found->second;
+
+	CompiledIgnoreRegex compiled;
+
+	compiled.regex			= std::make_shared<const std::wregex>(regexStr, cIgnoreRegexFlags);
+	compiled.linearRegex	= std::make_shared<const LinearRegex>(regexStr);
+
+	if (regexCache.size() >= cMaxCachedRegexes)
+	{
+		for (auto it = regexCache.begin(); it != regexCache.end();)
+		{
+			if (it->second.regex.use_count() == 1)
+				it = regexCache.erase(it);
+			else
+				++it;
+		}
+	}
+
+	regexCache.emplace(key, compiled);
+
+	return compiled;
+}
@@ -0,0 +1,44 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compiled ignore regexes shared by all compares - compiling a complex pattern with std::regex::optimize is expensive
+ * and it would otherwise be done anew on every re-compare. Compiled regexes are only read so they can be used by many
+ * compare threads at once.
+ */
+
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <regex>
+
+#include "LinearRegex.h"
+
+
+struct CompiledIgnoreRegex
+{
+	std::shared_ptr<const std::wregex>	regex;
+	std::shared_ptr<const LinearRegex>	linearRegex;	// Linear time matcher of regex if it supports it
+};
+
+
+/**
+ *  \brief  Returns the compiled regexStr from the cache, compiles and caches it if not there yet.
+ *          Throws std::regex_error if regexStr is not a valid ECMAScript regex.
+ */
+CompiledIgnoreRegex getCompiledIgnoreRegex(const std::wstring& regexStr);
@@ -0,0 +1,97 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Trace.h"
+
+
+#if defined(TRACELOGGING) && (TRACELOGGING != 0)
+
+#include <windows.h>
+#include <winmeta.h>
+#include <TraceLoggingProvider.h>
+
+
+// {C656E500-6340-5DA6-7A26-D14E9C30C20D} - the EventSource style GUID of the "ComparePlus" name
+TRACELOGGING_DEFINE_PROVIDER(tracingProvider, "ComparePlus",
+	(0xc656e500, 0x6340, 0x5da6, 0x7a, 0x26, 0xd1, 0x4e, 0x9c, 0x30, 0xc2, 0x0d));
+
+
+namespace // anonymous namespace
+{
+
+bool isRegistered = false;
+
+// Activity of the innermost trace scope of the thread - the parent of the next one started
+thread_local const GUID* currentActivityId = nullptr;
+
+} // anonymous namespace
+
+
+void registerTraceProvider()
+{
+	if (!isRegistered)
+		isRegistered = SUCCEEDED(TraceLoggingRegister(tracingProvider));
+}
+
+
+void unregisterTraceProvider()
+{
+	if (isRegistered)
+	{
+		TraceLoggingUnregister(tracingProvider);
+		isRegistered = false;
+	}
+}
+
+
+TraceScope::TraceScope(const char* phase, int64_t size1, int64_t size2)
+{
+	// The only cost while no session is listening
+	if (!TraceLoggingProviderEnabled(tracingProvider, WINEVENT_LEVEL_INFO, 0))
+		return;
+
+	if (::EventActivityIdControl(EVENT_ACTIVITY_CTRL_CREATE_ID, &_activityId) != ERROR_SUCCESS)
+		return;
+
+	_phase				= phase;
+	_parentActivityId	= currentActivityId;
+	currentActivityId	= &_activityId;
+
+	TraceLoggingWriteActivity(tracingProvider, "Phase", &_activityId, _parentActivityId,
+		TraceLoggingOpcode(WINEVENT_OPCODE_START),
+		TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+		TraceLoggingString(phase, "Name"),
+		TraceLoggingInt64(size1, "Size1"),
+		TraceLoggingInt64(size2, "Size2"));
+}
+
+
+TraceScope::~TraceScope()
+{
+	if (!_phase)
+		return;
+
+	// Written even if the session has stopped listening meanwhile - it is dropped then
+	TraceLoggingWriteActivity(tracingProvider, "Phase", &_activityId, nullptr,
+		TraceLoggingOpcode(WINEVENT_OPCODE_STOP),
+		TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+		TraceLoggingString(_phase, "Name"));
+
+	currentActivityId = _parentActivityId;
+}
+
+#endif // TRACELOGGING
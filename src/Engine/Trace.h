@@ -0,0 +1,82 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* ETW TraceLogging of the compare phases - each TraceScope writes a "Phase" start event when constructed and the
+ * matching stop event when destroyed, nested scopes are related to their parent ones by the activity IDs.
+ * The provider is named "ComparePlus" (GUID {C656E500-6340-5DA6-7A26-D14E9C30C20D} generated from the name), record it
+ * e.g. by: wpr / xperf / tracelog with *ComparePlus. While no trace session is listening a scope costs a single enabled
+ * check.
+ *
+ * Built by default with MSVC, MinGW builds need TRACELOGGING defined (and the TraceLogging headers of mingw-w64).
+ */
+
+
+#pragma once
+
+#include <cstdint>
+
+
+#if !defined(TRACELOGGING) && defined(_MSC_VER)
+#define TRACELOGGING	1
+#endif
+
+
+#if defined(TRACELOGGING) && (TRACELOGGING != 0)
+
+#include <windows.h>
+
+
+void registerTraceProvider();
+void unregisterTraceProvider();
+
+
+/**
+ *  \class  TraceScope
+ *  \brief  Start / stop events of the named phase - the sizes (lines, blocks, etc.) are logged with the start event,
+ *          -1 if not relevant to the phase
+ */
+class TraceScope
+{
+public:
+	TraceScope(const char* phase, int64_t size1 = -1, int64_t size2 = -1);
+	~TraceScope();
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char*	_phase {nullptr};
+	GUID		_activityId;
+	const GUID*	_parentActivityId {nullptr};
+};
+
+#else
+
+inline void registerTraceProvider() {}
+inline void unregisterTraceProvider() {}
+
+
+class TraceScope
+{
+public:
+	TraceScope(const char*, int64_t = -1, int64_t = -1) {}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#endif // TRACELOGGING
@@ -0,0 +1,441 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <windows.h>
+#include <cstring>
+#include <random>
+#include <algorithm>
+#include <exception>
+
+#include "Workload.h"
+
+
+namespace // anonymous namespace
+{
+
+constexpr uint32_t cWorkloadMagic	= 0x4C575043; // "CPWL"
+constexpr uint32_t cWorkloadVersion	= 1;
+
+
+// Workload file layout: magic, version, the options, the regex string, for each doc its codepage, lines count and
+// the hashes, line numbers and lengths arrays, then the changed blocks pairs count and each pair with its lines text.
+// Strings are stored as their length followed by the UTF-16 chars.
+class WorkloadWriter
+{
+public:
+	template <typename T>
+	inline void put(T value)
+	{
+		const char* bytes = reinterpret_cast<const char*>(&value);
+
+		_buf.insert(_buf.end(), bytes, bytes + sizeof(value));
+	}
+
+	template <typename T>
+	inline void putArray(const std::vector<T>& arr)
+	{
+		const char* bytes = reinterpret_cast<const char*>(arr.data());
+
+		_buf.insert(_buf.end(), bytes, bytes + arr.size() * sizeof(T));
+	}
+
+	inline void putString(const std::wstring& str)
+	{
+		put(static_cast<uint32_t>(str.size()));
+
+		const char* bytes = reinterpret_cast<const char*>(str.data());
+
+		_buf.insert(_buf.end(), bytes, bytes + str.size() * sizeof(wchar_t));
+	}
+
+	inline const std::vector<char>& data() const
+	{
+		return _buf;
+	}
+
+private:
+	std::vector<char> _buf;
+};
+
+
+class WorkloadReader
+{
+public:
+	WorkloadReader(const std::vector<char>& buf) : _pos(buf.data()), _end(buf.data() + buf.size()) {}
+
+	template <typename T>
+	inline bool get(T& value)
+	{
+		if (static_cast<size_t>(_end - _pos) < sizeof(value))
+			return false;
+
+		std::memcpy(&value, _pos, sizeof(value));
+		_pos += sizeof(value);
+
+		return true;
+	}
+
+	template <typename T>
+	inline bool getArray(std::vector<T>& arr, uint64_t count)
+	{
+		if (static_cast<uint64_t>(_end - _pos) / sizeof(T) < count)
+			return false;
+
+		arr.resize(static_cast<size_t>(count));
+		std::memcpy(arr.data(), _pos, arr.size() * sizeof(T));
+		_pos += arr.size() * sizeof(T);
+
+		return true;
+	}
+
+	inline bool getString(std::wstring& str)
+	{
+		uint32_t len;
+
+		if (!get(len) || static_cast<size_t>(_end - _pos) / sizeof(wchar_t) < len)
+			return false;
+
+		str.resize(len);
+
+		if (len)
+			std::memcpy(&str[0], _pos, len * sizeof(wchar_t));
+
+		_pos += len * sizeof(wchar_t);
+
+		return true;
+	}
+
+	inline bool atEnd() const
+	{
+		return (_pos == _end);
+	}
+
+private:
+	const char* _pos;
+	const char* const _end;
+};
+
+
+void putOptions(WorkloadWriter& out, const CompareOptions& options)
+{
+	const uint8_t flags[] = {
+		options.findUniqueMode, options.alignAllMatches, options.neverMarkIgnored, options.histogramDiff,
+		options.verifyLineMatches, options.detectMoves, options.detectCharDiffs, options.bestSeqChangedLines,
+		options.ignoreEmptyLines, options.ignoreChangedSpaces, options.ignoreAllSpaces, options.ignoreCase,
+		options.selectionCompare
+	};
+
+	for (uint8_t flag : flags)
+		out.put(flag);
+
+	out.put(static_cast<int32_t>(options.newFileViewId));
+	out.put(static_cast<int32_t>(options.changedThresholdPercent));
+	out.put(static_cast<int32_t>(options.diffCostLimit));
+	out.put(static_cast<int32_t>(options.bandedMatchLines));
+	out.put(static_cast<int32_t>(options.memoryBudgetMB));
+
+	out.putString(options.ignoreRegexStr);
+}
+
+
+bool getOptions(WorkloadReader& in, CompareOptions& options)
+{
+	bool* const flags[] = {
+		&options.findUniqueMode, &options.alignAllMatches, &options.neverMarkIgnored, &options.histogramDiff,
+		&options.verifyLineMatches, &options.detectMoves, &options.detectCharDiffs, &options.bestSeqChangedLines,
+		&options.ignoreEmptyLines, &options.ignoreChangedSpaces, &options.ignoreAllSpaces, &options.ignoreCase,
+		&options.selectionCompare
+	};
+
+	for (bool* flag : flags)
+	{
+		uint8_t value;
+
+		if (!in.get(value))
+			return false;
+
+		*flag = (value != 0);
+	}
+
+	int* const values[] = {
+		&options.newFileViewId, &options.changedThresholdPercent, &options.diffCostLimit,
+		&options.bandedMatchLines, &options.memoryBudgetMB
+	};
+
+	for (int* value : values)
+	{
+		int32_t v;
+
+		if (!in.get(v))
+			return false;
+
+		*value = static_cast<int>(v);
+	}
+
+	options.recompareOnChange	= false;
+	options.backgroundCompare	= false;
+
+	std::wstring regexStr;
+
+	if (!in.getString(regexStr))
+		return false;
+
+	try
+	{
+		options.setIgnoreRegex(regexStr);
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+bool writeFile(const wchar_t* filePath, const std::vector<char>& data)
+{
+	const std::wstring tmpPath = std::wstring(filePath) + L".tmp";
+
+	HANDLE hFile = ::CreateFileW(tmpPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	const char* bytes = data.data();
+	size_t len = data.size();
+
+	bool written = true;
+
+	while (len && written)
+	{
+		const DWORD toWrite = static_cast<DWORD>(std::min<size_t>(len, 64 * 1024 * 1024));
+		DWORD lenWritten = 0;
+
+		written = (::WriteFile(hFile, bytes, toWrite, &lenWritten, NULL) && lenWritten == toWrite);
+
+		bytes	+= lenWritten;
+		len		-= lenWritten;
+	}
+
+	::CloseHandle(hFile);
+
+	if (written)
+		written = (::MoveFileExW(tmpPath.c_str(), filePath, MOVEFILE_REPLACE_EXISTING) != 0);
+
+	if (!written)
+		::DeleteFileW(tmpPath.c_str());
+
+	return written;
+}
+
+
+bool readFile(const wchar_t* filePath, std::vector<char>& data)
+{
+	HANDLE hFile = ::CreateFileW(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+
+	bool read = (::GetFileSizeEx(hFile, &fileSize) && static_cast<uint64_t>(fileSize.QuadPart) <= SIZE_MAX);
+
+	if (read)
+	{
+		data.resize(static_cast<size_t>(fileSize.QuadPart));
+
+		char* bytes = data.data();
+		size_t len = data.size();
+
+		while (len && read)
+		{
+			const DWORD toRead = static_cast<DWORD>(std::min<size_t>(len, 64 * 1024 * 1024));
+			DWORD lenRead = 0;
+
+			read = (::ReadFile(hFile, bytes, toRead, &lenRead, NULL) && lenRead == toRead);
+
+			bytes	+= lenRead;
+			len		-= lenRead;
+		}
+	}
+
+	::CloseHandle(hFile);
+
+	return read;
+}
+
+} // anonymous namespace
+
+
+TextScrambler::TextScrambler(uint64_t key)
+{
+	std::mt19937_64 rng(key);
+
+	for (int i = 0; i < 26; ++i)
+		_letters[i] = static_cast<wchar_t>(L'a' + i);
+
+	for (int i = 0; i < 10; ++i)
+		_digits[i] = static_cast<wchar_t>(L'0' + i);
+
+	for (int i = 0; i < 64; ++i)
+		_latin1[i] = static_cast<wchar_t>(0xC0 + i);
+
+	for (int i = 0; i < 256; ++i)
+		_lowByte[i] = static_cast<wchar_t>(i);
+
+	std::shuffle(_letters, _letters + 26, rng);
+	std::shuffle(_digits, _digits + 10, rng);
+
+	// The multiplication and division signs are not letters - they are kept
+	std::shuffle(_latin1, _latin1 + 0x17, rng);
+	std::shuffle(_latin1 + 0x18, _latin1 + 0x37, rng);
+	std::shuffle(_latin1 + 0x38, _latin1 + 64, rng);
+
+	std::shuffle(_lowByte, _lowByte + 256, rng);
+}
+
+
+void TextScrambler::scramble(std::wstring& text) const
+{
+	for (wchar_t& c : text)
+	{
+		if (c >= L'a' && c <= L'z')
+			c = _letters[c - L'a'];
+		else if (c >= L'A' && c <= L'Z')
+			c = static_cast<wchar_t>(_letters[c - L'A'] - L'a' + L'A');
+		else if (c >= L'0' && c <= L'9')
+			c = _digits[c - L'0'];
+		else if (c >= 0xC0 && c <= 0xFF)
+			c = _latin1[c - 0xC0];
+		// Surrogates are kept so the text stays valid UTF-16
+		else if (c > 0xFF && (c < 0xD800 || c > 0xDFFF))
+			c = static_cast<wchar_t>((c & 0xFF00) | _lowByte[c & 0xFF]);
+	}
+}
+
+
+bool saveWorkload(const wchar_t* filePath, const CompareWorkload& workload)
+{
+	WorkloadWriter out;
+
+	out.put(cWorkloadMagic);
+	out.put(cWorkloadVersion);
+
+	putOptions(out, workload.options);
+
+	for (const auto& doc : workload.docs)
+	{
+		const std::vector<int64_t> lines(doc.lines.begin(), doc.lines.end());
+
+		out.put(static_cast<int32_t>(doc.codepage));
+		out.put(static_cast<uint64_t>(doc.hashes.size()));
+		out.putArray(doc.hashes);
+		out.putArray(lines);
+		out.putArray(doc.lengths);
+	}
+
+	out.put(static_cast<uint64_t>(workload.changedBlocks.size()));
+
+	for (const auto& pair : workload.changedBlocks)
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			out.put(static_cast<int64_t>(pair.off[i]));
+			out.put(static_cast<int64_t>(pair.len[i]));
+
+			for (const auto& lineText : pair.text[i])
+				out.putString(lineText);
+		}
+	}
+
+	return writeFile(filePath, out.data());
+}
+
+
+bool loadWorkload(const wchar_t* filePath, CompareWorkload& workload)
+{
+	std::vector<char> data;
+
+	if (!readFile(filePath, data))
+		return false;
+
+	WorkloadReader in(data);
+
+	uint32_t magic;
+	uint32_t version;
+
+	if (!in.get(magic) || !in.get(version) || magic != cWorkloadMagic || version != cWorkloadVersion)
+		return false;
+
+	if (!getOptions(in, workload.options))
+		return false;
+
+	for (auto& doc : workload.docs)
+	{
+		int32_t		codepage;
+		uint64_t	linesCount;
+
+		std::vector<int64_t> lines;
+
+		if (!in.get(codepage) || !in.get(linesCount) || !in.getArray(doc.hashes, linesCount) ||
+				!in.getArray(lines, linesCount) || !in.getArray(doc.lengths, linesCount))
+			return false;
+
+		doc.codepage = static_cast<int>(codepage);
+		doc.lines.assign(lines.begin(), lines.end());
+	}
+
+	uint64_t pairsCount;
+
+	if (!in.get(pairsCount))
+		return false;
+
+	workload.changedBlocks.clear();
+
+	for (uint64_t p = 0; p < pairsCount; ++p)
+	{
+		WorkloadBlockPair pair;
+
+		for (int i = 0; i < 2; ++i)
+		{
+			int64_t off;
+			int64_t len;
+
+			if (!in.get(off) || !in.get(len) || off < 0 || len < 0 ||
+					static_cast<uint64_t>(off + len) > workload.docs[i].hashes.size())
+				return false;
+
+			pair.off[i] = static_cast<intptr_t>(off);
+			pair.len[i] = static_cast<intptr_t>(len);
+
+			pair.text[i].resize(pair.len[i]);
+
+			for (auto& lineText : pair.text[i])
+			{
+				if (!in.getString(lineText))
+					return false;
+			}
+		}
+
+		workload.changedBlocks.emplace_back(std::move(pair));
+	}
+
+	return in.atEnd();
+}
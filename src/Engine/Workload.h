@@ -0,0 +1,97 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compare workload records - the compare engine inputs of a real compare stored to a file so the compare can be
+ * replayed and profiled offline (by the command line tool) without the compared documents. Only the lines hashes and
+ * lengths are stored and optionally the text of the changed blocks lines - scrambled so it is not readable but still
+ * differs where the original text differs. Nothing here depends on Notepad++ or Scintilla.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+#include "CompareOptions.h"
+
+
+struct WorkloadDoc
+{
+	int		codepage {0};
+
+	// Hash, document line number and length in bytes (without EOL) of each compared line - ignored empty lines are
+	// not part of the compare and are left out
+	std::vector<uint64_t>	hashes;
+	std::vector<intptr_t>	lines;
+	std::vector<uint32_t>	lengths;
+};
+
+
+// Changed blocks pair (removed lines replaced by added ones) - the lines are indexes in WorkloadDoc
+struct WorkloadBlockPair
+{
+	intptr_t	off[2];
+	intptr_t	len[2];
+
+	// Scrambled UTF-16 text of each block line
+	std::vector<std::wstring>	text[2];
+};
+
+
+struct CompareWorkload
+{
+	CompareOptions	options;
+
+	WorkloadDoc		docs[2];
+
+	// Empty if the workload has been recorded without text
+	std::vector<WorkloadBlockPair>	changedBlocks;
+};
+
+
+/**
+ *  \class  TextScrambler
+ *  \brief  Replaces each letter and digit of the text by another one picked by the key - equal chars stay equal
+ *          (case is kept as well) so the char and word diffs of the scrambled text are the same as the original ones
+ */
+class TextScrambler
+{
+public:
+	explicit TextScrambler(uint64_t key);
+
+	void scramble(std::wstring& text) const;
+
+private:
+	wchar_t _letters[26];
+	wchar_t _digits[10];
+	wchar_t _latin1[64];	// U+00C0 - U+00FF
+	wchar_t _lowByte[256];	// Low byte of the chars above U+00FF - they stay in their 256 chars block
+};
+
+
+/**
+ *  \brief  Writes the workload to filePath at once - the file is replaced or not touched if the write fails.
+ */
+bool saveWorkload(const wchar_t* filePath, const CompareWorkload& workload);
+
+/**
+ *  \brief  Reads the workload from filePath. Returns false if the file can't be read or is not a valid workload
+ *          of this version.
+ */
+bool loadWorkload(const wchar_t* filePath, CompareWorkload& workload);
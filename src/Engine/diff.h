@@ -44,10 +44,33 @@
 #include <cstdlib>
 #include <climits>
 #include <utility>
-#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <exception>
 
 #include "varray.h"
 
+#if defined(__MINGW32__) && !defined(_GLIBCXX_HAS_GTHREADS)
+#include "../mingw-std-threads/mingw.thread.h"
+#else
+#include <thread>
+#endif // __MINGW32__ ...
+
+#ifndef MULTITHREAD
+#define MULTITHREAD		1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define DIFF_SSE2		1
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
 
 enum class diff_type
 {
@@ -77,7 +100,152 @@ struct diff_info<void>
 };
 
 
-typedef std::function<bool()> IsCancelledFn;
+// Cancel flag set by another thread (the progress dialog) - only loaded in the compare loops, nothing is called
+typedef const std::atomic<bool>* CancelFlag;
+
+// V-array buffer of the compare - can be shared between consecutive DiffCalc runs (one at a time)
+// to avoid allocating it anew for each of them
+typedef varray<intptr_t> DiffWorkspace;
+
+
+/**
+ *  \struct  diff_snake
+ *  \brief   Extends the diff snakes - counts the equal elements of the two sequences from a position on
+ */
+template <typename Elem>
+struct diff_snake
+{
+	// Count of equal elements at the starts of a and b (len at most)
+	static inline intptr_t forward(const Elem* a, const Elem* b, intptr_t len)
+	{
+		intptr_t n = 0;
+
+		while (n < len && a[n] == b[n])
+			++n;
+
+		return n;
+	}
+
+	// Count of equal elements right before aEnd and bEnd (len at most)
+	static inline intptr_t backward(const Elem* aEnd, const Elem* bEnd, intptr_t len)
+	{
+		intptr_t n = 0;
+
+		while (n < len && aEnd[-1 - n] == bEnd[-1 - n])
+			++n;
+
+		return n;
+	}
+};
+
+
+#ifdef DIFF_SSE2
+
+// The compare engine diffs 32-bit line IDs - long matching runs of near identical documents are compared 4 IDs
+// (8 with AVX2) at a time. The first elements are compared one by one as most snakes are short.
+template <>
+struct diff_snake<uint32_t>
+{
+	static inline intptr_t forward(const uint32_t* a, const uint32_t* b, intptr_t len)
+	{
+		if (len <= 0 || a[0] != b[0])
+			return 0;
+
+		intptr_t n = 1;
+
+#if defined(__AVX2__)
+		for (; n + 8 <= len; n += 8)
+		{
+			const __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + n)),
+					_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + n)));
+
+			const unsigned notEq = ~static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(eq))) & 0xFF;
+
+			if (notEq)
+				return n + firstBit(notEq);
+		}
+#endif
+
+		for (; n + 4 <= len; n += 4)
+		{
+			const __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + n)),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + n)));
+
+			const unsigned notEq = ~static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(eq))) & 0xF;
+
+			if (notEq)
+				return n + firstBit(notEq);
+		}
+
+		while (n < len && a[n] == b[n])
+			++n;
+
+		return n;
+	}
+
+	static inline intptr_t backward(const uint32_t* aEnd, const uint32_t* bEnd, intptr_t len)
+	{
+		if (len <= 0 || aEnd[-1] != bEnd[-1])
+			return 0;
+
+		intptr_t n = 1;
+
+#if defined(__AVX2__)
+		for (; n + 8 <= len; n += 8)
+		{
+			const __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(aEnd - n - 8)),
+					_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bEnd - n - 8)));
+
+			const unsigned notEq = ~static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(eq))) & 0xFF;
+
+			// The highest element is the nearest to the snake
+			if (notEq)
+				return n + 7 - lastBit(notEq);
+		}
+#endif
+
+		for (; n + 4 <= len; n += 4)
+		{
+			const __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(aEnd - n - 4)),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(bEnd - n - 4)));
+
+			const unsigned notEq = ~static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(eq))) & 0xF;
+
+			if (notEq)
+				return n + 3 - lastBit(notEq);
+		}
+
+		while (n < len && aEnd[-1 - n] == bEnd[-1 - n])
+			++n;
+
+		return n;
+	}
+
+private:
+	static inline intptr_t firstBit(unsigned bits)
+	{
+#if defined(_MSC_VER)
+		unsigned long idx;
+		_BitScanForward(&idx, bits);
+		return static_cast<intptr_t>(idx);
+#else
+		return __builtin_ctz(bits);
+#endif
+	}
+
+	static inline intptr_t lastBit(unsigned bits)
+	{
+#if defined(_MSC_VER)
+		unsigned long idx;
+		_BitScanReverse(&idx, bits);
+		return static_cast<intptr_t>(idx);
+#else
+		return 31 - __builtin_clz(bits);
+#endif
+	}
+};
+
+#endif // DIFF_SSE2
 
 
 /**
@@ -88,10 +256,11 @@ template <typename Elem, typename UserDataT = void>
 class DiffCalc
 {
 public:
-	DiffCalc(const std::vector<Elem>& v1, const std::vector<Elem>& v2,
-		IsCancelledFn isCancelled = nullptr);
+	template <typename Alloc>
+	DiffCalc(const std::vector<Elem, Alloc>& v1, const std::vector<Elem, Alloc>& v2,
+		CancelFlag cancelled = nullptr, DiffWorkspace* workspace = nullptr);
 	DiffCalc(const Elem v1[], intptr_t v1_size, const Elem v2[], intptr_t v2_size,
-		IsCancelledFn isCancelled = nullptr);
+		CancelFlag cancelled = nullptr, DiffWorkspace* workspace = nullptr);
 
 	// Runs the actual compare and returns the differences + swap flag indicating if the
 	// compared sequences have been swapped for better results (if true, _a and _b have been swapped,
@@ -99,21 +268,50 @@ public:
 	std::pair<std::vector<diff_info<UserDataT>>, bool> operator()(bool doDiffsCombine = false,
 			bool doBoundaryShift = false);
 
+	// Limits the edit cost searched for each middle snake (0 means no limit). When the limit is reached the problem
+	// is split at the furthest reaching path found so far - the differences are still valid but might not be minimal
+	inline void setCostLimit(intptr_t maxCost)
+	{
+		_dmax = (maxCost > 0) ? maxCost : INTPTR_MAX;
+	}
+
+	// True if the cost limit has been reached and the differences might not be minimal
+	inline bool isApproximated() const
+	{
+		return _approximated;
+	}
+
+	// Lets the recursion use up to threadsCount threads - big enough independent sub-problems are then solved
+	// concurrently. The differences are the same as the single threaded ones.
+	inline void setParallel(int threadsCount)
+	{
+		_forkDepth = 0;
+
+		while ((1 << _forkDepth) < threadsCount)
+			++_forkDepth;
+	}
+
 	DiffCalc(const DiffCalc&) = delete;
 	const DiffCalc& operator=(const DiffCalc&) = delete;
 
-private:
+protected:
 	static constexpr int		_cCancelCheckItrInterval {3000};
-	static constexpr intptr_t	_cDmax {INTPTR_MAX};
+
+	// Min elements count of both sub-problems to be solved concurrently - smaller ones are not worth a thread
+	static constexpr intptr_t	_cMinForkLen {10000};
 
 	struct middle_snake {
 		intptr_t x, y, u, v;
 	};
 
 	inline intptr_t& _v(intptr_t k, intptr_t r);
+	inline void _wipe_buf();
 	void _edit(diff_type type, intptr_t off, intptr_t len);
 	intptr_t _find_middle_snake(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend, middle_snake& ms);
+	bool _find_best_split(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend, intptr_t d, middle_snake& ms);
 	intptr_t _ses(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend);
+	bool _ses_forked(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend, const middle_snake& ms,
+			intptr_t& result);
 	void _combine_diffs();
 	void _shift_boundaries();
 	inline intptr_t _count_replaces();
@@ -123,29 +321,41 @@ private:
 	const Elem*	_b;
 	intptr_t _b_size;
 
-	IsCancelledFn _isCancelled;
+	CancelFlag _cancelled;
 	int _cancelCheckCount;
 
+	intptr_t _dmax {INTPTR_MAX};
+	bool _approximated {false};
+
+	// Recursion levels left at which sub-problems can still be forked to other threads
+	int _forkDepth {0};
+
 	std::vector<diff_info<UserDataT>> _diff;
 
-	varray<intptr_t> _buf;
+	DiffWorkspace _own_buf;
+	DiffWorkspace& _buf;
+
+	intptr_t* _v_data {nullptr};
 };
 
 
 template <typename Elem, typename UserDataT>
-DiffCalc<Elem, UserDataT>::DiffCalc(const std::vector<Elem>& v1, const std::vector<Elem>& v2,
-		IsCancelledFn isCancelled) :
+template <typename Alloc>
+DiffCalc<Elem, UserDataT>::DiffCalc(const std::vector<Elem, Alloc>& v1, const std::vector<Elem, Alloc>& v2,
+		CancelFlag cancelled, DiffWorkspace* workspace) :
 	_a(v1.data()), _a_size(v1.size()), _b(v2.data()), _b_size(v2.size()),
-	_isCancelled(isCancelled), _cancelCheckCount(_cCancelCheckItrInterval)
+	_cancelled(cancelled), _cancelCheckCount(_cCancelCheckItrInterval),
+	_buf(workspace ? *workspace : _own_buf)
 {
 }
 
 
 template <typename Elem, typename UserDataT>
 DiffCalc<Elem, UserDataT>::DiffCalc(const Elem v1[], intptr_t v1_size, const Elem v2[], intptr_t v2_size,
-		IsCancelledFn isCancelled) :
+		CancelFlag cancelled, DiffWorkspace* workspace) :
 	_a(v1), _a_size(v1_size), _b(v2), _b_size(v2_size),
-	_isCancelled(isCancelled), _cancelCheckCount(_cCancelCheckItrInterval)
+	_cancelled(cancelled), _cancelCheckCount(_cCancelCheckItrInterval),
+	_buf(workspace ? *workspace : _own_buf)
 {
 }
 
@@ -156,7 +366,17 @@ inline intptr_t& DiffCalc<Elem, UserDataT>::_v(intptr_t k, intptr_t r)
 	/* Pack -N to N into 0 to N * 2 */
 	const intptr_t j = (k <= 0) ? (-k * 4 + r) : (k * 4 + (r - 2));
 
-	return _buf.get(j);
+	// No range check here - _find_middle_snake() reserves the buffer for each d
+	return _v_data[j];
+}
+
+
+template <typename Elem, typename UserDataT>
+inline void DiffCalc<Elem, UserDataT>::_wipe_buf()
+{
+	// Shared workspace is kept as is to be reused by the next compare
+	if (&_buf == &_own_buf)
+		_own_buf.get().clear();
 }
 
 
@@ -195,6 +415,11 @@ intptr_t DiffCalc<Elem, UserDataT>::_find_middle_snake(intptr_t aoff, intptr_t a
 	const intptr_t delta = aend - bend;
 	const intptr_t odd = delta & 1;
 	const intptr_t mid = (aend + bend) / 2 + odd;
+	const intptr_t absDelta = (delta < 0) ? -delta : delta;
+
+	// Max |k| used below is |delta| + d + 1 (reverse search diagonals)
+	_buf.reserve(4 * (absDelta + 2) + 2);
+	_v_data = _buf.get().data();
 
 	_v(1, 0) = 0;
 	_v(delta - 1, 1) = aend;
@@ -203,12 +428,19 @@ intptr_t DiffCalc<Elem, UserDataT>::_find_middle_snake(intptr_t aoff, intptr_t a
 	{
 		intptr_t k, x, y;
 
-		if ((2 * d - 1) >= _cDmax)
-			return _cDmax;
+		// Too expensive - split at the furthest reaching path of the last cost searched in both directions
+		if (d > 1 && d > _dmax && _find_best_split(aoff, aend, boff, bend, d - 1, ms))
+		{
+			_approximated = true;
+			return 2 * d;
+		}
+
+		_buf.reserve(4 * (absDelta + d + 1) + 2);
+		_v_data = _buf.get().data();
 
 		if (!--_cancelCheckCount)
 		{
-			if (_isCancelled && _isCancelled())
+			if (_cancelled && _cancelled->load(std::memory_order_relaxed))
 				return -1;
 
 			_cancelCheckCount = _cCancelCheckItrInterval;
@@ -226,10 +458,12 @@ intptr_t DiffCalc<Elem, UserDataT>::_find_middle_snake(intptr_t aoff, intptr_t a
 			ms.x = x;
 			ms.y = y;
 
-			while (x < aend && y < bend &&  _a[aoff + x] == _b[boff + y])
 			{
-				++x;
-				++y;
+				const intptr_t snake = diff_snake<Elem>::forward(_a + aoff + x, _b + boff + y,
+						std::min(aend - x, bend - y));
+
+				x += snake;
+				y += snake;
 			}
 
 			_v(k, 0) = x;
@@ -263,10 +497,11 @@ intptr_t DiffCalc<Elem, UserDataT>::_find_middle_snake(intptr_t aoff, intptr_t a
 			ms.u = x;
 			ms.v = y;
 
-			while (x > 0 && y > 0 &&  _a[aoff + x - 1] == _b[boff + y - 1])
 			{
-				--x;
-				--y;
+				const intptr_t snake = diff_snake<Elem>::backward(_a + aoff + x, _b + boff + y, std::min(x, y));
+
+				x -= snake;
+				y -= snake;
 			}
 
 			_v(kr, 1) = x;
@@ -288,6 +523,66 @@ intptr_t DiffCalc<Elem, UserDataT>::_find_middle_snake(intptr_t aoff, intptr_t a
 }
 
 
+// Finds the forward or reverse d-path reaching the furthest towards the other end - the snake through its end point
+// is used to split the problem when the search is too expensive (like GNU diff does). Returns false if there is no
+// proper split point.
+template <typename Elem, typename UserDataT>
+bool DiffCalc<Elem, UserDataT>::_find_best_split(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend,
+	intptr_t d, middle_snake& ms)
+{
+	const intptr_t delta = aend - bend;
+	const intptr_t total = aend + bend;
+
+	intptr_t best = 0;
+
+	for (intptr_t k = d; k >= -d; k -= 2)
+	{
+		intptr_t x = _v(k, 0);
+		intptr_t y = x - k;
+
+		if (x <= aend && y >= 0 && y <= bend && (x + y) > best && (x + y) < total)
+		{
+			best = x + y;
+			ms.x = ms.u = x;
+			ms.y = ms.v = y;
+		}
+
+		const intptr_t kr = delta + k;
+
+		x = _v(kr, 1);
+		y = x - kr;
+
+		if (x >= 0 && x <= aend && y >= 0 && y <= bend && (total - x - y) > best && (x + y) > 0)
+		{
+			best = total - x - y;
+			ms.x = ms.u = x;
+			ms.y = ms.v = y;
+		}
+	}
+
+	if (best == 0)
+		return false;
+
+	// Both sub-problems must begin with a difference as _ses() expects - extend the split point to a whole snake
+	{
+		const intptr_t snake = diff_snake<Elem>::backward(_a + aoff + ms.x, _b + boff + ms.y, std::min(ms.x, ms.y));
+
+		ms.x -= snake;
+		ms.y -= snake;
+	}
+
+	{
+		const intptr_t snake = diff_snake<Elem>::forward(_a + aoff + ms.u, _b + boff + ms.v,
+				std::min(aend - ms.u, bend - ms.v));
+
+		ms.u += snake;
+		ms.v += snake;
+	}
+
+	return true;
+}
+
+
 template <typename Elem, typename UserDataT>
 intptr_t DiffCalc<Elem, UserDataT>::_ses(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend)
 {
@@ -313,11 +608,15 @@ intptr_t DiffCalc<Elem, UserDataT>::_ses(intptr_t aoff, intptr_t aend, intptr_t
 		if (d == -1)
 			return -1;
 
-		if (d >= _cDmax)
-			return _cDmax;
-
 		if (d > 1)
 		{
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+			intptr_t forkedRes;
+
+			if (_forkDepth > 0 && _ses_forked(aoff, aend, boff, bend, ms, forkedRes))
+				return (forkedRes == -1) ? -1 : d;
+#endif // MULTITHREAD
+
 			if (_ses(aoff, ms.x, boff, ms.y) == -1)
 				return -1;
 
@@ -383,6 +682,87 @@ intptr_t DiffCalc<Elem, UserDataT>::_ses(intptr_t aoff, intptr_t aend, intptr_t
 }
 
 
+// Solves the second sub-problem by a forked compare on another thread (with its own workspace and differences list)
+// while this one solves the first. The forked differences are then appended as if the recursion was sequential.
+// Returns false if the sub-problems are too small or the thread cannot be started - nothing is done then.
+template <typename Elem, typename UserDataT>
+bool DiffCalc<Elem, UserDataT>::_ses_forked(intptr_t aoff, intptr_t aend, intptr_t boff, intptr_t bend,
+	const middle_snake& ms, intptr_t& result)
+{
+	if ((ms.x + ms.y < _cMinForkLen) || ((aend - ms.u) + (bend - ms.v) < _cMinForkLen))
+		return false;
+
+	DiffCalc<Elem, UserDataT> second(_a, _a_size, _b, _b_size, _cancelled);
+
+	second._dmax		= _dmax;
+	second._forkDepth	= _forkDepth - 1;
+
+	intptr_t secondRes = -1;
+	std::exception_ptr secondError = nullptr;
+
+	std::thread worker;
+
+	try
+	{
+		worker = std::thread(
+			[&]()
+			{
+				try
+				{
+					secondRes = second._ses(aoff + ms.u, aend - ms.u, boff + ms.v, bend - ms.v);
+				}
+				catch (...)
+				{
+					secondError = std::current_exception();
+				}
+			});
+	}
+	catch (...)
+	{
+		return false;
+	}
+
+	--_forkDepth;
+
+	intptr_t firstRes = -1;
+
+	try
+	{
+		firstRes = _ses(aoff, ms.x, boff, ms.y);
+	}
+	catch (...)
+	{
+		worker.join();
+		throw;
+	}
+
+	++_forkDepth;
+
+	worker.join();
+
+	if (secondError)
+		std::rethrow_exception(secondError);
+
+	if (second._approximated)
+		_approximated = true;
+
+	if (firstRes == -1 || secondRes == -1)
+	{
+		result = -1;
+		return true;
+	}
+
+	_edit(diff_type::DIFF_MATCH, aoff + ms.x, ms.u - ms.x);
+
+	for (const auto& di: second._diff)
+		_edit(di.type, di.off, di.len);
+
+	result = firstRes + secondRes;
+
+	return true;
+}
+
+
 // If a whole matching block is contained at the end of the next diff block shift match down:
 // If [] surrounds the marked differences, basically [abc]d[efgd]hi is the same as [abcdefg]dhi
 // We combine diffs to make results more compact and clean
@@ -440,25 +820,30 @@ void DiffCalc<Elem, UserDataT>::_combine_diffs()
 			// The whole match is contained at the end of the next diff -
 			// move the match down linking the surrounding diffs and matches
 
+			// Copy the match as inserting below might invalidate the references
+			const intptr_t moved_off = match.off;
+			const intptr_t moved_len = match.len;
+
 			// Link match to the next matching block
-			if (i + 2 < static_cast<intptr_t>(_diff.size()))
+			if (i + 2 < static_cast<intptr_t>(_diff.size()) && _diff[i + 2].type == diff_type::DIFF_MATCH)
 			{
-				_diff[i + 2].off -= match.len;
-				_diff[i + 2].len += match.len;
+				_diff[i + 2].off -= moved_len;
+				_diff[i + 2].len += moved_len;
 			}
-			// Create new match block at the end
+			// Create new match block right after the next diff
 			else
 			{
 				diff_info<UserDataT> end_match;
 
 				end_match.type = diff_type::DIFF_MATCH;
-				end_match.off = match.off + next_diff->len;
-				end_match.len = match.len;
+				end_match.off = (next_diff->type == diff_type::DIFF_IN_1) ? moved_off + next_diff->len : moved_off;
+				end_match.len = moved_len;
 
-				_diff.emplace_back(end_match);
+				_diff.insert(_diff.begin() + i + 2, end_match);
 			}
 
-			next_diff->off -= match.len;
+			next_diff = &_diff[i + 1];
+			next_diff->off -= moved_len;
 
 			_diff.erase(_diff.begin() + i);
 
@@ -523,7 +908,9 @@ void DiffCalc<Elem, UserDataT>::_shift_boundaries()
 			el	= _a;
 		}
 
-		if (i + 1 < static_cast<intptr_t>(_diff.size()))
+		// Shift only diffs surrounded by matching blocks
+		if ((i + 1 < static_cast<intptr_t>(_diff.size())) && (_diff[i + 1].type == diff_type::DIFF_MATCH) &&
+			((i == 0) || (_diff[i - 1].type == diff_type::DIFF_MATCH)))
 		{
 			diff_info<UserDataT>& diff = _diff[i];
 			diff_info<UserDataT>* next_match_diff = &_diff[i + 1];
@@ -621,13 +1008,10 @@ std::pair<std::vector<diff_info<UserDataT>>, bool> DiffCalc<Elem, UserDataT>::op
 	/* The _ses function assumes we begin with a diff. The following ensures this is true by skipping any matches
 	 * in the beginning. This also helps to quickly process sequences that match entirely.
 	 */
-	intptr_t off = 0;
-
 	intptr_t asize = _a_size;
 	intptr_t bsize = _b_size;
 
-	while (off < asize && off < bsize && _a[off] == _b[off])
-		++off;
+	const intptr_t off = diff_snake<Elem>::forward(_a, _b, std::min(asize, bsize));
 
 	_edit(diff_type::DIFF_MATCH, 0, off);
 
@@ -644,7 +1028,7 @@ std::pair<std::vector<diff_info<UserDataT>>, bool> DiffCalc<Elem, UserDataT>::op
 	}
 
 	// Wipe temporal buffer to free memory
-	_buf.get().clear();
+	_wipe_buf();
 
 	// Swap compared sequences and re-compare to see if result is more optimal
 	{
@@ -662,7 +1046,7 @@ std::pair<std::vector<diff_info<UserDataT>>, bool> DiffCalc<Elem, UserDataT>::op
 		intptr_t newReplacesCount = _ses(off, bsize, off, asize);
 
 		// Wipe temporal buffer to free memory
-		_buf.get().clear();
+		_wipe_buf();
 
 		if (newReplacesCount != -1)
 			newReplacesCount = _count_replaces();
@@ -0,0 +1,264 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Histogram diff as introduced in JGit - a refinement of Bram Cohen's patience diff.
+ * The elements occurring least in the compared region are used as anchors - the longest common run around such
+ * anchor is taken as a match and the regions before and after it are processed the same way. Regions that have
+ * common elements but all of them occurring too often are compared with the Myers algorithm of the base class.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+#include "diff.h"
+
+
+/**
+ *  \class  HistogramDiffCalc
+ *  \brief  Same as DiffCalc but uses histogram diff algorithm (elements must also be hashable by ElemHash)
+ */
+template <typename Elem, typename UserDataT = void, typename ElemHash = std::hash<Elem>>
+class HistogramDiffCalc : public DiffCalc<Elem, UserDataT>
+{
+public:
+	using DiffCalc<Elem, UserDataT>::DiffCalc;
+
+	// Runs the actual compare and returns the differences + swap flag that is always false
+	// (the compared sequences are never swapped)
+	std::pair<std::vector<diff_info<UserDataT>>, bool> operator()(bool doDiffsCombine = false,
+			bool doBoundaryShift = false);
+
+private:
+	using Base = DiffCalc<Elem, UserDataT>;
+
+	// Elements occurring more often than that in a region are not considered as anchors
+	static constexpr intptr_t _cMaxOccurrences {64};
+
+	struct region {
+		intptr_t aoff, aend, boff, bend;
+		bool is_match;
+	};
+
+	struct occurrences {
+		intptr_t count;
+		std::vector<intptr_t> pos;
+	};
+
+	using histogram = std::unordered_map<Elem, occurrences, ElemHash>;
+
+	bool _process_region(const region& r, std::vector<region>& pending);
+};
+
+
+template <typename Elem, typename UserDataT, typename ElemHash>
+bool HistogramDiffCalc<Elem, UserDataT, ElemHash>::_process_region(const region& r, std::vector<region>& pending)
+{
+	intptr_t aoff = r.aoff;
+	intptr_t aend = r.aend;
+	intptr_t boff = r.boff;
+	intptr_t bend = r.bend;
+
+	// Common head is output right away, common tail is output after the rest of the region
+	{
+		const intptr_t off = aoff;
+
+		const intptr_t snake = diff_snake<Elem>::forward(this->_a + aoff, this->_b + boff,
+				std::min(aend - aoff, bend - boff));
+
+		aoff += snake;
+		boff += snake;
+
+		this->_edit(diff_type::DIFF_MATCH, off, aoff - off);
+	}
+
+	{
+		const intptr_t end = aend;
+
+		const intptr_t snake = diff_snake<Elem>::backward(this->_a + aend, this->_b + bend,
+				std::min(aend - aoff, bend - boff));
+
+		aend -= snake;
+		bend -= snake;
+
+		if (end > aend)
+			pending.push_back({ aend, end, bend, bend + (end - aend), true });
+	}
+
+	if (aoff == aend || boff == bend)
+	{
+		this->_edit(diff_type::DIFF_IN_1, aoff, aend - aoff);
+		this->_edit(diff_type::DIFF_IN_2, boff, bend - boff);
+
+		return true;
+	}
+
+	histogram hist;
+	hist.reserve(aend - aoff);
+
+	for (intptr_t i = aoff; i < aend; ++i)
+	{
+		occurrences& occ = hist[this->_a[i]];
+
+		if (++occ.count <= _cMaxOccurrences)
+			occ.pos.emplace_back(i);
+	}
+
+	bool anyCommon = false;
+
+	intptr_t bestCount	= _cMaxOccurrences + 1;
+	intptr_t bestLen	= 0;
+	intptr_t bestA		= 0;
+	intptr_t bestB		= 0;
+
+	for (intptr_t bi = boff; bi < bend;)
+	{
+		auto hi = hist.find(this->_b[bi]);
+
+		if (hi == hist.end())
+		{
+			++bi;
+			continue;
+		}
+
+		anyCommon = true;
+
+		if (hi->second.count > _cMaxOccurrences || hi->second.count > bestCount)
+		{
+			++bi;
+			continue;
+		}
+
+		intptr_t nextB = bi + 1;
+
+		for (intptr_t ai : hi->second.pos)
+		{
+			intptr_t as = ai;
+			intptr_t bs = bi;
+			intptr_t ae = ai + 1;
+			intptr_t be = bi + 1;
+
+			intptr_t minCount = hi->second.count;
+
+			while (as > aoff && bs > boff && this->_a[as - 1] == this->_b[bs - 1])
+			{
+				--as;
+				--bs;
+
+				if (minCount > 1)
+					minCount = std::min(minCount, hist[this->_a[as]].count);
+			}
+
+			while (ae < aend && be < bend && this->_a[ae] == this->_b[be])
+			{
+				if (minCount > 1)
+					minCount = std::min(minCount, hist[this->_a[ae]].count);
+
+				++ae;
+				++be;
+			}
+
+			if (nextB < be)
+				nextB = be;
+
+			if ((minCount < bestCount) || (minCount == bestCount && ae - as > bestLen))
+			{
+				bestCount	= minCount;
+				bestLen		= ae - as;
+				bestA		= as;
+				bestB		= bs;
+			}
+		}
+
+		bi = nextB;
+	}
+
+	if (!anyCommon)
+	{
+		this->_edit(diff_type::DIFF_IN_1, aoff, aend - aoff);
+		this->_edit(diff_type::DIFF_IN_2, boff, bend - boff);
+
+		return true;
+	}
+
+	// All common elements are too frequent - fall back to Myers
+	if (bestLen == 0)
+		return (this->_ses(aoff, aend - aoff, boff, bend - boff) != -1);
+
+	// Regions are processed in LIFO order so push the one after the match first
+	pending.push_back({ bestA + bestLen, aend, bestB + bestLen, bend, false });
+	pending.push_back({ bestA, bestA + bestLen, bestB, bestB + bestLen, true });
+	pending.push_back({ aoff, bestA, boff, bestB, false });
+
+	return true;
+}
+
+
+template <typename Elem, typename UserDataT, typename ElemHash>
+std::pair<std::vector<diff_info<UserDataT>>, bool> HistogramDiffCalc<Elem, UserDataT, ElemHash>::operator()(
+		bool doDiffsCombine, bool doBoundaryShift)
+{
+	// Explicit stack instead of recursion - the regions split count can be close to the sequences size
+	std::vector<region> pending;
+
+	pending.push_back({ 0, this->_a_size, 0, this->_b_size, false });
+
+	while (!pending.empty())
+	{
+		const region r = pending.back();
+		pending.pop_back();
+
+		if (r.is_match)
+		{
+			this->_edit(diff_type::DIFF_MATCH, r.aoff, r.aend - r.aoff);
+			continue;
+		}
+
+		if (!--this->_cancelCheckCount)
+		{
+			if (this->_cancelled && this->_cancelled->load(std::memory_order_relaxed))
+			{
+				this->_diff.clear();
+				return std::make_pair(this->_diff, false);
+			}
+
+			this->_cancelCheckCount = Base::_cCancelCheckItrInterval;
+		}
+
+		if (!_process_region(r, pending))
+		{
+			this->_diff.clear();
+			return std::make_pair(this->_diff, false);
+		}
+	}
+
+	// Wipe temporal buffer to free memory
+	this->_wipe_buf();
+
+	if (doDiffsCombine)
+		this->_combine_diffs();
+
+	if (doBoundaryShift)
+		this->_shift_boundaries();
+
+	return std::make_pair(this->_diff, false);
+}
@@ -27,6 +27,18 @@ public:
 		return _buf;
 	}
 
+	// Grows the array to at least size elements (it never shrinks) - use operator[] for unchecked access afterwards
+	inline void reserve(size_t size)
+	{
+		if (_buf.size() < size)
+			_buf.resize(size, { 0 });
+	}
+
+	inline Elem& operator[](size_t i)
+	{
+		return _buf[i];
+	}
+
 private:
 	std::vector<Elem> _buf;
 };
@@ -0,0 +1,405 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FolderCompareDialog.h"
+
+#include <windowsx.h>
+#include <commctrl.h>
+#include <uxtheme.h>
+#include <shlobj.h>
+#include <cwchar>
+
+#ifndef MULTITHREAD
+#define MULTITHREAD		1
+#endif
+
+
+namespace // anonymous namespace
+{
+
+const wchar_t* statusStr(FolderCmpStatus status)
+{
+	switch (status)
+	{
+		case FolderCmpStatus::SAME:			return L"Same";
+		case FolderCmpStatus::DIFFERENT:	return L"Different";
+		case FolderCmpStatus::ONLY_IN_1:	return L"Only in old";
+		case FolderCmpStatus::ONLY_IN_2:	return L"Only in new";
+		default:							return L"Read error";
+	}
+}
+
+
+std::wstring getEditText(HWND hCtrl)
+{
+	const int len = Edit_GetTextLength(hCtrl);
+
+	std::wstring text(len + 1, L'\0');
+
+	Edit_GetText(hCtrl, &text[0], len + 1);
+	text.resize(len);
+
+	return text;
+}
+
+} // anonymous namespace
+
+
+UINT FolderCompareDialog::doDialog(FolderCmpResults* results)
+{
+	_results = results;
+	_results->selected = -1;
+
+	return (UINT)::DialogBoxParam(_hInst, MAKEINTRESOURCE(IDD_FOLDER_CMP_DIALOG), _hParent,
+			(DLGPROC)dlgProc, (LPARAM)this);
+}
+
+
+INT_PTR CALLBACK FolderCompareDialog::run_dlgProc(UINT Message, WPARAM wParam, LPARAM lParam)
+{
+	switch (Message)
+	{
+		case WM_INITDIALOG:
+		{
+			goToCenter();
+
+			ETDTProc EnableDlgTheme =
+					(ETDTProc)::SendMessage(_nppData._nppHandle, NPPM_GETENABLETHEMETEXTUREFUNC, 0, 0);
+
+			if (EnableDlgTheme != NULL)
+				EnableDlgTheme(_hSelf, ETDT_ENABLETAB);
+
+			Edit_SetText(::GetDlgItem(_hSelf, IDC_FOLDER1), _results->folder1.c_str());
+			Edit_SetText(::GetDlgItem(_hSelf, IDC_FOLDER2), _results->folder2.c_str());
+
+			setChecked(IDC_FOLDER_DIFFS_ONLY, _results->diffsOnly);
+
+			initList();
+			fillList();
+		}
+		break;
+
+		case WM_TIMER:
+			if (wParam == cProgressTimer)
+			{
+				wchar_t status[128];
+
+				_snwprintf_s(status, _countof(status), _TRUNCATE, L"Comparing files contents: %Id of %Id",
+						static_cast<intptr_t>(_done), static_cast<intptr_t>(_total));
+				setStatus(status);
+			}
+		break;
+
+		case cCompareDoneMsg:
+			onCompareDone();
+		break;
+
+		case WM_NOTIFY:
+		{
+			const NMHDR* hdr = reinterpret_cast<const NMHDR*>(lParam);
+
+			if (hdr->idFrom == IDC_FOLDER_CMP_LIST && hdr->code == NM_DBLCLK && openSelected())
+				::EndDialog(_hSelf, IDOK);
+		}
+		break;
+
+		case WM_COMMAND:
+		{
+			switch (LOWORD(wParam))
+			{
+				case IDC_FOLDER1_BROWSE:
+				case IDC_FOLDER2_BROWSE:
+					browseFolder((LOWORD(wParam) == IDC_FOLDER1_BROWSE) ? IDC_FOLDER1 : IDC_FOLDER2);
+				return TRUE;
+
+				case IDC_FOLDER_COMPARE:
+					startCompare();
+				return TRUE;
+
+				case IDC_FOLDER_DIFFS_ONLY:
+					_results->diffsOnly = isCheckedOrNot(IDC_FOLDER_DIFFS_ONLY);
+					fillList();
+				return TRUE;
+
+				case IDOK:
+					if (!_worker && openSelected())
+						::EndDialog(_hSelf, IDOK);
+				return TRUE;
+
+				case IDCANCEL:
+					stopCompare();
+					::EndDialog(_hSelf, IDCANCEL);
+				return TRUE;
+
+				default:
+				return FALSE;
+			}
+		}
+		break;
+	}
+
+	return FALSE;
+}
+
+
+void FolderCompareDialog::initList()
+{
+	HWND hList = ::GetDlgItem(_hSelf, IDC_FOLDER_CMP_LIST);
+
+	ListView_SetExtendedListViewStyle(hList, LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+
+	RECT rc;
+	::GetClientRect(hList, &rc);
+
+	const int statusWidth = (rc.right - rc.left) / 5;
+
+	LVCOLUMN col = {};
+	col.mask = LVCF_TEXT | LVCF_WIDTH;
+
+	col.cx		= statusWidth;
+	col.pszText	= const_cast<LPWSTR>(L"Status");
+	ListView_InsertColumn(hList, 0, &col);
+
+	col.cx		= rc.right - rc.left - statusWidth - ::GetSystemMetrics(SM_CXVSCROLL);
+	col.pszText	= const_cast<LPWSTR>(L"File");
+	ListView_InsertColumn(hList, 1, &col);
+}
+
+
+void FolderCompareDialog::fillList()
+{
+	HWND hList = ::GetDlgItem(_hSelf, IDC_FOLDER_CMP_LIST);
+
+	::SendMessage(hList, WM_SETREDRAW, FALSE, 0);
+
+	ListView_DeleteAllItems(hList);
+
+	intptr_t differentCount	= 0;
+	intptr_t only1Count		= 0;
+	intptr_t only2Count		= 0;
+	intptr_t errorsCount	= 0;
+
+	int row = 0;
+
+	for (size_t i = 0; i < _results->entries.size(); ++i)
+	{
+		const FolderCmpEntry& entry = _results->entries[i];
+
+		switch (entry.status)
+		{
+			case FolderCmpStatus::DIFFERENT:	++differentCount;	break;
+			case FolderCmpStatus::ONLY_IN_1:	++only1Count;		break;
+			case FolderCmpStatus::ONLY_IN_2:	++only2Count;		break;
+			case FolderCmpStatus::READ_ERROR:	++errorsCount;		break;
+			default:												break;
+		}
+
+		if (_results->diffsOnly && entry.status == FolderCmpStatus::SAME)
+			continue;
+
+		LVITEM item = {};
+		item.mask		= LVIF_TEXT | LVIF_PARAM;
+		item.iItem		= row;
+		item.pszText	= const_cast<LPWSTR>(statusStr(entry.status));
+		item.lParam		= static_cast<LPARAM>(i);
+
+		ListView_InsertItem(hList, &item);
+		ListView_SetItemText(hList, row, 1, const_cast<LPWSTR>(entry.relPath.c_str()));
+
+		++row;
+	}
+
+	::SendMessage(hList, WM_SETREDRAW, TRUE, 0);
+
+	if (!_results->entries.empty())
+	{
+		wchar_t status[256];
+
+		_snwprintf_s(status, _countof(status), _TRUNCATE,
+				L"%Iu files: %Id different, %Id only in old, %Id only in new, %Id not readable",
+				_results->entries.size(), differentCount, only1Count, only2Count, errorsCount);
+		setStatus(status);
+	}
+}
+
+
+void FolderCompareDialog::browseFolder(int editCtrlId)
+{
+	BROWSEINFO bi = {};
+	bi.hwndOwner	= _hSelf;
+	bi.lpszTitle	= L"Select folder to compare";
+	bi.ulFlags		= BIF_RETURNONLYFSDIRS | BIF_NEWDIALOGSTYLE;
+
+	PIDLIST_ABSOLUTE pidl = ::SHBrowseForFolder(&bi);
+
+	if (pidl == NULL)
+		return;
+
+	wchar_t path[MAX_PATH];
+
+	if (::SHGetPathFromIDList(pidl, path))
+		Edit_SetText(::GetDlgItem(_hSelf, editCtrlId), path);
+
+	::ILFree(pidl);
+}
+
+
+void FolderCompareDialog::startCompare()
+{
+	if (_worker)
+		return;
+
+	const std::wstring folder1 = getEditText(::GetDlgItem(_hSelf, IDC_FOLDER1));
+	const std::wstring folder2 = getEditText(::GetDlgItem(_hSelf, IDC_FOLDER2));
+
+	if (folder1.empty() || folder2.empty())
+	{
+		setStatus(L"Select both folders to compare.");
+		return;
+	}
+
+	_results->folder1 = folder1;
+	_results->folder2 = folder2;
+
+	_cancelled	= false;
+	_done		= 0;
+	_total		= 0;
+
+	setBusy(true);
+	setStatus(L"Listing folders files...");
+
+	// Worker threads only update the counters - the dialog shows them on its timer
+	auto doCompare =
+		[this, folder1, folder2]()
+		{
+			try
+			{
+				_newEntriesValid = compareFolders(folder1.c_str(), folder2.c_str(), _newEntries, &_cancelled,
+						[this](intptr_t done, intptr_t total) { _done = done; _total = total; });
+			}
+			catch (...)
+			{
+				_newEntriesValid = false;
+				_newEntries.clear();
+			}
+
+			::PostMessage(_hSelf, cCompareDoneMsg, 0, 0);
+		};
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	try
+	{
+		_worker = std::make_unique<std::thread>(doCompare);
+		::SetTimer(_hSelf, cProgressTimer, 200, NULL);
+
+		return;
+	}
+	catch (...)
+	{
+		_worker = nullptr;
+	}
+#endif // MULTITHREAD
+
+	HCURSOR hOldCursor = ::SetCursor(::LoadCursor(NULL, IDC_WAIT));
+
+	doCompare();
+
+	::SetCursor(hOldCursor);
+}
+
+
+void FolderCompareDialog::stopCompare()
+{
+	if (!_worker)
+		return;
+
+	_cancelled = true;
+
+	_worker->join();
+	_worker = nullptr;
+
+	::KillTimer(_hSelf, cProgressTimer);
+}
+
+
+void FolderCompareDialog::onCompareDone()
+{
+	if (_worker)
+	{
+		_worker->join();
+		_worker = nullptr;
+
+		::KillTimer(_hSelf, cProgressTimer);
+	}
+
+	setBusy(false);
+
+	if (_newEntriesValid)
+	{
+		_results->entries = std::move(_newEntries);
+		fillList();
+	}
+	else
+	{
+		_results->entries.clear();
+		fillList();
+
+		setStatus(L"Folders cannot be read.");
+	}
+
+	_newEntries.clear();
+}
+
+
+void FolderCompareDialog::setStatus(const wchar_t* status)
+{
+	::SetDlgItemText(_hSelf, IDC_FOLDER_CMP_STATUS, status);
+}
+
+
+void FolderCompareDialog::setBusy(bool busy)
+{
+	static constexpr int cCtrlIds[] = {
+		IDC_FOLDER1, IDC_FOLDER2, IDC_FOLDER1_BROWSE, IDC_FOLDER2_BROWSE, IDC_FOLDER_COMPARE, IDC_FOLDER_DIFFS_ONLY,
+		IDC_FOLDER_CMP_LIST, IDOK
+	};
+
+	for (int id : cCtrlIds)
+		::EnableWindow(::GetDlgItem(_hSelf, id), !busy);
+}
+
+
+bool FolderCompareDialog::openSelected()
+{
+	HWND hList = ::GetDlgItem(_hSelf, IDC_FOLDER_CMP_LIST);
+
+	const int row = ListView_GetNextItem(hList, -1, LVNI_SELECTED);
+
+	if (row < 0)
+		return false;
+
+	LVITEM item = {};
+	item.mask	= LVIF_PARAM;
+	item.iItem	= row;
+
+	if (!ListView_GetItem(hList, &item))
+		return false;
+
+	_results->selected = static_cast<intptr_t>(item.lParam);
+
+	return true;
+}
@@ -23,6 +23,7 @@
 #include <regex>
 
 #include "NppHelpers.h"
+#include "RegexCache.h"
 
 
 UINT IgnoreRegexDialog::doDialog(UserSettings* settings)
@@ -127,7 +128,8 @@ bool IgnoreRegexDialog::isRegexValid(const wchar_t* regexStr)
 {
 	try
 	{
-		std::wregex testRegex(regexStr, std::regex::ECMAScript);
+		// Compiled once here - the compares take it from the cache
+		getCompiledIgnoreRegex(regexStr);
 	}
 	catch (std::regex_error& err)
 	{
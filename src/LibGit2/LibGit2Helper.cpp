@@ -85,6 +85,9 @@ std::unique_ptr<LibGit>& LibGit::load()
 	Inst->repository_workdir = (PGITREPOSITORYWORKDIR)::GetProcAddress(libGit2, "git_repository_workdir");
 	if (!Inst->repository_workdir)
 		Inst->_isInit = false;
+	Inst->repository_path = (PGITREPOSITORYPATH)::GetProcAddress(libGit2, "git_repository_path");
+	if (!Inst->repository_path)
+		Inst->_isInit = false;
 	Inst->repository_index = (PGITREPOSITORYINDEX)::GetProcAddress(libGit2, "git_repository_index");
 	if (!Inst->repository_index)
 		Inst->_isInit = false;
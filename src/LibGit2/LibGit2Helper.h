@@ -81,6 +81,7 @@ private:
 	typedef int (*PGITREPOSITORYOPENEXT) (git_repository **out, const char *path,
 			unsigned int flags, const char *ceiling_dirs);
 	typedef const char* (*PGITREPOSITORYWORKDIR) (git_repository *repo);
+	typedef const char* (*PGITREPOSITORYPATH) (git_repository *repo);
 	typedef int (*PGITREPOSITORYINDEX) (git_index **out, git_repository *repo);
 	typedef const git_index_entry* (*PGITINDEXGETBYPATH) (git_index *index, const char *path, int stage);
 	typedef int (*PGITBLOBLOOKUP) (git_blob **blob, git_repository *repo, const git_oid *id);
@@ -107,6 +108,7 @@ public:
 
 	PGITREPOSITORYOPENEXT	repository_open_ext;
 	PGITREPOSITORYWORKDIR	repository_workdir;
+	PGITREPOSITORYPATH		repository_path;
 	PGITREPOSITORYINDEX		repository_index;
 	PGITINDEXGETBYPATH		index_get_bypath;
 	PGITBLOBLOOKUP			blob_lookup;
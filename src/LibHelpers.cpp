@@ -20,16 +20,36 @@
 #include <stdlib.h>
 #include <shlwapi.h>
 #include <cstring>
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <climits>
 
 #include "Compare.h"
 #include "LibHelpers.h"
 #include "SQLite/SqliteHelper.h"
 #include "LibGit2/LibGit2Helper.h"
 
+#ifndef MULTITHREAD
+#define MULTITHREAD		1
+#endif
+
 
 namespace // anonymous namespace
 {
 
+// Libraries loading started by PrewarmVcsLibs() - LibGit::load() and InitSQLite() are not thread safe so the UI thread
+// waits for it before calling them itself
+std::future<void> vcsLibsPrewarm;
+
+
+inline void waitVcsLibsPrewarm()
+{
+	if (vcsLibsPrewarm.valid())
+		vcsLibsPrewarm.get();
+}
+
+
 void TCharToChar(const wchar_t* src, char* dest, int destCharsCount)
 {
 	::WideCharToMultiByte(CP_UTF8, 0, src, -1, dest, destCharsCount, NULL, NULL);
@@ -128,178 +148,652 @@ bool LocateDirUp(const TCHAR* dirName, const TCHAR* currentDir, TCHAR* fullDirPa
 	return false;
 }
 
-} // anonymous namespace
+inline bool getFileTime(const wchar_t* file, FILETIME& fileTime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA fileData;
 
+	if (!::GetFileAttributesExW(file, GetFileExInfoStandard, &fileData))
+		return false;
 
-bool GetSvnFile(const TCHAR* fullFilePath, TCHAR* svnFile, unsigned svnFileSize)
+	fileTime = fileData.ftLastWriteTime;
+
+	return true;
+}
+
+
+// Git repository kept open with its index and the file contents got from it
+struct GitRepo
 {
-	TCHAR svnTop[MAX_PATH];
-	TCHAR svnBase[MAX_PATH];
+	// Filtered blobs kept per repository - older ones are dropped when that size is exceeded
+	static constexpr size_t cMaxBlobsSize = 32 * 1024 * 1024;
 
-	_tcscpy_s(svnBase, _countof(svnBase), fullFilePath);
-	::PathRemoveFileSpec(svnBase);
+	void addBlob(std::string&& key, const std::shared_ptr<const GitFileContent>& content)
+	{
+		if (content->size() > cMaxBlobsSize)
+			return;
+
+		blobsSize += content->size();
 
-	bool ret = LocateDirUp(TEXT(".svn"), svnBase, svnTop, _countof(svnTop));
+		while (blobsSize > cMaxBlobsSize && !blobsOrder.empty())
+		{
+			auto oldest = blobs.find(blobsOrder.front());
 
-	if (ret)
+			blobsSize -= oldest->second->size();
+			blobs.erase(oldest);
+			blobsOrder.pop_front();
+		}
+
+		blobsOrder.push_back(key);
+		blobs.emplace(std::move(key), content);
+	}
+
+	git_repository*	repo {nullptr};
+	git_index*		index {nullptr};
+
+	// Work tree root in UTF-8 as LibGit2 returns it
+	std::string		workdir;
+
+	std::wstring	indexFile;
+	FILETIME		indexTime {};
+
+	std::unordered_map<std::string, std::shared_ptr<const GitFileContent>>	blobs;
+	std::deque<std::string>													blobsOrder;
+	size_t																	blobsSize {0};
+};
+
+
+/**
+ *  \class  GitRepoCache
+ *  \brief  Keeps the Git repositories open per work tree - opening the repository and reading its index is what
+ *          takes most of the Git diff time on big repositories and network shares
+ */
+class GitRepoCache
+{
+public:
+	~GitRepoCache()
 	{
-		ret = false;
+		clear();
+	}
+
+	// Returns the repository the file is in with its up to date index or nullptr if there is none
+	GitRepo* get(LibGit& gitLib, const char* filePath);
+
+	void clear();
+
+private:
+	bool open(LibGit& gitLib, const char* dir, GitRepo& repo);
+	void close(LibGit& gitLib, GitRepo& repo);
+
+	std::vector<std::unique_ptr<GitRepo>>		_repos;
+
+	// File directory to its repository
+	std::unordered_map<std::string, GitRepo*>	_dirRepos;
+};
 
-		TCHAR dotSvnIdx[MAX_PATH];
 
-		::PathCombine(dotSvnIdx, svnTop, TEXT(".svn"));
-		::PathCombine(svnBase, dotSvnIdx, TEXT("wc.db"));
+GitRepo* GitRepoCache::get(LibGit& gitLib, const char* filePath)
+{
+	char dir[MAX_PATH * 2];
+
+	strcpy_s(dir, sizeof(dir), filePath);
+	::PathRemoveFileSpecA(dir);
+
+	GitRepo* repo = nullptr;
 
-		// is it SVN 1.7 or above?
-		if (::PathFileExists(svnBase))
+	auto dirRepo = _dirRepos.find(dir);
+
+	if (dirRepo != _dirRepos.end())
+	{
+		repo = dirRepo->second;
+
+		FILETIME indexTime;
+
+		// Index changed since it was read - re-open the repository, the cached contents might be outdated too
+		if (!repo->repo || !getFileTime(repo->indexFile.c_str(), indexTime) ||
+			::CompareFileTime(&indexTime, &repo->indexTime) != 0)
 		{
-			if (!InitSQLite())
+			const std::string workdir = repo->workdir;
+
+			close(gitLib, *repo);
+
+			if (!open(gitLib, workdir.c_str(), *repo))
 			{
-				::MessageBox(nppData._nppHandle, TEXT("Failed to initialize SQLite - operation aborted."),
-						PLUGIN_NAME, MB_OK);
-				return false;
+				close(gitLib, *repo);
+				return nullptr;
 			}
+		}
 
-			sqlite3* ppDb;
+		return repo;
+	}
 
-			if (sqlite3_open16(svnBase, &ppDb) == SQLITE_OK)
-			{
-				RelativePath(fullFilePath, svnTop, svnBase, _countof(svnBase));
+	std::unique_ptr<GitRepo> newRepo(new GitRepo);
 
-				TCHAR sqlQuery[MAX_PATH + 64];
-				_sntprintf_s(sqlQuery, _countof(sqlQuery), _TRUNCATE,
-						TEXT("SELECT checksum FROM nodes_current WHERE local_relpath='%s';"), svnBase);
+	if (!open(gitLib, dir, *newRepo))
+	{
+		close(gitLib, *newRepo);
+		return nullptr;
+	}
 
-				sqlite3_stmt* pStmt;
+	// Another directory of an already opened work tree
+	for (auto& r : _repos)
+	{
+		if (r->repo && r->workdir == newRepo->workdir)
+		{
+			close(gitLib, *newRepo);
 
-				if (sqlite3_prepare16_v2(ppDb, sqlQuery, -1, &pStmt, NULL) == SQLITE_OK)
-				{
-					if (sqlite3_step(pStmt) == SQLITE_ROW)
-					{
-						const TCHAR* checksum = (const TCHAR*)sqlite3_column_text16(pStmt, 0);
+			_dirRepos.emplace(dir, r.get());
 
-						if (checksum[0] != 0)
-						{
-							TCHAR idx[128];
+			return r.get();
+		}
+	}
 
-							_tcsncpy_s(idx, _countof(idx), checksum + 6, 2);
+	repo = newRepo.get();
 
-							::PathCombine(svnBase, dotSvnIdx, TEXT("pristine"));
-							::PathCombine(dotSvnIdx, svnBase, idx);
+	_repos.emplace_back(std::move(newRepo));
+	_dirRepos.emplace(dir, repo);
 
-							_tcscpy_s(idx, _countof(idx), checksum + 6);
+	return repo;
+}
 
-							::PathCombine(svnBase, dotSvnIdx, idx);
-							_tcscat_s(svnBase, _countof(svnBase), TEXT(".svn-base"));
 
-							if (PathFileExists(svnBase))
-							{
-								_tcscpy_s(svnFile, svnFileSize, svnBase);
-								ret = true;
-							}
-						}
-					}
+bool GitRepoCache::open(LibGit& gitLib, const char* dir, GitRepo& repo)
+{
+	if (gitLib.repository_open_ext(&repo.repo, dir, 0, NULL))
+	{
+		repo.repo = nullptr;
+		return false;
+	}
 
-					sqlite3_finalize(pStmt);
-				}
+	const char* workdir = gitLib.repository_workdir(repo.repo);
 
-				sqlite3_close(ppDb);
-			}
+	if (!workdir)
+		return false;
+
+	repo.workdir = workdir;
+
+	{
+		std::string indexFile = gitLib.repository_path(repo.repo);
+		indexFile += "index";
+
+		const int len = ::MultiByteToWideChar(CP_UTF8, 0, indexFile.c_str(), -1, NULL, 0);
+
+		repo.indexFile.resize(len);
+		::MultiByteToWideChar(CP_UTF8, 0, indexFile.c_str(), -1, &repo.indexFile[0], len);
+	}
+
+	// Index time is taken before reading it so changes made meanwhile are not missed
+	if (!getFileTime(repo.indexFile.c_str(), repo.indexTime))
+		repo.indexTime = FILETIME {};
+
+	if (gitLib.repository_index(&repo.index, repo.repo))
+	{
+		repo.index = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+
+void GitRepoCache::close(LibGit& gitLib, GitRepo& repo)
+{
+	repo.blobs.clear();
+	repo.blobsOrder.clear();
+	repo.blobsSize = 0;
+
+	if (repo.index)
+		gitLib.index_free(repo.index);
+
+	if (repo.repo)
+		gitLib.repository_free(repo.repo);
+
+	repo.index	= nullptr;
+	repo.repo	= nullptr;
+}
+
+
+void GitRepoCache::clear()
+{
+	if (_repos.empty())
+		return;
+
+	std::unique_ptr<LibGit>& gitLib = LibGit::load();
+
+	if (gitLib)
+	{
+		for (auto& r : _repos)
+			close(*gitLib, *r);
+	}
+
+	_dirRepos.clear();
+	_repos.clear();
+}
+
+
+GitRepoCache gitRepos;
+
+
+// SVN working copy with its kept open database
+struct SvnWc
+{
+	// Working copy root and its .svn folder
+	std::wstring	root;
+	std::wstring	dotSvn;
+
+	sqlite3*		db {NULL};
+	sqlite3_stmt*	checksumStmt {NULL};
+};
+
+
+/**
+ *  \class  SvnWcCache
+ *  \brief  Keeps the found SVN working copies and their wc.db connections - locating the working copy root and
+ *          opening the database is what takes most of the SVN diff time on big working copies and network shares
+ */
+class SvnWcCache
+{
+public:
+	~SvnWcCache()
+	{
+		clear();
+	}
+
+	// Returns the working copy the directory is in or nullptr if there is none
+	SvnWc* get(const wchar_t* dir);
+
+	// Finds the pristine (base) file path of the file in the working copy
+	bool getPristine(SvnWc& wc, const wchar_t* fullFilePath, wchar_t* pristine, unsigned pristineSize);
+
+	void clear();
+
+private:
+	bool openDb(SvnWc& wc, const wchar_t* wcDb);
+	void closeDb(SvnWc& wc);
+
+	std::vector<std::unique_ptr<SvnWc>>			_wcs;
+
+	// File directory to its working copy
+	std::unordered_map<std::wstring, SvnWc*>	_dirWcs;
+};
+
+
+SvnWc* SvnWcCache::get(const wchar_t* dir)
+{
+	auto dirWc = _dirWcs.find(dir);
+
+	if (dirWc != _dirWcs.end())
+	{
+		if (::PathIsDirectory(dirWc->second->dotSvn.c_str()))
+			return dirWc->second;
+
+		// Working copy is gone - look for it again
+		closeDb(*dirWc->second);
+		_dirWcs.erase(dirWc);
+	}
+
+	wchar_t svnTop[MAX_PATH];
+
+	if (!LocateDirUp(L".svn", dir, svnTop, _countof(svnTop)))
+		return nullptr;
+
+	SvnWc* wc = nullptr;
+
+	for (auto& w : _wcs)
+	{
+		if (w->root == svnTop)
+		{
+			wc = w.get();
+			break;
 		}
-		else
+	}
+
+	if (!wc)
+	{
+		std::unique_ptr<SvnWc> newWc(new SvnWc);
+
+		wchar_t dotSvn[MAX_PATH];
+
+		::PathCombine(dotSvn, svnTop, L".svn");
+
+		newWc->root		= svnTop;
+		newWc->dotSvn	= dotSvn;
+
+		wc = newWc.get();
+
+		_wcs.emplace_back(std::move(newWc));
+	}
+
+	_dirWcs.emplace(dir, wc);
+
+	return wc;
+}
+
+
+bool SvnWcCache::getPristine(SvnWc& wc, const wchar_t* fullFilePath, wchar_t* pristine, unsigned pristineSize)
+{
+	wchar_t path[MAX_PATH];
+
+	::PathCombine(path, wc.dotSvn.c_str(), L"wc.db");
+
+	// is it SVN 1.7 or above?
+	if (!::PathFileExists(path))
+	{
+		closeDb(wc);
+
+		wchar_t textBase[MAX_PATH];
+
+		::PathCombine(textBase, wc.dotSvn.c_str(), L"text-base");
+		::PathCombine(path, textBase, ::PathFindFileName(fullFilePath));
+		_tcscat_s(path, _countof(path), L".svn-base");
+
+		// Is it an old SVN version?
+		if (!::PathFileExists(path))
+			return false;
+
+		_tcscpy_s(pristine, pristineSize, path);
+
+		return true;
+	}
+
+	if (!wc.db && !openDb(wc, path))
+		return false;
+
+	RelativePath(fullFilePath, wc.root.c_str(), path, _countof(path));
+
+	bool ret = false;
+	bool dbError = true;
+
+	if (sqlite3_bind_text16(wc.checksumStmt, 1, path, -1, SQLITE_STATIC) == SQLITE_OK)
+	{
+		const int res = sqlite3_step(wc.checksumStmt);
+
+		dbError = (res != SQLITE_ROW && res != SQLITE_DONE);
+
+		const wchar_t* checksum = (res == SQLITE_ROW) ?
+				static_cast<const wchar_t*>(sqlite3_column_text16(wc.checksumStmt, 0)) : nullptr;
+
+		// Checksum is "$sha1$" followed by the hash, the pristine is in a sub-folder named by the first two digits
+		if (checksum && wcslen(checksum) > 8)
 		{
-			::PathCombine(svnTop, dotSvnIdx, TEXT("text-base"));
+			wchar_t idx[128];
+
+			_tcsncpy_s(idx, _countof(idx), checksum + 6, 2);
 
-			const TCHAR* file = ::PathFindFileName(fullFilePath);
+			wchar_t pristineDir[MAX_PATH];
 
-			::PathCombine(svnBase, svnTop, file);
-			_tcscat_s(svnBase, _countof(svnBase), TEXT(".svn-base"));
+			::PathCombine(path, wc.dotSvn.c_str(), L"pristine");
+			::PathCombine(pristineDir, path, idx);
 
-			// Is it an old SVN version?
-			if (::PathFileExists(svnBase))
+			_tcscpy_s(idx, _countof(idx), checksum + 6);
+
+			::PathCombine(path, pristineDir, idx);
+			_tcscat_s(path, _countof(path), L".svn-base");
+
+			if (::PathFileExists(path))
 			{
-				_tcscpy_s(svnFile, svnFileSize, svnBase);
+				_tcscpy_s(pristine, pristineSize, path);
 				ret = true;
 			}
 		}
 	}
 
-	if (!ret)
-		::MessageBox(nppData._nppHandle, TEXT("No SVN data found."), PLUGIN_NAME, MB_OK);
+	// Statement reset releases the read lock - SVN should be free to update the database between the diffs
+	sqlite3_reset(wc.checksumStmt);
+
+	// Re-open the database on the next call, it might have been replaced
+	if (dbError)
+		closeDb(wc);
 
 	return ret;
 }
 
 
-std::vector<char> GetGitFileContent(const TCHAR* fullFilePath)
+bool SvnWcCache::openDb(SvnWc& wc, const wchar_t* wcDb)
 {
-	std::vector<char> gitFileContent;
+	char utf8Db[MAX_PATH * 3];
 
-	std::unique_ptr<LibGit>& gitLib = LibGit::load();
-	if (!gitLib)
+	TCharToChar(wcDb, utf8Db, sizeof(utf8Db));
+
+	if (sqlite3_open_v2(utf8Db, &wc.db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
 	{
-		::MessageBox(nppData._nppHandle, TEXT("Failed to initialize LibGit2 - operation aborted."),
+		closeDb(wc);
+		return false;
+	}
+
+	// SVN might be writing to the database right now
+	sqlite3_busy_timeout(wc.db, 1000);
+
+	if (sqlite3_prepare16_v2(wc.db, L"SELECT checksum FROM nodes_current WHERE local_relpath=?1;", -1,
+			&wc.checksumStmt, NULL) != SQLITE_OK)
+	{
+		closeDb(wc);
+		return false;
+	}
+
+	return true;
+}
+
+
+void SvnWcCache::closeDb(SvnWc& wc)
+{
+	if (wc.checksumStmt)
+		sqlite3_finalize(wc.checksumStmt);
+
+	if (wc.db)
+		sqlite3_close(wc.db);
+
+	wc.checksumStmt	= NULL;
+	wc.db			= NULL;
+}
+
+
+void SvnWcCache::clear()
+{
+	for (auto& w : _wcs)
+		closeDb(*w);
+
+	_dirWcs.clear();
+	_wcs.clear();
+}
+
+
+SvnWcCache svnWcs;
+
+
+// Returns empty content if the file cannot be read
+std::vector<char> readFileContent(const std::wstring& file)
+{
+	std::vector<char> content;
+
+	HANDLE hFile = ::CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+		return content;
+
+	LARGE_INTEGER fileSize;
+
+	if (::GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart > 0 && fileSize.QuadPart < INT_MAX)
+	{
+		content.resize(static_cast<size_t>(fileSize.QuadPart));
+
+		DWORD readBytes = 0;
+
+		if (!::ReadFile(hFile, content.data(), static_cast<DWORD>(content.size()), &readBytes, NULL))
+			content.clear();
+		else
+			content.resize(readBytes);
+	}
+
+	::CloseHandle(hFile);
+
+	return content;
+}
+
+} // anonymous namespace
+
+
+bool GetSvnFileContent(const TCHAR* fullFilePath, std::future<std::vector<char>>& svnContent)
+{
+	waitVcsLibsPrewarm();
+
+	if (!InitSQLite())
+	{
+		::MessageBox(nppData._nppHandle, TEXT("Failed to initialize SQLite - operation aborted."),
 				PLUGIN_NAME, MB_OK);
-		return gitFileContent;
+		return false;
 	}
 
-	git_repository* repo = NULL;
+	TCHAR svnFile[MAX_PATH];
 
-	char ansiGitFilePath[MAX_PATH];
+	_tcscpy_s(svnFile, _countof(svnFile), fullFilePath);
+	::PathRemoveFileSpec(svnFile);
 
+	SvnWc* wc = svnWcs.get(svnFile);
+
+	if (!wc || !svnWcs.getPristine(*wc, fullFilePath, svnFile, _countof(svnFile)))
 	{
-		char ansiPath[MAX_PATH * 2];
+		::MessageBox(nppData._nppHandle, TEXT("No SVN data found."), PLUGIN_NAME, MB_OK);
+		return false;
+	}
 
-		TCharToChar(fullFilePath, ansiPath, sizeof(ansiPath));
-		::PathRemoveFileSpecA(ansiPath);
+	const std::wstring pristine(svnFile);
 
-		if (!gitLib->repository_open_ext(&repo, ansiPath, 0, NULL))
-		{
-			const char* ansiGitDir = gitLib->repository_workdir(repo);
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	try
+	{
+		svnContent = std::async(std::launch::async, readFileContent, pristine);
+
+		return true;
+	}
+	catch (...)
+	{
+	}
+#endif // MULTITHREAD
 
-			//reinit with fullFilePath after modification by PathRemoveFileSpecA(), needed to get the relative path
-			TCharToChar(fullFilePath, ansiPath, sizeof(ansiPath));
+	svnContent = std::async(std::launch::deferred, readFileContent, pristine);
 
-			RelativePath(ansiPath, ansiGitDir, ansiGitFilePath, sizeof(ansiGitFilePath));
-		}
+	return true;
+}
+
+
+GitFileContent::~GitFileContent()
+{
+	std::unique_ptr<LibGit>& gitLib = LibGit::load();
+
+	if (gitLib)
+	{
+		git_buf gitBuf = { _ptr, _allocSize, _size };
+
+		gitLib->buf_free(&gitBuf);
+	}
+}
+
+
+std::shared_ptr<const GitFileContent> GetGitFileContent(const TCHAR* fullFilePath)
+{
+	waitVcsLibsPrewarm();
+
+	std::unique_ptr<LibGit>& gitLib = LibGit::load();
+	if (!gitLib)
+	{
+		::MessageBox(nppData._nppHandle, TEXT("Failed to initialize LibGit2 - operation aborted."),
+				PLUGIN_NAME, MB_OK);
+		return nullptr;
 	}
 
+	std::shared_ptr<const GitFileContent> content;
+
+	char ansiPath[MAX_PATH * 2];
+
+	TCharToChar(fullFilePath, ansiPath, sizeof(ansiPath));
+
+	GitRepo* repo = gitRepos.get(*gitLib, ansiPath);
+
 	if (repo)
 	{
-		git_index* index;
+		char ansiGitFilePath[MAX_PATH];
 
-		if (!gitLib->repository_index(&index, repo))
+		RelativePath(ansiPath, repo->workdir.c_str(), ansiGitFilePath, sizeof(ansiGitFilePath));
+
+		const git_index_entry* e = gitLib->index_get_bypath(repo->index, ansiGitFilePath, 0);
+
+		if (e)
 		{
-			const git_index_entry* e = gitLib->index_get_bypath(index, ansiGitFilePath, 0);
+			// Filtering depends on the file path attributes
+			std::string blobKey(reinterpret_cast<const char*>(e->id.id), sizeof(e->id.id));
+			blobKey += ansiGitFilePath;
 
-			if (e)
-			{
-				git_blob* blob;
+			auto cached = repo->blobs.find(blobKey);
 
-				if (!gitLib->blob_lookup(&blob, repo, &e->id))
-				{
-					git_buf gitBuf = { 0 };
+			if (cached != repo->blobs.end())
+				return cached->second;
 
-					if (!gitLib->blob_filtered_content(&gitBuf, blob, ansiGitFilePath, 1))
-					{
-						gitFileContent.resize(gitBuf.size + 1, 0);
-						std::memcpy(gitFileContent.data(), gitBuf.ptr, gitBuf.size);
+			git_blob* blob;
 
-						gitLib->buf_free(&gitBuf);
-					}
+			if (!gitLib->blob_lookup(&blob, repo->repo, &e->id))
+			{
+				git_buf gitBuf = { 0 };
 
-					gitLib->blob_free(blob);
+				if (!gitLib->blob_filtered_content(&gitBuf, blob, ansiGitFilePath, 1))
+				{
+					if (gitBuf.ptr)
+						content = std::make_shared<const GitFileContent>(gitBuf.ptr, gitBuf.asize, gitBuf.size);
+					else
+						gitLib->buf_free(&gitBuf);
 				}
+
+				gitLib->blob_free(blob);
 			}
 
-			gitLib->index_free(index);
+			if (content)
+				repo->addBlob(std::move(blobKey), content);
 		}
-
-		gitLib->repository_free(repo);
 	}
 
-	if (gitFileContent.empty())
+	if (!content)
 		::MessageBox(nppData._nppHandle, TEXT("No Git data found."), PLUGIN_NAME, MB_OK);
 
-	return gitFileContent;
+	return content;
+}
+
+
+void PrewarmVcsLibs()
+{
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	if (vcsLibsPrewarm.valid())
+		return;
+
+	const bool loadGit = isGITlibFound();
+	const bool loadSQLite = isSQLlibFound();
+
+	if (!loadGit && !loadSQLite)
+		return;
+
+	try
+	{
+		vcsLibsPrewarm = std::async(std::launch::async,
+			[loadGit, loadSQLite]()
+			{
+				// Failures are reported by the VCS functions when the libraries are actually needed
+				if (loadGit)
+					LibGit::load();
+
+				if (loadSQLite)
+					InitSQLite();
+			});
+	}
+	catch (...)
+	{
+	}
+#endif // MULTITHREAD
+}
+
+
+void ClearVcsCaches()
+{
+	waitVcsLibsPrewarm();
+
+	gitRepos.clear();
+	svnWcs.clear();
 }
@@ -22,9 +22,59 @@
 #include <windows.h>
 #include <tchar.h>
 #include <vector>
+#include <memory>
+
+#if defined(__MINGW32__) && !defined(_GLIBCXX_HAS_GTHREADS)
+#include "mingw-std-threads/mingw.future.h"
+#else
+#include <future>
+#endif // __MINGW32__ ...
+
+
+/**
+ *  \class  GitFileContent
+ *  \brief  File text in the buffer LibGit2 has filtered it into - zero terminated, kept as is to avoid copying it
+ */
+class GitFileContent
+{
+public:
+	GitFileContent(char* ptr, size_t allocSize, size_t size) : _ptr(ptr), _allocSize(allocSize), _size(size) {}
+	~GitFileContent();
+
+	GitFileContent(const GitFileContent&) = delete;
+	GitFileContent& operator=(const GitFileContent&) = delete;
+
+	inline const char* data() const
+	{
+		return _ptr;
+	}
+
+	inline size_t size() const
+	{
+		return _size;
+	}
+
+private:
+	char*	_ptr;
+	size_t	_allocSize;
+	size_t	_size;
+};
+
 
 bool isSQLlibFound();
 bool isGITlibFound();
 
-bool GetSvnFile(const TCHAR* fullFilePath, TCHAR* svnFile, unsigned svnFileSize);
-std::vector<char> GetGitFileContent(const TCHAR* fullFilePath);
+// Finds the file SVN base and starts reading it in the background - the content is empty if it cannot be read.
+// The working copies roots and their databases are kept open between the calls.
+bool GetSvnFileContent(const TCHAR* fullFilePath, std::future<std::vector<char>>& svnContent);
+
+// Returns the file content in the Git index or nullptr if not found. The repositories are kept open and the contents
+// cached by blob id between the calls - they are dropped when the repository index file changes.
+std::shared_ptr<const GitFileContent> GetGitFileContent(const TCHAR* fullFilePath);
+
+// Starts loading and initializing the found Git and SVN libraries in the background so the first Git/SVN diff doesn't
+// pay for it. The VCS functions above wait for it to finish before using the libraries.
+void PrewarmVcsLibs();
+
+// Closes the kept open repositories and databases - to be called before the plugin is unloaded
+void ClearVcsCaches();
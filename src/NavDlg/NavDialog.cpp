@@ -34,6 +34,23 @@
 #include <algorithm>
 
 
+namespace // anonymous namespace
+{
+
+// Returns the marker brush index of the line marker mask or -1 if the line is drawn in the default color
+inline int markerBrushIdx(int mask)
+{
+	if (mask & MARKER_MASK_ADDED)		return 0;
+	if (mask & MARKER_MASK_REMOVED)		return 1;
+	if (mask & MARKER_MASK_MOVED)		return 2;
+	if (mask & MARKER_MASK_CHANGED)		return 3;
+
+	return -1;
+}
+
+}
+
+
 const int NavDialog::cSpace = 0;
 const int NavDialog::cScrollerWidth = 20;
 
@@ -63,6 +80,9 @@ void NavDialog::NavView::reset()
 {
 	m_lineMap.clear();
 
+	m_selTop	= -1;
+	m_selBottom	= -1;
+
 	if (m_hViewDC)
 	{
 		::DeleteDC(m_hViewDC);
@@ -130,6 +150,36 @@ void NavDialog::NavView::paint(HDC hDC, int xPos, int yPos, int width, int heigh
 	// Fill view
 	::StretchBlt(hDC, r.left + 1, r.top + 1, width, h, m_hViewDC, 0, hOffset, 1, h / hScale, SRCCOPY);
 
+	// Selector is out of scope so don't draw it
+	if (!getSelectorSpan(yPos, height, hScale, hOffset, m_selTop, m_selBottom))
+	{
+		m_selTop	= -1;
+		m_selBottom	= -1;
+
+		return;
+	}
+
+	r.top		= m_selTop;
+	r.bottom	= m_selBottom;
+
+	::Rectangle(hDC, r.left, r.top, r.right, r.bottom);
+
+	BLENDFUNCTION blend = { 0 };
+	blend.BlendOp = AC_SRC_OVER;
+	blend.SourceConstantAlpha = 80;
+
+	::AlphaBlend(hDC, r.left + 1, r.top + 1, width, r.bottom - r.top - 2, m_hSelDC, 0, 0, 1, 1, blend);
+}
+
+
+bool NavDialog::NavView::getSelectorSpan(int yPos, int height, int hScale, int hOffset, int& top, int& bottom) const
+{
+	const int usefulHeight = (maxBmpLines() - hOffset) * hScale;
+
+	int h = (height - usefulHeight) > 0 ? usefulHeight : height;
+	if (h <= 0)
+		return false;
+
 	intptr_t firstVisible	= CallScintilla(m_view, SCI_DOCLINEFROMVISIBLE, m_firstVisible, 0);
 	intptr_t lastVisible	= m_firstVisible + CallScintilla(m_view, SCI_LINESONSCREEN, 0, 0);
 
@@ -143,9 +193,8 @@ void NavDialog::NavView::paint(HDC hDC, int xPos, int yPos, int width, int heigh
 
 	h /= hScale;
 
-	// Selector is out of scope so don't draw it
 	if (firstVisible > hOffset + h || lastVisible < hOffset)
-		return;
+		return false;
 
 	if (firstVisible < hOffset)
 		firstVisible = hOffset;
@@ -156,17 +205,10 @@ void NavDialog::NavView::paint(HDC hDC, int xPos, int yPos, int width, int heigh
 	firstVisible	*= hScale;
 	lastVisible		*= hScale;
 
-	r.top		= static_cast<int>(firstVisible + yPos - hOffset);
-	r.bottom	= static_cast<int>(lastVisible + yPos - hOffset + 2);
-
-	::Rectangle(hDC, r.left, r.top, r.right, r.bottom);
-
-	BLENDFUNCTION blend = { 0 };
-	blend.BlendOp = AC_SRC_OVER;
-	blend.SourceConstantAlpha = 80;
+	top		= static_cast<int>(firstVisible + yPos - hOffset);
+	bottom	= static_cast<int>(lastVisible + yPos - hOffset + 2);
 
-	::AlphaBlend(hDC, r.left + 1, r.top + 1, width, static_cast<int>(lastVisible - firstVisible),
-			m_hSelDC, 0, 0, 1, 1, blend);
+	return true;
 }
 
 
@@ -258,12 +300,49 @@ void NavDialog::Update()
 	}
 	else
 	{
+		const int scrollOffset =
+				(m_hScroll && ::IsWindowVisible(m_hScroll)) ? ::GetScrollPos(m_hScroll, SB_CTL) : 0;
+
 		m_view[0].updateFirstVisible();
 		m_view[1].updateFirstVisible();
 
-		updateScroll();
+		if (updateScroll() != scrollOffset)
+		{
+			::InvalidateRect(_hSelf, NULL, FALSE);
+			return;
+		}
+
+		// Only the selectors have moved - repaint just the bands they leave and enter
+		RECT r;
+		::GetClientRect(_hSelf, &r);
+
+		for (NavView& view : m_view)
+		{
+			int top;
+			int bottom;
+
+			if (!view.getSelectorSpan(cSpace, m_navHeight, m_pixelsPerLine, scrollOffset, top, bottom))
+				top = bottom = -1;
+
+			if ((top == view.m_selTop) && (bottom == view.m_selBottom))
+				continue;
+
+			if (view.m_selTop >= 0)
+			{
+				r.top		= view.m_selTop;
+				r.bottom	= view.m_selBottom;
+
+				::InvalidateRect(_hSelf, &r, FALSE);
+			}
 
-		::InvalidateRect(_hSelf, NULL, FALSE);
+			if (top >= 0)
+			{
+				r.top		= top;
+				r.bottom	= bottom;
+
+				::InvalidateRect(_hSelf, &r, FALSE);
+			}
+		}
 	}
 }
 
@@ -356,6 +435,14 @@ void NavDialog::createBitmaps()
 	m_hBackBrush				= ::CreateSolidBrush(m_clr._default);
 	HBRUSH hInverseBackBrush	= ::CreateSolidBrush(m_clr._default ^ 0xFFFFFF);
 
+	HBRUSH hMarkerBrushes[] =
+	{
+		::CreateSolidBrush(m_clr.added),
+		::CreateSolidBrush(m_clr.removed),
+		::CreateSolidBrush(m_clr.moved),
+		::CreateSolidBrush(m_clr.changed)
+	};
+
 	for (int viewId = 0; viewId < 2; ++viewId)
 	{
 		bmpRect.bottom = 1;
@@ -365,54 +452,126 @@ void NavDialog::createBitmaps()
 		bmpRect.bottom = static_cast<int>(m_view[viewId].m_lines);
 		::FillRect(m_view[viewId].m_hViewDC, &bmpRect, m_hBackBrush);
 
-		m_view[viewId].m_lineMap.clear();
+		const int view = m_view[viewId].m_view;
 
-		intptr_t skipLine	= reductionRatio;
-		int prevMarker		= m_clr._default;
-		int bmpLine			= 0;
+		const DiffMap_t* diffMap = getNavDiffMap(view);
 
-		for (intptr_t i = 0; i < m_view[viewId].m_lines; ++i)
-		{
-			int marker = static_cast<int>(CallScintilla(m_view[viewId].m_view, SCI_MARKERGET, i, 0));
-			if (!marker && !reductionRatio)
-				continue;
-
-			if (marker & MARKER_MASK_ADDED)			marker = m_clr.added;
-			else if (marker & MARKER_MASK_REMOVED)	marker = m_clr.removed;
-			else if (marker & MARKER_MASK_MOVED)	marker = m_clr.moved;
-			else if (marker & MARKER_MASK_CHANGED)	marker = m_clr.changed;
-			else if (reductionRatio)				marker = m_clr._default;
-			else
-				continue;
+		DiffMap_t markedLines;
 
-			if (reductionRatio)
+		// No up-to-date compare results - collect the marked lines runs from the view
+		if (diffMap == nullptr)
+		{
+			for (intptr_t line = CallScintilla(view, SCI_MARKERNEXT, 0, MARKER_MASK_LINE); line >= 0;
+					line = CallScintilla(view, SCI_MARKERNEXT, line + 1, MARKER_MASK_LINE))
 			{
-				if (prevMarker == marker)
-					--skipLine;
-
-				if (prevMarker != marker || !skipLine)
-				{
-					skipLine = reductionRatio;
-					prevMarker = marker;
-
-					m_view[viewId].m_lineMap.push_back(i);
+				const int mask = static_cast<int>(CallScintilla(view, SCI_MARKERGET, line, 0));
 
-					::SetPixel(m_view[viewId].m_hViewDC, 0, bmpLine++, marker);
-				}
-			}
-			else
-			{
-				::SetPixel(m_view[viewId].m_hViewDC, 0, static_cast<int>(i), marker);
+				if (!markedLines.empty() && (markedLines.back().mask == mask) &&
+						(markedLines.back().line + markedLines.back().len == line))
+					++markedLines.back().len;
+				else
+					markedLines.push_back({ line, 1, mask });
 			}
+
+			diffMap = &markedLines;
 		}
+
+		drawViewBitmap(m_view[viewId], *diffMap, reductionRatio, hMarkerBrushes);
 	}
 
+	for (HBRUSH hBrush : hMarkerBrushes)
+		::DeleteObject(hBrush);
+
 	::DeleteObject(hInverseBackBrush);
 
 	setScalingFactor();
 }
 
 
+void NavDialog::drawViewBitmap(NavView& view, const DiffMap_t& diffMap, intptr_t reductionRatio,
+	HBRUSH hMarkerBrushes[])
+{
+	view.m_lineMap.clear();
+
+	RECT rowsRect = { 0 };
+	rowsRect.right = 1;
+
+	// A bitmap line per document line - just fill the marked runs, the rest is already in background color
+	if (!reductionRatio)
+	{
+		for (const auto& run: diffMap)
+		{
+			if (run.line >= view.m_lines)
+				break;
+
+			const int brushIdx = markerBrushIdx(run.mask);
+			if (brushIdx < 0)
+				continue;
+
+			rowsRect.top	= static_cast<int>(run.line);
+			rowsRect.bottom	= static_cast<int>(std::min(run.line + run.len, view.m_lines));
+
+			::FillRect(view.m_hViewDC, &rowsRect, hMarkerBrushes[brushIdx]);
+		}
+
+		return;
+	}
+
+	// Reduced bitmap - a color change always gets a bitmap line and lines of the same color are sampled once per
+	// reductionRatio lines. m_lineMap keeps the document line of each bitmap line.
+	int			bmpLine			= 0;
+	int			prevBrushIdx	= -1;
+	intptr_t	nextSample		= reductionRatio - 1;
+
+	auto addSegment = [&](intptr_t startLine, intptr_t endLine, int brushIdx)
+	{
+		if (startLine >= endLine)
+			return;
+
+		if (brushIdx != prevBrushIdx)
+		{
+			prevBrushIdx	= brushIdx;
+			nextSample		= startLine;
+		}
+
+		const int firstBmpLine = bmpLine;
+
+		for (; nextSample < endLine; nextSample += reductionRatio, ++bmpLine)
+			view.m_lineMap.push_back(nextSample);
+
+		if ((brushIdx >= 0) && (bmpLine > firstBmpLine))
+		{
+			rowsRect.top	= firstBmpLine;
+			rowsRect.bottom	= bmpLine;
+
+			::FillRect(view.m_hViewDC, &rowsRect, hMarkerBrushes[brushIdx]);
+		}
+	};
+
+	intptr_t line = 0;
+
+	for (const auto& run: diffMap)
+	{
+		if (run.line >= view.m_lines)
+			break;
+
+		// Runs of lines carrying several marks might overlap
+		const intptr_t startLine	= std::max(run.line, line);
+		const intptr_t endLine		= std::min(run.line + run.len, view.m_lines);
+
+		if (startLine >= endLine)
+			continue;
+
+		addSegment(line, startLine, -1);
+		addSegment(startLine, endLine, markerBrushIdx(run.mask));
+
+		line = endLine;
+	}
+
+	addSegment(line, view.m_lines, -1);
+}
+
+
 void NavDialog::showScroller(RECT& r)
 {
 	const int x = r.right - cSpace - cScrollerWidth;
@@ -20,6 +20,7 @@
 #pragma once
 
 #include "Compare.h"
+#include "Engine.h"
 #include "DockingFeature/Window.h"
 #include "DockingFeature/DockingDlgInterface.h"
 
@@ -27,6 +28,10 @@
 #include <vector>
 
 
+// Returns the diff map of the view if the active compare results are up to date, nullptr otherwise
+const DiffMap_t* getNavDiffMap(int view);
+
+
 class NavDialog : public DockingDlgInterface
 {
 public:
@@ -70,7 +75,8 @@ private:
 	 */
 	struct NavView
 	{
-		NavView() : m_view(0), m_hViewDC(NULL), m_hSelDC(NULL), m_hViewBMP(NULL), m_hSelBMP(NULL) {}
+		NavView() : m_view(0), m_hViewDC(NULL), m_hSelDC(NULL), m_hViewBMP(NULL), m_hSelBMP(NULL),
+				m_selTop(-1), m_selBottom(-1) {}
 
 		~NavView()
 		{
@@ -82,6 +88,8 @@ private:
 		void paint(HDC hDC, int xPos, int yPos, int width, int height, int heightTotal,
 				int hScale, int hOffset, bool shrinkLeftSideOfEmptyArea, int backColor);
 
+		bool getSelectorSpan(int yPos, int height, int hScale, int hOffset, int& top, int& bottom) const;
+
 		void updateFirstVisible()
 		{
 			m_firstVisible = CallScintilla(m_view, SCI_GETFIRSTVISIBLELINE, 0, 0);
@@ -117,12 +125,17 @@ private:
 		intptr_t	m_firstVisible;
 		intptr_t	m_lines;
 
+		// Vertical span of the last painted selector, -1 if not painted
+		int			m_selTop;
+		int			m_selBottom;
+
 		std::vector<intptr_t>	m_lineMap;
 	};
 
 	void doDialog();
 
 	void createBitmaps();
+	void drawViewBitmap(NavView& view, const DiffMap_t& diffMap, intptr_t reductionRatio, HBRUSH hMarkerBrushes[]);
 	void showScroller(RECT& r);
 
 	void setScalingFactor();
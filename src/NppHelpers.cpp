@@ -513,6 +513,26 @@ void markTextAsChanged(int view, intptr_t start, intptr_t length, int color)
 }
 
 
+// Marks all ranges (pairs of start position and length) setting the indicator only once
+void markTextAsChanged(int view, const std::vector<std::pair<intptr_t, intptr_t>>& ranges, int color)
+{
+	if (ranges.empty())
+		return;
+
+	const int curIndic = static_cast<int>(CallScintilla(view, SCI_GETINDICATORCURRENT, 0, 0));
+	CallScintilla(view, SCI_SETINDICATORCURRENT, INDIC_HIGHLIGHT, 0);
+	CallScintilla(view, SCI_SETINDICATORVALUE, color | SC_INDICVALUEBIT, 0);
+
+	for (const auto& range: ranges)
+	{
+		if (range.second > 0)
+			CallScintilla(view, SCI_INDICATORFILLRANGE, range.first, range.second);
+	}
+
+	CallScintilla(view, SCI_SETINDICATORCURRENT, curIndic, 0);
+}
+
+
 void clearChangedIndicator(int view, intptr_t start, intptr_t length)
 {
 	if (length > 0)
@@ -545,27 +565,6 @@ std::vector<char> getText(int view, intptr_t startPos, intptr_t endPos)
 }
 
 
-void toLowerCase(std::vector<char>& text, int codepage)
-{
-	const int len = static_cast<int>(text.size());
-
-	if (len == 0)
-		return;
-
-	const int wLen = ::MultiByteToWideChar(codepage, 0, text.data(), len, NULL, 0);
-
-	std::vector<wchar_t> wText(wLen);
-
-	::MultiByteToWideChar(codepage, 0, text.data(), len, wText.data(), wLen);
-
-	wText.push_back(L'\0');
-	::CharLowerW((LPWSTR)wText.data());
-	wText.pop_back();
-
-	::WideCharToMultiByte(codepage, 0, wText.data(), wLen, text.data(), len, NULL, NULL);
-}
-
-
 void clearWindow(int view)
 {
 	CallScintilla(view, SCI_FOLDALL, SC_FOLDACTION_EXPAND, 0);
@@ -757,7 +756,7 @@ void hideOutsideRange(int view, intptr_t startLine, intptr_t endLine)
 }
 
 
-void hideUnmarked(int view, int markMask)
+void hideUnmarked(int view, int markMask, intptr_t contextLines)
 {
 	const intptr_t linesCount = CallScintilla(view, SCI_GETLINECOUNT, 0, 0);
 
@@ -775,7 +774,20 @@ void hideUnmarked(int view, int markMask)
 		if (nextMarkedLine < 0)
 			nextMarkedLine = linesCount;
 
-		CallScintilla(view, SCI_HIDELINES, nextUnmarkedLine, nextMarkedLine - 1);
+		intptr_t hideStart	= nextUnmarkedLine;
+		intptr_t hideEnd	= nextMarkedLine - 1;
+
+		if (contextLines)
+		{
+			if ((hideStart > 1) || isLineMarked(view, 0, markMask))
+				hideStart += contextLines;
+
+			if (nextMarkedLine < linesCount)
+				hideEnd -= contextLines;
+		}
+
+		if (hideStart <= hideEnd)
+			CallScintilla(view, SCI_HIDELINES, hideStart, hideEnd);
 	}
 }
 
@@ -24,65 +24,9 @@
 #include <utility>
 
 #include "Compare.h"
+#include "DiffMarkers.h"
 
 
-enum Marker_t
-{
-	MARKER_CHANGED_LINE = 0,
-	MARKER_ADDED_LINE,
-	MARKER_REMOVED_LINE,
-	MARKER_MOVED_LINE,
-	MARKER_BLANK,
-	MARKER_CHANGED_SYMBOL,
-	MARKER_CHANGED_LOCAL_SYMBOL,
-	MARKER_ADDED_SYMBOL,
-	MARKER_ADDED_LOCAL_SYMBOL,
-	MARKER_REMOVED_SYMBOL,
-	MARKER_REMOVED_LOCAL_SYMBOL,
-	MARKER_MOVED_LINE_SYMBOL,
-	MARKER_MOVED_BLOCK_BEGIN_SYMBOL,
-	MARKER_MOVED_BLOCK_MID_SYMBOL,
-	MARKER_MOVED_BLOCK_END_SYMBOL,
-	MARKER_ARROW_SYMBOL
-};
-
-
-constexpr int MARKER_MASK_CHANGED		=	(1 << MARKER_CHANGED_LINE)	|	(1 << MARKER_CHANGED_SYMBOL);
-constexpr int MARKER_MASK_CHANGED_LOCAL	=	(1 << MARKER_CHANGED_LINE)	|	(1 << MARKER_CHANGED_LOCAL_SYMBOL);
-constexpr int MARKER_MASK_ADDED			=	(1 << MARKER_ADDED_LINE)	|	(1 << MARKER_ADDED_SYMBOL);
-constexpr int MARKER_MASK_ADDED_LOCAL	=	(1 << MARKER_ADDED_LINE)	|	(1 << MARKER_ADDED_LOCAL_SYMBOL);
-constexpr int MARKER_MASK_REMOVED		=	(1 << MARKER_REMOVED_LINE)	|	(1 << MARKER_REMOVED_SYMBOL);
-constexpr int MARKER_MASK_REMOVED_LOCAL	=	(1 << MARKER_REMOVED_LINE)	|	(1 << MARKER_REMOVED_LOCAL_SYMBOL);
-constexpr int MARKER_MASK_MOVED_LINE	=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_LINE_SYMBOL);
-constexpr int MARKER_MASK_MOVED_BEGIN	=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_BLOCK_BEGIN_SYMBOL);
-constexpr int MARKER_MASK_MOVED_MID		=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_BLOCK_MID_SYMBOL);
-constexpr int MARKER_MASK_MOVED_END		=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_BLOCK_END_SYMBOL);
-constexpr int MARKER_MASK_MOVED			=	(1 << MARKER_MOVED_LINE)	|	(1 << MARKER_MOVED_LINE_SYMBOL) |
-																			(1 << MARKER_MOVED_BLOCK_BEGIN_SYMBOL) |
-																			(1 << MARKER_MOVED_BLOCK_MID_SYMBOL) |
-																			(1 << MARKER_MOVED_BLOCK_END_SYMBOL);
-
-constexpr int MARKER_MASK_BLANK			=	(1 << MARKER_BLANK);
-constexpr int MARKER_MASK_ARROW			=	(1 << MARKER_ARROW_SYMBOL);
-
-constexpr int MARKER_MASK_LINE			=	(1 << MARKER_CHANGED_LINE) |
-											(1 << MARKER_ADDED_LINE) |
-											(1 << MARKER_REMOVED_LINE) |
-											(1 << MARKER_MOVED_LINE);
-
-constexpr int MARKER_MASK_SYMBOL		=	(1 << MARKER_CHANGED_SYMBOL) |
-											(1 << MARKER_CHANGED_LOCAL_SYMBOL) |
-											(1 << MARKER_ADDED_SYMBOL) |
-											(1 << MARKER_ADDED_LOCAL_SYMBOL) |
-											(1 << MARKER_REMOVED_SYMBOL) |
-											(1 << MARKER_REMOVED_LOCAL_SYMBOL) |
-											(1 << MARKER_MOVED_LINE_SYMBOL) |
-											(1 << MARKER_MOVED_BLOCK_BEGIN_SYMBOL) |
-											(1 << MARKER_MOVED_BLOCK_MID_SYMBOL) |
-											(1 << MARKER_MOVED_BLOCK_END_SYMBOL);
-
-constexpr int MARKER_MASK_ALL			=	MARKER_MASK_LINE | MARKER_MASK_SYMBOL;
-
 constexpr int MARGIN_NUM = 4;
 
 
@@ -200,6 +144,37 @@ private:
 };
 
 
+/**
+ *  \struct
+ *  \brief    Suppresses the view redraw and modification notifications - used when setting many marks at once
+ *  \warning  Don't use that helper struct if somewhere in its scope the view document is changed!!!
+ */
+struct ScopedViewRedrawBlocker
+{
+	ScopedViewRedrawBlocker(int view) : _view(view),
+		_hView((view == MAIN_VIEW) ? nppData._scintillaMainHandle : nppData._scintillaSecondHandle)
+	{
+		_modEventMask = CallScintilla(_view, SCI_GETMODEVENTMASK, 0, 0);
+
+		CallScintilla(_view, SCI_SETMODEVENTMASK, SC_MOD_NONE, 0);
+		::SendMessage(_hView, WM_SETREDRAW, FALSE, 0);
+	}
+
+	~ScopedViewRedrawBlocker()
+	{
+		::SendMessage(_hView, WM_SETREDRAW, TRUE, 0);
+		::InvalidateRect(_hView, NULL, TRUE);
+
+		CallScintilla(_view, SCI_SETMODEVENTMASK, _modEventMask, 0);
+	}
+
+private:
+	int			_view;
+	HWND		_hView;
+	LRESULT		_modEventMask;
+};
+
+
 /**
  *  \struct
  *  \brief
@@ -399,6 +374,20 @@ inline LRESULT getCurrentBuffId()
 }
 
 
+// Notepad++ buffer encodings as returned by NPPM_GETBUFFERENCODING
+enum UniMode
+{
+	uni8Bit = 0,
+	uniUTF8,
+	uni16BE,
+	uni16LE,
+	uniCookie,
+	uni7Bit,
+	uni16BE_NoBOM,
+	uni16LE_NoBOM
+};
+
+
 inline int getEncoding(LRESULT buffId)
 {
 	return static_cast<int>(::SendMessage(nppData._nppHandle, NPPM_GETBUFFERENCODING, buffId, 0));
@@ -659,6 +648,7 @@ void blinkRange(int view, intptr_t startPos, intptr_t endPos);
 void centerAt(int view, intptr_t line);
 
 void markTextAsChanged(int view, intptr_t start, intptr_t length, int color);
+void markTextAsChanged(int view, const std::vector<std::pair<intptr_t, intptr_t>>& ranges, int color);
 void clearChangedIndicator(int view, intptr_t start, intptr_t length);
 
 void setNormalView(int view);
@@ -690,7 +680,7 @@ void setMarkers(int view, intptr_t startLine, const std::vector<int> &markers);
 
 void showRange(int view, intptr_t line, intptr_t length);
 void hideOutsideRange(int view, intptr_t startLine, intptr_t endLine);
-void hideUnmarked(int view, int markMask);
+void hideUnmarked(int view, int markMask, intptr_t contextLines = 0);
 
 bool isAdjacentAnnotation(int view, intptr_t line, bool down);
 bool isAdjacentAnnotationVisible(int view, intptr_t line, bool down);
@@ -705,7 +695,6 @@ inline void clearAnnotation(int view, intptr_t line)
 void clearAnnotations(int view, intptr_t startLine, intptr_t length);
 
 std::vector<char> getText(int view, intptr_t startPos, intptr_t endPos);
-void toLowerCase(std::vector<char>& text, int codepage = CP_UTF8);
 
 void addBlankSection(int view, intptr_t line, intptr_t length, intptr_t selectionMarkPosition = 0,
 		const char *text = nullptr);
@@ -20,6 +20,7 @@
 
 #include <windowsx.h>
 #include <cstdlib>
+#include <algorithm>
 
 #include "Compare.h"
 #include "ProgressDlg.h"
@@ -39,14 +40,15 @@ const int ProgressDlg::cPhases[] = {
 	10,		// Docs2 hashes
 	20,		// Docs diff
 	90,		// Blocks diff
-	100,	// Results colorization and presentation
+	95,		// Results collection and alignment
+	100,	// Results colorization (marks application)
 };
 
 
 progress_ptr ProgressDlg::Inst;
 
 
-progress_ptr& ProgressDlg::Open(const TCHAR* info)
+progress_ptr& ProgressDlg::Open(const TCHAR* info, bool disableNpp)
 {
 	if (Inst)
 		return Inst;
@@ -61,7 +63,11 @@ progress_ptr& ProgressDlg::Open(const TCHAR* info)
 		}
 		else
 		{
-			::EnableWindow(nppData._nppHandle, FALSE);
+			if (disableNpp)
+			{
+				::EnableWindow(nppData._nppHandle, FALSE);
+				Inst->_nppDisabled = true;
+			}
 
 			if (info)
 				Inst->SetInfo(info);
@@ -86,17 +92,11 @@ void ProgressDlg::Show() const
 			::UpdateWindow(_hwnd);
 		}
 
-		::KillTimer(_hwnd, 1);
+		::KillTimer(_hwnd, cShowTimerId);
 	}
 }
 
 
-bool ProgressDlg::IsCancelled() const
-{
-	return (::WaitForSingleObject(_hActiveState, 0) != WAIT_OBJECT_0);
-}
-
-
 unsigned ProgressDlg::NextPhase()
 {
 	if (IsCancelled())
@@ -140,31 +140,14 @@ bool ProgressDlg::SetCount(intptr_t cnt, unsigned phase)
 		return false;
 
 	if ((phase == 0 || phase - 1 == _phase) && _count < cnt && cnt <= _max)
-	{
 		_count = cnt;
-		update();
-	}
-
-	return true;
-}
-
-
-bool ProgressDlg::Advance(intptr_t cnt, unsigned phase)
-{
-	if (IsCancelled())
-		return false;
-
-	if (phase == 0 || phase - 1 == _phase)
-	{
-		_count += cnt;
-		update();
-	}
 
 	return true;
 }
 
 
-ProgressDlg::ProgressDlg() : _hwnd(NULL),  _hKeyHook(NULL),
+ProgressDlg::ProgressDlg() : _hwnd(NULL), _hThread(NULL), _hActiveState(NULL), _hPText(NULL), _hPBar(NULL),
+		_hBtn(NULL), _hKeyHook(NULL), _nppDisabled(false), _cancelled(false),
 		_phase(0), _phaseRange(cPhases[0]), _phasePosOffset(0), _max(cPhases[0]), _count(0), _pos(0)
 {
 	::GetModuleHandleEx(
@@ -201,8 +184,11 @@ ProgressDlg::~ProgressDlg()
 
 	destroy();
 
-	::EnableWindow(nppData._nppHandle, TRUE);
-	::SetForegroundWindow(nppData._nppHandle);
+	if (_nppDisabled)
+	{
+		::EnableWindow(nppData._nppHandle, TRUE);
+		::SetForegroundWindow(nppData._nppHandle);
+	}
 
 	::UnregisterClass(cClassName, _hInst);
 }
@@ -210,7 +196,7 @@ ProgressDlg::~ProgressDlg()
 
 HWND ProgressDlg::create()
 {
-	// Create manually reset non-signaled event
+	// Create manually reset non-signaled event - set when the progress window is created
 	_hActiveState = ::CreateEvent(NULL, TRUE, FALSE, NULL);
 	if (!_hActiveState)
 		return NULL;
@@ -242,7 +228,7 @@ HWND ProgressDlg::create()
 
 void ProgressDlg::cancel()
 {
-	::ResetEvent(_hActiveState);
+	_cancelled = true;
 	::EnableWindow(_hBtn, FALSE);
 
 	SetInfo(TEXT("Cancelling compare, please wait..."));
@@ -253,7 +239,8 @@ void ProgressDlg::destroy()
 {
 	if (_hwnd)
 	{
-		::KillTimer(_hwnd, 1);
+		::KillTimer(_hwnd, cShowTimerId);
+		::KillTimer(_hwnd, cUpdateTimerId);
 		::PostMessage(_hwnd, WM_CLOSE, 0, 0);
 		_hwnd = NULL;
 
@@ -264,9 +251,18 @@ void ProgressDlg::destroy()
 }
 
 
+// Called on the progress window timer - the counters might be in the middle of a phase change but the position only
+// moves forward anyway
 void ProgressDlg::update()
 {
-	const unsigned newPos = static_cast<unsigned>(((_count * _phaseRange) / _max) + _phasePosOffset);
+	const intptr_t max = _max;
+
+	if (max <= 0)
+		return;
+
+	const intptr_t count = std::min<intptr_t>(_count, max);
+
+	const unsigned newPos = static_cast<unsigned>(((count * _phaseRange) / max) + _phasePosOffset);
 
 	if (newPos > _pos)
 	{
@@ -344,7 +340,8 @@ BOOL ProgressDlg::createProgressWindow()
 
 	::ShowWindow(_hwnd, SW_HIDE);
 
-	::SetTimer(_hwnd, 1, cInitialShowDelay_ms, NULL);
+	::SetTimer(_hwnd, cShowTimerId, cInitialShowDelay_ms, NULL);
+	::SetTimer(_hwnd, cUpdateTimerId, cUpdateInterval_ms, NULL);
 
 	return TRUE;
 }
@@ -444,6 +441,8 @@ LRESULT APIENTRY ProgressDlg::wndProc(HWND hwnd, UINT umsg, WPARAM wparam, LPARA
 	switch (umsg)
 	{
 		case WM_CREATE:
+			::SetWindowLongPtr(hwnd, GWLP_USERDATA,
+					(LONG_PTR)reinterpret_cast<CREATESTRUCT*>(lparam)->lpCreateParams);
 			return 0;
 
 		case WM_SETFOCUS:
@@ -459,7 +458,17 @@ LRESULT APIENTRY ProgressDlg::wndProc(HWND hwnd, UINT umsg, WPARAM wparam, LPARA
 			break;
 
 		case WM_TIMER:
-			Inst->Show();
+			if (wparam == cUpdateTimerId)
+			{
+				ProgressDlg* pw = reinterpret_cast<ProgressDlg*>(::GetWindowLongPtr(hwnd, GWLP_USERDATA));
+
+				if (pw)
+					pw->update();
+			}
+			else
+			{
+				Inst->Show();
+			}
 			return 0;
 
 		case WM_DESTROY:
@@ -25,16 +25,22 @@
 #include <commctrl.h>
 
 #include <memory>
+#include <atomic>
+
+#include "Engine.h"
 
 
 class ProgressDlg;
 using progress_ptr = std::shared_ptr<ProgressDlg>;
 
 
-class ProgressDlg
+// The compare engine progress of the plugin
+class ProgressDlg : public CompareProgress
 {
 public:
-	static progress_ptr& Open(const TCHAR* info = NULL);
+	// Notepad++ is disabled while the progress is open unless disableNpp is false (background compares - the compare
+	// takes care of the documents changed meanwhile)
+	static progress_ptr& Open(const TCHAR* info = NULL, bool disableNpp = true);
 
 	static progress_ptr& Get()
 	{
@@ -46,21 +52,47 @@ public:
 		Inst.reset();
 	}
 
-    ~ProgressDlg();
+    ~ProgressDlg() override;
 
 	inline void SetInfo(const TCHAR *info) const
 	{
-		::SendMessage(_hPText, WM_SETTEXT, 0, (LPARAM)info);
+		if (_hPText)
+			::SendMessage(_hPText, WM_SETTEXT, 0, (LPARAM)info);
 	}
 
-	void Show() const;
+	void Show() const override;
 
-	bool IsCancelled() const;
+	// The engine compare loops only update the atomic counters and check the cancel flag - the progress window
+	// samples the counters on its own timer so the methods below can be called by any thread
+	inline bool IsCancelled() const override
+	{
+		return _cancelled.load(std::memory_order_relaxed);
+	}
+
+	inline const std::atomic<bool>* CancelFlag() const override
+	{
+		return &_cancelled;
+	}
+
+	inline void Cancel() override
+	{
+		_cancelled = true;
+	}
 
-	unsigned NextPhase();
-	bool SetMaxCount(intptr_t max, unsigned phase = 0);
+	unsigned NextPhase() override;
+	bool SetMaxCount(intptr_t max, unsigned phase = 0) override;
 	bool SetCount(intptr_t cnt, unsigned phase = 0);
-	bool Advance(intptr_t cnt = 1, unsigned phase = 0);
+
+	inline bool Advance(intptr_t cnt = 1, unsigned phase = 0) override
+	{
+		if (IsCancelled())
+			return false;
+
+		if (phase == 0 || phase - 1 == _phase)
+			_count.fetch_add(cnt, std::memory_order_relaxed);
+
+		return true;
+	}
 
 private:
     static const TCHAR cClassName[];
@@ -71,6 +103,10 @@ private:
     static const int cBTNheight;
 
 	static const int cInitialShowDelay_ms = 500;
+	static const int cUpdateInterval_ms = 50;
+
+	static const UINT_PTR cShowTimerId = 1;
+	static const UINT_PTR cUpdateTimerId = 2;
 
 	static const int cPhases[];
 
@@ -92,7 +128,8 @@ private:
 
     inline void setPos(intptr_t pos) const
 	{
-		::PostMessage(_hPBar, PBM_SETPOS, (WPARAM)pos, 0);
+		if (_hPBar)
+			::PostMessage(_hPBar, PBM_SETPOS, (WPARAM)pos, 0);
 	}
 
     void update();
@@ -110,11 +147,16 @@ private:
     HWND			_hBtn;
     HHOOK			_hKeyHook;
 
-	unsigned	_phase;
-	unsigned	_phaseRange;
-	unsigned	_phasePosOffset;
-	intptr_t	_max;
-	intptr_t	_count;
+	bool		_nppDisabled;
+
+	std::atomic<bool>	_cancelled;
+
+	std::atomic<unsigned>	_phase;
+	std::atomic<unsigned>	_phaseRange;
+	std::atomic<unsigned>	_phasePosOffset;
+	std::atomic<intptr_t>	_max;
+	std::atomic<intptr_t>	_count;
 
+	// Accessed by the progress window thread only
 	unsigned	_pos;
 };
@@ -26,8 +26,12 @@
 
 
 PSQLOPEN16			sqlite3_open16;
+PSQLOPENV2			sqlite3_open_v2;
+PSQLBUSYTIMEOUT		sqlite3_busy_timeout;
 PSQLPREPARE16V2		sqlite3_prepare16_v2;
+PSQLBINDTEXT16		sqlite3_bind_text16;
 PSQLSTEP			sqlite3_step;
+PSQLRESET			sqlite3_reset;
 PSQLCOLUMNTEXT16	sqlite3_column_text16;
 PSQLFINALZE			sqlite3_finalize;
 PSQLCLOSE			sqlite3_close;
@@ -81,12 +85,24 @@ bool InitSQLite()
 		sqlite3_open16 = (PSQLOPEN16)::GetProcAddress(ligSQLite, "sqlite3_open16");
 		if (!sqlite3_open16)
 			return false;
+		sqlite3_open_v2 = (PSQLOPENV2)::GetProcAddress(ligSQLite, "sqlite3_open_v2");
+		if (!sqlite3_open_v2)
+			return false;
+		sqlite3_busy_timeout = (PSQLBUSYTIMEOUT)::GetProcAddress(ligSQLite, "sqlite3_busy_timeout");
+		if (!sqlite3_busy_timeout)
+			return false;
 		sqlite3_prepare16_v2 = (PSQLPREPARE16V2)::GetProcAddress(ligSQLite, "sqlite3_prepare16_v2");
 		if (!sqlite3_prepare16_v2)
 			return false;
+		sqlite3_bind_text16 = (PSQLBINDTEXT16)::GetProcAddress(ligSQLite, "sqlite3_bind_text16");
+		if (!sqlite3_bind_text16)
+			return false;
 		sqlite3_step = (PSQLSTEP)::GetProcAddress(ligSQLite, "sqlite3_step");
 		if (!sqlite3_step)
 			return false;
+		sqlite3_reset = (PSQLRESET)::GetProcAddress(ligSQLite, "sqlite3_reset");
+		if (!sqlite3_reset)
+			return false;
 		sqlite3_column_text16 = (PSQLCOLUMNTEXT16)::GetProcAddress(ligSQLite, "sqlite3_column_text16");
 		if (!sqlite3_column_text16)
 			return false;
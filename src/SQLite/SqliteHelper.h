@@ -23,19 +23,34 @@
 #define sqlite3_stmt	HANDLE
 #define SQLITE_OK		0
 #define SQLITE_ROW		100
+#define SQLITE_DONE		101
 
+#define SQLITE_OPEN_READONLY	0x00000001
+
+#define SQLITE_STATIC	((PSQLDESTRUCTOR)0)
+
+
+typedef void (*PSQLDESTRUCTOR) (void *);
 
 typedef int (*PSQLOPEN16) (const void *filename, sqlite3 **ppDb);
+typedef int (*PSQLOPENV2) (const char *filename, sqlite3 **ppDb, int flags, const char *zVfs);
+typedef int (*PSQLBUSYTIMEOUT) (sqlite3 *db, int ms);
 typedef int (*PSQLPREPARE16V2) (sqlite3 *db, const void *zSql, int nByte, sqlite3_stmt **ppStmt, const char **pzTail);
+typedef int (*PSQLBINDTEXT16) (sqlite3_stmt *pStmt, int idx, const void *text, int nBytes, PSQLDESTRUCTOR destr);
 typedef int (*PSQLSTEP) (sqlite3_stmt *pStmt);
+typedef int (*PSQLRESET) (sqlite3_stmt *pStmt);
 typedef const void * (*PSQLCOLUMNTEXT16) (sqlite3_stmt *pStmt, int iCol);
 typedef int (*PSQLFINALZE) (sqlite3_stmt *pStmt);
 typedef int (*PSQLCLOSE) (sqlite3 *db);
 
 
 extern PSQLOPEN16		sqlite3_open16;
+extern PSQLOPENV2		sqlite3_open_v2;
+extern PSQLBUSYTIMEOUT	sqlite3_busy_timeout;
 extern PSQLPREPARE16V2	sqlite3_prepare16_v2;
+extern PSQLBINDTEXT16	sqlite3_bind_text16;
 extern PSQLSTEP			sqlite3_step;
+extern PSQLRESET		sqlite3_reset;
 extern PSQLCOLUMNTEXT16	sqlite3_column_text16;
 extern PSQLFINALZE		sqlite3_finalize;
 extern PSQLCLOSE		sqlite3_close;
@@ -119,6 +119,15 @@ INT_PTR CALLBACK SettingsDialog::run_dlgProc(UINT Message, WPARAM wParam, LPARAM
 					settings.WrapAround				= (bool) DEFAULT_WRAP_AROUND;
 					settings.GotoFirstDiff			= (bool) DEFAULT_GOTO_FIRST_DIFF;
 					settings.PromptToCloseOnMatch	= (bool) DEFAULT_PROMPT_CLOSE_ON_MATCH;
+					settings.HistogramDiff			= (bool) DEFAULT_HISTOGRAM_DIFF;
+					settings.VerifyLineMatches		= (bool) DEFAULT_VERIFY_LINE_MATCHES;
+					settings.BackgroundCompare		= (bool) DEFAULT_BACKGROUND_COMPARE;
+					settings.PrewarmVcsLibs			= (bool) DEFAULT_PREWARM_VCS_LIBS;
+					settings.DiffCostLimit			= DEFAULT_DIFF_COST_LIMIT;
+					settings.BandedMatchLines		= DEFAULT_BANDED_MATCH_LINES;
+					settings.HashIndexMinSizeMB		= DEFAULT_HASH_INDEX_MIN_SIZE_MB;
+					settings.ShowOnlyDiffsContext	= DEFAULT_SHOW_ONLY_DIFFS_CONTEXT;
+					settings.MemoryBudgetMB			= DEFAULT_MEMORY_BUDGET_MB;
 
 					if (isDarkMode())
 					{
@@ -287,6 +296,12 @@ void SettingsDialog::SetParams(UserSettings* settings)
 			settings->GotoFirstDiff ? BST_CHECKED : BST_UNCHECKED);
 	Button_SetCheck(::GetDlgItem(_hSelf, IDC_FOLLOWING_CARET),
 			settings->FollowingCaret ? BST_CHECKED : BST_UNCHECKED);
+	Button_SetCheck(::GetDlgItem(_hSelf, IDC_HISTOGRAM_DIFF),
+			settings->HistogramDiff ? BST_CHECKED : BST_UNCHECKED);
+	Button_SetCheck(::GetDlgItem(_hSelf, IDC_VERIFY_LINE_MATCHES),
+			settings->VerifyLineMatches ? BST_CHECKED : BST_UNCHECKED);
+	Button_SetCheck(::GetDlgItem(_hSelf, IDC_BACKGROUND_COMPARE),
+			settings->BackgroundCompare ? BST_CHECKED : BST_UNCHECKED);
 
 	// Set current colors configured in option dialog
 	_ColorComboAdded.setColor(settings->colors().added);
@@ -368,6 +383,9 @@ void SettingsDialog::GetParams()
 	_Settings->WrapAround			= (Button_GetCheck(::GetDlgItem(_hSelf, IDC_WRAP_AROUND)) == BST_CHECKED);
 	_Settings->GotoFirstDiff		= (Button_GetCheck(::GetDlgItem(_hSelf, IDC_GOTO_FIRST_DIFF)) == BST_CHECKED);
 	_Settings->FollowingCaret		= (Button_GetCheck(::GetDlgItem(_hSelf, IDC_FOLLOWING_CARET)) == BST_CHECKED);
+	_Settings->HistogramDiff		= (Button_GetCheck(::GetDlgItem(_hSelf, IDC_HISTOGRAM_DIFF)) == BST_CHECKED);
+	_Settings->VerifyLineMatches	= (Button_GetCheck(::GetDlgItem(_hSelf, IDC_VERIFY_LINE_MATCHES)) == BST_CHECKED);
+	_Settings->BackgroundCompare	= (Button_GetCheck(::GetDlgItem(_hSelf, IDC_BACKGROUND_COMPARE)) == BST_CHECKED);
 
 	// Get color chosen in dialog
 	_ColorComboAdded.getColor((LPCOLORREF)&_Settings->colors().added);
@@ -36,6 +36,15 @@ const TCHAR UserSettings::promptCloseOnMatchSetting[]		= TEXT("prompt_to_close_o
 const TCHAR UserSettings::wrapAroundSetting[]				= TEXT("wrap_around");
 const TCHAR UserSettings::gotoFirstDiffSetting[]			= TEXT("go_to_first_on_recompare");
 const TCHAR UserSettings::followingCaretSetting[]			= TEXT("following_caret");
+const TCHAR UserSettings::histogramDiffSetting[]			= TEXT("histogram_diff");
+const TCHAR UserSettings::verifyLineMatchesSetting[]		= TEXT("verify_line_matches");
+const TCHAR UserSettings::backgroundCompareSetting[]		= TEXT("background_compare");
+const TCHAR UserSettings::prewarmVcsLibsSetting[]			= TEXT("prewarm_vcs_libs");
+const TCHAR UserSettings::diffCostLimitSetting[]			= TEXT("diff_cost_limit");
+const TCHAR UserSettings::bandedMatchLinesSetting[]		= TEXT("banded_match_lines");
+const TCHAR UserSettings::hashIndexMinSizeMBSetting[]	= TEXT("hash_index_min_size_mb");
+const TCHAR UserSettings::showOnlyDiffsContextSetting[]	= TEXT("show_only_diffs_context_lines");
+const TCHAR UserSettings::memoryBudgetMBSetting[]		= TEXT("memory_budget_mb");
 
 const TCHAR UserSettings::detectMovesSetting[]				= TEXT("detect_moves");
 const TCHAR UserSettings::detectCharDiffsSetting[]			= TEXT("detect_character_diffs");
@@ -116,6 +125,43 @@ void UserSettings::load()
 			DEFAULT_GOTO_FIRST_DIFF, iniFile) != 0;
 	PromptToCloseOnMatch	= ::GetPrivateProfileInt(mainSection, promptCloseOnMatchSetting,
 			DEFAULT_PROMPT_CLOSE_ON_MATCH, iniFile) != 0;
+	HistogramDiff			= ::GetPrivateProfileInt(mainSection, histogramDiffSetting,
+			DEFAULT_HISTOGRAM_DIFF, iniFile) != 0;
+	VerifyLineMatches		= ::GetPrivateProfileInt(mainSection, verifyLineMatchesSetting,
+			DEFAULT_VERIFY_LINE_MATCHES, iniFile) != 0;
+	BackgroundCompare		= ::GetPrivateProfileInt(mainSection, backgroundCompareSetting,
+			DEFAULT_BACKGROUND_COMPARE, iniFile) != 0;
+	PrewarmVcsLibs			= ::GetPrivateProfileInt(mainSection, prewarmVcsLibsSetting,
+			DEFAULT_PREWARM_VCS_LIBS, iniFile) != 0;
+	DiffCostLimit			= ::GetPrivateProfileInt(mainSection, diffCostLimitSetting,
+			DEFAULT_DIFF_COST_LIMIT, iniFile);
+
+	if (DiffCostLimit < 0)
+		DiffCostLimit = DEFAULT_DIFF_COST_LIMIT;
+
+	BandedMatchLines		= ::GetPrivateProfileInt(mainSection, bandedMatchLinesSetting,
+			DEFAULT_BANDED_MATCH_LINES, iniFile);
+
+	if (BandedMatchLines < 0)
+		BandedMatchLines = DEFAULT_BANDED_MATCH_LINES;
+
+	HashIndexMinSizeMB		= ::GetPrivateProfileInt(mainSection, hashIndexMinSizeMBSetting,
+			DEFAULT_HASH_INDEX_MIN_SIZE_MB, iniFile);
+
+	if (HashIndexMinSizeMB < 0)
+		HashIndexMinSizeMB = DEFAULT_HASH_INDEX_MIN_SIZE_MB;
+
+	ShowOnlyDiffsContext	= ::GetPrivateProfileInt(mainSection, showOnlyDiffsContextSetting,
+			DEFAULT_SHOW_ONLY_DIFFS_CONTEXT, iniFile);
+
+	if (ShowOnlyDiffsContext < 0)
+		ShowOnlyDiffsContext = DEFAULT_SHOW_ONLY_DIFFS_CONTEXT;
+
+	MemoryBudgetMB			= ::GetPrivateProfileInt(mainSection, memoryBudgetMBSetting,
+			DEFAULT_MEMORY_BUDGET_MB, iniFile);
+
+	if (MemoryBudgetMB < 0)
+		MemoryBudgetMB = DEFAULT_MEMORY_BUDGET_MB;
 
 	DetectMoves			= ::GetPrivateProfileInt(mainSection, detectMovesSetting,			1, iniFile) != 0;
 	DetectCharDiffs		= ::GetPrivateProfileInt(mainSection, detectCharDiffsSetting,		0, iniFile) != 0;
@@ -267,6 +313,14 @@ void UserSettings::save()
 			GotoFirstDiff ? TEXT("1") : TEXT("0"), iniFile);
 	::WritePrivateProfileString(mainSection, promptCloseOnMatchSetting,
 			PromptToCloseOnMatch ? TEXT("1") : TEXT("0"), iniFile);
+	::WritePrivateProfileString(mainSection, histogramDiffSetting,
+			HistogramDiff ? TEXT("1") : TEXT("0"), iniFile);
+	::WritePrivateProfileString(mainSection, verifyLineMatchesSetting,
+			VerifyLineMatches ? TEXT("1") : TEXT("0"), iniFile);
+	::WritePrivateProfileString(mainSection, backgroundCompareSetting,
+			BackgroundCompare ? TEXT("1") : TEXT("0"), iniFile);
+	::WritePrivateProfileString(mainSection, prewarmVcsLibsSetting,
+			PrewarmVcsLibs ? TEXT("1") : TEXT("0"), iniFile);
 
 	::WritePrivateProfileString(mainSection, detectMovesSetting,
 			DetectMoves ? TEXT("1") : TEXT("0"), iniFile);
@@ -352,6 +406,21 @@ void UserSettings::save()
 	_itot_s(ChangedThresholdPercent, buffer, 64, 10);
 	::WritePrivateProfileString(colorsSection, changedThresholdSetting, buffer, iniFile);
 
+	_itot_s(DiffCostLimit, buffer, 64, 10);
+	::WritePrivateProfileString(mainSection, diffCostLimitSetting, buffer, iniFile);
+
+	_itot_s(BandedMatchLines, buffer, 64, 10);
+	::WritePrivateProfileString(mainSection, bandedMatchLinesSetting, buffer, iniFile);
+
+	_itot_s(HashIndexMinSizeMB, buffer, 64, 10);
+	::WritePrivateProfileString(mainSection, hashIndexMinSizeMBSetting, buffer, iniFile);
+
+	_itot_s(ShowOnlyDiffsContext, buffer, 64, 10);
+	::WritePrivateProfileString(mainSection, showOnlyDiffsContextSetting, buffer, iniFile);
+
+	_itot_s(MemoryBudgetMB, buffer, 64, 10);
+	::WritePrivateProfileString(mainSection, memoryBudgetMBSetting, buffer, iniFile);
+
 	::WritePrivateProfileString(toolbarSection, enableToolbarSetting,
 			EnableToolbar ? TEXT("1") : TEXT("0"), iniFile);
 	::WritePrivateProfileString(toolbarSection, setAsFirstTBSetting,
@@ -36,6 +36,15 @@
 #define DEFAULT_WRAP_AROUND				0
 #define DEFAULT_GOTO_FIRST_DIFF			1
 #define DEFAULT_PROMPT_CLOSE_ON_MATCH	0
+#define DEFAULT_HISTOGRAM_DIFF			0
+#define DEFAULT_VERIFY_LINE_MATCHES		0
+#define DEFAULT_BACKGROUND_COMPARE		0
+#define DEFAULT_PREWARM_VCS_LIBS		0
+#define DEFAULT_DIFF_COST_LIMIT			0
+#define DEFAULT_BANDED_MATCH_LINES		0
+#define DEFAULT_HASH_INDEX_MIN_SIZE_MB	0
+#define DEFAULT_SHOW_ONLY_DIFFS_CONTEXT	0
+#define DEFAULT_MEMORY_BUDGET_MB		0
 
 #define DEFAULT_STATUS_INFO				0
 
@@ -132,6 +141,15 @@ public:
 	static const TCHAR wrapAroundSetting[];
 	static const TCHAR gotoFirstDiffSetting[];
 	static const TCHAR promptCloseOnMatchSetting[];
+	static const TCHAR histogramDiffSetting[];
+	static const TCHAR verifyLineMatchesSetting[];
+	static const TCHAR backgroundCompareSetting[];
+	static const TCHAR prewarmVcsLibsSetting[];
+	static const TCHAR diffCostLimitSetting[];
+	static const TCHAR bandedMatchLinesSetting[];
+	static const TCHAR hashIndexMinSizeMBSetting[];
+	static const TCHAR showOnlyDiffsContextSetting[];
+	static const TCHAR memoryBudgetMBSetting[];
 
 	static const TCHAR detectMovesSetting[];
 	static const TCHAR detectCharDiffsSetting[];
@@ -195,6 +213,28 @@ public:
 	bool			WrapAround;
 	bool			GotoFirstDiff;
 	bool			PromptToCloseOnMatch;
+	bool			HistogramDiff;
+	bool			VerifyLineMatches;
+	bool			BackgroundCompare;
+
+	// Git and SVN libraries are loaded in the background on startup instead of on the first Git/SVN diff
+	bool			PrewarmVcsLibs;
+
+	// Max edit cost the line diff searches for each of its split points (0 means unlimited - always minimal diff)
+	int				DiffCostLimit;
+
+	// Changed blocks lines are matched only to that many lines around the same relative position in the other block
+	// (0 means all lines are matched to each other)
+	int				BandedMatchLines;
+
+	// Line hashes of saved files of at least that many MB are kept in index files between the sessions (0 means never)
+	int				HashIndexMinSizeMB;
+
+	// Unmarked lines kept visible around each diff by Show Only Diffs
+	int				ShowOnlyDiffsContext;
+
+	// Memory the compare engine should fit in (0 means no limit) - cheaper compare strategies are used above it
+	int				MemoryBudgetMB;
 
 	bool			DetectMoves;
 	bool			DetectCharDiffs;
@@ -0,0 +1,463 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2011 Jean-Sebastien Leroy (jean.sebastien.leroy@gmail.com)
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include <windows.h>
+
+#include "Compare.h"
+#include "NppHelpers.h"
+#include "ProgressDlg.h"
+#include "ViewsCompare.h"
+
+#if defined(__MINGW32__) && !defined(_GLIBCXX_HAS_GTHREADS)
+#include "mingw-std-threads/mingw.thread.h"
+#else
+#include <thread>
+#endif // __MINGW32__ ...
+
+#ifndef MULTITHREAD
+#define MULTITHREAD		1
+#endif
+
+
+#ifdef DLOG
+
+// The compare engine debug log goes to the plugin one
+void engineLog(const std::string& str)
+{
+	LOGD(LOG_ALGO, str);
+}
+
+
+void engineLogTime()
+{
+	LOGD_GET_TIME;
+}
+
+#endif
+
+
+namespace // anonymous namespace
+{
+
+// Reads the document in the view through Scintilla - must be used by the UI thread only
+class ScintillaDocSource : public DocSource
+{
+public:
+	explicit ScintillaDocSource(int view) : _view(view) {}
+
+	intptr_t linesCount() const override
+	{
+		return CallScintilla(_view, SCI_GETLINECOUNT, 0, 0);
+	}
+
+	intptr_t length() const override
+	{
+		return CallScintilla(_view, SCI_GETLENGTH, 0, 0);
+	}
+
+	int codepage() const override
+	{
+		return getCodepage(_view);
+	}
+
+	bool defaultLineEnds() const override
+	{
+		return (CallScintilla(_view, SCI_GETLINEENDTYPESACTIVE, 0, 0) == SC_LINE_END_TYPE_DEFAULT);
+	}
+
+	intptr_t lineStart(intptr_t line) const override
+	{
+		return getLineStart(_view, line);
+	}
+
+	intptr_t lineEnd(intptr_t line) const override
+	{
+		return getLineEnd(_view, line);
+	}
+
+	const char* rangePointer(intptr_t startPos, intptr_t len) const override
+	{
+		return reinterpret_cast<const char*>(CallScintilla(_view, SCI_GETRANGEPOINTER, startPos, len));
+	}
+
+	// Getting the range pointer moves Scintilla's gap - copying the text range doesn't
+	std::vector<char> text(intptr_t startPos, intptr_t endPos) const override
+	{
+		return getText(_view, startPos, endPos);
+	}
+
+	intptr_t lineFromPosition(intptr_t pos) const override
+	{
+		return CallScintilla(_view, SCI_LINEFROMPOSITION, pos, 0);
+	}
+
+private:
+	const int _view;
+};
+
+
+// Dispatches the pending paint messages (and the messages sent by other threads) so that Notepad++ keeps
+// repainting while the UI thread is busy applying the compare results. Input is not processed - it is queued until
+// the results are applied.
+void pumpPaintMessages()
+{
+	static constexpr int cMaxDispatched = 64;
+
+	MSG msg;
+
+	for (int i = 0; i < cMaxDispatched && ::PeekMessage(&msg, NULL, WM_PAINT, WM_PAINT, PM_REMOVE); ++i)
+		::DispatchMessage(&msg);
+}
+
+
+// Lets the UI repaint every cTimeSlice_ms while the compare results are being applied by the UI thread
+class UiTimeSlicer
+{
+public:
+	explicit UiTimeSlicer(bool enabled) : _enabled(enabled), _sliceStart(::GetTickCount()) {}
+
+	inline void operator()()
+	{
+		if (_enabled && (::GetTickCount() - _sliceStart >= cTimeSlice_ms))
+		{
+			pumpPaintMessages();
+			_sliceStart = ::GetTickCount();
+		}
+	}
+
+private:
+	static constexpr DWORD cTimeSlice_ms = 50;
+
+	const bool	_enabled;
+	DWORD		_sliceStart;
+};
+
+
+// Notepad++ has been closed while the compare was running in the background - the views are gone
+bool nppClosed = false;
+
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+
+// Dispatches all pending messages so that Notepad++ stays usable while the compare runs in the background.
+// The thread timers are not dispatched - those are the plugin's delayed works that act on the compares and they
+// come again when the compare is over. Returns false on WM_QUIT (posted again for Notepad++ message loop).
+bool pumpMessages()
+{
+	MSG msg;
+
+	while (::PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+	{
+		if (msg.message == WM_QUIT)
+		{
+			nppClosed = true;
+			::PostQuitMessage(static_cast<int>(msg.wParam));
+			return false;
+		}
+
+		if (msg.message == WM_TIMER && msg.hwnd == NULL)
+			continue;
+
+		::TranslateMessage(&msg);
+		::DispatchMessage(&msg);
+	}
+
+	return true;
+}
+
+
+// Runs compareFn by a worker thread while the UI thread keeps Notepad++ running (Notepad++ is not disabled).
+// compareFn must not call Scintilla (the documents should be read from snapshots). The plugin cancels the compare if
+// its documents change meanwhile - the results are then dropped before they get to the views.
+CompareResult runInBackground(const std::function<CompareResult()>& compareFn)
+{
+	HANDLE hDone = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!hDone)
+		return compareFn();
+
+	CompareResult result = CompareResult::COMPARE_CANCELLED;
+
+	std::exception_ptr error = nullptr;
+
+	std::thread worker;
+
+	try
+	{
+		worker = std::thread(
+			[&]()
+			{
+				try
+				{
+					result = compareFn();
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
+
+				::SetEvent(hDone);
+			});
+	}
+	catch (...)
+	{
+		::CloseHandle(hDone);
+		return compareFn();
+	}
+
+	while (::MsgWaitForMultipleObjects(1, &hDone, FALSE, INFINITE, QS_ALLINPUT) == WAIT_OBJECT_0 + 1)
+	{
+		// Notepad++ is closing - just wait for the compare to end
+		if (!pumpMessages())
+		{
+			ProgressDlg::Get()->Cancel();
+			::WaitForSingleObject(hDone, INFINITE);
+			break;
+		}
+	}
+
+	worker.join();
+
+	::CloseHandle(hDone);
+
+	if (error)
+		std::rethrow_exception(error);
+
+	// The documents might have changed while compared
+	if (ProgressDlg::Get()->IsCancelled())
+		return CompareResult::COMPARE_CANCELLED;
+
+	return result;
+}
+
+#endif // MULTITHREAD
+
+
+/**
+ *  \class  SciCompareViews
+ *  \brief  The Notepad++ views the compare engine reads the documents from and marks the results in
+ */
+class SciCompareViews : public CompareViews
+{
+public:
+	const DocSource& doc(int view) const override
+	{
+		return _docs[view];
+	}
+
+	intptr_t docId(int view) const override
+	{
+		return getDocId(view);
+	}
+
+	// Clears the view marks from fromLine on - the whole window if that's the first line
+	void clearMarksFrom(int view, intptr_t fromLine) override;
+
+	// Applies the diff maps markers and the collected changed text marks to both views. If fromLines are given only
+	// the marks from these lines on are applied - the ones above are left in the views from the last compare.
+	// Returns false if cancelled.
+	bool applyMarks(const DiffMap_t diffMaps[2], const ViewMarks viewMarks[2], const CompareOptions& options,
+			const intptr_t* fromLines) override;
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	CompareResult runInBackground(const std::function<CompareResult()>& compareFn) override
+	{
+		return ::runInBackground(compareFn);
+	}
+#endif // MULTITHREAD
+
+private:
+	const ScintillaDocSource _docs[2] { ScintillaDocSource(MAIN_VIEW), ScintillaDocSource(SUB_VIEW) };
+};
+
+
+void SciCompareViews::clearMarksFrom(int view, intptr_t fromLine)
+{
+	if (fromLine <= 0)
+	{
+		clearWindow(view);
+		return;
+	}
+
+	const intptr_t linesCount = CallScintilla(view, SCI_GETLINECOUNT, 0, 0);
+
+	if (fromLine >= linesCount)
+		return;
+
+	clearMarks(view, fromLine, linesCount - fromLine);
+
+	// The blank lines aligning a line are the annotation of the line above it
+	clearAnnotations(view, fromLine - 1, linesCount - fromLine + 1);
+}
+
+
+// The views redraw and modification notifications are suppressed while the marks are set
+bool SciCompareViews::applyMarks(const DiffMap_t diffMaps[2], const ViewMarks viewMarks[2],
+		const CompareOptions& options, const intptr_t* fromLines)
+{
+	static constexpr intptr_t cProgressStep = 1024;
+
+	progress_ptr& progress = ProgressDlg::Get();
+
+	progress->SetMaxCount(static_cast<intptr_t>(diffMaps[MAIN_VIEW].size() + diffMaps[SUB_VIEW].size() +
+			viewMarks[MAIN_VIEW].changedText.size() + viewMarks[SUB_VIEW].changedText.size()) + 1);
+
+	UiTimeSlicer timeSlice(options.backgroundCompare);
+
+	for (int view = MAIN_VIEW; view <= SUB_VIEW; ++view)
+	{
+		const ViewMarks& marks = viewMarks[view];
+
+		const int changedTextColor = (marks.changedTextMask == MARKER_MASK_ADDED) ?
+				Settings.colors().add_highlight : Settings.colors().rem_highlight;
+
+		const intptr_t fromLine = fromLines ? fromLines[view] : 0;
+
+		ScopedViewRedrawBlocker redrawBlocker(view);
+
+		intptr_t progressCount = 0;
+
+		for (const auto& run: diffMaps[view])
+		{
+			for (intptr_t line = std::max(run.line, fromLine); line < run.line + run.len; ++line)
+				CallScintilla(view, SCI_MARKERADDSET, line, run.mask);
+
+			if (++progressCount == cProgressStep)
+			{
+				if (!progress->Advance(progressCount))
+					return false;
+
+				progressCount = 0;
+
+				timeSlice();
+			}
+		}
+
+		if (fromLine > 0)
+		{
+			const intptr_t fromPos = (fromLine < CallScintilla(view, SCI_GETLINECOUNT, 0, 0)) ?
+					getLineStart(view, fromLine) : CallScintilla(view, SCI_GETLENGTH, 0, 0);
+
+			std::vector<std::pair<intptr_t, intptr_t>> changedText;
+
+			for (const auto& range: marks.changedText)
+			{
+				if (range.first + range.second > fromPos)
+				{
+					const intptr_t start = std::max(range.first, fromPos);
+
+					changedText.emplace_back(start, range.first + range.second - start);
+				}
+			}
+
+			markTextAsChanged(view, changedText, changedTextColor);
+		}
+		else
+		{
+			markTextAsChanged(view, marks.changedText, changedTextColor);
+		}
+
+		if (!progress->Advance(progressCount + static_cast<intptr_t>(marks.changedText.size())))
+			return false;
+	}
+
+	return (progress->NextPhase() != 0);
+}
+
+} // anonymous namespace
+
+
+CompareResult compareViews(const CompareOptions& options, const TCHAR* progressInfo, CompareSummary& summary,
+		IncrementalCompare* incremental, LineHashCache* mainLineHashes, LineHashCache* subLineHashes)
+{
+	CompareResult result = CompareResult::COMPARE_ERROR;
+
+#if defined(MULTITHREAD) && (MULTITHREAD != 0)
+	const bool inBackground = options.backgroundCompare;
+#else
+	const bool inBackground = false;
+#endif
+
+	// The views might show other documents after a background compare - those are not to be cleared
+	const intptr_t comparedDocs[2] = { getDocId(MAIN_VIEW), getDocId(SUB_VIEW) };
+
+	auto clearViews =
+		[&comparedDocs]()
+		{
+			if (nppClosed)
+				return;
+
+			for (int view: { MAIN_VIEW, SUB_VIEW })
+			{
+				if (getDocId(view) == comparedDocs[view])
+					clearWindow(view);
+			}
+		};
+
+	if (!progressInfo || !ProgressDlg::Open(progressInfo, !inBackground))
+	{
+		if (incremental)
+			incremental->clear();
+
+		return CompareResult::COMPARE_ERROR;
+	}
+
+	try
+	{
+		SciCompareViews views;
+
+		// Kept alive for the engine threads even if the dialog is closed meanwhile
+		const progress_ptr progress = ProgressDlg::Get();
+
+		result = runCompare(options, views, *progress, summary, incremental, mainLineHashes, subLineHashes);
+
+		ProgressDlg::Close();
+
+		if (result != CompareResult::COMPARE_MISMATCH)
+			clearViews();
+	}
+	catch (std::exception& e)
+	{
+		ProgressDlg::Close();
+
+		clearViews();
+
+		char msg[128];
+		_snprintf_s(msg, _countof(msg), _TRUNCATE, "Exception occurred: %s", e.what());
+		::MessageBoxA(nppData._nppHandle, msg, "ComparePlus", MB_OK | MB_ICONWARNING);
+	}
+	catch (...)
+	{
+		ProgressDlg::Close();
+
+		::MessageBoxA(nppData._nppHandle, "Unknown exception occurred.", "ComparePlus", MB_OK | MB_ICONWARNING);
+	}
+
+	if (incremental && result != CompareResult::COMPARE_MISMATCH)
+		incremental->clear();
+
+	return result;
+}
@@ -0,0 +1,30 @@
+/*
+ * This file is part of ComparePlus plugin for Notepad++
+ * Copyright (C)2017-2022 Pavel Nedev (pg.nedev@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <windows.h>
+
+#include "Engine.h"
+
+
+// Compares the documents in the Notepad++ views and marks the results in them - the compare engine runs over the
+// views through Scintilla with the progress shown by the plugin progress dialog
+CompareResult compareViews(const CompareOptions& options, const TCHAR* progressInfo, CompareSummary& summary,
+		IncrementalCompare* incremental = nullptr, LineHashCache* mainLineHashes = nullptr,
+		LineHashCache* subLineHashes = nullptr);
@@ -56,6 +56,8 @@
 #define IDD_SETTINGS_DIALOG				103
 #define IDD_NAV_DIALOG					104
 #define IDD_IGNORE_REGEX_DIALOG			105
+#define IDD_FOLDER_CMP_DIALOG			106
+#define IDD_BATCH_CMP_DIALOG			107
 
 #define IDB_SETFIRST					120
 #define IDB_SETFIRST_RTL				121
@@ -139,9 +141,28 @@
 #define IDC_NAVIGATION_TB				1047
 #define IDC_SHOW_ONLY_DIFFS_TB			1048
 #define IDC_NAV_BAR_TB					1049
+#define IDC_HISTOGRAM_DIFF				1050
+#define IDC_VERIFY_LINE_MATCHES			1051
+#define IDC_BACKGROUND_COMPARE			1052
 
 #define IDC_IGNORE_REGEX				1070
 
+#define IDC_FOLDER1						1080
+#define IDC_FOLDER2						1081
+#define IDC_FOLDER1_BROWSE				1082
+#define IDC_FOLDER2_BROWSE				1083
+#define IDC_FOLDER_COMPARE				1084
+#define IDC_FOLDER_DIFFS_ONLY			1085
+#define IDC_FOLDER_CMP_LIST				1086
+#define IDC_FOLDER_CMP_STATUS			1087
+
+#define IDC_BATCH_REFERENCE				1090
+#define IDC_BATCH_ADD					1091
+#define IDC_BATCH_REMOVE				1092
+#define IDC_BATCH_COMPARE				1093
+#define IDC_BATCH_CMP_LIST				1094
+#define IDC_BATCH_CMP_STATUS			1095
+
 #define IDC_STATIC						-1
 
 #define COLOR_POPUP_OK		10000